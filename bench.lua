@@ -0,0 +1,918 @@
+
+-- best of 3 runs
+local function bench( name, n, f )
+   local dt = math.huge
+   for r=1, 3 do
+      local t0 = os.clock()
+      f( n )
+      dt = math.min( dt, os.clock() - t0 )
+   end
+   print( string.format( "%-32s %10.1f ns/op", name, dt * 1e9 / n ) )
+end
+
+local N = 2000000
+
+local function bench_method_call()
+   local buf = ByteArray.init( 1, 2, 3, 4 )
+   bench( "method call (position reset)", N, function( n )
+      for i=1, n do
+	 buf.position = 0
+	 buf:readUnsignedByte()
+      end
+   end )
+end
+
+local function bench_property()
+   local buf = ByteArray.init( 1, 2, 3, 4 )
+   bench( "property get (length)", N, function( n )
+      local x
+      for i=1, n do
+	 x = buf.length
+      end
+   end )
+   bench( "property get (bytesAvailable)", N, function( n )
+      local x
+      for i=1, n do
+	 x = buf.bytesAvailable
+      end
+   end )
+end
+
+local function bench_index()
+   local buf = ByteArray.init( 1, 2, 3, 4 )
+   bench( "integer index", N, function( n )
+      local x
+      for i=1, n do
+	 x = buf[3]
+      end
+   end )
+end
+
+local function bench_typed()
+   local K = 512
+   local buf = ByteArray.create( 8 * K )
+   for i=1, K do buf:writeDouble( i ) end
+   local readers = {
+      "readUnsignedByte", "readShort", "readInt", "readUnsignedInt",
+      "readFloat", "readDouble"
+   }
+   for _, name in ipairs( readers ) do
+      local f = buf[name]
+      bench( name, N, function( n )
+	 for i=1, n/K do
+	    buf.position = 0
+	    for j=1, K do f( buf ) end
+	 end
+      end )
+   end
+   local writers = {
+      "writeUnsignedByte", "writeShort", "writeInt", "writeUnsignedInt",
+      "writeFloat", "writeDouble"
+   }
+   for _, name in ipairs( writers ) do
+      local f = buf[name]
+      bench( name, N, function( n )
+	 for i=1, n/K do
+	    buf.position = 0
+	    for j=1, K do f( buf, j ) end
+	 end
+      end )
+   end
+end
+
+local function bench_array()
+   local M = 10000
+   local buf = ByteArray.create( 4 * M, ByteArray.BIG_ENDIAN )
+   for i=1, M do buf:writeUnsignedInt( i ) end
+   local single = {
+      { "readUnsignedShort", "readUnsignedShorts" },
+      { "readUnsignedInt", "readUnsignedInts" },
+      { "readFloat", "readFloats" },
+   }
+   for _, v in ipairs( single ) do
+      local f, bulk = buf[v[1]], buf[v[2]]
+      bench( v[1] .. " x10k (BE)", 200, function( n )
+	 for i=1, n do
+	    buf.position = 0
+	    local t = {}
+	    for j=1, M do t[j] = f( buf ) end
+	 end
+      end )
+      bench( v[2] .. "(10k) (BE)", 200, function( n )
+	 for i=1, n do
+	    buf.position = 0
+	    bulk( buf, M )
+	 end
+      end )
+   end
+   buf.position = 0
+   local t = buf:readUnsignedShorts( M, {} )
+   bench( "writeUnsignedShorts(10k) (BE)", 200, function( n )
+      for i=1, n do
+	 buf.position = 0
+	 buf:writeUnsignedShorts( t )
+      end
+   end )
+end
+
+local function bench_swap()
+   local M = 1024 * 1024
+   local buf = ByteArray.create( M )
+   buf.length = M
+   for _, w in ipairs{ 2, 4, 8 } do
+      local t0 = os.clock()
+      local n = 200
+      for i=1, n do buf:swapEndian( w, 0 ) end
+      local dt = os.clock() - t0
+      print( string.format( "%-32s %10.1f MB/s", "swapEndian(" .. w .. ") 1MB", n / dt ) )
+   end
+end
+
+local function bench_varint()
+   local M = 10000
+   local buf = ByteArray.create()
+   for i=1, M do buf:writeVarUInt( i * 977 ) end
+   local function lua_varint( b )
+      local r, shift = 0, 0
+      while true do
+	 local c = b:readUnsignedByte()
+	 r = r + (c % 128) * 2^shift
+	 if c < 128 then return r end
+	 shift = shift + 7
+      end
+   end
+   bench( "varint in lua x10k", 100, function( n )
+      for i=1, n do
+	 buf.position = 0
+	 for j=1, M do lua_varint( buf ) end
+      end
+   end )
+   local f = buf.readVarUInt
+   bench( "readVarUInt x10k", 100, function( n )
+      for i=1, n do
+	 buf.position = 0
+	 for j=1, M do f( buf ) end
+      end
+   end )
+   bench( "readVarUInts(10k)", 100, function( n )
+      for i=1, n do
+	 buf.position = 0
+	 buf:readVarUInts( M )
+      end
+   end )
+end
+
+-- appending 1MB, counts capacity changes as reallocations
+local function bench_append()
+   local M = 1024 * 1024
+   local reallocs
+   local function count( buf, last )
+      if buf.capacity ~= last then reallocs = reallocs + 1 end
+      return buf.capacity
+   end
+   bench( "writeUnsignedByte x1M", 5, function( n )
+      for i=1, n do
+	 local buf = ByteArray.create()
+	 for j=1, M do buf:writeUnsignedByte( j % 256 ) end
+      end
+   end )
+   bench( "writeInt x256k", 5, function( n )
+      for i=1, n do
+	 local buf = ByteArray.create()
+	 for j=1, M / 4 do buf:writeInt( j ) end
+      end
+   end )
+   if ByteArray.create().capacity then
+      reallocs = 0
+      local buf, last = ByteArray.create(), 0
+      for j=1, M do
+	 buf:writeUnsignedByte( j % 256 )
+	 last = count( buf, last )
+      end
+      print( string.format( "%-32s %10d", "reallocs appending 1MB", reallocs ) )
+   end
+end
+
+local function bench_create()
+   bench( "create + 6 byte header", N, function( n )
+      for i=1, n do
+	 ByteArray.create( 6 ):writeUnsignedShort( i % 65536 ):writeUnsignedInt( i )
+      end
+   end )
+   bench( "create()", N, function( n )
+      for i=1, n do
+	 ByteArray.create()
+      end
+   end )
+end
+
+-- short lived 256KB buffers, the collector has to see their real size
+local function bench_gc_pressure()
+   local peak = 0
+   bench( "create(256KB) x1000", 1, function( n )
+      for i=1, n * 1000 do
+	 local buf = ByteArray.create( 256 * 1024 )
+	 buf.length = 256 * 1024
+	 if ByteArray.memoryUsage then
+	    peak = math.max( peak, ByteArray.memoryUsage() )
+	 end
+      end
+   end )
+   if ByteArray.memoryUsage then
+      print( string.format( "%-32s %10.1f MB", "peak buffer memory", peak / 2^20 ) )
+   end
+end
+
+-- a 64KB frame cut into 1KB messages
+local function bench_slice()
+   local frame = ByteArray.create( 65536 )
+   frame.length = 65536
+   bench( "slice 64KB frame into 1KB x64", 20000, function( n )
+      for i=1, n do
+	 for off=0, 65535, 1024 do frame:slice( off, off + 1024 ) end
+      end
+   end )
+end
+
+-- 64MB outbound stream in 1KB packets
+local function bench_chain()
+   local packet = string.rep( "p", 1024 )
+   bench( "ByteArray append 64MB", 1, function( n )
+      local buf = ByteArray.create()
+      for i=1, 65536 do buf:writeString( packet ) end
+   end )
+   bench( "chain append 64MB", 1, function( n )
+      local c = ByteArray.chain()
+      for i=1, 65536 do c:writeString( packet ) end
+   end )
+   local c = ByteArray.chain()
+   bench( "chain writeInt/readInt", N, function( n )
+      for i=1, n do c:writeInt( i ) c:readInt() end
+   end )
+end
+
+-- receive loop: 16KB arrives, 100 byte messages are parsed and dropped
+local function bench_consume()
+   local chunk = string.rep( "m", 16 * 1024 )
+   local function run( n, drop )
+      local rx, peak = ByteArray.create(), 0
+      for i=1, n do
+	 rx.position = #rx
+	 rx:writeString( chunk )
+	 rx.position = 0
+	 while rx.bytesAvailable >= 100 do
+	    rx:readString( 100 )
+	    rx = drop( rx )
+	 end
+	 peak = math.max( peak, rx.capacity )
+      end
+      return peak
+   end
+   bench( "receive 16MB, slice the rest", 1, function( n )
+      run( 1024, function( rx ) return rx:slice( rx.position ) end )
+   end )
+   local peak
+   if not ByteArray.create().discard then return end
+   bench( "receive 16MB, discard", 1, function( n )
+      peak = run( 1024, function( rx ) return rx:discard() end )
+   end )
+   print( string.format( "%-32s %10.1f KB", "peak capacity", peak / 1024 ) )
+end
+
+-- 12 field header, 32 bytes
+local function bench_header()
+   local buf = ByteArray.create( 64, ByteArray.BIG_ENDIAN )
+   local fmt = ">HHIIBBHHIiIB"
+   bench( "header 12 x write*", N / 10, function( n )
+      for i=1, n do
+	 buf.position = 0
+	 buf:writeUnsignedShort( 1 ):writeUnsignedShort( 2 )
+	 buf:writeUnsignedInt( 3 ):writeUnsignedInt( 4 )
+	 buf:writeUnsignedByte( 5 ):writeUnsignedByte( 6 )
+	 buf:writeUnsignedShort( 7 ):writeUnsignedShort( 8 )
+	 buf:writeUnsignedInt( 9 ):writeInt( -10 )
+	 buf:writeUnsignedInt( 11 ):writeUnsignedByte( 12 )
+      end
+   end )
+   bench( "header 12 x read*", N / 10, function( n )
+      for i=1, n do
+	 buf.position = 0
+	 buf:readUnsignedShort() buf:readUnsignedShort()
+	 buf:readUnsignedInt() buf:readUnsignedInt()
+	 buf:readUnsignedByte() buf:readUnsignedByte()
+	 buf:readUnsignedShort() buf:readUnsignedShort()
+	 buf:readUnsignedInt() buf:readInt()
+	 buf:readUnsignedInt() buf:readUnsignedByte()
+      end
+   end )
+   if buf.pack then
+      bench( "header pack", N / 10, function( n )
+	 for i=1, n do
+	    buf.position = 0
+	    buf:pack( fmt, 1, 2, 3, 4, 5, 6, 7, 8, 9, -10, 11, 12 )
+	 end
+      end )
+      bench( "header unpack", N / 10, function( n )
+	 for i=1, n do
+	    buf.position = 0
+	    buf:unpack( fmt )
+	 end
+      end )
+   end
+   if string.pack then
+      local sfmt = ">I2I2I4I4BBI2I2I4i4I4B"
+      local s = string.pack( sfmt, 1, 2, 3, 4, 5, 6, 7, 8, 9, -10, 11, 12 )
+      bench( "header string.pack", N / 10, function( n )
+	 for i=1, n do
+	    string.pack( sfmt, 1, 2, 3, 4, 5, 6, 7, 8, 9, -10, 11, 12 )
+	 end
+      end )
+      bench( "header string.unpack", N / 10, function( n )
+	 for i=1, n do
+	    string.unpack( sfmt, s )
+	 end
+      end )
+   end
+end
+
+-- protobuf message of 5 fields, against a string based lua codec
+local function bench_protobuf()
+   if not ByteArray.schema then return end
+   local Child = ByteArray.schema{ { 1, "a", "int32" } }
+   local Person = ByteArray.schema{
+      { 1, "id", "int32" }, { 2, "name", "string" }, { 3, "email", "string" },
+      { 4, "scores", "int32", repeated = true, packed = true },
+      { 5, "child", "message", Child },
+   }
+   local msg = { id = 1234, name = "Alice Example", email = "alice@example.com",
+		 scores = { 1, 20, 300, 4000, 50000, 6, 70, 800 }, child = { a = 9 } }
+
+   local function varint( t, v )
+      while v >= 128 do t[#t+1] = string.char( v % 128 + 128 ) v = math.floor( v / 128 ) end
+      t[#t+1] = string.char( v )
+   end
+   local function lua_encode( m )
+      local t = {}
+      varint( t, 8 ) varint( t, m.id )
+      varint( t, 18 ) varint( t, #m.name ) t[#t+1] = m.name
+      varint( t, 26 ) varint( t, #m.email ) t[#t+1] = m.email
+      local s = {}
+      for _, v in ipairs( m.scores ) do varint( s, v ) end
+      s = table.concat( s )
+      varint( t, 34 ) varint( t, #s ) t[#t+1] = s
+      local c = {}
+      varint( c, 8 ) varint( c, m.child.a )
+      c = table.concat( c )
+      varint( t, 42 ) varint( t, #c ) t[#t+1] = c
+      return table.concat( t )
+   end
+   local function rdvarint( s, i )
+      local v, m = 0, 1
+      while true do
+	 local b = s:byte( i )
+	 i = i + 1
+	 v = v + (b % 128) * m
+	 if b < 128 then return v, i end
+	 m = m * 128
+      end
+   end
+   local function lua_decode( s, i, j )
+      local m = {}
+      while i <= j do
+	 local key, n
+	 key, i = rdvarint( s, i )
+	 local f = math.floor( key / 8 )
+	 if f == 1 then m.id, i = rdvarint( s, i )
+	 else
+	    n, i = rdvarint( s, i )
+	    local sub = s:sub( i, i + n - 1 )
+	    if f == 2 then m.name = sub
+	    elseif f == 3 then m.email = sub
+	    elseif f == 4 then
+	       local t, k = {}, 1
+	       while k <= n do t[#t+1], k = rdvarint( sub, k ) end
+	       m.scores = t
+	    elseif f == 5 then m.child = lua_decode( sub, 1, n ) end
+	    i = i + n
+	 end
+      end
+      return m
+   end
+
+   local buf = ByteArray.create()
+   bench( "protobuf lua encode + writeString", N / 20, function( n )
+      for i=1, n do
+	 buf:clear()
+	 buf:writeString( lua_encode( msg ) )
+      end
+   end )
+   bench( "protobuf writeProtobuf", N / 20, function( n )
+      for i=1, n do
+	 buf:clear()
+	 buf:writeProtobuf( Person, msg )
+      end
+   end )
+   bench( "protobuf toString + lua decode", N / 20, function( n )
+      for i=1, n do
+	 local s = buf:toString()
+	 lua_decode( s, 1, #s )
+      end
+   end )
+   bench( "protobuf readProtobuf", N / 20, function( n )
+      for i=1, n do
+	 buf.position = 0
+	 buf:readProtobuf( Person )
+      end
+   end )
+end
+
+-- AMF3 message with 50 typed objects, against a byte by byte lua decoder
+local function bench_amf3()
+   if not ByteArray.create().readObject then return end
+   local items = {}
+   for i=1, 50 do
+      items[i] = { __class = "game.Item", id = i, name = "item" .. (i % 5), count = i * 3, weight = i / 4 }
+   end
+   local msg = { cmd = "inventory", seq = 123456, pos = { x = 1.5, y = 2.5 }, items = items }
+
+   local function lua_decoder( b )
+      local strings, objects, traits
+      local function u29()
+	 local v = 0
+	 for i=1, 3 do
+	    local c = b:readUnsignedByte()
+	    if c < 128 then return v * 128 + c end
+	    v = v * 128 + c - 128
+	 end
+	 return v * 256 + b:readUnsignedByte()
+      end
+      local function str()
+	 local h = u29()
+	 if h % 2 == 0 then return strings[h / 2 + 1] end
+	 local n = (h - 1) / 2
+	 if n == 0 then return "" end
+	 local s = b:readString( n )
+	 strings[#strings+1] = s
+	 return s
+      end
+      local value
+      local function members( t )
+	 while true do
+	    local k = str()
+	    if k == "" then return end
+	    t[k] = value()
+	 end
+      end
+      function value()
+	 local m = b:readUnsignedByte()
+	 if m <= 1 then return nil
+	 elseif m == 2 then return false
+	 elseif m == 3 then return true
+	 elseif m == 4 then
+	    local v = u29()
+	    return v >= 2^28 and v - 2^29 or v
+	 elseif m == 5 then return b:readDouble()
+	 elseif m == 6 then return str() end
+	 local h = u29()
+	 if h % 2 == 0 then return objects[h / 2 + 1] end
+	 local t = {}
+	 objects[#objects+1] = t
+	 if m == 9 then
+	    members( t )
+	    for i=1, (h - 1) / 2 do t[i] = value() end
+	 elseif m == 10 then
+	    local tr
+	    if math.floor( h / 2 ) % 2 == 0 then tr = traits[math.floor( h / 4 ) + 1]
+	    else
+	       tr = { cls = str(), dynamic = math.floor( h / 8 ) % 2 == 1 }
+	       for i=1, math.floor( h / 16 ) do tr[i] = str() end
+	       traits[#traits+1] = tr
+	    end
+	    if tr.cls ~= "" then t.__class = tr.cls end
+	    for i=1, #tr do t[tr[i]] = value() end
+	    if tr.dynamic then members( t ) end
+	 end
+	 return t
+      end
+      return function()
+	 strings, objects, traits = {}, {}, {}
+	 return value()
+      end
+   end
+
+   local buf = ByteArray.create( 4096, ByteArray.BIG_ENDIAN )
+   buf:writeObject( msg )
+   local size = #buf
+   local decode = lua_decoder( buf )
+   local function rate( name, f )
+      local dt = math.huge
+      for r=1, 3 do
+	 local t0 = os.clock()
+	 for i=1, 2000 do f() end
+	 dt = math.min( dt, os.clock() - t0 )
+      end
+      print( string.format( "%-32s %10.1f MB/s", name, size * 2000 / dt / 2^20 ) )
+   end
+   rate( "amf3 lua decoder", function() buf.position = 0 decode() end )
+   rate( "amf3 readObject", function() buf.position = 0 buf:readObject() end )
+   rate( "amf3 writeObject", function() buf:clear() buf:writeObject( msg ) end )
+end
+
+local function bench_msgpack()
+   if not ByteArray.create().writeMsgPack then return end
+   local items = {}
+   for i=1, 50 do
+      items[i] = { id = i, name = "item" .. (i % 5), count = i * 3, weight = i / 4 }
+   end
+   local msg = { cmd = "inventory", seq = 123456, pos = { x = 1.5, y = 2.5 }, items = items }
+
+   -- the usual pure lua encoder, the string is copied in afterwards
+   local char, concat, floor = string.char, table.concat, math.floor
+   local function be( v, n )
+      local b = {}
+      for i=n, 1, -1 do
+	 b[i] = v % 256
+	 v = floor( v / 256 )
+      end
+      return char( (unpack or table.unpack)( b, 1, n ) )
+   end
+   local double = string.pack and function( d ) return string.pack( ">Bd", 0xcb, d ) end
+   double = double or function( d )
+      local sign = d < 0 and 128 or 0
+      d = math.abs( d )
+      local m, e = math.frexp( d )
+      m = (m * 2 - 1) * 2^52
+      e = e + 1022
+      local hi = floor( m / 2^32 )
+      return char( 0xcb, sign + floor( e / 16 ), (e % 16) * 16 + floor( hi / 2^16 ) ) ..
+	 be( hi % 2^16, 2 ) .. be( m % 2^32, 4 )
+   end
+   local encode
+   function encode( v, out )
+      local t = type( v )
+      if t == "number" then
+	 if v == floor( v ) and v >= 0 then
+	    if v < 128 then out[#out+1] = char( v )
+	    elseif v < 2^16 then out[#out+1] = char( 0xcd ) .. be( v, 2 )
+	    else out[#out+1] = char( 0xce ) .. be( v, 4 ) end
+	 else out[#out+1] = double( v ) end
+      elseif t == "string" then
+	 local n = #v
+	 out[#out+1] = n < 32 and char( 0xa0 + n ) or char( 0xd9, n )
+	 out[#out+1] = v
+      elseif t == "table" then
+	 local n, count = #v, 0
+	 for _ in pairs( v ) do count = count + 1 end
+	 if n > 0 and n == count then
+	    out[#out+1] = n < 16 and char( 0x90 + n ) or char( 0xdc ) .. be( n, 2 )
+	    for i=1, n do encode( v[i], out ) end
+	 else
+	    out[#out+1] = count < 16 and char( 0x80 + count ) or char( 0xde ) .. be( count, 2 )
+	    for k, x in pairs( v ) do
+	       encode( k, out )
+	       encode( x, out )
+	    end
+	 end
+      else out[#out+1] = char( v and 0xc3 or 0xc2 ) end
+   end
+
+   local buf = ByteArray.create( 4096 )
+   buf:writeMsgPack( msg )
+   local size = #buf
+   local function rate( name, f )
+      local dt = math.huge
+      for r=1, 3 do
+	 local t0 = os.clock()
+	 for i=1, 2000 do f() end
+	 dt = math.min( dt, os.clock() - t0 )
+      end
+      print( string.format( "%-32s %10.1f MB/s", name, size * 2000 / dt / 2^20 ) )
+   end
+   rate( "msgpack lua encoder", function()
+      local out = {}
+      encode( msg, out )
+      buf:clear()
+      buf:writeString( concat( out ) )
+   end )
+   rate( "msgpack writeMsgPack", function() buf:clear() buf:writeMsgPack( msg ) end )
+   rate( "msgpack readMsgPack", function() buf.position = 0 buf:readMsgPack() end )
+end
+
+local function bench_lz4()
+   if not ByteArray.create().compress then return end
+   -- corpus: 512 KiB of text from a small vocabulary and 512 KiB of
+   -- fixed size records, both from a fixed seed
+   local seed = 1
+   local function rnd( n )
+      seed = (seed * 1103515245 + 12345) % 2^31
+      return math.floor( seed / 2^16 ) % n
+   end
+   local words = {}
+   for i=1, 500 do
+      local w = {}
+      for j=1, 2 + rnd( 8 ) do w[j] = string.char( 97 + rnd( 26 ) ) end
+      words[i] = table.concat( w )
+   end
+   local corpus = ByteArray.create( 1024*1024, ByteArray.LITTLE_ENDIAN )
+   while #corpus < 512*1024 do
+      corpus:writeString( words[1 + rnd( rnd( 500 ) + 1 )] )
+      corpus:writeString( rnd( 12 ) == 0 and ".\n" or " " )
+   end
+   while #corpus < 1024*1024 do
+      corpus:writeInt( #corpus ):writeShort( rnd( 100 ) ):writeUnsignedByte( rnd( 4 ) )
+      corpus:writeDouble( rnd( 1000 ) / 8 ):writeString( words[1 + rnd( 20 )] ):writeUnsignedByte( 0 )
+   end
+   local size = #corpus
+
+   local function rate( name, f )
+      local dt = math.huge
+      for r=1, 3 do
+	 local t0 = os.clock()
+	 for i=1, 10 do f() end
+	 dt = math.min( dt, os.clock() - t0 )
+      end
+      print( string.format( "%-32s %10.1f MB/s", name, size * 10 / dt / 2^20 ) )
+   end
+   local z = ByteArray.create( size )
+   for _, level in ipairs{ 1, 5, 9 } do
+      z:clear()
+      corpus.position = 0
+      corpus:compress( z, level )
+      print( string.format( "%-32s %10.3f", "lz4 ratio level " .. level, #z / size ) )
+      rate( "lz4 compress level " .. level, function()
+	 z:clear()
+	 corpus.position = 0
+	 corpus:compress( z, level )
+      end )
+   end
+   local out = ByteArray.create( size )
+   rate( "lz4 decompress", function()
+      z.position = 0
+      out:clear()
+      z:decompress( size, out )
+   end )
+   rate( "lz4 frame compress", function()
+      z:clear()
+      corpus.position = 0
+      ByteArray.compressStream( z )( corpus, true )
+   end )
+   rate( "lz4 frame decompress", function()
+      z.position = 0
+      out:clear()
+      ByteArray.decompressStream( out )( z )
+   end )
+end
+
+local function bench_checksum()
+   if not ByteArray.create().crc32 then return end
+   local size = 1024*1024
+   local buf = ByteArray.create( size )
+   for i=1, size / 8 do buf:writeDouble( i / 7 ) end
+
+   local function rate( name, n, f )
+      local dt = math.huge
+      for r=1, 3 do
+	 local t0 = os.clock()
+	 for i=1, n do f() end
+	 dt = math.min( dt, os.clock() - t0 )
+      end
+      print( string.format( "%-32s %10.1f MB/s", name, size * n / dt / 2^20 ) )
+   end
+
+   -- the lua loop it replaces, over buf[i]
+   local adler = function()
+      local a, b = 1, 0
+      for i=1, size do
+	 a = (a + buf[i]) % 65521
+	 b = (b + a) % 65521
+      end
+      return b * 65536 + a
+   end
+   assert( adler() == buf:adler32() )
+   rate( "adler32 lua buf[i]", 1, adler )
+   rate( "crc32", 100, function() buf:crc32() end )
+   rate( "crc32c", 100, function() buf:crc32c() end )
+   rate( "adler32", 100, function() buf:adler32() end )
+   rate( "xxh64", 100, function() buf:xxh64() end )
+end
+
+local function bench_search()
+   if not ByteArray.create().indexOf then return end
+   -- a redis style reply of short lines
+   local parts = {}
+   for i=1, 20000 do parts[#parts+1] = "$" .. (i % 97) .. "\r\nvalue" .. i .. "\r\n" end
+   local text = table.concat( parts )
+   local buf = ByteArray.load( text )
+   local lines = 40000
+
+   local function run( name, f )
+      local dt = math.huge
+      for r=1, 3 do
+	 buf.position = 0
+	 local t0 = os.clock()
+	 f()
+	 dt = math.min( dt, os.clock() - t0 )
+      end
+      print( string.format( "%-32s %10.1f MB/s", name, #text / dt / 2^20 ) )
+   end
+
+   -- the lua loops it replaces
+   run( "lines lua buf[i]", function()
+      local n, start = 0, 1
+      for i=1, #buf - 1 do
+	 if buf[i] == 13 and buf[i+1] == 10 then
+	    buf.position = start - 1
+	    buf:readString( i - start )
+	    start = i + 2
+	    n = n + 1
+	 end
+      end
+      assert( n == lines )
+   end )
+   run( "lines string.find", function()
+      local n, start = 0, 1
+      local s = buf:toString()
+      while true do
+	 local i = string.find( s, "\r\n", start, true )
+	 if not i then break end
+	 local _ = s:sub( start, i - 1 )
+	 start = i + 2
+	 n = n + 1
+      end
+      assert( n == lines )
+   end )
+   run( "readUntil", function()
+      for i=1, lines do buf:readUntil( "\r\n" ) end
+   end )
+   run( "readLine", function()
+      for i=1, lines do buf:readLine() end
+   end )
+
+   -- one long scan for the end of a large header block
+   local big = ByteArray.create( 4*1024*1024 )
+   while #big < 4*1024*1024 do big:writeString( "X-Header-Name: some value\r\n" ) end
+   big:writeString( "\r\n\r\n" )
+   local function scan( name, k, at, n )
+      local dt = math.huge
+      for r=1, 3 do
+	 local t0 = os.clock()
+	 for i=1, n do assert( big:indexOf( k ) == at ) end
+	 dt = math.min( dt, os.clock() - t0 )
+      end
+      print( string.format( "%-32s %10.1f MB/s", name, #big * n / dt / 2^20 ) )
+   end
+   scan( "indexOf byte", 0, nil, 20 )
+   scan( "indexOf \\r\\n\\r\\n", "\r\n\r\n", #big - 6, 20 )
+end
+
+local function bench_codec()
+   if not ByteArray.create().toBase64 then return end
+   local size = 1024*1024
+   local buf = ByteArray.create( size )
+   for i=1, size / 8 do buf:writeDouble( i / 7 ) end
+   local b64, hex = buf:toBase64(), buf:toHex()
+
+   local function rate( name, n, f )
+      local dt = math.huge
+      for r=1, 3 do
+	 local t0 = os.clock()
+	 for i=1, n do f() end
+	 dt = math.min( dt, os.clock() - t0 )
+      end
+      print( string.format( "%-32s %10.1f MB/s", name, size * n / dt / 2^20 ) )
+   end
+
+   -- the lua library way, one string.char per 3 bytes
+   local A = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"
+   local enc = {}
+   for i=0, 63 do enc[i] = A:sub( i + 1, i + 1 ) end
+   rate( "base64 lua toString", 1, function()
+      local s = buf:toString()
+      local out = {}
+      for i=1, #s - 2, 3 do
+	 local a, b, c = s:byte( i, i + 2 )
+	 local v = a * 65536 + b * 256 + c
+	 out[#out+1] = enc[math.floor( v / 262144 )] .. enc[math.floor( v / 4096 ) % 64] ..
+	    enc[math.floor( v / 64 ) % 64] .. enc[v % 64]
+      end
+      return table.concat( out )
+   end )
+   rate( "toBase64", 100, function() buf:toBase64() end )
+   local to = ByteArray.create( size )
+   rate( "fromBase64 into a ByteArray", 100, function()
+      to.position = 0
+      ByteArray.fromBase64( b64, to )
+   end )
+   rate( "toHex", 100, function() buf:toHex() end )
+   rate( "fromHex into a ByteArray", 100, function()
+      to.position = 0
+      ByteArray.fromHex( hex, to )
+   end )
+end
+
+local function bench_transform()
+   if not ByteArray.create().xorMask then return end
+   local size = 1024*1024
+   local buf = ByteArray.create( size )
+   for i=1, size / 8 do buf:writeDouble( i / 7 ) end
+   local key = "\55\250\33\61"
+
+   local function time( name, n, f )
+      local dt = math.huge
+      for r=1, 3 do
+	 local t0 = os.clock()
+	 for i=1, n do f() end
+	 dt = math.min( dt, os.clock() - t0 )
+      end
+      print( string.format( "%-32s %10.1f us per MiB", name, dt / n * 1e6 ) )
+   end
+
+   -- the lua unmasking it replaces, xor through a table as 5.1 has no operator
+   local xt = {}
+   for a=0, 255 do
+      for k=0, 255 do
+	 local x, y, r = a, k, 0
+	 for bit=0, 7 do
+	    if x % 2 ~= y % 2 then r = r + 2^bit end
+	    x, y = math.floor( x / 2 ), math.floor( y / 2 )
+	 end
+	 xt[a * 256 + k] = r
+      end
+   end
+   local k = { key:byte( 1, 4 ) }
+   time( "unmask lua buf[i]", 1, function()
+      for i=1, size do
+	 buf[i] = xt[buf[i] * 256 + k[(i - 1) % 4 + 1]]
+      end
+   end )
+   time( "xorMask", 100, function() buf:xorMask( key ) end )
+   time( "xorMask, odd offset and phase", 100, function() buf:xorMask( key, 1, size - 2, 3 ) end )
+   time( "fill", 100, function() buf:fill( 0x20 ) end )
+   time( "copyWithin, overlapping", 100, function() buf:copyWithin( 1, 0, size - 1 ) end )
+end
+
+local function bench_compare()
+   if not ByteArray.create().equals then return end
+   -- 4 KiB records that differ in the last byte
+   local body = string.rep( "0123456789abcdef", 256 )
+   local a, b = ByteArray.create(), ByteArray.create()
+   a:writeString( body ):writeByte( 1 )
+   b:writeString( body ):writeByte( 2 )
+   local n = 20000
+
+   local function time( name, f )
+      local dt = math.huge
+      for r=1, 3 do
+	 local t0 = os.clock()
+	 f()
+	 dt = math.min( dt, os.clock() - t0 )
+      end
+      print( string.format( "%-32s %10.1f ns per op", name, dt / n * 1e9 ) )
+   end
+
+   time( "toString() == toString()", function()
+      for i=1, n do assert( a:toString() ~= b:toString() ) end
+   end )
+   time( "a == b", function()
+      for i=1, n do assert( a ~= b ) end
+   end )
+   time( "a:equals( b )", function()
+      for i=1, n do assert( not a:equals( b ) ) end
+   end )
+   time( "a < b", function()
+      for i=1, n do assert( a < b ) end
+   end )
+
+   -- dedup keys for the records
+   local seen = {}
+   time( "seen[toString()]", function()
+      for i=1, n do seen[a:toString()] = true end
+   end )
+   time( "seen[hash()]", function()
+      for i=1, n do seen[a:hash()] = true end
+   end )
+end
+
+bench_method_call()
+bench_property()
+bench_index()
+bench_typed()
+bench_array()
+bench_swap()
+bench_varint()
+bench_append()
+bench_create()
+bench_gc_pressure()
+bench_slice()
+bench_chain()
+bench_consume()
+bench_header()
+bench_protobuf()
+bench_amf3()
+bench_msgpack()
+bench_lz4()
+bench_checksum()
+bench_search()
+bench_codec()
+bench_transform()
+bench_compare()
@@ -4,14 +4,97 @@
 #include "stddef.h"
 #include "stdlib.h"
 #include "string.h"
+#include "errno.h"
 #include "lauxlib.h"
-#include "setjmp.h"
 #include "math.h"
+#include "float.h"
+#include "limits.h"
+
+// file descriptor I/O
+#if defined(__unix__) || defined(__APPLE__)
+#define BYTEARRAY_POSIX
+#include "fcntl.h"
+#include "unistd.h"
+#include "sys/stat.h"
+#include "sys/uio.h"
+#endif
+
+// ByteArray.mmap, define BYTEARRAY_NO_MMAP to leave it out
+#if defined(BYTEARRAY_POSIX) && !defined(BYTEARRAY_NO_MMAP)
+#define BYTEARRAY_MMAP
+#include "sys/mman.h"
+#endif
+
+// default maxBytes of readFrom
+#ifndef BYTEARRAY_READ_SIZE
+#define BYTEARRAY_READ_SIZE (64*1024)
+#endif
+
+// iovecs per writev call
+#ifndef BYTEARRAY_WRITEV_BATCH
+#define BYTEARRAY_WRITEV_BATCH 64
+#endif
+
+// chunk size of ByteArray.chain, and how many free chunks a lua_State keeps
+#ifndef BYTEARRAY_CHUNK_SIZE
+#define BYTEARRAY_CHUNK_SIZE (16*1024)
+#endif
+
+#ifndef BYTEARRAY_CHUNK_CACHE
+#define BYTEARRAY_CHUNK_CACHE 64
+#endif
+
+// compiled pack / unpack formats kept per lua_State, the cache starts
+// over when it is full
+#ifndef BYTEARRAY_FORMAT_CACHE
+#define BYTEARRAY_FORMAT_CACHE 256
+#endif
+
+// nesting limit of encoded messages, it bounds the C stack
+#ifndef BYTEARRAY_MAX_DEPTH
+#define BYTEARRAY_MAX_DEPTH 100
+#endif
+
+#if LUA_VERSION_NUM >= 502
+#define lua_objlen lua_rawlen
+#ifndef luaL_checkint
+#define luaL_checkint(L, n) ((int)luaL_checkinteger(L, (n)))
+#endif
+#define luaL_register(L, name, l) (lua_newtable(L), luaL_setfuncs(L, l, 0),	\
+				   lua_pushvalue(L, -1), lua_setglobal(L, name))
+#define lua_setfenv(L, idx) (lua_setuservalue(L, idx), 1)
+#define lua_getfenv(L, idx) lua_getuservalue(L, idx)
+#endif
 
 #ifndef BYTEARRAY_RESERVE_SIZE
 #define BYTEARRAY_RESERVE_SIZE 128
 #endif
 
+// capacity grows by this percentage of itself, but never more than
+// BYTEARRAY_GROWTH_CAP bytes beyond what is needed
+#ifndef BYTEARRAY_GROWTH_PERCENT
+#define BYTEARRAY_GROWTH_PERCENT 100
+#endif
+
+#ifndef BYTEARRAY_GROWTH_CAP
+#define BYTEARRAY_GROWTH_CAP (16*1024*1024)
+#endif
+
+// payloads up to this size live inside the userdata, no extra malloc
+#ifndef BYTEARRAY_INLINE_SIZE
+#define BYTEARRAY_INLINE_SIZE 64
+#endif
+
+// buffer memory is reported to the lua collector in steps of this size
+#ifndef BYTEARRAY_GC_STEP
+#define BYTEARRAY_GC_STEP (64*1024)
+#endif
+
+// default per lua_State limit for buffer memory in bytes, 0 is unlimited
+#ifndef BYTEARRAY_MEMORY_LIMIT
+#define BYTEARRAY_MEMORY_LIMIT 0
+#endif
+
 #define BYTEARRAY_USE_CSTRING
 
 #define ENDIAN_LITTLE 0
@@ -22,6 +105,9 @@
 typedef struct {
   uint8_t endian: 1;
   uint8_t readonly: 1;
+  uint8_t shared: 1;   // storage may have other owners, copy before writing
+  uint8_t mapped: 1;   // buffer is a file mapping described by BufMap
+  uint8_t chained: 1;  // segmented buffer described by BufChain
 } BufFlag;
 
 enum {
@@ -29,44 +115,128 @@ enum {
   ERR_NOMEM,
   ERR_OVERFLOW,
   ERR_READONLY,
-  ERR_OUTOFRANGE
+  ERR_OUTOFRANGE,
+  ERR_MALFORMED,
+  ERR_INVALIDTYPE,
+  ERR_DEPTH,
+  ERR_CYCLE
 };
 
+// define BYTEARRAY_LARGE_BUFFER for buffers above 4 GiB
+#ifdef BYTEARRAY_LARGE_BUFFER
+typedef uint64_t buflen_t;
+#else
 typedef uint32_t buflen_t;
+#endif
+#define BUFLEN_MAX ((buflen_t)~(buflen_t)0)
+
+// One per lua_State. Heap buffers come from the state's allocator, the
+// collector does not see them so the growth is reported as debt.
+typedef struct {
+  lua_Alloc allocf;
+  void    *ud;
+  size_t   used;
+  size_t   limit;
+  size_t   debt;
+  void    *chunks;     // free BufChunk list
+  size_t   nchunks;
+  size_t   maxchunks;
+} BufAlloc;
+
+// heap storage, shared by slices until one of them writes
+typedef struct {
+  size_t   refs;
+  size_t   size;
+  uint8_t  data[];
+} BufStore;
+
+// kept in the inline storage of a mapped Buf
+typedef struct {
+  void    *base;
+  size_t   size;
+} BufMap;
+
+typedef struct BufChunk {
+  struct BufChunk *next;
+  size_t   length;
+  uint8_t  data[BYTEARRAY_CHUNK_SIZE];
+} BufChunk;
+
+// kept in the inline storage of a chained Buf, offset is the read
+// position in head and length counts the unread bytes
+typedef struct {
+  BufChunk *head;
+  BufChunk *tail;
+  size_t   offset;
+  size_t   length;
+} BufChain;
+
+// the inline storage of a Buf holds a BufMap or a BufChain in place of
+// bytes, it starts at an offset aligned for both
+typedef union {
+  BufMap   map;
+  BufChain chain;
+} BufInline;
+
+#if defined(__GNUC__)
+#define BUF_LOCAL_ALIGN __attribute__((aligned(__alignof__(BufInline))))
+#elif __STDC_VERSION__ >= 201112L
+#define BUF_LOCAL_ALIGN _Alignas(BufInline)
+#else
+#define BUF_LOCAL_ALIGN
+#endif
 
+// Buf is the lua userdata itself, buffer points either to the inline
+// storage at its tail or into store once it outgrows szlocal bytes.
 typedef struct {
+  BufAlloc *alloc;
+  BufStore *store;
   uint8_t *buffer;
   BufFlag  flag;
   buflen_t position;
   buflen_t length;
   buflen_t szbuffer;
+  buflen_t szlocal;
+  BUF_LOCAL_ALIGN uint8_t local[];
 } Buf;
 
-static jmp_buf except;
+// No mutable module state: native endian is fixed at compile time so
+// any number of lua_State may use the module from different threads.
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define NATIVE_ENDIAN ENDIAN_BIG
+#elif defined(__BYTE_ORDER__) || defined(_WIN32)
+#define NATIVE_ENDIAN ENDIAN_LITTLE
+#endif
 
-static int8_t nativeEndian = -1;
-static int getNativeEndian()
+static inline int getNativeEndian()
 {
-  if( nativeEndian < 0 )
-    {
-      int x = 1;
-      if( *(char*)&x == 1 ) 
-	nativeEndian = ENDIAN_LITTLE;
-      else nativeEndian = ENDIAN_BIG;
-    }
-  return nativeEndian;  
+#ifdef NATIVE_ENDIAN
+  return NATIVE_ENDIAN;
+#else
+  const union { uint16_t u; uint8_t c[2]; } x = { 1 };
+  return x.c[0] == 1 ? ENDIAN_LITTLE : ENDIAN_BIG;
+#endif
 }
 
 static inline BufFlag flag( int endian, int ro )
 {
-  BufFlag r = {endian, ro};
+  BufFlag r = {endian, ro, 0, 0, 0};
   return r;
 }
 
-static inline buflen_t grow( buflen_t len, buflen_t need )
+// new capacity for at least need bytes, amortised geometric growth
+// rounded up to BYTEARRAY_RESERVE_SIZE, saturates at BUFLEN_MAX
+static inline buflen_t grow( buflen_t capacity, buflen_t need )
 {
-  int times = (len + need) / BYTEARRAY_RESERVE_SIZE;
-  return (times+1) * BYTEARRAY_RESERVE_SIZE;
+  buflen_t extra = capacity / 100 * BYTEARRAY_GROWTH_PERCENT
+    + capacity % 100 * BYTEARRAY_GROWTH_PERCENT / 100;
+  buflen_t want = need;
+  if( capacity < need && extra > need - capacity )
+    want = extra > BUFLEN_MAX - capacity ? BUFLEN_MAX : capacity + extra;
+  if( want - need > BYTEARRAY_GROWTH_CAP ) want = need + BYTEARRAY_GROWTH_CAP;
+
+  if( want > BUFLEN_MAX - BYTEARRAY_RESERVE_SIZE ) return BUFLEN_MAX;
+  return (want + BYTEARRAY_RESERVE_SIZE - 1) / BYTEARRAY_RESERVE_SIZE * BYTEARRAY_RESERVE_SIZE;
 }
 
 #define SWAP(a, b, t) {				\
@@ -75,59 +245,296 @@ static inline buflen_t grow( buflen_t len, buflen_t need )
   (b) = tmp;					\
   }
 
+#if defined(__GNUC__)
+#define BSWAP16(x) __builtin_bswap16(x)
+#define BSWAP32(x) __builtin_bswap32(x)
+#define BSWAP64(x) __builtin_bswap64(x)
+#define CTZ64(x) __builtin_ctzll(x)
+#define CLZ64(x) __builtin_clzll(x)
+#else
+#define BSWAP16(x) ((uint16_t)(((x) >> 8) | ((x) << 8)))
+#define BSWAP32(x) ((((x) & 0xff000000u) >> 24) | (((x) & 0x00ff0000u) >>  8) | \
+		    (((x) & 0x0000ff00u) <<  8) | (((x) & 0x000000ffu) << 24))
+#define BSWAP64(x) (((uint64_t)BSWAP32((uint32_t)(x)) << 32) | BSWAP32((uint32_t)((x) >> 32)))
+static inline int CTZ64( uint64_t x )
+{
+  int n = 0;
+  for( ; !(x & 1); x >>= 1 ) ++n;
+  return n;
+}
+static inline int CLZ64( uint64_t x )
+{
+  int n = 0;
+  for( ; !(x >> 63); x <<= 1 ) ++n;
+  return n;
+}
+#endif
+
+#define SWAP_VALUE( type, BSWAP, q ) {		\
+    type v;					\
+    memcpy( &v, q, sizeof(type) );		\
+    v = BSWAP(v);				\
+    memcpy( q, &v, sizeof(type) );		\
+  }
+
+// sz is a constant at every call site, so this inlines to one bswap
 static inline void adjustEndian( uint8_t *first, buflen_t sz, int e )
 {
-  if( sz > 1 && e != nativeEndian ){
+  if( sz < 2 || e == getNativeEndian() ) return;
+
+  switch( sz ){
+  case 2: SWAP_VALUE( uint16_t, BSWAP16, first ); break;
+  case 4: SWAP_VALUE( uint32_t, BSWAP32, first ); break;
+  case 8: SWAP_VALUE( uint64_t, BSWAP64, first ); break;
+  default:
     for(uint8_t *last = &first[sz-1]; first < last; ++first, --last ){
       SWAP( *first, *last, uint8_t );
     }
   }
 }
 
-// constructor
-static Buf* createBuf( buflen_t sz, int endian )
+// ------------ endian swap kernels ---------------
+// swapRun reverses count values of width (2, 4 or 8) bytes in place.
+// On x86 the SSSE3 / AVX2 kernel is picked at runtime, the scalar loop
+// handles the tail and every other target.
+
+#define SWAP_RUN_TEMPLATE( type, BSWAP ) {			\
+    for( ; count > 0; --count, first += sizeof(type) )		\
+      SWAP_VALUE( type, BSWAP, first );				\
+  }
+
+static void swapRunScalar( uint8_t *first, size_t width, size_t count )
+{
+  switch( width ){
+  case 2: SWAP_RUN_TEMPLATE( uint16_t, BSWAP16 ); break;
+  case 4: SWAP_RUN_TEMPLATE( uint32_t, BSWAP32 ); break;
+  case 8: SWAP_RUN_TEMPLATE( uint64_t, BSWAP64 ); break;
+  }
+}
+
+#if !defined(BYTEARRAY_NO_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BYTEARRAY_SIMD_X86
+#include "immintrin.h"
+
+static inline __m128i swapMask128( size_t width )
 {
-  Buf* retval = realloc( NULL, sizeof(Buf) );
-  if( retval == NULL ) return retval;
-  
-  retval->flag = flag( endian, READ_WRITE );
-  retval->position = 0;
-  retval->buffer = NULL;
-  retval->length = 0;
-  retval->szbuffer = 0;
-  if( sz > 0 ){
-    retval->buffer = realloc( NULL, sz );
-    if( retval->buffer == NULL ){
-      free( retval );
-      return NULL;
+  if( width == 2 )
+    return _mm_setr_epi8( 1,0, 3,2, 5,4, 7,6, 9,8, 11,10, 13,12, 15,14 );
+  else if( width == 4 )
+    return _mm_setr_epi8( 3,2,1,0, 7,6,5,4, 11,10,9,8, 15,14,13,12 );
+  return _mm_setr_epi8( 7,6,5,4,3,2,1,0, 15,14,13,12,11,10,9,8 );
+}
+
+__attribute__((target("ssse3")))
+static void swapRunSSSE3( uint8_t *first, size_t width, size_t count )
+{
+  __m128i mask = swapMask128( width );
+  size_t per = 16 / width;
+  for( ; count >= per; count -= per, first += 16 ){
+    __m128i v = _mm_loadu_si128( (__m128i*)first );
+    _mm_storeu_si128( (__m128i*)first, _mm_shuffle_epi8(v, mask) );
+  }
+  swapRunScalar( first, width, count );
+}
+
+__attribute__((target("avx2")))
+static void swapRunAVX2( uint8_t *first, size_t width, size_t count )
+{
+  // the shuffle works per 128 bit lane, the same mask goes to both lanes
+  __m128i m = swapMask128( width );
+  __m256i mask = _mm256_inserti128_si256( _mm256_castsi128_si256(m), m, 1 );
+  size_t per = 32 / width;
+  for( ; count >= per; count -= per, first += 32 ){
+    __m256i v = _mm256_loadu_si256( (__m256i*)first );
+    _mm256_storeu_si256( (__m256i*)first, _mm256_shuffle_epi8(v, mask) );
+  }
+  swapRunSSSE3( first, width, count );
+}
+#endif//BYTEARRAY_SIMD_X86
+
+static void swapRun( uint8_t *first, size_t width, size_t count )
+{
+#ifdef BYTEARRAY_SIMD_X86
+  if( count * width >= 32 ){
+    if( __builtin_cpu_supports("avx2") ){
+      swapRunAVX2( first, width, count );
+      return;
     }
-    else {
-      memset( retval->buffer, 0, sz );
-      retval->szbuffer = sz;
+    if( __builtin_cpu_supports("ssse3") ){
+      swapRunSSSE3( first, width, count );
+      return;
     }
   }
-  return retval;
+#endif
+  swapRunScalar( first, width, count );
 }
 
-static Buf* fromArray( void *arr, buflen_t len, int endian )
+// xor n bytes with the 4 byte key repeated
+static void xorRunScalar( uint8_t *first, const uint8_t key[4], size_t n )
 {
-  Buf* retval = realloc( NULL, sizeof(Buf) );
-  if( retval == NULL ) return retval;
-  
-  retval->flag = flag( endian, READ_ONLY );
-  retval->position = 0;
-  retval->buffer = arr;
-  retval->length = len;
-  retval->szbuffer = len;
-  
+  uint8_t pattern[8] = { key[0], key[1], key[2], key[3], key[0], key[1], key[2], key[3] };
+  uint64_t k;
+  memcpy( &k, pattern, sizeof(k) );
+  for( ; n >= 8; n -= 8, first += 8 ){
+    uint64_t v;
+    memcpy( &v, first, sizeof(v) );
+    v ^= k;
+    memcpy( first, &v, sizeof(v) );
+  }
+  for( size_t i=0; i < n; ++i ) first[i] ^= key[i % 4];
+}
+
+#ifdef BYTEARRAY_SIMD_X86
+__attribute__((target("sse2")))
+static void xorRunSSE2( uint8_t *first, const uint8_t key[4], size_t n )
+{
+  int32_t k32;
+  memcpy( &k32, key, sizeof(k32) );
+  __m128i k = _mm_set1_epi32( k32 );
+  for( ; n >= 16; n -= 16, first += 16 ){
+    __m128i v = _mm_loadu_si128( (__m128i*)first );
+    _mm_storeu_si128( (__m128i*)first, _mm_xor_si128(v, k) );
+  }
+  xorRunScalar( first, key, n );
+}
+
+__attribute__((target("avx2")))
+static void xorRunAVX2( uint8_t *first, const uint8_t key[4], size_t n )
+{
+  int32_t k32;
+  memcpy( &k32, key, sizeof(k32) );
+  __m256i k = _mm256_set1_epi32( k32 );
+  for( ; n >= 64; n -= 64, first += 64 ){
+    __m256i a = _mm256_loadu_si256( (__m256i*)first );
+    __m256i b = _mm256_loadu_si256( (__m256i*)(first + 32) );
+    _mm256_storeu_si256( (__m256i*)first, _mm256_xor_si256(a, k) );
+    _mm256_storeu_si256( (__m256i*)(first + 32), _mm256_xor_si256(b, k) );
+  }
+  xorRunSSE2( first, key, n );
+}
+#endif//BYTEARRAY_SIMD_X86
+
+static void xorRun( uint8_t *first, const uint8_t key[4], size_t n )
+{
+#ifdef BYTEARRAY_SIMD_X86
+  if( n >= 32 ){
+    if( __builtin_cpu_supports("avx2") ){
+      xorRunAVX2( first, key, n );
+      return;
+    }
+    xorRunSSE2( first, key, n );
+    return;
+  }
+#endif
+  xorRunScalar( first, key, n );
+}
+
+// adjustEndian over count values of width bytes in one pass
+static inline void adjustEndianRun( uint8_t *first, size_t width, size_t count, int e )
+{
+  if( width < 2 || e == getNativeEndian() ) return;
+  swapRun( first, width, count );
+}
+
+// NULL if the limit is exceeded or the allocator fails
+static void* allocBytes( BufAlloc *a, void *ptr, size_t osize, size_t nsize )
+{
+  if( nsize > osize && a->limit > 0 ){
+    size_t more = nsize - osize;
+    if( more > a->limit || a->used > a->limit - more ) return NULL;
+  }
+
+  void *retval = a->allocf( a->ud, ptr, osize, nsize );
+  if( retval == NULL && nsize > 0 ) return NULL;
+
+  a->used += nsize - osize;
+  if( nsize > osize ) a->debt += nsize - osize;
   return retval;
 }
 
+static BufStore* allocStore( BufAlloc *a, size_t size )
+{
+  if( size > SIZE_MAX - sizeof(BufStore) ) return NULL;
+  BufStore *s = allocBytes( a, NULL, 0, sizeof(BufStore) + size );
+  if( s == NULL ) return NULL;
+  s->refs = 1;
+  s->size = size;
+  return s;
+}
+
+static void releaseStore( BufAlloc *a, BufStore *s )
+{
+  if( --s->refs == 0 )
+    allocBytes( a, s, sizeof(BufStore) + s->size, 0 );
+}
+
+// constructor, p is sizeof(Buf) + szlocal bytes of storage. It is valid
+// to release even when the heap allocation failed.
+static int createBuf( Buf *p, buflen_t szlocal, buflen_t sz, int endian )
+{
+  p->flag = flag( endian, READ_WRITE );
+  p->position = 0;
+  p->length = 0;
+  p->szlocal = szlocal;
+  p->store = NULL;
+  p->buffer = p->local;
+  p->szbuffer = sz <= szlocal ? sz : 0;
+  if( sz > szlocal ){
+    BufStore *s = allocStore( p->alloc, sz );
+    if( s == NULL ) return ERR_NOMEM;
+    p->store = s;
+    p->buffer = s->data;
+    p->szbuffer = sz;
+  }
+  return ERR_OK;
+}
+
+static void fromArray( Buf *p, void *arr, buflen_t len, int endian )
+{
+  p->flag = flag( endian, READ_ONLY );
+  p->position = 0;
+  p->store = NULL;
+  p->buffer = arr;
+  p->length = len;
+  p->szbuffer = len;
+  p->szlocal = 0;
+}
+
+// p becomes a view of len bytes of src from pos, no copy
+static void shareBuf( Buf *p, Buf *src, buflen_t pos, buflen_t len )
+{
+  p->flag = flag( src->flag.endian, READ_WRITE );
+  p->flag.shared = 1;
+  src->flag.shared = 1;
+  src->store->refs++;
+
+  p->store = src->store;
+  p->buffer = src->buffer + pos;
+  p->position = 0;
+  p->length = len;
+  p->szbuffer = len;
+}
+
+static void releaseChain( Buf *p );
+
 static void release( Buf *p )
 {
-  if( !p->flag.readonly )
-    free( p->buffer );
-  free( p );
+#ifdef BYTEARRAY_MMAP
+  if( p->flag.mapped ){
+    BufMap *m = (BufMap*)p->local;
+    munmap( m->base, m->size );
+    p->flag.mapped = 0;
+  }
+#endif
+  if( p->flag.chained ){
+    releaseChain( p );
+    p->flag.chained = 0;
+  }
+  if( p->store != NULL )
+    releaseStore( p->alloc, p->store );
+  p->store = NULL;
+  p->buffer = p->local;
+  p->szbuffer = 0;
 }
 
 static inline uint8_t* getBuffer( Buf *p )
@@ -145,19 +552,113 @@ static inline buflen_t getCapacity( Buf *p )
   return p->szbuffer;
 }
 
-static void resizeBuffer( Buf *p, buflen_t size )
+static int resizeBuffer( Buf *p, buflen_t size );
+
+// Storage of its own with capacity size for a shared Buf. The last owner
+// keeps the storage, others copy the bytes out.
+static int unshare( Buf *p, buflen_t size )
 {
-  buflen_t l = getCapacity(p);
-  if( l == size ) return;
+  BufStore *s = p->store;
+  buflen_t n = getLength(p) < size ? getLength(p) : size;
+
+  if( s->refs == 1 ){
+    if( p->buffer != s->data )
+      memmove( s->data, p->buffer, n );
+    p->buffer = s->data;
+    p->szbuffer = s->size;
+    p->flag.shared = 0;
+    return resizeBuffer(p, size);
+  }
+
+  BufStore *ns = NULL;
+  uint8_t *dst = p->local;
+  if( size > p->szlocal ){
+    ns = allocStore( p->alloc, size );
+    if( ns == NULL ) return ERR_NOMEM;
+    dst = ns->data;
+  }
+  memcpy( dst, p->buffer, n );
+  releaseStore( p->alloc, s );
+  
+  p->store = ns;
+  p->buffer = dst;
+  p->szbuffer = size;
+  p->flag.shared = 0;
+  return ERR_OK;
+}
+
+// ERR_READONLY, or make sure the storage is not shared before writing
+#define WRITABLE_CHECK( p ) {				\
+    if( p->flag.readonly ) return ERR_READONLY;		\
+    if( p->flag.shared ){				\
+      int err = unshare( p, getCapacity(p) );		\
+      if( err ) return err;				\
+    }							\
+  }
+
+// ERR_OK if the bytes of p may be written in place
+static int writable( Buf *p )
+{
+  WRITABLE_CHECK( p );
+  return ERR_OK;
+}
+
+// Bytes dropped by discard() in front of buffer, they are reused when
+// the buffer is compacted. Shared and read only storage is never moved.
+static inline buflen_t getHeadroom( Buf *p )
+{
+  if( p->flag.shared || p->flag.readonly ) return 0;
+  return p->buffer - (p->store ? p->store->data : p->local);
+}
+
+// move the bytes to the front of the storage, capacity grows by headroom
+static void compactBuf( Buf *p )
+{
+  buflen_t head = getHeadroom(p);
+  if( head == 0 ) return;
+
+  uint8_t *base = p->buffer - head;
+  memmove( base, p->buffer, getLength(p) );
+  p->buffer = base;
+  p->szbuffer += head;
+}
+
+// Capacity beyond length is not zero filled, the bytes are cleared when
+// length grows over them (setLength, assign).
+static int resizeBuffer( Buf *p, buflen_t size )
+{
+  if( getCapacity(p) == size && !p->flag.shared ) return ERR_OK;
 
-  if( p->flag.readonly ) longjmp( except, ERR_READONLY );
+  if( p->flag.readonly ) return ERR_READONLY;
+  if( p->flag.shared ) return unshare( p, size );
   
-  uint8_t *new_buffer = realloc( p->buffer, size );
-  if( new_buffer == NULL ) longjmp( except, ERR_NOMEM );
+  compactBuf( p );
+  buflen_t l = getCapacity(p);
+  if( l == size ) return ERR_OK;
+
+  BufStore *s = p->store;
+  if( size <= p->szlocal ){
+    // fits inline again, leave the heap
+    if( s != NULL ){
+      memcpy( p->local, p->buffer, l < size ? l : size );
+      releaseStore( p->alloc, s );
+      s = NULL;
+    }
+  }
+  else {
+    s = allocBytes( p->alloc, s, s ? sizeof(BufStore) + s->size : 0, sizeof(BufStore) + size );
+    if( s == NULL ) return ERR_NOMEM;
+    if( p->store == NULL ){
+      s->refs = 1;
+      memcpy( s->data, p->local, l );
+    }
+    s->size = size;
+  }
   
-  if( l < size ) memset( new_buffer+l, 0, size-l );
-  p->buffer = new_buffer;
+  p->store = s;
+  p->buffer = s ? s->data : p->local;
   p->szbuffer = size;
+  return ERR_OK;
 }
 
 static inline buflen_t getPosition( Buf *p )
@@ -172,16 +673,18 @@ static inline void setPosition( Buf *p, buflen_t pos )
   else p->position = getLength(p);
 }
 
-static void setLength( Buf *p, buflen_t len )
+static int setLength( Buf *p, buflen_t len )
 {
   buflen_t l = getLength(p);
-  if( len == l ) return;
+  if( len == l ) return ERR_OK;
 
-  if( p->flag.readonly ) longjmp( except, ERR_READONLY );
+  WRITABLE_CHECK( p );
   
   buflen_t size = getCapacity(p);
-  if( size < len ) 
-    resizeBuffer(p, len);
+  if( size < len ){
+    int err = resizeBuffer(p, len);
+    if( err ) return err;
+  }
 
   if( l < len )
     memset( getBuffer(p)+l, 0, len-l );
@@ -190,6 +693,7 @@ static void setLength( Buf *p, buflen_t len )
 
   if( len < getPosition(p) )
     setPosition(p, len);
+  return ERR_OK;
 }
 
 static inline int getEndian( Buf *p )
@@ -214,58 +718,168 @@ static inline int at( Buf *p, buflen_t pos )
   else return EOF;
 }
 
-static inline void assign( Buf *p, buflen_t pos, uint8_t val )
+static inline int assign( Buf *p, buflen_t pos, uint8_t val )
 {
-  if( p->flag.readonly ) longjmp( except, ERR_READONLY );
+  WRITABLE_CHECK( p );
   
-  if( getCapacity(p) < pos )
-    resizeBuffer(p, pos+1);
+  if( getCapacity(p) <= pos ){
+    int err = resizeBuffer(p, grow(getCapacity(p), pos+1));
+    if( err ) return err;
+  }
   
+  if( getLength(p) < pos )
+    memset( getBuffer(p)+getLength(p), 0, pos-getLength(p) );
   getBuffer(p)[ pos++ ] = val;
   p->length = pos > p->length ? pos : p->length;
+  return ERR_OK;
+}
+
+static inline int clear( Buf *p )
+{
+  if( p->flag.readonly ) return ERR_READONLY;
+
+  // nothing to copy, just let go of the shared storage
+  if( p->flag.shared ){
+    release( p );
+    p->flag.shared = 0;
+  }
+
+  p->position = 0;
+  p->length = 0;
+  compactBuf( p );
+  return ERR_OK;
+}
+
+// make capacity at least size, never shrinks
+static int reserveCapacity( Buf *p, buflen_t size )
+{
+  if( p->flag.readonly ) return ERR_READONLY;
+  if( size <= getCapacity(p) ) return ERR_OK;
+  return resizeBuffer(p, size);
 }
 
-static inline void clear( Buf *p )
+// room for sz more bytes after length, to be filled from outside
+static int reserveTail( Buf *p, size_t sz )
 {
-  if( !p->flag.readonly ) {
-    memset( p->buffer, 0, p->szbuffer );
-    p->position = 0;
-    p->length = 0;
+  WRITABLE_CHECK( p );
+  if( getCapacity(p) - getLength(p) < sz ){
+    if( sz > (size_t)(BUFLEN_MAX - getLength(p)) ) return ERR_OVERFLOW;
+    return resizeBuffer(p, grow(getCapacity(p), getLength(p) + sz));
   }
-  else longjmp( except, ERR_READONLY );
+  return ERR_OK;
+}
+
+// drop n bytes from the front, position moves back with them. O(1), the
+// storage is reused by compact() or when the buffer runs out of room.
+static int discard( Buf *p, buflen_t n )
+{
+  if( p->flag.readonly ) return ERR_READONLY;
+  if( n > getLength(p) ) return ERR_OUTOFRANGE;
+
+  p->buffer += n;
+  p->length -= n;
+  p->szbuffer -= n;
+  p->position = getPosition(p) > n ? getPosition(p) - n : 0;
+
+  // empty, start over at the front for free
+  if( getLength(p) == 0 ) compactBuf( p );
+  return ERR_OK;
+}
+
+static int compact( Buf *p )
+{
+  WRITABLE_CHECK( p );
+  compactBuf( p );
+  return ERR_OK;
+}
+
+static int shrinkToFit( Buf *p )
+{
+  if( p->flag.readonly ) return ERR_READONLY;
+  return resizeBuffer(p, getLength(p));
+}
+
+// reverse the bytes of count values of width bytes from offset
+static int swapEndian( Buf *p, size_t width, buflen_t offset, size_t count )
+{
+  WRITABLE_CHECK( p );
+  if( offset > getLength(p) || count > (getLength(p) - offset) / width )
+    return ERR_OUTOFRANGE;
+
+  swapRun( getBuffer(p) + offset, width, count );
+  return ERR_OK;
+}
+
+// xor len bytes from offset with key, key[phase % 4] goes to the first byte
+static int xorMask( Buf *p, const uint8_t key[4], size_t phase, buflen_t offset, size_t len )
+{
+  WRITABLE_CHECK( p );
+  if( offset > getLength(p) || len > getLength(p) - offset )
+    return ERR_OUTOFRANGE;
+
+  uint8_t k[4];
+  for( int i=0; i < 4; ++i ) k[i] = key[(phase + i) % 4];
+  xorRun( getBuffer(p) + offset, k, len );
+  return ERR_OK;
+}
+
+static int fill( Buf *p, uint8_t c, buflen_t offset, size_t len )
+{
+  WRITABLE_CHECK( p );
+  if( offset > getLength(p) || len > getLength(p) - offset )
+    return ERR_OUTOFRANGE;
+
+  memset( getBuffer(p) + offset, c, len );
+  return ERR_OK;
+}
+
+// the bytes [start, end) to target, the two ranges may overlap
+static int copyWithin( Buf *p, buflen_t target, buflen_t start, buflen_t end )
+{
+  WRITABLE_CHECK( p );
+  if( start > end || end > getLength(p) || target > getLength(p) - (end - start) )
+    return ERR_OUTOFRANGE;
+
+  memmove( getBuffer(p) + target, getBuffer(p) + start, end - start );
+  return ERR_OK;
 }
 
-static Buf* cut( Buf *p, size_t pos, size_t len )
+// copy [pos, pos+len) of p into the empty dst
+static int cut( Buf *dst, Buf *p, size_t pos, size_t len )
 {
   size_t size = getLength(p);
-  if( pos + len > size ) len = size - pos;
+  if( pos > size ) pos = size;
+  if( len > size - pos ) len = size - pos;
 
-  Buf *retval = createBuf( len, getEndian(p) );
-  if( retval == NULL ) longjmp( except, ERR_NOMEM );
+  int err = reserveCapacity( dst, len );
+  if( err ) return err;
   
-  if( pos < size && len > 0 ){
-    memcpy( retval->buffer, p->buffer+pos, len );
+  if( len > 0 ){
+    memcpy( dst->buffer, p->buffer+pos, len );
   }
   
-  retval->length = len;
-  return retval;
+  dst->length = len;
+  return ERR_OK;
 }
 
 // ------------ read data ---------------
+// Every reader / writer returns ERR_xxx, the value read is stored into
+// the out parameter. Only the lua binding turns a failure into lua_error.
 #define UPDATE_LENGTH(p) p->length = p->length < p->position ? p->position : p->length;
 
-#define RANGE_CHECK( p, sz ) {						\
-    if(getBytesAvailable(p) < sz) longjmp( except, ERR_OUTOFRANGE );	\
+#define RANGE_CHECK( p, sz ) {					\
+    if( getBytesAvailable(p) < sz ) return ERR_OUTOFRANGE;	\
   }
 
-static int readBoolean( Buf *p )
+static inline int readBoolean( Buf *p, int *out )
 {
   RANGE_CHECK( p, sizeof(uint8_t) );
 
-  return at(p, p->position++) != 0;
+  *out = p->buffer[p->position++] != 0;
+  return ERR_OK;
 }
 
-static void readBytes( Buf *p, void *bytes, uint32_t offset, size_t length )
+static int readBytes( Buf *p, void *bytes, size_t offset, size_t length )
 {
   RANGE_CHECK( p, length );
 
@@ -274,11 +888,12 @@ static void readBytes( Buf *p, void *bytes, uint32_t offset, size_t length )
 
   memcpy( p_data_src, p->buffer + p->position, length );
   p->position += length;
+  return ERR_OK;
 }
 
 #ifdef _MEMORY_ALIGN_SAFE
 #define READ_BUILDIN_TEMPLATE( type, name )			\
-  static type name( Buf *p )					\
+  static inline int name( Buf *p, type *out )			\
   {								\
     size_t sz = sizeof(type);					\
     RANGE_CHECK(p, sz);						\
@@ -288,11 +903,12 @@ static void readBytes( Buf *p, void *bytes, uint32_t offset, size_t length )
     adjustEndian( (uint8_t*)&retval, sz, getEndian(p) );	\
 								\
     p->position += sz;						\
-    return retval;						\
+    *out = retval;						\
+    return ERR_OK;						\
   }
 #else
 #define READ_BUILDIN_TEMPLATE( type, name )			\
-  static type name( Buf *p )					\
+  static inline int name( Buf *p, type *out )			\
   {								\
     size_t sz = sizeof(type);					\
     RANGE_CHECK(p, sz);						\
@@ -301,7 +917,8 @@ static void readBytes( Buf *p, void *bytes, uint32_t offset, size_t length )
     adjustEndian( (uint8_t*)&retval, sz, getEndian(p) );	\
 								\
     p->position += sz;						\
-    return retval;						\
+    *out = retval;						\
+    return ERR_OK;						\
   }
 #endif//_MEMORY_ALIGN_SAFE
 
@@ -311,32 +928,65 @@ READ_BUILDIN_TEMPLATE( uint16_t, readUnsignedShort )
 READ_BUILDIN_TEMPLATE( int16_t, readShort )
 READ_BUILDIN_TEMPLATE( uint32_t, readUnsignedInt )
 READ_BUILDIN_TEMPLATE( int32_t, readInt )
+READ_BUILDIN_TEMPLATE( uint64_t, readUnsignedInt64 )
+READ_BUILDIN_TEMPLATE( int64_t, readInt64 )
 READ_BUILDIN_TEMPLATE( double, readDouble )
 READ_BUILDIN_TEMPLATE( float, readFloat )
 
+// read count values of width bytes into out, endian adjusted
+static int readArray( Buf *p, void *out, size_t width, size_t count )
+{
+  if( count > getBytesAvailable(p) / width ) return ERR_OUTOFRANGE;
+
+  size_t sz = width * count;
+  memcpy( out, p->buffer + p->position, sz );
+  adjustEndianRun( out, width, count, getEndian(p) );
+  p->position += sz;
+  return ERR_OK;
+}
+
 // ------------ write data ---------------
 
-#define RANGE_RESERVE( p, sz ) {				\
-    if( p->flag.readonly ) longjmp( except, ERR_READONLY );	\
-								\
-    if( getCapacity(p) - getPosition(p) < sz ){			\
-      buflen_t nsz = grow(getCapacity(p), sz);			\
-      if( nsz < getCapacity(p) ) longjmp(except, ERR_OVERFLOW);	\
-								\
-      resizeBuffer(p, nsz);					\
-    }								\
+// slow path of RANGE_RESERVE
+static int reserve( Buf *p, size_t sz )
+{
+  if( p->flag.readonly ) return ERR_READONLY;
+
+  if( getCapacity(p) - getPosition(p) < sz ){
+    // reuse discarded bytes when that is cheaper than growing
+    buflen_t head = getHeadroom(p);
+    if( head >= getLength(p) && head >= sz - (getCapacity(p) - getPosition(p)) ){
+      compactBuf( p );
+      return ERR_OK;
+    }
+
+    if( sz > (size_t)(BUFLEN_MAX - getPosition(p)) ) return ERR_OVERFLOW;
+    buflen_t nsz = grow(getCapacity(p), getPosition(p) + sz);
+
+    return resizeBuffer(p, nsz);
+  }
+  if( p->flag.shared ) return unshare( p, getCapacity(p) );
+  return ERR_OK;
+}
+
+#define RANGE_RESERVE( p, sz ) {					\
+    if( p->flag.readonly || p->flag.shared || getCapacity(p) - getPosition(p) < sz ){ \
+      int err = reserve( p, sz );					\
+      if( err ) return err;						\
+    }									\
   }
 
-static void writeBoolean( Buf *p, int value )
+static inline int writeBoolean( Buf *p, int value )
 {
   RANGE_RESERVE(p, 1);
 
   uint8_t boolean = value != 0;
   getBuffer(p)[p->position++] = boolean;
   UPDATE_LENGTH(p);
+  return ERR_OK;
 }
 
-static void writeBytes( Buf *p, const void *bytes, uint32_t offset, size_t length )
+static int writeBytes( Buf *p, const void *bytes, size_t offset, size_t length )
 {
   RANGE_RESERVE(p, length);
 
@@ -344,11 +994,12 @@ static void writeBytes( Buf *p, const void *bytes, uint32_t offset, size_t lengt
   memcpy( p->buffer + p->position, src, length );
   p->position += length;
   UPDATE_LENGTH(p);
+  return ERR_OK;
 }
 
 #ifdef _MEMORY_ALIGN_SAFE
 #define WRITE_BUILDIN_TEMPLATE( type, name )	\
-  static void name( Buf *p, type value )	\
+  static inline int name( Buf *p, type value )	\
   {						\
     size_t sz = sizeof(type);			\
     RANGE_RESERVE(p, sz);			\
@@ -359,10 +1010,11 @@ static void writeBytes( Buf *p, const void *bytes, uint32_t offset, size_t lengt
     						\
     p->position += sz;				\
     UPDATE_LENGTH(p);				\
+    return ERR_OK;				\
   }
 #else
 #define WRITE_BUILDIN_TEMPLATE( type, name )		\
-  static void name( Buf *p, type value )		\
+  static inline int name( Buf *p, type value )		\
   {							\
     size_t sz = sizeof(type);				\
     RANGE_RESERVE(p, sz);				\
@@ -373,6 +1025,7 @@ static void writeBytes( Buf *p, const void *bytes, uint32_t offset, size_t lengt
 							\
     p->position += sz;					\
     UPDATE_LENGTH(p);					\
+    return ERR_OK;					\
   }
 #endif//_MEMORY_ALIGN_SAFE
 
@@ -382,509 +1035,5657 @@ WRITE_BUILDIN_TEMPLATE( uint16_t, writeUnsignedShort )
 WRITE_BUILDIN_TEMPLATE( int16_t, writeShort )
 WRITE_BUILDIN_TEMPLATE( uint32_t, writeUnsignedInt )
 WRITE_BUILDIN_TEMPLATE( int32_t, writeInt )
+WRITE_BUILDIN_TEMPLATE( uint64_t, writeUnsignedInt64 )
+WRITE_BUILDIN_TEMPLATE( int64_t, writeInt64 )
 WRITE_BUILDIN_TEMPLATE( double, writeDouble )
 WRITE_BUILDIN_TEMPLATE( float, writeFloat )
 
-// ------------------- for lua -------------------
+// write count native values of width bytes, endian adjusted in place
+static int writeArray( Buf *p, const void *in, size_t width, size_t count )
+{
+  if( count > (buflen_t)~0 / width ) return ERR_OVERFLOW;
 
-// -------------- literal constant in lvm ----------------
+  size_t sz = width * count;
+  RANGE_RESERVE(p, sz);
 
-#ifdef _MEMORY_ECONOMY
-// declare lua_error message content
-#define MSG_NOMEM                      "NoMem"
-#define MSG_OUTOFRANGE                 "EndOfBuf"
-#define MSG_OVERFLOW                   "LenOvfl"
-#define MSG_INVALIDTYPE                "ErrorType"
-#define MSG_READONLY                   "RoBuf"
+  uint8_t *dst = p->buffer + p->position;
+  memcpy( dst, in, sz );
+  adjustEndianRun( dst, width, count, getEndian(p) );
+  p->position += sz;
+  UPDATE_LENGTH(p);
+  return ERR_OK;
+}
 
-// declare name for module
-#define MODULE_NAME                    "buf"
+// the first n bytes of src, which may be p itself and move on reserve
+static int writeBuf( Buf *p, Buf *src, size_t n )
+{
+  RANGE_RESERVE(p, n);
 
-#define CONSTANT_ENDIAN_L              "LE"
-#define CONSTANT_ENDIAN_B              "BE"
+  memmove( p->buffer + p->position, src->buffer, n );
+  p->position += n;
+  UPDATE_LENGTH(p);
+  return ERR_OK;
+}
 
-// declare constructor
-#define CONSTRUCTOR_CREATE             "create" // local b = buf.create(size, endian)
-#define CONSTRUCTOR_INITER             "init"   // local b = buf.init( 49, 50, 51 )
-#define CONSTRUCTOR_FROMARR            "load"   // local b = buf.load( "hello,world" ) -- read only
+// ------------ varint ---------------
+// LEB128 unsigned varint up to 64 bits, signed values use zigzag
 
-// declare member
-#define MEMBER_LENGTH                  "len"    // local l = b.length OR b.length = 1024
-#define MEMBER_POSITION                "pos"    // local p = b.pos OR b.pos = 1
-#define MEMBER_ENDIAN                  "endian" // local e = b.endian OR b.endian = 0
-#define MEMBER_AVAILABLE               "free"   // local a = b.free                    -- read only
+#define VARINT_MAXLEN 10
 
-// declare method
-#define METHOD_READBOOL                "rdb"    // local t = b:rdb()
-#define METHOD_WRITEBOOL               "wrb"    // b:wrb( false )
-#define METHOD_READU8                  "u8r"    // local u = b:u8r()
-#define METHOD_WRITEU8                 "u8w"    // b:u8w( 0x21 )
-#define METHOD_READS8                  "s8r"    // local i = b:s8r()
-#define METHOD_WRITES8                 "s8w"    // b:s8w( 49 )
-#define METHOD_READU16                 "u16r"
-#define METHOD_WRITEU16                "u16w"
-#define METHOD_READS16                 "s16r"
-#define METHOD_WRITES16                "s16w"
-#define METHOD_READU32                 "u32r"
-#define METHOD_WRITEU32                "u32w"
-#define METHOD_READS32                 "s32r"
-#define METHOD_WRITES32                "s32w"
-#define METHOD_READFLOAT               "f32r"
-#define METHOD_WRITEFLOAT              "f32w"
-#define METHOD_READDOUBLE              "f64r"
-#define METHOD_WRITEDOUBLE             "f64w"
-#define METHOD_READCSTR                "trr"
-#define METHOD_WRITECSTR               "trw"
-#define METHOD_READSTR                 "strr"
-#define METHOD_WRITESTR                "strw"
+#define ZIGZAG_ENCODE(n) (((uint64_t)(n) << 1) ^ (uint64_t)((int64_t)(n) >> 63))
+#define ZIGZAG_DECODE(v) ((int64_t)((v) >> 1) ^ -(int64_t)((v) & 1))
 
-#define METHOD_READBYTES               "read"   // local s = buf.create(); b:read(s, 0, b.length)
+static inline uint64_t load64le( const uint8_t *q )
+{
+  uint64_t x;
+  memcpy( &x, q, sizeof(x) );
+  if( getNativeEndian() == ENDIAN_BIG ) x = BSWAP64(x);
+  return x;
+}
+
+// slow path, checks every byte against the available range
+static int readVarUIntSlow( Buf *p, uint64_t *out )
+{
+  const uint8_t *b = p->buffer + p->position;
+  buflen_t avail = getBytesAvailable(p);
+  uint64_t r = 0;
+  for( int i=0; i < VARINT_MAXLEN; ++i ){
+    if( (buflen_t)i >= avail ) return ERR_OUTOFRANGE;
+    r |= (uint64_t)(b[i] & 0x7f) << (7*i);
+    if( b[i] < 0x80 ){
+      if( i == VARINT_MAXLEN-1 && b[i] > 1 ) return ERR_MALFORMED;
+      p->position += i+1;
+      *out = r;
+      return ERR_OK;
+    }
+  }
+  return ERR_MALFORMED;
+}
+
+static inline int readVarUInt( Buf *p, uint64_t *out )
+{
+  if( getBytesAvailable(p) < VARINT_MAXLEN ) return readVarUIntSlow(p, out);
+
+  // fast path: find the terminating byte among the first 8 with one
+  // mask, then pack the 7 bit groups without a per-byte branch
+  const uint8_t *b = p->buffer + p->position;
+  if( b[0] < 0x80 ){
+    *out = b[0];
+    p->position += 1;
+    return ERR_OK;
+  }
+
+  uint64_t x = load64le(b);
+  uint64_t stop = ~x & 0x8080808080808080ull;
+  if( stop == 0 ) return readVarUIntSlow(p, out);
+
+  int bits = CTZ64(stop) + 1;  // 8 * number of bytes
+  if( bits < 64 ) x &= (1ull << bits) - 1;
+  x = ((x & 0x7f007f007f007f00ull) >> 1) | (x & 0x007f007f007f007full);
+  x = ((x & 0x3fff00003fff0000ull) >> 2) | (x & 0x00003fff00003fffull);
+  x = ((x & 0x0fffffff00000000ull) >> 4) | (x & 0x000000000fffffffull);
+  *out = x;
+  p->position += bits >> 3;
+  return ERR_OK;
+}
+
+static inline int readVarInt( Buf *p, int64_t *out )
+{
+  uint64_t v;
+  int err = readVarUInt(p, &v);
+  if( err ) return err;
+  *out = ZIGZAG_DECODE(v);
+  return ERR_OK;
+}
+
+static inline int writeVarUInt( Buf *p, uint64_t v )
+{
+  RANGE_RESERVE(p, VARINT_MAXLEN);
+
+  uint8_t *b = p->buffer + p->position;
+  size_t n = 0;
+  while( v >= 0x80 ){
+    b[n++] = (uint8_t)v | 0x80;
+    v >>= 7;
+  }
+  b[n++] = (uint8_t)v;
+  p->position += n;
+  UPDATE_LENGTH(p);
+  return ERR_OK;
+}
+
+static inline int writeVarInt( Buf *p, int64_t v )
+{
+  return writeVarUInt(p, ZIGZAG_ENCODE(v));
+}
+
+// ------------ pack format ---------------
+// A format string is compiled once into a list of ops, every op moves
+// one value. Endian switches are folded into the ops that follow them.
+//
+//   < > =    little, big, native endian until the next switch, the
+//            buffer endian is used before the first one
+//   b B      int8, uint8         h H   int16, uint16
+//   i I      int32, uint32       l L   int64, uint64
+//   f d      float, double       ?     boolean
+//   v V      varint, zigzag varint
+//   z        string end with \0
+//   s[n]     string after its length as an unsigned int of n bytes
+//            (1, 2, 4 or 8, default 4)
+//   c<n>     string of n bytes, padded with \0 when packed
+//   x[n]     n bytes (default 1) skipped, or zero filled when packed
+//
+// spaces are ignored
+
+#define ENDIAN_BUFFER 2
+
+enum {
+  PACK_S8, PACK_U8, PACK_S16, PACK_U16, PACK_S32, PACK_U32,
+  PACK_S64, PACK_U64, PACK_F32, PACK_F64, PACK_BOOL,
+  PACK_VARU, PACK_VARS, PACK_CSTR, PACK_LSTR, PACK_FSTR, PACK_SKIP
+};
+
+typedef struct {
+  uint8_t  code;
+  uint8_t  endian;
+  buflen_t arg;      // width of the length of s, size of c and x
+} PackOp;
+
+typedef struct {
+  size_t   nop;
+  size_t   nvalue;   // values taken by pack and returned by unpack
+  uint64_t fixed;    // packed size without the strings
+  PackOp   op[];     // at most one op per format character
+} PackProg;
+
+// the number after a format character, def if there is none
+static int formatSize( const char **fmt, const char *end, uint64_t def, buflen_t *out )
+{
+  const char *s = *fmt;
+  if( s == end || *s < '0' || *s > '9' ){
+    *out = (buflen_t)def;
+    return ERR_OK;
+  }
+
+  uint64_t n = 0;
+  for( ; s < end && *s >= '0' && *s <= '9'; ++s ){
+    n = n * 10 + (*s - '0');
+    if( n > BUFLEN_MAX ) return ERR_OVERFLOW;
+  }
+  *fmt = s;
+  *out = (buflen_t)n;
+  return ERR_OK;
+}
+
+static int compilePack( PackProg *prog, const char *fmt, size_t len )
+{
+  static const struct { char c; uint8_t code; uint8_t width; } simple[] = {
+    { 'b', PACK_S8, 1 }, { 'B', PACK_U8, 1 }, { 'h', PACK_S16, 2 }, { 'H', PACK_U16, 2 },
+    { 'i', PACK_S32, 4 }, { 'I', PACK_U32, 4 }, { 'l', PACK_S64, 8 }, { 'L', PACK_U64, 8 },
+    { 'f', PACK_F32, 4 }, { 'd', PACK_F64, 8 }, { '?', PACK_BOOL, 1 },
+    { 'v', PACK_VARU, VARINT_MAXLEN }, { 'V', PACK_VARS, VARINT_MAXLEN },
+    { 'z', PACK_CSTR, 0 }, { 0, 0, 0 }
+  };
+
+  const char *end = fmt + len;
+  int endian = ENDIAN_BUFFER;
+  prog->nop = prog->nvalue = 0;
+  prog->fixed = 0;
+
+  while( fmt < end ){
+    char c = *fmt++;
+    if( c == ' ' ) continue;
+    if( c == '<' || c == '>' || c == '=' ){
+      endian = c == '<' ? ENDIAN_LITTLE : c == '>' ? ENDIAN_BIG : getNativeEndian();
+      continue;
+    }
+
+    PackOp *op = &prog->op[prog->nop++];
+    op->endian = endian;
+    op->arg = 0;
+
+    int i = 0;
+    while( simple[i].c && simple[i].c != c ) ++i;
+    if( simple[i].c ){
+      op->code = simple[i].code;
+      prog->fixed += simple[i].width;
+    }
+    else if( c == 's' ){
+      op->code = PACK_LSTR;
+      if( formatSize(&fmt, end, 4, &op->arg) ) return ERR_MALFORMED;
+      if( op->arg != 1 && op->arg != 2 && op->arg != 4 && op->arg != 8 ) return ERR_MALFORMED;
+      prog->fixed += op->arg;
+    }
+    else if( c == 'c' || c == 'x' ){
+      op->code = c == 'c' ? PACK_FSTR : PACK_SKIP;
+      if( c == 'c' && (fmt == end || *fmt < '0' || *fmt > '9') ) return ERR_MALFORMED;
+      if( formatSize(&fmt, end, 1, &op->arg) ) return ERR_MALFORMED;
+      prog->fixed += op->arg;
+    }
+    else return ERR_MALFORMED;
+
+    if( op->code != PACK_SKIP ) ++prog->nvalue;
+  }
+  return ERR_OK;
+}
+
+// ------------ protobuf wire format ---------------
+// A schema is compiled from a lua table into its fields sorted by
+// number. Names and message schemas stay on the lua side, slot is the
+// index of the field in the table it was defined with.
+
+enum {
+  PB_VARINT = 0,
+  PB_FIXED64 = 1,
+  PB_LEN = 2,
+  PB_FIXED32 = 5
+};
+
+enum {
+  PBT_DOUBLE, PBT_FLOAT, PBT_INT32, PBT_INT64, PBT_UINT32, PBT_UINT64,
+  PBT_SINT32, PBT_SINT64, PBT_FIXED32, PBT_FIXED64, PBT_SFIXED32,
+  PBT_SFIXED64, PBT_BOOL, PBT_ENUM, PBT_STRING, PBT_BYTES, PBT_MESSAGE
+};
+
+static const char *const pb_typenames[] = {
+  "double", "float", "int32", "int64", "uint32", "uint64",
+  "sint32", "sint64", "fixed32", "fixed64", "sfixed32",
+  "sfixed64", "bool", "enum", "string", "bytes", "message", NULL
+};
+
+static inline int pbWireType( int type )
+{
+  switch( type ){
+  case PBT_DOUBLE: case PBT_FIXED64: case PBT_SFIXED64: return PB_FIXED64;
+  case PBT_FLOAT: case PBT_FIXED32: case PBT_SFIXED32: return PB_FIXED32;
+  case PBT_STRING: case PBT_BYTES: case PBT_MESSAGE: return PB_LEN;
+  default: return PB_VARINT;
+  }
+}
+
+typedef struct {
+  uint32_t number;
+  uint32_t slot;
+  uint8_t  type;
+  uint8_t  wire;
+  uint8_t  repeated: 1;
+  uint8_t  packed: 1;   // repeated numbers in one length delimited record
+  uint8_t  lazy: 1;     // message or bytes read as a ByteArray slice
+} PbField;
+
+typedef struct {
+  size_t   nfield;
+  PbField  field[];
+} PbSchema;
+
+static const PbField* pbFind( const PbSchema *s, uint64_t number )
+{
+  size_t lo = 0, hi = s->nfield;
+  while( lo < hi ){
+    size_t mid = (lo + hi) / 2;
+    if( s->field[mid].number < number ) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo < s->nfield && s->field[lo].number == number ? &s->field[lo] : NULL;
+}
+
+static int pbSkip( Buf *p, int wire )
+{
+  uint64_t n;
+  int err;
+  switch( wire ){
+  case PB_VARINT: return readVarUInt(p, &n);
+  case PB_FIXED64: n = 8; break;
+  case PB_FIXED32: n = 4; break;
+  case PB_LEN:
+    if( (err = readVarUInt(p, &n)) ) return err;
+    break;
+  default: return ERR_MALFORMED;
+  }
+  if( getBytesAvailable(p) < n ) return ERR_OUTOFRANGE;
+  p->position += n;
+  return ERR_OK;
+}
+
+// a length delimited record is written with a one byte length that is
+// fixed up at the end, the bytes move when the length needs more
+static inline int pbBeginLen( Buf *p, buflen_t *start )
+{
+  int err = writeUnsignedByte(p, 0);
+  *start = getPosition(p);
+  return err;
+}
+
+static int pbEndLen( Buf *p, buflen_t start )
+{
+  uint64_t len = getPosition(p) - start;
+  if( len < 0x80 ){
+    p->buffer[start-1] = (uint8_t)len;
+    return ERR_OK;
+  }
+
+  size_t extra = 0;
+  for( uint64_t v = len >> 7; v >= 0x80; v >>= 7 ) ++extra;
+  ++extra;
+  RANGE_RESERVE(p, extra);
+
+  memmove( p->buffer + start + extra, p->buffer + start, len );
+  p->position = start - 1;
+  writeVarUInt(p, len);
+  p->position = start + extra + len;
+  UPDATE_LENGTH(p);
+  return ERR_OK;
+}
+
+// ------------ AMF3 ---------------
+// U29 integers are 7 bits per byte, big end first, the fourth byte
+// carries 8 bits. Doubles are big endian.
+
+enum {
+  AMF3_UNDEFINED = 0x00,
+  AMF3_NULL = 0x01,
+  AMF3_FALSE = 0x02,
+  AMF3_TRUE = 0x03,
+  AMF3_INTEGER = 0x04,
+  AMF3_DOUBLE = 0x05,
+  AMF3_STRING = 0x06,
+  AMF3_XMLDOC = 0x07,
+  AMF3_DATE = 0x08,
+  AMF3_ARRAY = 0x09,
+  AMF3_OBJECT = 0x0a,
+  AMF3_XML = 0x0b,
+  AMF3_BYTEARRAY = 0x0c
+};
+
+#define U29_MAX     0x1fffffff
+#define AMF3_INTMIN (-0x10000000)
+#define AMF3_INTMAX 0x0fffffff
+
+static int readU29( Buf *p, uint32_t *out )
+{
+  const uint8_t *b = p->buffer + p->position;
+  buflen_t avail = getBytesAvailable(p);
+  uint32_t v = 0;
+  for( int i=0; i < 4; ++i ){
+    if( (buflen_t)i >= avail ) return ERR_OUTOFRANGE;
+    if( i == 3 ){
+      v = (v << 8) | b[i];
+    }
+    else {
+      v = (v << 7) | (b[i] & 0x7f);
+      if( b[i] < 0x80 ){
+	p->position += i + 1;
+	*out = v;
+	return ERR_OK;
+      }
+    }
+  }
+  p->position += 4;
+  *out = v;
+  return ERR_OK;
+}
+
+static int writeU29( Buf *p, uint32_t v )
+{
+  uint8_t b[4];
+  size_t n;
+  if( v < 0x80 ){
+    b[0] = (uint8_t)v;
+    n = 1;
+  }
+  else if( v < 0x4000 ){
+    b[0] = (uint8_t)(v >> 7 | 0x80);
+    b[1] = (uint8_t)(v & 0x7f);
+    n = 2;
+  }
+  else if( v < 0x200000 ){
+    b[0] = (uint8_t)(v >> 14 | 0x80);
+    b[1] = (uint8_t)(v >> 7 | 0x80);
+    b[2] = (uint8_t)(v & 0x7f);
+    n = 3;
+  }
+  else if( v <= U29_MAX ){
+    b[0] = (uint8_t)(v >> 22 | 0x80);
+    b[1] = (uint8_t)(v >> 15 | 0x80);
+    b[2] = (uint8_t)(v >> 8 | 0x80);
+    b[3] = (uint8_t)v;
+    n = 4;
+  }
+  else return ERR_OVERFLOW;
+  return writeBytes(p, b, 0, n);
+}
+
+// ------------ MessagePack ---------------
+// Markers carry the type and often the value or length, everything
+// after them is big endian.
+
+enum {
+  MP_FIXMAP = 0x80,
+  MP_FIXARRAY = 0x90,
+  MP_FIXSTR = 0xa0,
+  MP_NIL = 0xc0,
+  MP_FALSE = 0xc2,
+  MP_TRUE = 0xc3,
+  MP_BIN8 = 0xc4,     // bin16, bin32 follow
+  MP_FLOAT32 = 0xca,
+  MP_FLOAT64 = 0xcb,
+  MP_UINT8 = 0xcc,    // uint16, uint32, uint64 follow
+  MP_INT8 = 0xd0,     // int16, int32, int64 follow
+  MP_STR8 = 0xd9,     // str16, str32 follow
+  MP_ARRAY16 = 0xdc,
+  MP_ARRAY32 = 0xdd,
+  MP_MAP16 = 0xde,
+  MP_MAP32 = 0xdf,
+  MP_NEGFIXINT = 0xe0
+};
+
+// number encoding of writeMsgPack
+enum {
+  MP_AUTO,    // integral numbers as integers, the rest as float 64
+  MP_DOUBLE,  // only lua integers as integers
+  MP_SINGLE   // as MP_AUTO, float 32 when that loses nothing
+};
+
+// marker followed by the low n bytes of v
+static inline int mpWriteHead( Buf *p, uint8_t marker, uint64_t v, size_t n )
+{
+  uint8_t b[9];
+  b[0] = marker;
+  for( size_t i=n; i > 0; --i, v >>= 8 ) b[i] = (uint8_t)v;
+  return writeBytes(p, b, 0, n + 1);
+}
+
+// length header of a str, bin, array or map family: the fix form below
+// fixlim if fix is set, then m8 if set, m16 and m16 + 1 for 32 bits
+static int mpWriteLen( Buf *p, uint8_t fix, uint64_t fixlim, uint8_t m8, uint8_t m16, uint64_t n )
+{
+  if( fix && n < fixlim ) return writeUnsignedByte(p, (uint8_t)(fix | n));
+  if( m8 && n <= 0xff ) return mpWriteHead(p, m8, n, 1);
+  if( n <= 0xffff ) return mpWriteHead(p, m16, n, 2);
+  if( n <= 0xffffffff ) return mpWriteHead(p, m16 + 1, n, 4);
+  return ERR_OVERFLOW;
+}
+
+static int mpWriteUInt( Buf *p, uint64_t v )
+{
+  if( v < 0x80 ) return writeUnsignedByte(p, (uint8_t)v);
+  if( v <= 0xff ) return mpWriteHead(p, MP_UINT8, v, 1);
+  if( v <= 0xffff ) return mpWriteHead(p, MP_UINT8 + 1, v, 2);
+  if( v <= 0xffffffff ) return mpWriteHead(p, MP_UINT8 + 2, v, 4);
+  return mpWriteHead(p, MP_UINT8 + 3, v, 8);
+}
+
+static int mpWriteInt( Buf *p, int64_t v )
+{
+  if( v >= 0 ) return mpWriteUInt(p, (uint64_t)v);
+  if( v >= -32 ) return writeUnsignedByte(p, (uint8_t)v);
+  if( v >= INT8_MIN ) return mpWriteHead(p, MP_INT8, (uint64_t)v, 1);
+  if( v >= INT16_MIN ) return mpWriteHead(p, MP_INT8 + 1, (uint64_t)v, 2);
+  if( v >= INT32_MIN ) return mpWriteHead(p, MP_INT8 + 2, (uint64_t)v, 4);
+  return mpWriteHead(p, MP_INT8 + 3, (uint64_t)v, 8);
+}
+
+static int mpWriteFloat( Buf *p, double d, int policy )
+{
+  if( policy != MP_DOUBLE ){
+    if( d >= 0 && d < 18446744073709551616.0 && d == (double)(uint64_t)d )
+      return mpWriteUInt(p, (uint64_t)d);
+    if( d < 0 && d >= -9223372036854775808.0 && d == (double)(int64_t)d )
+      return mpWriteInt(p, (int64_t)d);
+  }
+  uint64_t u;
+  if( policy == MP_SINGLE && (d != d || fabs(d) > DBL_MAX || (fabs(d) <= FLT_MAX && (double)(float)d == d)) ){
+    float f = (float)d;
+    uint32_t w;
+    memcpy(&w, &f, sizeof(w));
+    return mpWriteHead(p, MP_FLOAT32, w, 4);
+  }
+  memcpy(&u, &d, sizeof(u));
+  return mpWriteHead(p, MP_FLOAT64, u, 8);
+}
+
+// width bytes, lengths and unsigned integers
+static int mpReadUInt( Buf *q, buflen_t width, uint64_t *out )
+{
+  if( getBytesAvailable(q) < width ) return ERR_OUTOFRANGE;
+  const uint8_t *b = q->buffer + q->position;
+  uint64_t v = 0;
+  for( buflen_t i=0; i < width; ++i ) v = v << 8 | b[i];
+  q->position += width;
+  *out = v;
+  return ERR_OK;
+}
+
+// ------------ LZ4 ---------------
+// The LZ4 block format: sequences of a token, literals and a match of
+// at least 4 bytes at an offset of up to 64 KiB back. The last 5 bytes
+// are always literals and no match starts in the last 12 bytes.
+
+#define LZ4_MINMATCH     4
+#define LZ4_LASTLITERALS 5
+#define LZ4_MFLIMIT      12
+#define LZ4_MAXOFFSET    65535
+#define LZ4_MAXINPUT     0x7e000000
+#define LZ4_HASHLOG      12    // fast level, 16 KiB on the stack
+#define LZ4_CHAINLOG     15    // higher levels, hash chains in a window
+#define LZ4_MAXLEVEL     9
+#define LZ4_BOUND(n)     ((n) + (n) / 255 + 16)
+
+static inline uint32_t load32le( const uint8_t *q )
+{
+  uint32_t x;
+  memcpy( &x, q, sizeof(x) );
+  if( getNativeEndian() == ENDIAN_BIG ) x = BSWAP32(x);
+  return x;
+}
+
+static inline void store32le( uint8_t *q, uint32_t x )
+{
+  if( getNativeEndian() == ENDIAN_BIG ) x = BSWAP32(x);
+  memcpy( q, &x, sizeof(x) );
+}
+
+static inline uint32_t lz4Hash( const uint8_t *q, int log )
+{
+  uint32_t x;
+  memcpy( &x, q, sizeof(x) );
+  return (x * 2654435761u) >> (32 - log);
+}
+
+// bytes equal at a and b, up to end
+static inline size_t lz4Count( const uint8_t *a, const uint8_t *b, const uint8_t *end )
+{
+  const uint8_t *start = a;
+  while( a + 8 <= end ){
+    uint64_t x, y;
+    memcpy( &x, a, 8 );
+    memcpy( &y, b, 8 );
+    if( x != y ){
+      x ^= y;
+      return a - start + (getNativeEndian() == ENDIAN_LITTLE ? CTZ64(x) : CLZ64(x)) / 8;
+    }
+    a += 8;
+    b += 8;
+  }
+  while( a < end && *a == *b ){
+    ++a;
+    ++b;
+  }
+  return a - start;
+}
+
+static inline uint8_t* lz4Length( uint8_t *op, size_t n )
+{
+  for( ; n >= 255; n -= 255 ) *op++ = 255;
+  *op++ = (uint8_t)n;
+  return op;
+}
+
+// one sequence, lit literals from anchor and a match of ml bytes at off
+static inline uint8_t* lz4Sequence( uint8_t *op, const uint8_t *anchor, size_t lit, size_t off, size_t ml )
+{
+  uint8_t *token = op++;
+  *token = (uint8_t)((lit < 15 ? lit : 15) << 4);
+  if( lit >= 15 ) op = lz4Length(op, lit - 15);
+  memcpy( op, anchor, lit );
+  op += lit;
+  if( ml == 0 ) return op;
+
+  *op++ = (uint8_t)off;
+  *op++ = (uint8_t)(off >> 8);
+  ml -= LZ4_MINMATCH;
+  *token |= (uint8_t)(ml < 15 ? ml : 15);
+  if( ml >= 15 ) op = lz4Length(op, ml - 15);
+  return op;
+}
+
+// inserts ip into the hash chains and returns its longest match in
+// attempts candidates, 0 if none
+static inline size_t lz4ChainMatch( const uint8_t *src, const uint8_t *ip, const uint8_t *limit,
+				    uint32_t *table, uint16_t *chain, int attempts, const uint8_t **match )
+{
+  size_t pos = ip - src, best = 0;
+  uint32_t h = lz4Hash(ip, LZ4_CHAINLOG);
+  size_t cand = table[h];
+  chain[pos & 0xffff] = (uint16_t)(pos - cand > 0xffff ? 0xffff : pos - cand);
+  table[h] = (uint32_t)pos;
+
+  while( attempts-- > 0 && cand < pos && pos - cand <= LZ4_MAXOFFSET ){
+    const uint8_t *c = src + cand;
+    if( c[best] == ip[best] && load32le(c) == load32le(ip) ){
+      size_t ml = LZ4_MINMATCH + lz4Count(ip + LZ4_MINMATCH, c + LZ4_MINMATCH, limit);
+      if( ml > best ){
+	best = ml;
+	*match = c;
+      }
+    }
+    uint16_t d = chain[cand & 0xffff];
+    if( d == 0 || d > cand ) break;
+    cand -= d;
+  }
+  return best >= LZ4_MINMATCH ? best : 0;
+}
+
+#define LZ4_SCRATCH_SIZE ((sizeof(uint32_t) << LZ4_CHAINLOG) + sizeof(uint16_t) * 65536)
+
+// compress n bytes of src to dst, which holds LZ4_BOUND(n). Level 1 is
+// the single probe of lz4 fast, above it 2^level hash chain entries are
+// searched, scratch holds LZ4_SCRATCH_SIZE for their tables. Returns
+// the compressed size.
+static size_t lz4Encode( const uint8_t *src, size_t n, uint8_t *dst, int level, void *scratch )
+{
+  uint8_t *op = dst;
+  const uint8_t *anchor = src, *ip = src + 1;
+  const uint8_t *mflimit = src + n - LZ4_MFLIMIT, *limit = src + n - LZ4_LASTLITERALS;
+  if( n < LZ4_MFLIMIT + 1 ) goto last;
+
+  if( level <= 1 ){
+    uint32_t table[1 << LZ4_HASHLOG];
+    memset( table, 0, sizeof(table) );
+    while( ip < mflimit ){
+      // skip faster the longer nothing matches
+      const uint8_t *match;
+      unsigned step = 1 << 6;
+      for( ;; ){
+	uint32_t h = lz4Hash(ip, LZ4_HASHLOG);
+	match = src + table[h];
+	table[h] = (uint32_t)(ip - src);
+	if( ip - match <= LZ4_MAXOFFSET && load32le(match) == load32le(ip) ) break;
+	ip += step++ >> 6;
+	if( ip >= mflimit ) goto last;
+      }
+      while( ip > anchor && match > src && ip[-1] == match[-1] ){
+	--ip;
+	--match;
+      }
+      size_t ml = LZ4_MINMATCH + lz4Count(ip + LZ4_MINMATCH, match + LZ4_MINMATCH, limit);
+      op = lz4Sequence(op, anchor, ip - anchor, ip - match, ml);
+      ip += ml;
+      anchor = ip;
+      if( ip < mflimit ) table[lz4Hash(ip - 2, LZ4_HASHLOG)] = (uint32_t)(ip - 2 - src);
+    }
+  }
+  else {
+    uint32_t *table = scratch;
+    uint16_t *chain = (uint16_t*)(table + (1 << LZ4_CHAINLOG));
+    memset( table, 0, sizeof(uint32_t) << LZ4_CHAINLOG );
+    int attempts = 1 << level;
+    ip = src;
+    while( ip < mflimit ){
+      const uint8_t *match;
+      size_t ml = lz4ChainMatch(src, ip, limit, table, chain, attempts, &match);
+      if( ml == 0 ){
+	++ip;
+	continue;
+      }
+      op = lz4Sequence(op, anchor, ip - anchor, ip - match, ml);
+      // the positions inside the match go into the chains too
+      const uint8_t *end = ip + ml;
+      while( ++ip < end && ip < mflimit ) lz4ChainMatch(src, ip, ip, table, chain, 0, &match);
+      ip = end;
+      anchor = ip;
+    }
+  }
+
+ last:
+  op = lz4Sequence(op, anchor, src + n - anchor, 0, 0);
+  return op - dst;
+}
+
+// decode one block of inlen bytes to out, which holds up to outlen.
+// Matches may reach back to base, the start of earlier output. A block
+// ends with literals at the end of the input or of the output,
+// *consumed and *produced tell which.
+static int lz4Decode( const uint8_t *in, size_t inlen, const uint8_t *base, uint8_t *out, size_t outlen,
+		      size_t *consumed, size_t *produced )
+{
+  const uint8_t *ip = in, *iend = in + inlen;
+  uint8_t *op = out, *oend = out + outlen;
+  for( ;; ){
+    if( ip >= iend ) return ERR_MALFORMED;
+    unsigned token = *ip++;
+    size_t lit = token >> 4;
+    if( lit == 15 ){
+      uint8_t b;
+      do {
+	if( ip >= iend ) return ERR_MALFORMED;
+	lit += b = *ip++;
+      } while( b == 255 );
+    }
+    if( lit > (size_t)(iend - ip) || lit > (size_t)(oend - op) ) return ERR_MALFORMED;
+    // in 16 byte steps while both ends have room for the overshoot
+    if( lit <= 16 && iend - ip >= 16 && oend - op >= 16 ) memcpy( op, ip, 16 );
+    else memcpy( op, ip, lit );
+    op += lit;
+    ip += lit;
+    if( ip == iend || op == oend ) break;
+
+    if( iend - ip < 2 ) return ERR_MALFORMED;
+    size_t off = ip[0] | (size_t)ip[1] << 8;
+    ip += 2;
+    if( off == 0 || off > (size_t)(op - base) ) return ERR_MALFORMED;
+    size_t ml = token & 15;
+    if( ml == 15 ){
+      uint8_t b;
+      do {
+	if( ip >= iend ) return ERR_MALFORMED;
+	ml += b = *ip++;
+      } while( b == 255 );
+    }
+    ml += LZ4_MINMATCH;
+    if( ml > (size_t)(oend - op) ) return ERR_MALFORMED;
+
+    const uint8_t *m = op - off;
+    // every step reads only bytes written before it
+    if( off >= 16 && (size_t)(oend - op) >= ml + 16 ){
+      for( size_t i=0; i < ml; i += 16 ) memcpy( op + i, m + i, 16 );
+    }
+    else for( size_t i=0; i < ml; ++i ) op[i] = m[i];
+    op += ml;
+  }
+  *consumed = ip - in;
+  *produced = op - out;
+  return ERR_OK;
+}
+
+// ------------ LZ4 frame ---------------
+// A frame is a header, blocks of a 4 byte size, the top bit set if
+// stored as is, and a zero size at the end. Written frames use 64 KiB
+// independent blocks without checksums.
+
+#define LZ4F_MAGIC        0x184d2204
+#define LZ4F_BLOCKSIZE    (64*1024)
+#define LZ4F_FLG          0x60      // version 1, independent blocks
+#define LZ4F_BD           0x40      // 64 KiB blocks
+#define LZ4F_UNCOMPRESSED 0x80000000u
+
+enum {
+  LZ4F_BLOCK_CHECKSUM = 0x10,
+  LZ4F_CONTENT_SIZE = 0x08,
+  LZ4F_CONTENT_CHECKSUM = 0x04,
+  LZ4F_DICTID = 0x01
+};
+
+#define XXH_PRIME32_1 0x9e3779b1u
+#define XXH_PRIME32_2 0x85ebca77u
+#define XXH_PRIME32_3 0xc2b2ae3du
+#define XXH_PRIME32_4 0x27d4eb2fu
+#define XXH_PRIME32_5 0x165667b1u
+
+static inline uint32_t rotl32( uint32_t x, int r )
+{
+  return x << r | x >> (32 - r);
+}
+
+static inline uint32_t xxh32Round( uint32_t v, uint32_t x )
+{
+  return rotl32(v + x * XXH_PRIME32_2, 13) * XXH_PRIME32_1;
+}
+
+// XXH32, the header and block checksums of frames
+static uint32_t xxh32( const uint8_t *q, size_t n, uint32_t seed )
+{
+  const uint8_t *end = q + n;
+  uint32_t h;
+  if( n >= 16 ){
+    uint32_t v1 = seed + XXH_PRIME32_1 + XXH_PRIME32_2, v2 = seed + XXH_PRIME32_2;
+    uint32_t v3 = seed, v4 = seed - XXH_PRIME32_1;
+    for( ; q + 16 <= end; q += 16 ){
+      v1 = xxh32Round(v1, load32le(q));
+      v2 = xxh32Round(v2, load32le(q + 4));
+      v3 = xxh32Round(v3, load32le(q + 8));
+      v4 = xxh32Round(v4, load32le(q + 12));
+    }
+    h = rotl32(v1, 1) + rotl32(v2, 7) + rotl32(v3, 12) + rotl32(v4, 18);
+  }
+  else h = seed + XXH_PRIME32_5;
+  h += (uint32_t)n;
+  for( ; q + 4 <= end; q += 4 ) h = rotl32(h + load32le(q) * XXH_PRIME32_3, 17) * XXH_PRIME32_4;
+  for( ; q < end; ++q ) h = rotl32(h + *q * XXH_PRIME32_5, 11) * XXH_PRIME32_1;
+  h ^= h >> 15;
+  h *= XXH_PRIME32_2;
+  h ^= h >> 13;
+  h *= XXH_PRIME32_3;
+  h ^= h >> 16;
+  return h;
+}
+
+// ------------ checksums ---------------
+// CRC-32 (zlib) and CRC-32C (Castagnoli) slice by 8, CRC-32C with the
+// SSE4.2 instruction where there is one, Adler-32 and XXH64. All of
+// them continue from the value of the bytes before.
+
+#define CRC32_POLY  0xedb88320u
+#define CRC32C_POLY 0x82f63b78u
+#define ADLER_BASE  65521u
+#define ADLER_NMAX  5552      // bytes before the sums could overflow
+
+// slicing-by-8 tables, entry [j][i] is the crc register after byte i and j
+// zero bytes, for CRC32_POLY and CRC32C_POLY
+static const uint32_t crc_tables[2][8][256] = {
+  { // CRC32_POLY
+    {
+      0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f,
+      0xe963a535, 0x9e6495a3, 0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988,
+      0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91, 0x1db71064, 0x6ab020f2,
+      0xf3b97148, 0x84be41de, 0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7,
+      0x136c9856, 0x646ba8c0, 0xfd62f97a, 0x8a65c9ec, 0x14015c4f, 0x63066cd9,
+      0xfa0f3d63, 0x8d080df5, 0x3b6e20c8, 0x4c69105e, 0xd56041e4, 0xa2677172,
+      0x3c03e4d1, 0x4b04d447, 0xd20d85fd, 0xa50ab56b, 0x35b5a8fa, 0x42b2986c,
+      0xdbbbc9d6, 0xacbcf940, 0x32d86ce3, 0x45df5c75, 0xdcd60dcf, 0xabd13d59,
+      0x26d930ac, 0x51de003a, 0xc8d75180, 0xbfd06116, 0x21b4f4b5, 0x56b3c423,
+      0xcfba9599, 0xb8bda50f, 0x2802b89e, 0x5f058808, 0xc60cd9b2, 0xb10be924,
+      0x2f6f7c87, 0x58684c11, 0xc1611dab, 0xb6662d3d, 0x76dc4190, 0x01db7106,
+      0x98d220bc, 0xefd5102a, 0x71b18589, 0x06b6b51f, 0x9fbfe4a5, 0xe8b8d433,
+      0x7807c9a2, 0x0f00f934, 0x9609a88e, 0xe10e9818, 0x7f6a0dbb, 0x086d3d2d,
+      0x91646c97, 0xe6635c01, 0x6b6b51f4, 0x1c6c6162, 0x856530d8, 0xf262004e,
+      0x6c0695ed, 0x1b01a57b, 0x8208f4c1, 0xf50fc457, 0x65b0d9c6, 0x12b7e950,
+      0x8bbeb8ea, 0xfcb9887c, 0x62dd1ddf, 0x15da2d49, 0x8cd37cf3, 0xfbd44c65,
+      0x4db26158, 0x3ab551ce, 0xa3bc0074, 0xd4bb30e2, 0x4adfa541, 0x3dd895d7,
+      0xa4d1c46d, 0xd3d6f4fb, 0x4369e96a, 0x346ed9fc, 0xad678846, 0xda60b8d0,
+      0x44042d73, 0x33031de5, 0xaa0a4c5f, 0xdd0d7cc9, 0x5005713c, 0x270241aa,
+      0xbe0b1010, 0xc90c2086, 0x5768b525, 0x206f85b3, 0xb966d409, 0xce61e49f,
+      0x5edef90e, 0x29d9c998, 0xb0d09822, 0xc7d7a8b4, 0x59b33d17, 0x2eb40d81,
+      0xb7bd5c3b, 0xc0ba6cad, 0xedb88320, 0x9abfb3b6, 0x03b6e20c, 0x74b1d29a,
+      0xead54739, 0x9dd277af, 0x04db2615, 0x73dc1683, 0xe3630b12, 0x94643b84,
+      0x0d6d6a3e, 0x7a6a5aa8, 0xe40ecf0b, 0x9309ff9d, 0x0a00ae27, 0x7d079eb1,
+      0xf00f9344, 0x8708a3d2, 0x1e01f268, 0x6906c2fe, 0xf762575d, 0x806567cb,
+      0x196c3671, 0x6e6b06e7, 0xfed41b76, 0x89d32be0, 0x10da7a5a, 0x67dd4acc,
+      0xf9b9df6f, 0x8ebeeff9, 0x17b7be43, 0x60b08ed5, 0xd6d6a3e8, 0xa1d1937e,
+      0x38d8c2c4, 0x4fdff252, 0xd1bb67f1, 0xa6bc5767, 0x3fb506dd, 0x48b2364b,
+      0xd80d2bda, 0xaf0a1b4c, 0x36034af6, 0x41047a60, 0xdf60efc3, 0xa867df55,
+      0x316e8eef, 0x4669be79, 0xcb61b38c, 0xbc66831a, 0x256fd2a0, 0x5268e236,
+      0xcc0c7795, 0xbb0b4703, 0x220216b9, 0x5505262f, 0xc5ba3bbe, 0xb2bd0b28,
+      0x2bb45a92, 0x5cb36a04, 0xc2d7ffa7, 0xb5d0cf31, 0x2cd99e8b, 0x5bdeae1d,
+      0x9b64c2b0, 0xec63f226, 0x756aa39c, 0x026d930a, 0x9c0906a9, 0xeb0e363f,
+      0x72076785, 0x05005713, 0x95bf4a82, 0xe2b87a14, 0x7bb12bae, 0x0cb61b38,
+      0x92d28e9b, 0xe5d5be0d, 0x7cdcefb7, 0x0bdbdf21, 0x86d3d2d4, 0xf1d4e242,
+      0x68ddb3f8, 0x1fda836e, 0x81be16cd, 0xf6b9265b, 0x6fb077e1, 0x18b74777,
+      0x88085ae6, 0xff0f6a70, 0x66063bca, 0x11010b5c, 0x8f659eff, 0xf862ae69,
+      0x616bffd3, 0x166ccf45, 0xa00ae278, 0xd70dd2ee, 0x4e048354, 0x3903b3c2,
+      0xa7672661, 0xd06016f7, 0x4969474d, 0x3e6e77db, 0xaed16a4a, 0xd9d65adc,
+      0x40df0b66, 0x37d83bf0, 0xa9bcae53, 0xdebb9ec5, 0x47b2cf7f, 0x30b5ffe9,
+      0xbdbdf21c, 0xcabac28a, 0x53b39330, 0x24b4a3a6, 0xbad03605, 0xcdd70693,
+      0x54de5729, 0x23d967bf, 0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94,
+      0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d
+    },
+    {
+      0x00000000, 0x191b3141, 0x32366282, 0x2b2d53c3, 0x646cc504, 0x7d77f445,
+      0x565aa786, 0x4f4196c7, 0xc8d98a08, 0xd1c2bb49, 0xfaefe88a, 0xe3f4d9cb,
+      0xacb54f0c, 0xb5ae7e4d, 0x9e832d8e, 0x87981ccf, 0x4ac21251, 0x53d92310,
+      0x78f470d3, 0x61ef4192, 0x2eaed755, 0x37b5e614, 0x1c98b5d7, 0x05838496,
+      0x821b9859, 0x9b00a918, 0xb02dfadb, 0xa936cb9a, 0xe6775d5d, 0xff6c6c1c,
+      0xd4413fdf, 0xcd5a0e9e, 0x958424a2, 0x8c9f15e3, 0xa7b24620, 0xbea97761,
+      0xf1e8e1a6, 0xe8f3d0e7, 0xc3de8324, 0xdac5b265, 0x5d5daeaa, 0x44469feb,
+      0x6f6bcc28, 0x7670fd69, 0x39316bae, 0x202a5aef, 0x0b07092c, 0x121c386d,
+      0xdf4636f3, 0xc65d07b2, 0xed705471, 0xf46b6530, 0xbb2af3f7, 0xa231c2b6,
+      0x891c9175, 0x9007a034, 0x179fbcfb, 0x0e848dba, 0x25a9de79, 0x3cb2ef38,
+      0x73f379ff, 0x6ae848be, 0x41c51b7d, 0x58de2a3c, 0xf0794f05, 0xe9627e44,
+      0xc24f2d87, 0xdb541cc6, 0x94158a01, 0x8d0ebb40, 0xa623e883, 0xbf38d9c2,
+      0x38a0c50d, 0x21bbf44c, 0x0a96a78f, 0x138d96ce, 0x5ccc0009, 0x45d73148,
+      0x6efa628b, 0x77e153ca, 0xbabb5d54, 0xa3a06c15, 0x888d3fd6, 0x91960e97,
+      0xded79850, 0xc7cca911, 0xece1fad2, 0xf5facb93, 0x7262d75c, 0x6b79e61d,
+      0x4054b5de, 0x594f849f, 0x160e1258, 0x0f152319, 0x243870da, 0x3d23419b,
+      0x65fd6ba7, 0x7ce65ae6, 0x57cb0925, 0x4ed03864, 0x0191aea3, 0x188a9fe2,
+      0x33a7cc21, 0x2abcfd60, 0xad24e1af, 0xb43fd0ee, 0x9f12832d, 0x8609b26c,
+      0xc94824ab, 0xd05315ea, 0xfb7e4629, 0xe2657768, 0x2f3f79f6, 0x362448b7,
+      0x1d091b74, 0x04122a35, 0x4b53bcf2, 0x52488db3, 0x7965de70, 0x607eef31,
+      0xe7e6f3fe, 0xfefdc2bf, 0xd5d0917c, 0xcccba03d, 0x838a36fa, 0x9a9107bb,
+      0xb1bc5478, 0xa8a76539, 0x3b83984b, 0x2298a90a, 0x09b5fac9, 0x10aecb88,
+      0x5fef5d4f, 0x46f46c0e, 0x6dd93fcd, 0x74c20e8c, 0xf35a1243, 0xea412302,
+      0xc16c70c1, 0xd8774180, 0x9736d747, 0x8e2de606, 0xa500b5c5, 0xbc1b8484,
+      0x71418a1a, 0x685abb5b, 0x4377e898, 0x5a6cd9d9, 0x152d4f1e, 0x0c367e5f,
+      0x271b2d9c, 0x3e001cdd, 0xb9980012, 0xa0833153, 0x8bae6290, 0x92b553d1,
+      0xddf4c516, 0xc4eff457, 0xefc2a794, 0xf6d996d5, 0xae07bce9, 0xb71c8da8,
+      0x9c31de6b, 0x852aef2a, 0xca6b79ed, 0xd37048ac, 0xf85d1b6f, 0xe1462a2e,
+      0x66de36e1, 0x7fc507a0, 0x54e85463, 0x4df36522, 0x02b2f3e5, 0x1ba9c2a4,
+      0x30849167, 0x299fa026, 0xe4c5aeb8, 0xfdde9ff9, 0xd6f3cc3a, 0xcfe8fd7b,
+      0x80a96bbc, 0x99b25afd, 0xb29f093e, 0xab84387f, 0x2c1c24b0, 0x350715f1,
+      0x1e2a4632, 0x07317773, 0x4870e1b4, 0x516bd0f5, 0x7a468336, 0x635db277,
+      0xcbfad74e, 0xd2e1e60f, 0xf9ccb5cc, 0xe0d7848d, 0xaf96124a, 0xb68d230b,
+      0x9da070c8, 0x84bb4189, 0x03235d46, 0x1a386c07, 0x31153fc4, 0x280e0e85,
+      0x674f9842, 0x7e54a903, 0x5579fac0, 0x4c62cb81, 0x8138c51f, 0x9823f45e,
+      0xb30ea79d, 0xaa1596dc, 0xe554001b, 0xfc4f315a, 0xd7626299, 0xce7953d8,
+      0x49e14f17, 0x50fa7e56, 0x7bd72d95, 0x62cc1cd4, 0x2d8d8a13, 0x3496bb52,
+      0x1fbbe891, 0x06a0d9d0, 0x5e7ef3ec, 0x4765c2ad, 0x6c48916e, 0x7553a02f,
+      0x3a1236e8, 0x230907a9, 0x0824546a, 0x113f652b, 0x96a779e4, 0x8fbc48a5,
+      0xa4911b66, 0xbd8a2a27, 0xf2cbbce0, 0xebd08da1, 0xc0fdde62, 0xd9e6ef23,
+      0x14bce1bd, 0x0da7d0fc, 0x268a833f, 0x3f91b27e, 0x70d024b9, 0x69cb15f8,
+      0x42e6463b, 0x5bfd777a, 0xdc656bb5, 0xc57e5af4, 0xee530937, 0xf7483876,
+      0xb809aeb1, 0xa1129ff0, 0x8a3fcc33, 0x9324fd72
+    },
+    {
+      0x00000000, 0x01c26a37, 0x0384d46e, 0x0246be59, 0x0709a8dc, 0x06cbc2eb,
+      0x048d7cb2, 0x054f1685, 0x0e1351b8, 0x0fd13b8f, 0x0d9785d6, 0x0c55efe1,
+      0x091af964, 0x08d89353, 0x0a9e2d0a, 0x0b5c473d, 0x1c26a370, 0x1de4c947,
+      0x1fa2771e, 0x1e601d29, 0x1b2f0bac, 0x1aed619b, 0x18abdfc2, 0x1969b5f5,
+      0x1235f2c8, 0x13f798ff, 0x11b126a6, 0x10734c91, 0x153c5a14, 0x14fe3023,
+      0x16b88e7a, 0x177ae44d, 0x384d46e0, 0x398f2cd7, 0x3bc9928e, 0x3a0bf8b9,
+      0x3f44ee3c, 0x3e86840b, 0x3cc03a52, 0x3d025065, 0x365e1758, 0x379c7d6f,
+      0x35dac336, 0x3418a901, 0x3157bf84, 0x3095d5b3, 0x32d36bea, 0x331101dd,
+      0x246be590, 0x25a98fa7, 0x27ef31fe, 0x262d5bc9, 0x23624d4c, 0x22a0277b,
+      0x20e69922, 0x2124f315, 0x2a78b428, 0x2bbade1f, 0x29fc6046, 0x283e0a71,
+      0x2d711cf4, 0x2cb376c3, 0x2ef5c89a, 0x2f37a2ad, 0x709a8dc0, 0x7158e7f7,
+      0x731e59ae, 0x72dc3399, 0x7793251c, 0x76514f2b, 0x7417f172, 0x75d59b45,
+      0x7e89dc78, 0x7f4bb64f, 0x7d0d0816, 0x7ccf6221, 0x798074a4, 0x78421e93,
+      0x7a04a0ca, 0x7bc6cafd, 0x6cbc2eb0, 0x6d7e4487, 0x6f38fade, 0x6efa90e9,
+      0x6bb5866c, 0x6a77ec5b, 0x68315202, 0x69f33835, 0x62af7f08, 0x636d153f,
+      0x612bab66, 0x60e9c151, 0x65a6d7d4, 0x6464bde3, 0x662203ba, 0x67e0698d,
+      0x48d7cb20, 0x4915a117, 0x4b531f4e, 0x4a917579, 0x4fde63fc, 0x4e1c09cb,
+      0x4c5ab792, 0x4d98dda5, 0x46c49a98, 0x4706f0af, 0x45404ef6, 0x448224c1,
+      0x41cd3244, 0x400f5873, 0x4249e62a, 0x438b8c1d, 0x54f16850, 0x55330267,
+      0x5775bc3e, 0x56b7d609, 0x53f8c08c, 0x523aaabb, 0x507c14e2, 0x51be7ed5,
+      0x5ae239e8, 0x5b2053df, 0x5966ed86, 0x58a487b1, 0x5deb9134, 0x5c29fb03,
+      0x5e6f455a, 0x5fad2f6d, 0xe1351b80, 0xe0f771b7, 0xe2b1cfee, 0xe373a5d9,
+      0xe63cb35c, 0xe7fed96b, 0xe5b86732, 0xe47a0d05, 0xef264a38, 0xeee4200f,
+      0xeca29e56, 0xed60f461, 0xe82fe2e4, 0xe9ed88d3, 0xebab368a, 0xea695cbd,
+      0xfd13b8f0, 0xfcd1d2c7, 0xfe976c9e, 0xff5506a9, 0xfa1a102c, 0xfbd87a1b,
+      0xf99ec442, 0xf85cae75, 0xf300e948, 0xf2c2837f, 0xf0843d26, 0xf1465711,
+      0xf4094194, 0xf5cb2ba3, 0xf78d95fa, 0xf64fffcd, 0xd9785d60, 0xd8ba3757,
+      0xdafc890e, 0xdb3ee339, 0xde71f5bc, 0xdfb39f8b, 0xddf521d2, 0xdc374be5,
+      0xd76b0cd8, 0xd6a966ef, 0xd4efd8b6, 0xd52db281, 0xd062a404, 0xd1a0ce33,
+      0xd3e6706a, 0xd2241a5d, 0xc55efe10, 0xc49c9427, 0xc6da2a7e, 0xc7184049,
+      0xc25756cc, 0xc3953cfb, 0xc1d382a2, 0xc011e895, 0xcb4dafa8, 0xca8fc59f,
+      0xc8c97bc6, 0xc90b11f1, 0xcc440774, 0xcd866d43, 0xcfc0d31a, 0xce02b92d,
+      0x91af9640, 0x906dfc77, 0x922b422e, 0x93e92819, 0x96a63e9c, 0x976454ab,
+      0x9522eaf2, 0x94e080c5, 0x9fbcc7f8, 0x9e7eadcf, 0x9c381396, 0x9dfa79a1,
+      0x98b56f24, 0x99770513, 0x9b31bb4a, 0x9af3d17d, 0x8d893530, 0x8c4b5f07,
+      0x8e0de15e, 0x8fcf8b69, 0x8a809dec, 0x8b42f7db, 0x89044982, 0x88c623b5,
+      0x839a6488, 0x82580ebf, 0x801eb0e6, 0x81dcdad1, 0x8493cc54, 0x8551a663,
+      0x8717183a, 0x86d5720d, 0xa9e2d0a0, 0xa820ba97, 0xaa6604ce, 0xaba46ef9,
+      0xaeeb787c, 0xaf29124b, 0xad6fac12, 0xacadc625, 0xa7f18118, 0xa633eb2f,
+      0xa4755576, 0xa5b73f41, 0xa0f829c4, 0xa13a43f3, 0xa37cfdaa, 0xa2be979d,
+      0xb5c473d0, 0xb40619e7, 0xb640a7be, 0xb782cd89, 0xb2cddb0c, 0xb30fb13b,
+      0xb1490f62, 0xb08b6555, 0xbbd72268, 0xba15485f, 0xb853f606, 0xb9919c31,
+      0xbcde8ab4, 0xbd1ce083, 0xbf5a5eda, 0xbe9834ed
+    },
+    {
+      0x00000000, 0xb8bc6765, 0xaa09c88b, 0x12b5afee, 0x8f629757, 0x37def032,
+      0x256b5fdc, 0x9dd738b9, 0xc5b428ef, 0x7d084f8a, 0x6fbde064, 0xd7018701,
+      0x4ad6bfb8, 0xf26ad8dd, 0xe0df7733, 0x58631056, 0x5019579f, 0xe8a530fa,
+      0xfa109f14, 0x42acf871, 0xdf7bc0c8, 0x67c7a7ad, 0x75720843, 0xcdce6f26,
+      0x95ad7f70, 0x2d111815, 0x3fa4b7fb, 0x8718d09e, 0x1acfe827, 0xa2738f42,
+      0xb0c620ac, 0x087a47c9, 0xa032af3e, 0x188ec85b, 0x0a3b67b5, 0xb28700d0,
+      0x2f503869, 0x97ec5f0c, 0x8559f0e2, 0x3de59787, 0x658687d1, 0xdd3ae0b4,
+      0xcf8f4f5a, 0x7733283f, 0xeae41086, 0x525877e3, 0x40edd80d, 0xf851bf68,
+      0xf02bf8a1, 0x48979fc4, 0x5a22302a, 0xe29e574f, 0x7f496ff6, 0xc7f50893,
+      0xd540a77d, 0x6dfcc018, 0x359fd04e, 0x8d23b72b, 0x9f9618c5, 0x272a7fa0,
+      0xbafd4719, 0x0241207c, 0x10f48f92, 0xa848e8f7, 0x9b14583d, 0x23a83f58,
+      0x311d90b6, 0x89a1f7d3, 0x1476cf6a, 0xaccaa80f, 0xbe7f07e1, 0x06c36084,
+      0x5ea070d2, 0xe61c17b7, 0xf4a9b859, 0x4c15df3c, 0xd1c2e785, 0x697e80e0,
+      0x7bcb2f0e, 0xc377486b, 0xcb0d0fa2, 0x73b168c7, 0x6104c729, 0xd9b8a04c,
+      0x446f98f5, 0xfcd3ff90, 0xee66507e, 0x56da371b, 0x0eb9274d, 0xb6054028,
+      0xa4b0efc6, 0x1c0c88a3, 0x81dbb01a, 0x3967d77f, 0x2bd27891, 0x936e1ff4,
+      0x3b26f703, 0x839a9066, 0x912f3f88, 0x299358ed, 0xb4446054, 0x0cf80731,
+      0x1e4da8df, 0xa6f1cfba, 0xfe92dfec, 0x462eb889, 0x549b1767, 0xec277002,
+      0x71f048bb, 0xc94c2fde, 0xdbf98030, 0x6345e755, 0x6b3fa09c, 0xd383c7f9,
+      0xc1366817, 0x798a0f72, 0xe45d37cb, 0x5ce150ae, 0x4e54ff40, 0xf6e89825,
+      0xae8b8873, 0x1637ef16, 0x048240f8, 0xbc3e279d, 0x21e91f24, 0x99557841,
+      0x8be0d7af, 0x335cb0ca, 0xed59b63b, 0x55e5d15e, 0x47507eb0, 0xffec19d5,
+      0x623b216c, 0xda874609, 0xc832e9e7, 0x708e8e82, 0x28ed9ed4, 0x9051f9b1,
+      0x82e4565f, 0x3a58313a, 0xa78f0983, 0x1f336ee6, 0x0d86c108, 0xb53aa66d,
+      0xbd40e1a4, 0x05fc86c1, 0x1749292f, 0xaff54e4a, 0x322276f3, 0x8a9e1196,
+      0x982bbe78, 0x2097d91d, 0x78f4c94b, 0xc048ae2e, 0xd2fd01c0, 0x6a4166a5,
+      0xf7965e1c, 0x4f2a3979, 0x5d9f9697, 0xe523f1f2, 0x4d6b1905, 0xf5d77e60,
+      0xe762d18e, 0x5fdeb6eb, 0xc2098e52, 0x7ab5e937, 0x680046d9, 0xd0bc21bc,
+      0x88df31ea, 0x3063568f, 0x22d6f961, 0x9a6a9e04, 0x07bda6bd, 0xbf01c1d8,
+      0xadb46e36, 0x15080953, 0x1d724e9a, 0xa5ce29ff, 0xb77b8611, 0x0fc7e174,
+      0x9210d9cd, 0x2aacbea8, 0x38191146, 0x80a57623, 0xd8c66675, 0x607a0110,
+      0x72cfaefe, 0xca73c99b, 0x57a4f122, 0xef189647, 0xfdad39a9, 0x45115ecc,
+      0x764dee06, 0xcef18963, 0xdc44268d, 0x64f841e8, 0xf92f7951, 0x41931e34,
+      0x5326b1da, 0xeb9ad6bf, 0xb3f9c6e9, 0x0b45a18c, 0x19f00e62, 0xa14c6907,
+      0x3c9b51be, 0x842736db, 0x96929935, 0x2e2efe50, 0x2654b999, 0x9ee8defc,
+      0x8c5d7112, 0x34e11677, 0xa9362ece, 0x118a49ab, 0x033fe645, 0xbb838120,
+      0xe3e09176, 0x5b5cf613, 0x49e959fd, 0xf1553e98, 0x6c820621, 0xd43e6144,
+      0xc68bceaa, 0x7e37a9cf, 0xd67f4138, 0x6ec3265d, 0x7c7689b3, 0xc4caeed6,
+      0x591dd66f, 0xe1a1b10a, 0xf3141ee4, 0x4ba87981, 0x13cb69d7, 0xab770eb2,
+      0xb9c2a15c, 0x017ec639, 0x9ca9fe80, 0x241599e5, 0x36a0360b, 0x8e1c516e,
+      0x866616a7, 0x3eda71c2, 0x2c6fde2c, 0x94d3b949, 0x090481f0, 0xb1b8e695,
+      0xa30d497b, 0x1bb12e1e, 0x43d23e48, 0xfb6e592d, 0xe9dbf6c3, 0x516791a6,
+      0xccb0a91f, 0x740cce7a, 0x66b96194, 0xde0506f1
+    },
+    {
+      0x00000000, 0x3d6029b0, 0x7ac05360, 0x47a07ad0, 0xf580a6c0, 0xc8e08f70,
+      0x8f40f5a0, 0xb220dc10, 0x30704bc1, 0x0d106271, 0x4ab018a1, 0x77d03111,
+      0xc5f0ed01, 0xf890c4b1, 0xbf30be61, 0x825097d1, 0x60e09782, 0x5d80be32,
+      0x1a20c4e2, 0x2740ed52, 0x95603142, 0xa80018f2, 0xefa06222, 0xd2c04b92,
+      0x5090dc43, 0x6df0f5f3, 0x2a508f23, 0x1730a693, 0xa5107a83, 0x98705333,
+      0xdfd029e3, 0xe2b00053, 0xc1c12f04, 0xfca106b4, 0xbb017c64, 0x866155d4,
+      0x344189c4, 0x0921a074, 0x4e81daa4, 0x73e1f314, 0xf1b164c5, 0xccd14d75,
+      0x8b7137a5, 0xb6111e15, 0x0431c205, 0x3951ebb5, 0x7ef19165, 0x4391b8d5,
+      0xa121b886, 0x9c419136, 0xdbe1ebe6, 0xe681c256, 0x54a11e46, 0x69c137f6,
+      0x2e614d26, 0x13016496, 0x9151f347, 0xac31daf7, 0xeb91a027, 0xd6f18997,
+      0x64d15587, 0x59b17c37, 0x1e1106e7, 0x23712f57, 0x58f35849, 0x659371f9,
+      0x22330b29, 0x1f532299, 0xad73fe89, 0x9013d739, 0xd7b3ade9, 0xead38459,
+      0x68831388, 0x55e33a38, 0x124340e8, 0x2f236958, 0x9d03b548, 0xa0639cf8,
+      0xe7c3e628, 0xdaa3cf98, 0x3813cfcb, 0x0573e67b, 0x42d39cab, 0x7fb3b51b,
+      0xcd93690b, 0xf0f340bb, 0xb7533a6b, 0x8a3313db, 0x0863840a, 0x3503adba,
+      0x72a3d76a, 0x4fc3feda, 0xfde322ca, 0xc0830b7a, 0x872371aa, 0xba43581a,
+      0x9932774d, 0xa4525efd, 0xe3f2242d, 0xde920d9d, 0x6cb2d18d, 0x51d2f83d,
+      0x167282ed, 0x2b12ab5d, 0xa9423c8c, 0x9422153c, 0xd3826fec, 0xeee2465c,
+      0x5cc29a4c, 0x61a2b3fc, 0x2602c92c, 0x1b62e09c, 0xf9d2e0cf, 0xc4b2c97f,
+      0x8312b3af, 0xbe729a1f, 0x0c52460f, 0x31326fbf, 0x7692156f, 0x4bf23cdf,
+      0xc9a2ab0e, 0xf4c282be, 0xb362f86e, 0x8e02d1de, 0x3c220dce, 0x0142247e,
+      0x46e25eae, 0x7b82771e, 0xb1e6b092, 0x8c869922, 0xcb26e3f2, 0xf646ca42,
+      0x44661652, 0x79063fe2, 0x3ea64532, 0x03c66c82, 0x8196fb53, 0xbcf6d2e3,
+      0xfb56a833, 0xc6368183, 0x74165d93, 0x49767423, 0x0ed60ef3, 0x33b62743,
+      0xd1062710, 0xec660ea0, 0xabc67470, 0x96a65dc0, 0x248681d0, 0x19e6a860,
+      0x5e46d2b0, 0x6326fb00, 0xe1766cd1, 0xdc164561, 0x9bb63fb1, 0xa6d61601,
+      0x14f6ca11, 0x2996e3a1, 0x6e369971, 0x5356b0c1, 0x70279f96, 0x4d47b626,
+      0x0ae7ccf6, 0x3787e546, 0x85a73956, 0xb8c710e6, 0xff676a36, 0xc2074386,
+      0x4057d457, 0x7d37fde7, 0x3a978737, 0x07f7ae87, 0xb5d77297, 0x88b75b27,
+      0xcf1721f7, 0xf2770847, 0x10c70814, 0x2da721a4, 0x6a075b74, 0x576772c4,
+      0xe547aed4, 0xd8278764, 0x9f87fdb4, 0xa2e7d404, 0x20b743d5, 0x1dd76a65,
+      0x5a7710b5, 0x67173905, 0xd537e515, 0xe857cca5, 0xaff7b675, 0x92979fc5,
+      0xe915e8db, 0xd475c16b, 0x93d5bbbb, 0xaeb5920b, 0x1c954e1b, 0x21f567ab,
+      0x66551d7b, 0x5b3534cb, 0xd965a31a, 0xe4058aaa, 0xa3a5f07a, 0x9ec5d9ca,
+      0x2ce505da, 0x11852c6a, 0x562556ba, 0x6b457f0a, 0x89f57f59, 0xb49556e9,
+      0xf3352c39, 0xce550589, 0x7c75d999, 0x4115f029, 0x06b58af9, 0x3bd5a349,
+      0xb9853498, 0x84e51d28, 0xc34567f8, 0xfe254e48, 0x4c059258, 0x7165bbe8,
+      0x36c5c138, 0x0ba5e888, 0x28d4c7df, 0x15b4ee6f, 0x521494bf, 0x6f74bd0f,
+      0xdd54611f, 0xe03448af, 0xa794327f, 0x9af41bcf, 0x18a48c1e, 0x25c4a5ae,
+      0x6264df7e, 0x5f04f6ce, 0xed242ade, 0xd044036e, 0x97e479be, 0xaa84500e,
+      0x4834505d, 0x755479ed, 0x32f4033d, 0x0f942a8d, 0xbdb4f69d, 0x80d4df2d,
+      0xc774a5fd, 0xfa148c4d, 0x78441b9c, 0x4524322c, 0x028448fc, 0x3fe4614c,
+      0x8dc4bd5c, 0xb0a494ec, 0xf704ee3c, 0xca64c78c
+    },
+    {
+      0x00000000, 0xcb5cd3a5, 0x4dc8a10b, 0x869472ae, 0x9b914216, 0x50cd91b3,
+      0xd659e31d, 0x1d0530b8, 0xec53826d, 0x270f51c8, 0xa19b2366, 0x6ac7f0c3,
+      0x77c2c07b, 0xbc9e13de, 0x3a0a6170, 0xf156b2d5, 0x03d6029b, 0xc88ad13e,
+      0x4e1ea390, 0x85427035, 0x9847408d, 0x531b9328, 0xd58fe186, 0x1ed33223,
+      0xef8580f6, 0x24d95353, 0xa24d21fd, 0x6911f258, 0x7414c2e0, 0xbf481145,
+      0x39dc63eb, 0xf280b04e, 0x07ac0536, 0xccf0d693, 0x4a64a43d, 0x81387798,
+      0x9c3d4720, 0x57619485, 0xd1f5e62b, 0x1aa9358e, 0xebff875b, 0x20a354fe,
+      0xa6372650, 0x6d6bf5f5, 0x706ec54d, 0xbb3216e8, 0x3da66446, 0xf6fab7e3,
+      0x047a07ad, 0xcf26d408, 0x49b2a6a6, 0x82ee7503, 0x9feb45bb, 0x54b7961e,
+      0xd223e4b0, 0x197f3715, 0xe82985c0, 0x23755665, 0xa5e124cb, 0x6ebdf76e,
+      0x73b8c7d6, 0xb8e41473, 0x3e7066dd, 0xf52cb578, 0x0f580a6c, 0xc404d9c9,
+      0x4290ab67, 0x89cc78c2, 0x94c9487a, 0x5f959bdf, 0xd901e971, 0x125d3ad4,
+      0xe30b8801, 0x28575ba4, 0xaec3290a, 0x659ffaaf, 0x789aca17, 0xb3c619b2,
+      0x35526b1c, 0xfe0eb8b9, 0x0c8e08f7, 0xc7d2db52, 0x4146a9fc, 0x8a1a7a59,
+      0x971f4ae1, 0x5c439944, 0xdad7ebea, 0x118b384f, 0xe0dd8a9a, 0x2b81593f,
+      0xad152b91, 0x6649f834, 0x7b4cc88c, 0xb0101b29, 0x36846987, 0xfdd8ba22,
+      0x08f40f5a, 0xc3a8dcff, 0x453cae51, 0x8e607df4, 0x93654d4c, 0x58399ee9,
+      0xdeadec47, 0x15f13fe2, 0xe4a78d37, 0x2ffb5e92, 0xa96f2c3c, 0x6233ff99,
+      0x7f36cf21, 0xb46a1c84, 0x32fe6e2a, 0xf9a2bd8f, 0x0b220dc1, 0xc07ede64,
+      0x46eaacca, 0x8db67f6f, 0x90b34fd7, 0x5bef9c72, 0xdd7beedc, 0x16273d79,
+      0xe7718fac, 0x2c2d5c09, 0xaab92ea7, 0x61e5fd02, 0x7ce0cdba, 0xb7bc1e1f,
+      0x31286cb1, 0xfa74bf14, 0x1eb014d8, 0xd5ecc77d, 0x5378b5d3, 0x98246676,
+      0x852156ce, 0x4e7d856b, 0xc8e9f7c5, 0x03b52460, 0xf2e396b5, 0x39bf4510,
+      0xbf2b37be, 0x7477e41b, 0x6972d4a3, 0xa22e0706, 0x24ba75a8, 0xefe6a60d,
+      0x1d661643, 0xd63ac5e6, 0x50aeb748, 0x9bf264ed, 0x86f75455, 0x4dab87f0,
+      0xcb3ff55e, 0x006326fb, 0xf135942e, 0x3a69478b, 0xbcfd3525, 0x77a1e680,
+      0x6aa4d638, 0xa1f8059d, 0x276c7733, 0xec30a496, 0x191c11ee, 0xd240c24b,
+      0x54d4b0e5, 0x9f886340, 0x828d53f8, 0x49d1805d, 0xcf45f2f3, 0x04192156,
+      0xf54f9383, 0x3e134026, 0xb8873288, 0x73dbe12d, 0x6eded195, 0xa5820230,
+      0x2316709e, 0xe84aa33b, 0x1aca1375, 0xd196c0d0, 0x5702b27e, 0x9c5e61db,
+      0x815b5163, 0x4a0782c6, 0xcc93f068, 0x07cf23cd, 0xf6999118, 0x3dc542bd,
+      0xbb513013, 0x700de3b6, 0x6d08d30e, 0xa65400ab, 0x20c07205, 0xeb9ca1a0,
+      0x11e81eb4, 0xdab4cd11, 0x5c20bfbf, 0x977c6c1a, 0x8a795ca2, 0x41258f07,
+      0xc7b1fda9, 0x0ced2e0c, 0xfdbb9cd9, 0x36e74f7c, 0xb0733dd2, 0x7b2fee77,
+      0x662adecf, 0xad760d6a, 0x2be27fc4, 0xe0beac61, 0x123e1c2f, 0xd962cf8a,
+      0x5ff6bd24, 0x94aa6e81, 0x89af5e39, 0x42f38d9c, 0xc467ff32, 0x0f3b2c97,
+      0xfe6d9e42, 0x35314de7, 0xb3a53f49, 0x78f9ecec, 0x65fcdc54, 0xaea00ff1,
+      0x28347d5f, 0xe368aefa, 0x16441b82, 0xdd18c827, 0x5b8cba89, 0x90d0692c,
+      0x8dd55994, 0x46898a31, 0xc01df89f, 0x0b412b3a, 0xfa1799ef, 0x314b4a4a,
+      0xb7df38e4, 0x7c83eb41, 0x6186dbf9, 0xaada085c, 0x2c4e7af2, 0xe712a957,
+      0x15921919, 0xdececabc, 0x585ab812, 0x93066bb7, 0x8e035b0f, 0x455f88aa,
+      0xc3cbfa04, 0x089729a1, 0xf9c19b74, 0x329d48d1, 0xb4093a7f, 0x7f55e9da,
+      0x6250d962, 0xa90c0ac7, 0x2f987869, 0xe4c4abcc
+    },
+    {
+      0x00000000, 0xa6770bb4, 0x979f1129, 0x31e81a9d, 0xf44f2413, 0x52382fa7,
+      0x63d0353a, 0xc5a73e8e, 0x33ef4e67, 0x959845d3, 0xa4705f4e, 0x020754fa,
+      0xc7a06a74, 0x61d761c0, 0x503f7b5d, 0xf64870e9, 0x67de9cce, 0xc1a9977a,
+      0xf0418de7, 0x56368653, 0x9391b8dd, 0x35e6b369, 0x040ea9f4, 0xa279a240,
+      0x5431d2a9, 0xf246d91d, 0xc3aec380, 0x65d9c834, 0xa07ef6ba, 0x0609fd0e,
+      0x37e1e793, 0x9196ec27, 0xcfbd399c, 0x69ca3228, 0x582228b5, 0xfe552301,
+      0x3bf21d8f, 0x9d85163b, 0xac6d0ca6, 0x0a1a0712, 0xfc5277fb, 0x5a257c4f,
+      0x6bcd66d2, 0xcdba6d66, 0x081d53e8, 0xae6a585c, 0x9f8242c1, 0x39f54975,
+      0xa863a552, 0x0e14aee6, 0x3ffcb47b, 0x998bbfcf, 0x5c2c8141, 0xfa5b8af5,
+      0xcbb39068, 0x6dc49bdc, 0x9b8ceb35, 0x3dfbe081, 0x0c13fa1c, 0xaa64f1a8,
+      0x6fc3cf26, 0xc9b4c492, 0xf85cde0f, 0x5e2bd5bb, 0x440b7579, 0xe27c7ecd,
+      0xd3946450, 0x75e36fe4, 0xb044516a, 0x16335ade, 0x27db4043, 0x81ac4bf7,
+      0x77e43b1e, 0xd19330aa, 0xe07b2a37, 0x460c2183, 0x83ab1f0d, 0x25dc14b9,
+      0x14340e24, 0xb2430590, 0x23d5e9b7, 0x85a2e203, 0xb44af89e, 0x123df32a,
+      0xd79acda4, 0x71edc610, 0x4005dc8d, 0xe672d739, 0x103aa7d0, 0xb64dac64,
+      0x87a5b6f9, 0x21d2bd4d, 0xe47583c3, 0x42028877, 0x73ea92ea, 0xd59d995e,
+      0x8bb64ce5, 0x2dc14751, 0x1c295dcc, 0xba5e5678, 0x7ff968f6, 0xd98e6342,
+      0xe86679df, 0x4e11726b, 0xb8590282, 0x1e2e0936, 0x2fc613ab, 0x89b1181f,
+      0x4c162691, 0xea612d25, 0xdb8937b8, 0x7dfe3c0c, 0xec68d02b, 0x4a1fdb9f,
+      0x7bf7c102, 0xdd80cab6, 0x1827f438, 0xbe50ff8c, 0x8fb8e511, 0x29cfeea5,
+      0xdf879e4c, 0x79f095f8, 0x48188f65, 0xee6f84d1, 0x2bc8ba5f, 0x8dbfb1eb,
+      0xbc57ab76, 0x1a20a0c2, 0x8816eaf2, 0x2e61e146, 0x1f89fbdb, 0xb9fef06f,
+      0x7c59cee1, 0xda2ec555, 0xebc6dfc8, 0x4db1d47c, 0xbbf9a495, 0x1d8eaf21,
+      0x2c66b5bc, 0x8a11be08, 0x4fb68086, 0xe9c18b32, 0xd82991af, 0x7e5e9a1b,
+      0xefc8763c, 0x49bf7d88, 0x78576715, 0xde206ca1, 0x1b87522f, 0xbdf0599b,
+      0x8c184306, 0x2a6f48b2, 0xdc27385b, 0x7a5033ef, 0x4bb82972, 0xedcf22c6,
+      0x28681c48, 0x8e1f17fc, 0xbff70d61, 0x198006d5, 0x47abd36e, 0xe1dcd8da,
+      0xd034c247, 0x7643c9f3, 0xb3e4f77d, 0x1593fcc9, 0x247be654, 0x820cede0,
+      0x74449d09, 0xd23396bd, 0xe3db8c20, 0x45ac8794, 0x800bb91a, 0x267cb2ae,
+      0x1794a833, 0xb1e3a387, 0x20754fa0, 0x86024414, 0xb7ea5e89, 0x119d553d,
+      0xd43a6bb3, 0x724d6007, 0x43a57a9a, 0xe5d2712e, 0x139a01c7, 0xb5ed0a73,
+      0x840510ee, 0x22721b5a, 0xe7d525d4, 0x41a22e60, 0x704a34fd, 0xd63d3f49,
+      0xcc1d9f8b, 0x6a6a943f, 0x5b828ea2, 0xfdf58516, 0x3852bb98, 0x9e25b02c,
+      0xafcdaab1, 0x09baa105, 0xfff2d1ec, 0x5985da58, 0x686dc0c5, 0xce1acb71,
+      0x0bbdf5ff, 0xadcafe4b, 0x9c22e4d6, 0x3a55ef62, 0xabc30345, 0x0db408f1,
+      0x3c5c126c, 0x9a2b19d8, 0x5f8c2756, 0xf9fb2ce2, 0xc813367f, 0x6e643dcb,
+      0x982c4d22, 0x3e5b4696, 0x0fb35c0b, 0xa9c457bf, 0x6c636931, 0xca146285,
+      0xfbfc7818, 0x5d8b73ac, 0x03a0a617, 0xa5d7ada3, 0x943fb73e, 0x3248bc8a,
+      0xf7ef8204, 0x519889b0, 0x6070932d, 0xc6079899, 0x304fe870, 0x9638e3c4,
+      0xa7d0f959, 0x01a7f2ed, 0xc400cc63, 0x6277c7d7, 0x539fdd4a, 0xf5e8d6fe,
+      0x647e3ad9, 0xc209316d, 0xf3e12bf0, 0x55962044, 0x90311eca, 0x3646157e,
+      0x07ae0fe3, 0xa1d90457, 0x579174be, 0xf1e67f0a, 0xc00e6597, 0x66796e23,
+      0xa3de50ad, 0x05a95b19, 0x34414184, 0x92364a30
+    },
+    {
+      0x00000000, 0xccaa009e, 0x4225077d, 0x8e8f07e3, 0x844a0efa, 0x48e00e64,
+      0xc66f0987, 0x0ac50919, 0xd3e51bb5, 0x1f4f1b2b, 0x91c01cc8, 0x5d6a1c56,
+      0x57af154f, 0x9b0515d1, 0x158a1232, 0xd92012ac, 0x7cbb312b, 0xb01131b5,
+      0x3e9e3656, 0xf23436c8, 0xf8f13fd1, 0x345b3f4f, 0xbad438ac, 0x767e3832,
+      0xaf5e2a9e, 0x63f42a00, 0xed7b2de3, 0x21d12d7d, 0x2b142464, 0xe7be24fa,
+      0x69312319, 0xa59b2387, 0xf9766256, 0x35dc62c8, 0xbb53652b, 0x77f965b5,
+      0x7d3c6cac, 0xb1966c32, 0x3f196bd1, 0xf3b36b4f, 0x2a9379e3, 0xe639797d,
+      0x68b67e9e, 0xa41c7e00, 0xaed97719, 0x62737787, 0xecfc7064, 0x205670fa,
+      0x85cd537d, 0x496753e3, 0xc7e85400, 0x0b42549e, 0x01875d87, 0xcd2d5d19,
+      0x43a25afa, 0x8f085a64, 0x562848c8, 0x9a824856, 0x140d4fb5, 0xd8a74f2b,
+      0xd2624632, 0x1ec846ac, 0x9047414f, 0x5ced41d1, 0x299dc2ed, 0xe537c273,
+      0x6bb8c590, 0xa712c50e, 0xadd7cc17, 0x617dcc89, 0xeff2cb6a, 0x2358cbf4,
+      0xfa78d958, 0x36d2d9c6, 0xb85dde25, 0x74f7debb, 0x7e32d7a2, 0xb298d73c,
+      0x3c17d0df, 0xf0bdd041, 0x5526f3c6, 0x998cf358, 0x1703f4bb, 0xdba9f425,
+      0xd16cfd3c, 0x1dc6fda2, 0x9349fa41, 0x5fe3fadf, 0x86c3e873, 0x4a69e8ed,
+      0xc4e6ef0e, 0x084cef90, 0x0289e689, 0xce23e617, 0x40ace1f4, 0x8c06e16a,
+      0xd0eba0bb, 0x1c41a025, 0x92cea7c6, 0x5e64a758, 0x54a1ae41, 0x980baedf,
+      0x1684a93c, 0xda2ea9a2, 0x030ebb0e, 0xcfa4bb90, 0x412bbc73, 0x8d81bced,
+      0x8744b5f4, 0x4beeb56a, 0xc561b289, 0x09cbb217, 0xac509190, 0x60fa910e,
+      0xee7596ed, 0x22df9673, 0x281a9f6a, 0xe4b09ff4, 0x6a3f9817, 0xa6959889,
+      0x7fb58a25, 0xb31f8abb, 0x3d908d58, 0xf13a8dc6, 0xfbff84df, 0x37558441,
+      0xb9da83a2, 0x7570833c, 0x533b85da, 0x9f918544, 0x111e82a7, 0xddb48239,
+      0xd7718b20, 0x1bdb8bbe, 0x95548c5d, 0x59fe8cc3, 0x80de9e6f, 0x4c749ef1,
+      0xc2fb9912, 0x0e51998c, 0x04949095, 0xc83e900b, 0x46b197e8, 0x8a1b9776,
+      0x2f80b4f1, 0xe32ab46f, 0x6da5b38c, 0xa10fb312, 0xabcaba0b, 0x6760ba95,
+      0xe9efbd76, 0x2545bde8, 0xfc65af44, 0x30cfafda, 0xbe40a839, 0x72eaa8a7,
+      0x782fa1be, 0xb485a120, 0x3a0aa6c3, 0xf6a0a65d, 0xaa4de78c, 0x66e7e712,
+      0xe868e0f1, 0x24c2e06f, 0x2e07e976, 0xe2ade9e8, 0x6c22ee0b, 0xa088ee95,
+      0x79a8fc39, 0xb502fca7, 0x3b8dfb44, 0xf727fbda, 0xfde2f2c3, 0x3148f25d,
+      0xbfc7f5be, 0x736df520, 0xd6f6d6a7, 0x1a5cd639, 0x94d3d1da, 0x5879d144,
+      0x52bcd85d, 0x9e16d8c3, 0x1099df20, 0xdc33dfbe, 0x0513cd12, 0xc9b9cd8c,
+      0x4736ca6f, 0x8b9ccaf1, 0x8159c3e8, 0x4df3c376, 0xc37cc495, 0x0fd6c40b,
+      0x7aa64737, 0xb60c47a9, 0x3883404a, 0xf42940d4, 0xfeec49cd, 0x32464953,
+      0xbcc94eb0, 0x70634e2e, 0xa9435c82, 0x65e95c1c, 0xeb665bff, 0x27cc5b61,
+      0x2d095278, 0xe1a352e6, 0x6f2c5505, 0xa386559b, 0x061d761c, 0xcab77682,
+      0x44387161, 0x889271ff, 0x825778e6, 0x4efd7878, 0xc0727f9b, 0x0cd87f05,
+      0xd5f86da9, 0x19526d37, 0x97dd6ad4, 0x5b776a4a, 0x51b26353, 0x9d1863cd,
+      0x1397642e, 0xdf3d64b0, 0x83d02561, 0x4f7a25ff, 0xc1f5221c, 0x0d5f2282,
+      0x079a2b9b, 0xcb302b05, 0x45bf2ce6, 0x89152c78, 0x50353ed4, 0x9c9f3e4a,
+      0x121039a9, 0xdeba3937, 0xd47f302e, 0x18d530b0, 0x965a3753, 0x5af037cd,
+      0xff6b144a, 0x33c114d4, 0xbd4e1337, 0x71e413a9, 0x7b211ab0, 0xb78b1a2e,
+      0x39041dcd, 0xf5ae1d53, 0x2c8e0fff, 0xe0240f61, 0x6eab0882, 0xa201081c,
+      0xa8c40105, 0x646e019b, 0xeae10678, 0x264b06e6
+    }
+  },
+  { // CRC32C_POLY
+    {
+      0x00000000, 0xf26b8303, 0xe13b70f7, 0x1350f3f4, 0xc79a971f, 0x35f1141c,
+      0x26a1e7e8, 0xd4ca64eb, 0x8ad958cf, 0x78b2dbcc, 0x6be22838, 0x9989ab3b,
+      0x4d43cfd0, 0xbf284cd3, 0xac78bf27, 0x5e133c24, 0x105ec76f, 0xe235446c,
+      0xf165b798, 0x030e349b, 0xd7c45070, 0x25afd373, 0x36ff2087, 0xc494a384,
+      0x9a879fa0, 0x68ec1ca3, 0x7bbcef57, 0x89d76c54, 0x5d1d08bf, 0xaf768bbc,
+      0xbc267848, 0x4e4dfb4b, 0x20bd8ede, 0xd2d60ddd, 0xc186fe29, 0x33ed7d2a,
+      0xe72719c1, 0x154c9ac2, 0x061c6936, 0xf477ea35, 0xaa64d611, 0x580f5512,
+      0x4b5fa6e6, 0xb93425e5, 0x6dfe410e, 0x9f95c20d, 0x8cc531f9, 0x7eaeb2fa,
+      0x30e349b1, 0xc288cab2, 0xd1d83946, 0x23b3ba45, 0xf779deae, 0x05125dad,
+      0x1642ae59, 0xe4292d5a, 0xba3a117e, 0x4851927d, 0x5b016189, 0xa96ae28a,
+      0x7da08661, 0x8fcb0562, 0x9c9bf696, 0x6ef07595, 0x417b1dbc, 0xb3109ebf,
+      0xa0406d4b, 0x522bee48, 0x86e18aa3, 0x748a09a0, 0x67dafa54, 0x95b17957,
+      0xcba24573, 0x39c9c670, 0x2a993584, 0xd8f2b687, 0x0c38d26c, 0xfe53516f,
+      0xed03a29b, 0x1f682198, 0x5125dad3, 0xa34e59d0, 0xb01eaa24, 0x42752927,
+      0x96bf4dcc, 0x64d4cecf, 0x77843d3b, 0x85efbe38, 0xdbfc821c, 0x2997011f,
+      0x3ac7f2eb, 0xc8ac71e8, 0x1c661503, 0xee0d9600, 0xfd5d65f4, 0x0f36e6f7,
+      0x61c69362, 0x93ad1061, 0x80fde395, 0x72966096, 0xa65c047d, 0x5437877e,
+      0x4767748a, 0xb50cf789, 0xeb1fcbad, 0x197448ae, 0x0a24bb5a, 0xf84f3859,
+      0x2c855cb2, 0xdeeedfb1, 0xcdbe2c45, 0x3fd5af46, 0x7198540d, 0x83f3d70e,
+      0x90a324fa, 0x62c8a7f9, 0xb602c312, 0x44694011, 0x5739b3e5, 0xa55230e6,
+      0xfb410cc2, 0x092a8fc1, 0x1a7a7c35, 0xe811ff36, 0x3cdb9bdd, 0xceb018de,
+      0xdde0eb2a, 0x2f8b6829, 0x82f63b78, 0x709db87b, 0x63cd4b8f, 0x91a6c88c,
+      0x456cac67, 0xb7072f64, 0xa457dc90, 0x563c5f93, 0x082f63b7, 0xfa44e0b4,
+      0xe9141340, 0x1b7f9043, 0xcfb5f4a8, 0x3dde77ab, 0x2e8e845f, 0xdce5075c,
+      0x92a8fc17, 0x60c37f14, 0x73938ce0, 0x81f80fe3, 0x55326b08, 0xa759e80b,
+      0xb4091bff, 0x466298fc, 0x1871a4d8, 0xea1a27db, 0xf94ad42f, 0x0b21572c,
+      0xdfeb33c7, 0x2d80b0c4, 0x3ed04330, 0xccbbc033, 0xa24bb5a6, 0x502036a5,
+      0x4370c551, 0xb11b4652, 0x65d122b9, 0x97baa1ba, 0x84ea524e, 0x7681d14d,
+      0x2892ed69, 0xdaf96e6a, 0xc9a99d9e, 0x3bc21e9d, 0xef087a76, 0x1d63f975,
+      0x0e330a81, 0xfc588982, 0xb21572c9, 0x407ef1ca, 0x532e023e, 0xa145813d,
+      0x758fe5d6, 0x87e466d5, 0x94b49521, 0x66df1622, 0x38cc2a06, 0xcaa7a905,
+      0xd9f75af1, 0x2b9cd9f2, 0xff56bd19, 0x0d3d3e1a, 0x1e6dcdee, 0xec064eed,
+      0xc38d26c4, 0x31e6a5c7, 0x22b65633, 0xd0ddd530, 0x0417b1db, 0xf67c32d8,
+      0xe52cc12c, 0x1747422f, 0x49547e0b, 0xbb3ffd08, 0xa86f0efc, 0x5a048dff,
+      0x8ecee914, 0x7ca56a17, 0x6ff599e3, 0x9d9e1ae0, 0xd3d3e1ab, 0x21b862a8,
+      0x32e8915c, 0xc083125f, 0x144976b4, 0xe622f5b7, 0xf5720643, 0x07198540,
+      0x590ab964, 0xab613a67, 0xb831c993, 0x4a5a4a90, 0x9e902e7b, 0x6cfbad78,
+      0x7fab5e8c, 0x8dc0dd8f, 0xe330a81a, 0x115b2b19, 0x020bd8ed, 0xf0605bee,
+      0x24aa3f05, 0xd6c1bc06, 0xc5914ff2, 0x37faccf1, 0x69e9f0d5, 0x9b8273d6,
+      0x88d28022, 0x7ab90321, 0xae7367ca, 0x5c18e4c9, 0x4f48173d, 0xbd23943e,
+      0xf36e6f75, 0x0105ec76, 0x12551f82, 0xe03e9c81, 0x34f4f86a, 0xc69f7b69,
+      0xd5cf889d, 0x27a40b9e, 0x79b737ba, 0x8bdcb4b9, 0x988c474d, 0x6ae7c44e,
+      0xbe2da0a5, 0x4c4623a6, 0x5f16d052, 0xad7d5351
+    },
+    {
+      0x00000000, 0x13a29877, 0x274530ee, 0x34e7a899, 0x4e8a61dc, 0x5d28f9ab,
+      0x69cf5132, 0x7a6dc945, 0x9d14c3b8, 0x8eb65bcf, 0xba51f356, 0xa9f36b21,
+      0xd39ea264, 0xc03c3a13, 0xf4db928a, 0xe7790afd, 0x3fc5f181, 0x2c6769f6,
+      0x1880c16f, 0x0b225918, 0x714f905d, 0x62ed082a, 0x560aa0b3, 0x45a838c4,
+      0xa2d13239, 0xb173aa4e, 0x859402d7, 0x96369aa0, 0xec5b53e5, 0xfff9cb92,
+      0xcb1e630b, 0xd8bcfb7c, 0x7f8be302, 0x6c297b75, 0x58ced3ec, 0x4b6c4b9b,
+      0x310182de, 0x22a31aa9, 0x1644b230, 0x05e62a47, 0xe29f20ba, 0xf13db8cd,
+      0xc5da1054, 0xd6788823, 0xac154166, 0xbfb7d911, 0x8b507188, 0x98f2e9ff,
+      0x404e1283, 0x53ec8af4, 0x670b226d, 0x74a9ba1a, 0x0ec4735f, 0x1d66eb28,
+      0x298143b1, 0x3a23dbc6, 0xdd5ad13b, 0xcef8494c, 0xfa1fe1d5, 0xe9bd79a2,
+      0x93d0b0e7, 0x80722890, 0xb4958009, 0xa737187e, 0xff17c604, 0xecb55e73,
+      0xd852f6ea, 0xcbf06e9d, 0xb19da7d8, 0xa23f3faf, 0x96d89736, 0x857a0f41,
+      0x620305bc, 0x71a19dcb, 0x45463552, 0x56e4ad25, 0x2c896460, 0x3f2bfc17,
+      0x0bcc548e, 0x186eccf9, 0xc0d23785, 0xd370aff2, 0xe797076b, 0xf4359f1c,
+      0x8e585659, 0x9dface2e, 0xa91d66b7, 0xbabffec0, 0x5dc6f43d, 0x4e646c4a,
+      0x7a83c4d3, 0x69215ca4, 0x134c95e1, 0x00ee0d96, 0x3409a50f, 0x27ab3d78,
+      0x809c2506, 0x933ebd71, 0xa7d915e8, 0xb47b8d9f, 0xce1644da, 0xddb4dcad,
+      0xe9537434, 0xfaf1ec43, 0x1d88e6be, 0x0e2a7ec9, 0x3acdd650, 0x296f4e27,
+      0x53028762, 0x40a01f15, 0x7447b78c, 0x67e52ffb, 0xbf59d487, 0xacfb4cf0,
+      0x981ce469, 0x8bbe7c1e, 0xf1d3b55b, 0xe2712d2c, 0xd69685b5, 0xc5341dc2,
+      0x224d173f, 0x31ef8f48, 0x050827d1, 0x16aabfa6, 0x6cc776e3, 0x7f65ee94,
+      0x4b82460d, 0x5820de7a, 0xfbc3faf9, 0xe861628e, 0xdc86ca17, 0xcf245260,
+      0xb5499b25, 0xa6eb0352, 0x920cabcb, 0x81ae33bc, 0x66d73941, 0x7575a136,
+      0x419209af, 0x523091d8, 0x285d589d, 0x3bffc0ea, 0x0f186873, 0x1cbaf004,
+      0xc4060b78, 0xd7a4930f, 0xe3433b96, 0xf0e1a3e1, 0x8a8c6aa4, 0x992ef2d3,
+      0xadc95a4a, 0xbe6bc23d, 0x5912c8c0, 0x4ab050b7, 0x7e57f82e, 0x6df56059,
+      0x1798a91c, 0x043a316b, 0x30dd99f2, 0x237f0185, 0x844819fb, 0x97ea818c,
+      0xa30d2915, 0xb0afb162, 0xcac27827, 0xd960e050, 0xed8748c9, 0xfe25d0be,
+      0x195cda43, 0x0afe4234, 0x3e19eaad, 0x2dbb72da, 0x57d6bb9f, 0x447423e8,
+      0x70938b71, 0x63311306, 0xbb8de87a, 0xa82f700d, 0x9cc8d894, 0x8f6a40e3,
+      0xf50789a6, 0xe6a511d1, 0xd242b948, 0xc1e0213f, 0x26992bc2, 0x353bb3b5,
+      0x01dc1b2c, 0x127e835b, 0x68134a1e, 0x7bb1d269, 0x4f567af0, 0x5cf4e287,
+      0x04d43cfd, 0x1776a48a, 0x23910c13, 0x30339464, 0x4a5e5d21, 0x59fcc556,
+      0x6d1b6dcf, 0x7eb9f5b8, 0x99c0ff45, 0x8a626732, 0xbe85cfab, 0xad2757dc,
+      0xd74a9e99, 0xc4e806ee, 0xf00fae77, 0xe3ad3600, 0x3b11cd7c, 0x28b3550b,
+      0x1c54fd92, 0x0ff665e5, 0x759baca0, 0x663934d7, 0x52de9c4e, 0x417c0439,
+      0xa6050ec4, 0xb5a796b3, 0x81403e2a, 0x92e2a65d, 0xe88f6f18, 0xfb2df76f,
+      0xcfca5ff6, 0xdc68c781, 0x7b5fdfff, 0x68fd4788, 0x5c1aef11, 0x4fb87766,
+      0x35d5be23, 0x26772654, 0x12908ecd, 0x013216ba, 0xe64b1c47, 0xf5e98430,
+      0xc10e2ca9, 0xd2acb4de, 0xa8c17d9b, 0xbb63e5ec, 0x8f844d75, 0x9c26d502,
+      0x449a2e7e, 0x5738b609, 0x63df1e90, 0x707d86e7, 0x0a104fa2, 0x19b2d7d5,
+      0x2d557f4c, 0x3ef7e73b, 0xd98eedc6, 0xca2c75b1, 0xfecbdd28, 0xed69455f,
+      0x97048c1a, 0x84a6146d, 0xb041bcf4, 0xa3e32483
+    },
+    {
+      0x00000000, 0xa541927e, 0x4f6f520d, 0xea2ec073, 0x9edea41a, 0x3b9f3664,
+      0xd1b1f617, 0x74f06469, 0x38513ec5, 0x9d10acbb, 0x773e6cc8, 0xd27ffeb6,
+      0xa68f9adf, 0x03ce08a1, 0xe9e0c8d2, 0x4ca15aac, 0x70a27d8a, 0xd5e3eff4,
+      0x3fcd2f87, 0x9a8cbdf9, 0xee7cd990, 0x4b3d4bee, 0xa1138b9d, 0x045219e3,
+      0x48f3434f, 0xedb2d131, 0x079c1142, 0xa2dd833c, 0xd62de755, 0x736c752b,
+      0x9942b558, 0x3c032726, 0xe144fb14, 0x4405696a, 0xae2ba919, 0x0b6a3b67,
+      0x7f9a5f0e, 0xdadbcd70, 0x30f50d03, 0x95b49f7d, 0xd915c5d1, 0x7c5457af,
+      0x967a97dc, 0x333b05a2, 0x47cb61cb, 0xe28af3b5, 0x08a433c6, 0xade5a1b8,
+      0x91e6869e, 0x34a714e0, 0xde89d493, 0x7bc846ed, 0x0f382284, 0xaa79b0fa,
+      0x40577089, 0xe516e2f7, 0xa9b7b85b, 0x0cf62a25, 0xe6d8ea56, 0x43997828,
+      0x37691c41, 0x92288e3f, 0x78064e4c, 0xdd47dc32, 0xc76580d9, 0x622412a7,
+      0x880ad2d4, 0x2d4b40aa, 0x59bb24c3, 0xfcfab6bd, 0x16d476ce, 0xb395e4b0,
+      0xff34be1c, 0x5a752c62, 0xb05bec11, 0x151a7e6f, 0x61ea1a06, 0xc4ab8878,
+      0x2e85480b, 0x8bc4da75, 0xb7c7fd53, 0x12866f2d, 0xf8a8af5e, 0x5de93d20,
+      0x29195949, 0x8c58cb37, 0x66760b44, 0xc337993a, 0x8f96c396, 0x2ad751e8,
+      0xc0f9919b, 0x65b803e5, 0x1148678c, 0xb409f5f2, 0x5e273581, 0xfb66a7ff,
+      0x26217bcd, 0x8360e9b3, 0x694e29c0, 0xcc0fbbbe, 0xb8ffdfd7, 0x1dbe4da9,
+      0xf7908dda, 0x52d11fa4, 0x1e704508, 0xbb31d776, 0x511f1705, 0xf45e857b,
+      0x80aee112, 0x25ef736c, 0xcfc1b31f, 0x6a802161, 0x56830647, 0xf3c29439,
+      0x19ec544a, 0xbcadc634, 0xc85da25d, 0x6d1c3023, 0x8732f050, 0x2273622e,
+      0x6ed23882, 0xcb93aafc, 0x21bd6a8f, 0x84fcf8f1, 0xf00c9c98, 0x554d0ee6,
+      0xbf63ce95, 0x1a225ceb, 0x8b277743, 0x2e66e53d, 0xc448254e, 0x6109b730,
+      0x15f9d359, 0xb0b84127, 0x5a968154, 0xffd7132a, 0xb3764986, 0x1637dbf8,
+      0xfc191b8b, 0x595889f5, 0x2da8ed9c, 0x88e97fe2, 0x62c7bf91, 0xc7862def,
+      0xfb850ac9, 0x5ec498b7, 0xb4ea58c4, 0x11abcaba, 0x655baed3, 0xc01a3cad,
+      0x2a34fcde, 0x8f756ea0, 0xc3d4340c, 0x6695a672, 0x8cbb6601, 0x29faf47f,
+      0x5d0a9016, 0xf84b0268, 0x1265c21b, 0xb7245065, 0x6a638c57, 0xcf221e29,
+      0x250cde5a, 0x804d4c24, 0xf4bd284d, 0x51fcba33, 0xbbd27a40, 0x1e93e83e,
+      0x5232b292, 0xf77320ec, 0x1d5de09f, 0xb81c72e1, 0xccec1688, 0x69ad84f6,
+      0x83834485, 0x26c2d6fb, 0x1ac1f1dd, 0xbf8063a3, 0x55aea3d0, 0xf0ef31ae,
+      0x841f55c7, 0x215ec7b9, 0xcb7007ca, 0x6e3195b4, 0x2290cf18, 0x87d15d66,
+      0x6dff9d15, 0xc8be0f6b, 0xbc4e6b02, 0x190ff97c, 0xf321390f, 0x5660ab71,
+      0x4c42f79a, 0xe90365e4, 0x032da597, 0xa66c37e9, 0xd29c5380, 0x77ddc1fe,
+      0x9df3018d, 0x38b293f3, 0x7413c95f, 0xd1525b21, 0x3b7c9b52, 0x9e3d092c,
+      0xeacd6d45, 0x4f8cff3b, 0xa5a23f48, 0x00e3ad36, 0x3ce08a10, 0x99a1186e,
+      0x738fd81d, 0xd6ce4a63, 0xa23e2e0a, 0x077fbc74, 0xed517c07, 0x4810ee79,
+      0x04b1b4d5, 0xa1f026ab, 0x4bdee6d8, 0xee9f74a6, 0x9a6f10cf, 0x3f2e82b1,
+      0xd50042c2, 0x7041d0bc, 0xad060c8e, 0x08479ef0, 0xe2695e83, 0x4728ccfd,
+      0x33d8a894, 0x96993aea, 0x7cb7fa99, 0xd9f668e7, 0x9557324b, 0x3016a035,
+      0xda386046, 0x7f79f238, 0x0b899651, 0xaec8042f, 0x44e6c45c, 0xe1a75622,
+      0xdda47104, 0x78e5e37a, 0x92cb2309, 0x378ab177, 0x437ad51e, 0xe63b4760,
+      0x0c158713, 0xa954156d, 0xe5f54fc1, 0x40b4ddbf, 0xaa9a1dcc, 0x0fdb8fb2,
+      0x7b2bebdb, 0xde6a79a5, 0x3444b9d6, 0x91052ba8
+    },
+    {
+      0x00000000, 0xdd45aab8, 0xbf672381, 0x62228939, 0x7b2231f3, 0xa6679b4b,
+      0xc4451272, 0x1900b8ca, 0xf64463e6, 0x2b01c95e, 0x49234067, 0x9466eadf,
+      0x8d665215, 0x5023f8ad, 0x32017194, 0xef44db2c, 0xe964b13d, 0x34211b85,
+      0x560392bc, 0x8b463804, 0x924680ce, 0x4f032a76, 0x2d21a34f, 0xf06409f7,
+      0x1f20d2db, 0xc2657863, 0xa047f15a, 0x7d025be2, 0x6402e328, 0xb9474990,
+      0xdb65c0a9, 0x06206a11, 0xd725148b, 0x0a60be33, 0x6842370a, 0xb5079db2,
+      0xac072578, 0x71428fc0, 0x136006f9, 0xce25ac41, 0x2161776d, 0xfc24ddd5,
+      0x9e0654ec, 0x4343fe54, 0x5a43469e, 0x8706ec26, 0xe524651f, 0x3861cfa7,
+      0x3e41a5b6, 0xe3040f0e, 0x81268637, 0x5c632c8f, 0x45639445, 0x98263efd,
+      0xfa04b7c4, 0x27411d7c, 0xc805c650, 0x15406ce8, 0x7762e5d1, 0xaa274f69,
+      0xb327f7a3, 0x6e625d1b, 0x0c40d422, 0xd1057e9a, 0xaba65fe7, 0x76e3f55f,
+      0x14c17c66, 0xc984d6de, 0xd0846e14, 0x0dc1c4ac, 0x6fe34d95, 0xb2a6e72d,
+      0x5de23c01, 0x80a796b9, 0xe2851f80, 0x3fc0b538, 0x26c00df2, 0xfb85a74a,
+      0x99a72e73, 0x44e284cb, 0x42c2eeda, 0x9f874462, 0xfda5cd5b, 0x20e067e3,
+      0x39e0df29, 0xe4a57591, 0x8687fca8, 0x5bc25610, 0xb4868d3c, 0x69c32784,
+      0x0be1aebd, 0xd6a40405, 0xcfa4bccf, 0x12e11677, 0x70c39f4e, 0xad8635f6,
+      0x7c834b6c, 0xa1c6e1d4, 0xc3e468ed, 0x1ea1c255, 0x07a17a9f, 0xdae4d027,
+      0xb8c6591e, 0x6583f3a6, 0x8ac7288a, 0x57828232, 0x35a00b0b, 0xe8e5a1b3,
+      0xf1e51979, 0x2ca0b3c1, 0x4e823af8, 0x93c79040, 0x95e7fa51, 0x48a250e9,
+      0x2a80d9d0, 0xf7c57368, 0xeec5cba2, 0x3380611a, 0x51a2e823, 0x8ce7429b,
+      0x63a399b7, 0xbee6330f, 0xdcc4ba36, 0x0181108e, 0x1881a844, 0xc5c402fc,
+      0xa7e68bc5, 0x7aa3217d, 0x52a0c93f, 0x8fe56387, 0xedc7eabe, 0x30824006,
+      0x2982f8cc, 0xf4c75274, 0x96e5db4d, 0x4ba071f5, 0xa4e4aad9, 0x79a10061,
+      0x1b838958, 0xc6c623e0, 0xdfc69b2a, 0x02833192, 0x60a1b8ab, 0xbde41213,
+      0xbbc47802, 0x6681d2ba, 0x04a35b83, 0xd9e6f13b, 0xc0e649f1, 0x1da3e349,
+      0x7f816a70, 0xa2c4c0c8, 0x4d801be4, 0x90c5b15c, 0xf2e73865, 0x2fa292dd,
+      0x36a22a17, 0xebe780af, 0x89c50996, 0x5480a32e, 0x8585ddb4, 0x58c0770c,
+      0x3ae2fe35, 0xe7a7548d, 0xfea7ec47, 0x23e246ff, 0x41c0cfc6, 0x9c85657e,
+      0x73c1be52, 0xae8414ea, 0xcca69dd3, 0x11e3376b, 0x08e38fa1, 0xd5a62519,
+      0xb784ac20, 0x6ac10698, 0x6ce16c89, 0xb1a4c631, 0xd3864f08, 0x0ec3e5b0,
+      0x17c35d7a, 0xca86f7c2, 0xa8a47efb, 0x75e1d443, 0x9aa50f6f, 0x47e0a5d7,
+      0x25c22cee, 0xf8878656, 0xe1873e9c, 0x3cc29424, 0x5ee01d1d, 0x83a5b7a5,
+      0xf90696d8, 0x24433c60, 0x4661b559, 0x9b241fe1, 0x8224a72b, 0x5f610d93,
+      0x3d4384aa, 0xe0062e12, 0x0f42f53e, 0xd2075f86, 0xb025d6bf, 0x6d607c07,
+      0x7460c4cd, 0xa9256e75, 0xcb07e74c, 0x16424df4, 0x106227e5, 0xcd278d5d,
+      0xaf050464, 0x7240aedc, 0x6b401616, 0xb605bcae, 0xd4273597, 0x09629f2f,
+      0xe6264403, 0x3b63eebb, 0x59416782, 0x8404cd3a, 0x9d0475f0, 0x4041df48,
+      0x22635671, 0xff26fcc9, 0x2e238253, 0xf36628eb, 0x9144a1d2, 0x4c010b6a,
+      0x5501b3a0, 0x88441918, 0xea669021, 0x37233a99, 0xd867e1b5, 0x05224b0d,
+      0x6700c234, 0xba45688c, 0xa345d046, 0x7e007afe, 0x1c22f3c7, 0xc167597f,
+      0xc747336e, 0x1a0299d6, 0x782010ef, 0xa565ba57, 0xbc65029d, 0x6120a825,
+      0x0302211c, 0xde478ba4, 0x31035088, 0xec46fa30, 0x8e647309, 0x5321d9b1,
+      0x4a21617b, 0x9764cbc3, 0xf54642fa, 0x2803e842
+    },
+    {
+      0x00000000, 0x38116fac, 0x7022df58, 0x4833b0f4, 0xe045beb0, 0xd854d11c,
+      0x906761e8, 0xa8760e44, 0xc5670b91, 0xfd76643d, 0xb545d4c9, 0x8d54bb65,
+      0x2522b521, 0x1d33da8d, 0x55006a79, 0x6d1105d5, 0x8f2261d3, 0xb7330e7f,
+      0xff00be8b, 0xc711d127, 0x6f67df63, 0x5776b0cf, 0x1f45003b, 0x27546f97,
+      0x4a456a42, 0x725405ee, 0x3a67b51a, 0x0276dab6, 0xaa00d4f2, 0x9211bb5e,
+      0xda220baa, 0xe2336406, 0x1ba8b557, 0x23b9dafb, 0x6b8a6a0f, 0x539b05a3,
+      0xfbed0be7, 0xc3fc644b, 0x8bcfd4bf, 0xb3debb13, 0xdecfbec6, 0xe6ded16a,
+      0xaeed619e, 0x96fc0e32, 0x3e8a0076, 0x069b6fda, 0x4ea8df2e, 0x76b9b082,
+      0x948ad484, 0xac9bbb28, 0xe4a80bdc, 0xdcb96470, 0x74cf6a34, 0x4cde0598,
+      0x04edb56c, 0x3cfcdac0, 0x51eddf15, 0x69fcb0b9, 0x21cf004d, 0x19de6fe1,
+      0xb1a861a5, 0x89b90e09, 0xc18abefd, 0xf99bd151, 0x37516aae, 0x0f400502,
+      0x4773b5f6, 0x7f62da5a, 0xd714d41e, 0xef05bbb2, 0xa7360b46, 0x9f2764ea,
+      0xf236613f, 0xca270e93, 0x8214be67, 0xba05d1cb, 0x1273df8f, 0x2a62b023,
+      0x625100d7, 0x5a406f7b, 0xb8730b7d, 0x806264d1, 0xc851d425, 0xf040bb89,
+      0x5836b5cd, 0x6027da61, 0x28146a95, 0x10050539, 0x7d1400ec, 0x45056f40,
+      0x0d36dfb4, 0x3527b018, 0x9d51be5c, 0xa540d1f0, 0xed736104, 0xd5620ea8,
+      0x2cf9dff9, 0x14e8b055, 0x5cdb00a1, 0x64ca6f0d, 0xccbc6149, 0xf4ad0ee5,
+      0xbc9ebe11, 0x848fd1bd, 0xe99ed468, 0xd18fbbc4, 0x99bc0b30, 0xa1ad649c,
+      0x09db6ad8, 0x31ca0574, 0x79f9b580, 0x41e8da2c, 0xa3dbbe2a, 0x9bcad186,
+      0xd3f96172, 0xebe80ede, 0x439e009a, 0x7b8f6f36, 0x33bcdfc2, 0x0badb06e,
+      0x66bcb5bb, 0x5eadda17, 0x169e6ae3, 0x2e8f054f, 0x86f90b0b, 0xbee864a7,
+      0xf6dbd453, 0xcecabbff, 0x6ea2d55c, 0x56b3baf0, 0x1e800a04, 0x269165a8,
+      0x8ee76bec, 0xb6f60440, 0xfec5b4b4, 0xc6d4db18, 0xabc5decd, 0x93d4b161,
+      0xdbe70195, 0xe3f66e39, 0x4b80607d, 0x73910fd1, 0x3ba2bf25, 0x03b3d089,
+      0xe180b48f, 0xd991db23, 0x91a26bd7, 0xa9b3047b, 0x01c50a3f, 0x39d46593,
+      0x71e7d567, 0x49f6bacb, 0x24e7bf1e, 0x1cf6d0b2, 0x54c56046, 0x6cd40fea,
+      0xc4a201ae, 0xfcb36e02, 0xb480def6, 0x8c91b15a, 0x750a600b, 0x4d1b0fa7,
+      0x0528bf53, 0x3d39d0ff, 0x954fdebb, 0xad5eb117, 0xe56d01e3, 0xdd7c6e4f,
+      0xb06d6b9a, 0x887c0436, 0xc04fb4c2, 0xf85edb6e, 0x5028d52a, 0x6839ba86,
+      0x200a0a72, 0x181b65de, 0xfa2801d8, 0xc2396e74, 0x8a0ade80, 0xb21bb12c,
+      0x1a6dbf68, 0x227cd0c4, 0x6a4f6030, 0x525e0f9c, 0x3f4f0a49, 0x075e65e5,
+      0x4f6dd511, 0x777cbabd, 0xdf0ab4f9, 0xe71bdb55, 0xaf286ba1, 0x9739040d,
+      0x59f3bff2, 0x61e2d05e, 0x29d160aa, 0x11c00f06, 0xb9b60142, 0x81a76eee,
+      0xc994de1a, 0xf185b1b6, 0x9c94b463, 0xa485dbcf, 0xecb66b3b, 0xd4a70497,
+      0x7cd10ad3, 0x44c0657f, 0x0cf3d58b, 0x34e2ba27, 0xd6d1de21, 0xeec0b18d,
+      0xa6f30179, 0x9ee26ed5, 0x36946091, 0x0e850f3d, 0x46b6bfc9, 0x7ea7d065,
+      0x13b6d5b0, 0x2ba7ba1c, 0x63940ae8, 0x5b856544, 0xf3f36b00, 0xcbe204ac,
+      0x83d1b458, 0xbbc0dbf4, 0x425b0aa5, 0x7a4a6509, 0x3279d5fd, 0x0a68ba51,
+      0xa21eb415, 0x9a0fdbb9, 0xd23c6b4d, 0xea2d04e1, 0x873c0134, 0xbf2d6e98,
+      0xf71ede6c, 0xcf0fb1c0, 0x6779bf84, 0x5f68d028, 0x175b60dc, 0x2f4a0f70,
+      0xcd796b76, 0xf56804da, 0xbd5bb42e, 0x854adb82, 0x2d3cd5c6, 0x152dba6a,
+      0x5d1e0a9e, 0x650f6532, 0x081e60e7, 0x300f0f4b, 0x783cbfbf, 0x402dd013,
+      0xe85bde57, 0xd04ab1fb, 0x9879010f, 0xa0686ea3
+    },
+    {
+      0x00000000, 0xef306b19, 0xdb8ca0c3, 0x34bccbda, 0xb2f53777, 0x5dc55c6e,
+      0x697997b4, 0x8649fcad, 0x6006181f, 0x8f367306, 0xbb8ab8dc, 0x54bad3c5,
+      0xd2f32f68, 0x3dc34471, 0x097f8fab, 0xe64fe4b2, 0xc00c303e, 0x2f3c5b27,
+      0x1b8090fd, 0xf4b0fbe4, 0x72f90749, 0x9dc96c50, 0xa975a78a, 0x4645cc93,
+      0xa00a2821, 0x4f3a4338, 0x7b8688e2, 0x94b6e3fb, 0x12ff1f56, 0xfdcf744f,
+      0xc973bf95, 0x2643d48c, 0x85f4168d, 0x6ac47d94, 0x5e78b64e, 0xb148dd57,
+      0x370121fa, 0xd8314ae3, 0xec8d8139, 0x03bdea20, 0xe5f20e92, 0x0ac2658b,
+      0x3e7eae51, 0xd14ec548, 0x570739e5, 0xb83752fc, 0x8c8b9926, 0x63bbf23f,
+      0x45f826b3, 0xaac84daa, 0x9e748670, 0x7144ed69, 0xf70d11c4, 0x183d7add,
+      0x2c81b107, 0xc3b1da1e, 0x25fe3eac, 0xcace55b5, 0xfe729e6f, 0x1142f576,
+      0x970b09db, 0x783b62c2, 0x4c87a918, 0xa3b7c201, 0x0e045beb, 0xe13430f2,
+      0xd588fb28, 0x3ab89031, 0xbcf16c9c, 0x53c10785, 0x677dcc5f, 0x884da746,
+      0x6e0243f4, 0x813228ed, 0xb58ee337, 0x5abe882e, 0xdcf77483, 0x33c71f9a,
+      0x077bd440, 0xe84bbf59, 0xce086bd5, 0x213800cc, 0x1584cb16, 0xfab4a00f,
+      0x7cfd5ca2, 0x93cd37bb, 0xa771fc61, 0x48419778, 0xae0e73ca, 0x413e18d3,
+      0x7582d309, 0x9ab2b810, 0x1cfb44bd, 0xf3cb2fa4, 0xc777e47e, 0x28478f67,
+      0x8bf04d66, 0x64c0267f, 0x507ceda5, 0xbf4c86bc, 0x39057a11, 0xd6351108,
+      0xe289dad2, 0x0db9b1cb, 0xebf65579, 0x04c63e60, 0x307af5ba, 0xdf4a9ea3,
+      0x5903620e, 0xb6330917, 0x828fc2cd, 0x6dbfa9d4, 0x4bfc7d58, 0xa4cc1641,
+      0x9070dd9b, 0x7f40b682, 0xf9094a2f, 0x16392136, 0x2285eaec, 0xcdb581f5,
+      0x2bfa6547, 0xc4ca0e5e, 0xf076c584, 0x1f46ae9d, 0x990f5230, 0x763f3929,
+      0x4283f2f3, 0xadb399ea, 0x1c08b7d6, 0xf338dccf, 0xc7841715, 0x28b47c0c,
+      0xaefd80a1, 0x41cdebb8, 0x75712062, 0x9a414b7b, 0x7c0eafc9, 0x933ec4d0,
+      0xa7820f0a, 0x48b26413, 0xcefb98be, 0x21cbf3a7, 0x1577387d, 0xfa475364,
+      0xdc0487e8, 0x3334ecf1, 0x0788272b, 0xe8b84c32, 0x6ef1b09f, 0x81c1db86,
+      0xb57d105c, 0x5a4d7b45, 0xbc029ff7, 0x5332f4ee, 0x678e3f34, 0x88be542d,
+      0x0ef7a880, 0xe1c7c399, 0xd57b0843, 0x3a4b635a, 0x99fca15b, 0x76ccca42,
+      0x42700198, 0xad406a81, 0x2b09962c, 0xc439fd35, 0xf08536ef, 0x1fb55df6,
+      0xf9fab944, 0x16cad25d, 0x22761987, 0xcd46729e, 0x4b0f8e33, 0xa43fe52a,
+      0x90832ef0, 0x7fb345e9, 0x59f09165, 0xb6c0fa7c, 0x827c31a6, 0x6d4c5abf,
+      0xeb05a612, 0x0435cd0b, 0x308906d1, 0xdfb96dc8, 0x39f6897a, 0xd6c6e263,
+      0xe27a29b9, 0x0d4a42a0, 0x8b03be0d, 0x6433d514, 0x508f1ece, 0xbfbf75d7,
+      0x120cec3d, 0xfd3c8724, 0xc9804cfe, 0x26b027e7, 0xa0f9db4a, 0x4fc9b053,
+      0x7b757b89, 0x94451090, 0x720af422, 0x9d3a9f3b, 0xa98654e1, 0x46b63ff8,
+      0xc0ffc355, 0x2fcfa84c, 0x1b736396, 0xf443088f, 0xd200dc03, 0x3d30b71a,
+      0x098c7cc0, 0xe6bc17d9, 0x60f5eb74, 0x8fc5806d, 0xbb794bb7, 0x544920ae,
+      0xb206c41c, 0x5d36af05, 0x698a64df, 0x86ba0fc6, 0x00f3f36b, 0xefc39872,
+      0xdb7f53a8, 0x344f38b1, 0x97f8fab0, 0x78c891a9, 0x4c745a73, 0xa344316a,
+      0x250dcdc7, 0xca3da6de, 0xfe816d04, 0x11b1061d, 0xf7fee2af, 0x18ce89b6,
+      0x2c72426c, 0xc3422975, 0x450bd5d8, 0xaa3bbec1, 0x9e87751b, 0x71b71e02,
+      0x57f4ca8e, 0xb8c4a197, 0x8c786a4d, 0x63480154, 0xe501fdf9, 0x0a3196e0,
+      0x3e8d5d3a, 0xd1bd3623, 0x37f2d291, 0xd8c2b988, 0xec7e7252, 0x034e194b,
+      0x8507e5e6, 0x6a378eff, 0x5e8b4525, 0xb1bb2e3c
+    },
+    {
+      0x00000000, 0x68032cc8, 0xd0065990, 0xb8057558, 0xa5e0c5d1, 0xcde3e919,
+      0x75e69c41, 0x1de5b089, 0x4e2dfd53, 0x262ed19b, 0x9e2ba4c3, 0xf628880b,
+      0xebcd3882, 0x83ce144a, 0x3bcb6112, 0x53c84dda, 0x9c5bfaa6, 0xf458d66e,
+      0x4c5da336, 0x245e8ffe, 0x39bb3f77, 0x51b813bf, 0xe9bd66e7, 0x81be4a2f,
+      0xd27607f5, 0xba752b3d, 0x02705e65, 0x6a7372ad, 0x7796c224, 0x1f95eeec,
+      0xa7909bb4, 0xcf93b77c, 0x3d5b83bd, 0x5558af75, 0xed5dda2d, 0x855ef6e5,
+      0x98bb466c, 0xf0b86aa4, 0x48bd1ffc, 0x20be3334, 0x73767eee, 0x1b755226,
+      0xa370277e, 0xcb730bb6, 0xd696bb3f, 0xbe9597f7, 0x0690e2af, 0x6e93ce67,
+      0xa100791b, 0xc90355d3, 0x7106208b, 0x19050c43, 0x04e0bcca, 0x6ce39002,
+      0xd4e6e55a, 0xbce5c992, 0xef2d8448, 0x872ea880, 0x3f2bddd8, 0x5728f110,
+      0x4acd4199, 0x22ce6d51, 0x9acb1809, 0xf2c834c1, 0x7ab7077a, 0x12b42bb2,
+      0xaab15eea, 0xc2b27222, 0xdf57c2ab, 0xb754ee63, 0x0f519b3b, 0x6752b7f3,
+      0x349afa29, 0x5c99d6e1, 0xe49ca3b9, 0x8c9f8f71, 0x917a3ff8, 0xf9791330,
+      0x417c6668, 0x297f4aa0, 0xe6ecfddc, 0x8eefd114, 0x36eaa44c, 0x5ee98884,
+      0x430c380d, 0x2b0f14c5, 0x930a619d, 0xfb094d55, 0xa8c1008f, 0xc0c22c47,
+      0x78c7591f, 0x10c475d7, 0x0d21c55e, 0x6522e996, 0xdd279cce, 0xb524b006,
+      0x47ec84c7, 0x2fefa80f, 0x97eadd57, 0xffe9f19f, 0xe20c4116, 0x8a0f6dde,
+      0x320a1886, 0x5a09344e, 0x09c17994, 0x61c2555c, 0xd9c72004, 0xb1c40ccc,
+      0xac21bc45, 0xc422908d, 0x7c27e5d5, 0x1424c91d, 0xdbb77e61, 0xb3b452a9,
+      0x0bb127f1, 0x63b20b39, 0x7e57bbb0, 0x16549778, 0xae51e220, 0xc652cee8,
+      0x959a8332, 0xfd99affa, 0x459cdaa2, 0x2d9ff66a, 0x307a46e3, 0x58796a2b,
+      0xe07c1f73, 0x887f33bb, 0xf56e0ef4, 0x9d6d223c, 0x25685764, 0x4d6b7bac,
+      0x508ecb25, 0x388de7ed, 0x808892b5, 0xe88bbe7d, 0xbb43f3a7, 0xd340df6f,
+      0x6b45aa37, 0x034686ff, 0x1ea33676, 0x76a01abe, 0xcea56fe6, 0xa6a6432e,
+      0x6935f452, 0x0136d89a, 0xb933adc2, 0xd130810a, 0xccd53183, 0xa4d61d4b,
+      0x1cd36813, 0x74d044db, 0x27180901, 0x4f1b25c9, 0xf71e5091, 0x9f1d7c59,
+      0x82f8ccd0, 0xeafbe018, 0x52fe9540, 0x3afdb988, 0xc8358d49, 0xa036a181,
+      0x1833d4d9, 0x7030f811, 0x6dd54898, 0x05d66450, 0xbdd31108, 0xd5d03dc0,
+      0x8618701a, 0xee1b5cd2, 0x561e298a, 0x3e1d0542, 0x23f8b5cb, 0x4bfb9903,
+      0xf3feec5b, 0x9bfdc093, 0x546e77ef, 0x3c6d5b27, 0x84682e7f, 0xec6b02b7,
+      0xf18eb23e, 0x998d9ef6, 0x2188ebae, 0x498bc766, 0x1a438abc, 0x7240a674,
+      0xca45d32c, 0xa246ffe4, 0xbfa34f6d, 0xd7a063a5, 0x6fa516fd, 0x07a63a35,
+      0x8fd9098e, 0xe7da2546, 0x5fdf501e, 0x37dc7cd6, 0x2a39cc5f, 0x423ae097,
+      0xfa3f95cf, 0x923cb907, 0xc1f4f4dd, 0xa9f7d815, 0x11f2ad4d, 0x79f18185,
+      0x6414310c, 0x0c171dc4, 0xb412689c, 0xdc114454, 0x1382f328, 0x7b81dfe0,
+      0xc384aab8, 0xab878670, 0xb66236f9, 0xde611a31, 0x66646f69, 0x0e6743a1,
+      0x5daf0e7b, 0x35ac22b3, 0x8da957eb, 0xe5aa7b23, 0xf84fcbaa, 0x904ce762,
+      0x2849923a, 0x404abef2, 0xb2828a33, 0xda81a6fb, 0x6284d3a3, 0x0a87ff6b,
+      0x17624fe2, 0x7f61632a, 0xc7641672, 0xaf673aba, 0xfcaf7760, 0x94ac5ba8,
+      0x2ca92ef0, 0x44aa0238, 0x594fb2b1, 0x314c9e79, 0x8949eb21, 0xe14ac7e9,
+      0x2ed97095, 0x46da5c5d, 0xfedf2905, 0x96dc05cd, 0x8b39b544, 0xe33a998c,
+      0x5b3fecd4, 0x333cc01c, 0x60f48dc6, 0x08f7a10e, 0xb0f2d456, 0xd8f1f89e,
+      0xc5144817, 0xad1764df, 0x15121187, 0x7d113d4f
+    },
+    {
+      0x00000000, 0x493c7d27, 0x9278fa4e, 0xdb448769, 0x211d826d, 0x6821ff4a,
+      0xb3657823, 0xfa590504, 0x423b04da, 0x0b0779fd, 0xd043fe94, 0x997f83b3,
+      0x632686b7, 0x2a1afb90, 0xf15e7cf9, 0xb86201de, 0x847609b4, 0xcd4a7493,
+      0x160ef3fa, 0x5f328edd, 0xa56b8bd9, 0xec57f6fe, 0x37137197, 0x7e2f0cb0,
+      0xc64d0d6e, 0x8f717049, 0x5435f720, 0x1d098a07, 0xe7508f03, 0xae6cf224,
+      0x7528754d, 0x3c14086a, 0x0d006599, 0x443c18be, 0x9f789fd7, 0xd644e2f0,
+      0x2c1de7f4, 0x65219ad3, 0xbe651dba, 0xf759609d, 0x4f3b6143, 0x06071c64,
+      0xdd439b0d, 0x947fe62a, 0x6e26e32e, 0x271a9e09, 0xfc5e1960, 0xb5626447,
+      0x89766c2d, 0xc04a110a, 0x1b0e9663, 0x5232eb44, 0xa86bee40, 0xe1579367,
+      0x3a13140e, 0x732f6929, 0xcb4d68f7, 0x827115d0, 0x593592b9, 0x1009ef9e,
+      0xea50ea9a, 0xa36c97bd, 0x782810d4, 0x31146df3, 0x1a00cb32, 0x533cb615,
+      0x8878317c, 0xc1444c5b, 0x3b1d495f, 0x72213478, 0xa965b311, 0xe059ce36,
+      0x583bcfe8, 0x1107b2cf, 0xca4335a6, 0x837f4881, 0x79264d85, 0x301a30a2,
+      0xeb5eb7cb, 0xa262caec, 0x9e76c286, 0xd74abfa1, 0x0c0e38c8, 0x453245ef,
+      0xbf6b40eb, 0xf6573dcc, 0x2d13baa5, 0x642fc782, 0xdc4dc65c, 0x9571bb7b,
+      0x4e353c12, 0x07094135, 0xfd504431, 0xb46c3916, 0x6f28be7f, 0x2614c358,
+      0x1700aeab, 0x5e3cd38c, 0x857854e5, 0xcc4429c2, 0x361d2cc6, 0x7f2151e1,
+      0xa465d688, 0xed59abaf, 0x553baa71, 0x1c07d756, 0xc743503f, 0x8e7f2d18,
+      0x7426281c, 0x3d1a553b, 0xe65ed252, 0xaf62af75, 0x9376a71f, 0xda4ada38,
+      0x010e5d51, 0x48322076, 0xb26b2572, 0xfb575855, 0x2013df3c, 0x692fa21b,
+      0xd14da3c5, 0x9871dee2, 0x4335598b, 0x0a0924ac, 0xf05021a8, 0xb96c5c8f,
+      0x6228dbe6, 0x2b14a6c1, 0x34019664, 0x7d3deb43, 0xa6796c2a, 0xef45110d,
+      0x151c1409, 0x5c20692e, 0x8764ee47, 0xce589360, 0x763a92be, 0x3f06ef99,
+      0xe44268f0, 0xad7e15d7, 0x572710d3, 0x1e1b6df4, 0xc55fea9d, 0x8c6397ba,
+      0xb0779fd0, 0xf94be2f7, 0x220f659e, 0x6b3318b9, 0x916a1dbd, 0xd856609a,
+      0x0312e7f3, 0x4a2e9ad4, 0xf24c9b0a, 0xbb70e62d, 0x60346144, 0x29081c63,
+      0xd3511967, 0x9a6d6440, 0x4129e329, 0x08159e0e, 0x3901f3fd, 0x703d8eda,
+      0xab7909b3, 0xe2457494, 0x181c7190, 0x51200cb7, 0x8a648bde, 0xc358f6f9,
+      0x7b3af727, 0x32068a00, 0xe9420d69, 0xa07e704e, 0x5a27754a, 0x131b086d,
+      0xc85f8f04, 0x8163f223, 0xbd77fa49, 0xf44b876e, 0x2f0f0007, 0x66337d20,
+      0x9c6a7824, 0xd5560503, 0x0e12826a, 0x472eff4d, 0xff4cfe93, 0xb67083b4,
+      0x6d3404dd, 0x240879fa, 0xde517cfe, 0x976d01d9, 0x4c2986b0, 0x0515fb97,
+      0x2e015d56, 0x673d2071, 0xbc79a718, 0xf545da3f, 0x0f1cdf3b, 0x4620a21c,
+      0x9d642575, 0xd4585852, 0x6c3a598c, 0x250624ab, 0xfe42a3c2, 0xb77edee5,
+      0x4d27dbe1, 0x041ba6c6, 0xdf5f21af, 0x96635c88, 0xaa7754e2, 0xe34b29c5,
+      0x380faeac, 0x7133d38b, 0x8b6ad68f, 0xc256aba8, 0x19122cc1, 0x502e51e6,
+      0xe84c5038, 0xa1702d1f, 0x7a34aa76, 0x3308d751, 0xc951d255, 0x806daf72,
+      0x5b29281b, 0x1215553c, 0x230138cf, 0x6a3d45e8, 0xb179c281, 0xf845bfa6,
+      0x021cbaa2, 0x4b20c785, 0x906440ec, 0xd9583dcb, 0x613a3c15, 0x28064132,
+      0xf342c65b, 0xba7ebb7c, 0x4027be78, 0x091bc35f, 0xd25f4436, 0x9b633911,
+      0xa777317b, 0xee4b4c5c, 0x350fcb35, 0x7c33b612, 0x866ab316, 0xcf56ce31,
+      0x14124958, 0x5d2e347f, 0xe54c35a1, 0xac704886, 0x7734cfef, 0x3e08b2c8,
+      0xc451b7cc, 0x8d6dcaeb, 0x56294d82, 0x1f1530a5
+    }
+  }
+};
+
+static uint32_t crcSlice8( const uint32_t (*t)[256], uint32_t crc, const uint8_t *q, size_t n )
+{
+  crc = ~crc;
+  for( ; n >= 8; n -= 8, q += 8 ){
+    uint32_t lo = load32le(q) ^ crc, hi = load32le(q + 4);
+    crc = t[7][lo & 0xff] ^ t[6][lo >> 8 & 0xff] ^ t[5][lo >> 16 & 0xff] ^ t[4][lo >> 24] ^
+      t[3][hi & 0xff] ^ t[2][hi >> 8 & 0xff] ^ t[1][hi >> 16 & 0xff] ^ t[0][hi >> 24];
+  }
+  for( ; n > 0; --n ) crc = crc >> 8 ^ t[0][(crc ^ *q++) & 0xff];
+  return ~crc;
+}
+
+static uint32_t crc32( uint32_t crc, const uint8_t *q, size_t n )
+{
+  return crcSlice8(crc_tables[0], crc, q, n);
+}
+
+#ifdef BYTEARRAY_SIMD_X86
+__attribute__((target("sse4.2")))
+static uint32_t crc32cSSE42( uint32_t crc, const uint8_t *q, size_t n )
+{
+  crc = ~crc;
+#ifdef __x86_64__
+  uint64_t c = crc;
+  for( ; n >= 8; n -= 8, q += 8 ){
+    uint64_t x;
+    memcpy( &x, q, sizeof(x) );
+    c = _mm_crc32_u64( c, x );
+  }
+  crc = (uint32_t)c;
+#endif
+  for( ; n >= 4; n -= 4, q += 4 ){
+    uint32_t x;
+    memcpy( &x, q, sizeof(x) );
+    crc = _mm_crc32_u32( crc, x );
+  }
+  for( ; n > 0; --n ) crc = _mm_crc32_u8( crc, *q++ );
+  return ~crc;
+}
+#endif//BYTEARRAY_SIMD_X86
+
+static uint32_t crc32c( uint32_t crc, const uint8_t *q, size_t n )
+{
+#ifdef BYTEARRAY_SIMD_X86
+  if( __builtin_cpu_supports("sse4.2") ) return crc32cSSE42(crc, q, n);
+#endif
+  return crcSlice8(crc_tables[1], crc, q, n);
+}
+
+static uint32_t adler32( uint32_t adler, const uint8_t *q, size_t n )
+{
+  uint32_t a = adler & 0xffff, b = adler >> 16;
+  while( n > 0 ){
+    size_t k = n < ADLER_NMAX ? n : ADLER_NMAX;
+    n -= k;
+    for( ; k >= 8; k -= 8, q += 8 ){
+      a += q[0]; b += a;
+      a += q[1]; b += a;
+      a += q[2]; b += a;
+      a += q[3]; b += a;
+      a += q[4]; b += a;
+      a += q[5]; b += a;
+      a += q[6]; b += a;
+      a += q[7]; b += a;
+    }
+    for( ; k > 0; --k ){
+      a += *q++;
+      b += a;
+    }
+    a %= ADLER_BASE;
+    b %= ADLER_BASE;
+  }
+  return b << 16 | a;
+}
+
+#define XXH_PRIME64_1 0x9e3779b185ebca87ull
+#define XXH_PRIME64_2 0xc2b2ae3d27d4eb4full
+#define XXH_PRIME64_3 0x165667b19e3779f9ull
+#define XXH_PRIME64_4 0x85ebca77c2b2ae63ull
+#define XXH_PRIME64_5 0x27d4eb2f165667c5ull
+
+static inline uint64_t rotl64( uint64_t x, int r )
+{
+  return x << r | x >> (64 - r);
+}
+
+static inline uint64_t xxh64Round( uint64_t v, uint64_t x )
+{
+  return rotl64(v + x * XXH_PRIME64_2, 31) * XXH_PRIME64_1;
+}
+
+static inline uint64_t xxh64Merge( uint64_t h, uint64_t v )
+{
+  return (h ^ xxh64Round(0, v)) * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+// XXH64, the seed starts a new hash rather than continuing one
+static uint64_t xxh64( const uint8_t *q, size_t n, uint64_t seed )
+{
+  const uint8_t *end = q + n;
+  uint64_t h;
+  if( n >= 32 ){
+    uint64_t v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2, v2 = seed + XXH_PRIME64_2;
+    uint64_t v3 = seed, v4 = seed - XXH_PRIME64_1;
+    for( ; q + 32 <= end; q += 32 ){
+      v1 = xxh64Round(v1, load64le(q));
+      v2 = xxh64Round(v2, load64le(q + 8));
+      v3 = xxh64Round(v3, load64le(q + 16));
+      v4 = xxh64Round(v4, load64le(q + 24));
+    }
+    h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+    h = xxh64Merge(h, v1);
+    h = xxh64Merge(h, v2);
+    h = xxh64Merge(h, v3);
+    h = xxh64Merge(h, v4);
+  }
+  else h = seed + XXH_PRIME64_5;
+  h += (uint64_t)n;
+  for( ; q + 8 <= end; q += 8 ) h = rotl64(h ^ xxh64Round(0, load64le(q)), 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+  if( q + 4 <= end ){
+    h = rotl64(h ^ (uint64_t)load32le(q) * XXH_PRIME64_1, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+    q += 4;
+  }
+  for( ; q < end; ++q ) h = rotl64(h ^ *q * XXH_PRIME64_5, 11) * XXH_PRIME64_1;
+  h ^= h >> 33;
+  h *= XXH_PRIME64_2;
+  h ^= h >> 29;
+  h *= XXH_PRIME64_3;
+  h ^= h >> 32;
+  return h;
+}
+
+// ------------ searching ---------------
+// memchr finds single bytes. Longer needles compare their first and last
+// byte against 16 / 32 positions at once and memcmp only the candidates.
+
+static const uint8_t* findBytesScalar( const uint8_t *s, size_t n, const uint8_t *k, size_t m )
+{
+  if( m > n ) return NULL;
+  const uint8_t *end = s + n - m + 1;
+  while( s < end ){
+    s = memchr( s, k[0], end - s );
+    if( s == NULL ) return NULL;
+    if( s[m-1] == k[m-1] && memcmp(s + 1, k + 1, m - 2) == 0 ) return s;
+    ++s;
+  }
+  return NULL;
+}
+
+#ifdef BYTEARRAY_SIMD_X86
+__attribute__((target("sse2")))
+static const uint8_t* findBytesSSE2( const uint8_t *s, size_t n, const uint8_t *k, size_t m )
+{
+  __m128i first = _mm_set1_epi8( (char)k[0] );
+  __m128i last = _mm_set1_epi8( (char)k[m-1] );
+  size_t i = 0;
+  for( ; i + m - 1 + 16 <= n; i += 16 ){
+    __m128i a = _mm_loadu_si128( (const __m128i*)(s + i) );
+    __m128i b = _mm_loadu_si128( (const __m128i*)(s + i + m - 1) );
+    unsigned mask = _mm_movemask_epi8( _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)) );
+    for( ; mask != 0; mask &= mask - 1 ){
+      const uint8_t *q = s + i + __builtin_ctz(mask);
+      if( memcmp(q + 1, k + 1, m - 2) == 0 ) return q;
+    }
+  }
+  return findBytesScalar( s + i, n - i, k, m );
+}
+
+__attribute__((target("avx2")))
+static const uint8_t* findBytesAVX2( const uint8_t *s, size_t n, const uint8_t *k, size_t m )
+{
+  __m256i first = _mm256_set1_epi8( (char)k[0] );
+  __m256i last = _mm256_set1_epi8( (char)k[m-1] );
+  size_t i = 0;
+  for( ; i + m - 1 + 32 <= n; i += 32 ){
+    __m256i a = _mm256_loadu_si256( (const __m256i*)(s + i) );
+    __m256i b = _mm256_loadu_si256( (const __m256i*)(s + i + m - 1) );
+    unsigned mask = _mm256_movemask_epi8( _mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)) );
+    for( ; mask != 0; mask &= mask - 1 ){
+      const uint8_t *q = s + i + __builtin_ctz(mask);
+      if( memcmp(q + 1, k + 1, m - 2) == 0 ) return q;
+    }
+  }
+  return findBytesSSE2( s + i, n - i, k, m );
+}
+#endif//BYTEARRAY_SIMD_X86
+
+// the first k[0..m) in s[0..n), NULL if none
+static const uint8_t* findBytes( const uint8_t *s, size_t n, const uint8_t *k, size_t m )
+{
+  if( m > n ) return NULL;
+  if( m == 0 ) return s;
+  if( m == 1 ) return memchr( s, k[0], n );
+#ifdef BYTEARRAY_SIMD_X86
+  if( n - m >= 32 ){
+    if( __builtin_cpu_supports("avx2") ) return findBytesAVX2( s, n, k, m );
+    return findBytesSSE2( s, n, k, m );
+  }
+#endif
+  return findBytesScalar( s, n, k, m );
+}
+
+// ------------ base64 / hex ---------------
+// The SIMD kernels map 6 bit groups or nibbles to characters with pshufb
+// lookups, and decoders give the rest of the input, from the first
+// block with a bad character, to the scalar code that reports it.
+
+static const char b64_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static const char hex_digits[] = "0123456789abcdef";
+
+// the 6 bit value of each base64 character, -1 for the others
+static const int8_t b64_values[256] = {
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63,
+  52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1,
+  -1,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+  15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, -1,
+  -1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+  41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+};
+
+static inline int hexValue( uint8_t c )
+{
+  if( c >= '0' && c <= '9' ) return c - '0';
+  c |= 0x20;
+  if( c >= 'a' && c <= 'f' ) return c - 'a' + 10;
+  return -1;
+}
+
+// the encoded length of n bytes, 4 characters per 3 bytes padded with =
+#define B64_ENCODED( n ) (((n) + 2) / 3 * 4)
+
+static size_t b64EncodeScalar( const uint8_t *s, size_t n, char *out )
+{
+  char *o = out;
+  for( ; n >= 3; n -= 3, s += 3, o += 4 ){
+    uint32_t v = (uint32_t)s[0] << 16 | (uint32_t)s[1] << 8 | s[2];
+    o[0] = b64_alphabet[v >> 18];
+    o[1] = b64_alphabet[v >> 12 & 0x3f];
+    o[2] = b64_alphabet[v >> 6 & 0x3f];
+    o[3] = b64_alphabet[v & 0x3f];
+  }
+  if( n > 0 ){
+    uint32_t v = (uint32_t)s[0] << 16 | (n > 1 ? (uint32_t)s[1] << 8 : 0);
+    o[0] = b64_alphabet[v >> 18];
+    o[1] = b64_alphabet[v >> 12 & 0x3f];
+    o[2] = n > 1 ? b64_alphabet[v >> 6 & 0x3f] : '=';
+    o[3] = '=';
+    o += 4;
+  }
+  return o - out;
+}
+
+// the decoded length of a padded base64 string, -1 if it cannot be one
+static int64_t b64Decoded( const uint8_t *s, size_t n )
+{
+  if( n % 4 != 0 ) return -1;
+  size_t pad = n > 0 && s[n-1] == '=' ? (s[n-2] == '=' ? 2 : 1) : 0;
+  return (int64_t)(n / 4 * 3 - pad);
+}
+
+static int b64DecodeScalar( const uint8_t *s, size_t n, uint8_t *out )
+{
+  for( ; n > 0; n -= 4, s += 4 ){
+    int a = b64_values[s[0]], b = b64_values[s[1]], c = b64_values[s[2]], d = b64_values[s[3]];
+    if( (a | b) < 0 ) return ERR_MALFORMED;
+    *out++ = (uint8_t)(a << 2 | b >> 4);
+    if( (c | d) < 0 ){
+      // padding ends the string, and the bits it cuts off are zero
+      if( n != 4 || s[3] != '=' ) return ERR_MALFORMED;
+      if( s[2] == '=' ) return (b & 0x0f) ? ERR_MALFORMED : ERR_OK;
+      if( c < 0 || (c & 0x03) ) return ERR_MALFORMED;
+      *out++ = (uint8_t)(b << 4 | c >> 2);
+      return ERR_OK;
+    }
+    *out++ = (uint8_t)(b << 4 | c >> 2);
+    *out++ = (uint8_t)(c << 6 | d);
+  }
+  return ERR_OK;
+}
+
+static size_t hexEncodeScalar( const uint8_t *s, size_t n, char *out )
+{
+  for( size_t i=0; i < n; ++i ){
+    out[2*i] = hex_digits[s[i] >> 4];
+    out[2*i+1] = hex_digits[s[i] & 0x0f];
+  }
+  return 2 * n;
+}
+
+static int hexDecodeScalar( const uint8_t *s, size_t n, uint8_t *out )
+{
+  for( ; n > 0; n -= 2, s += 2 ){
+    int h = hexValue(s[0]), l = hexValue(s[1]);
+    if( h < 0 || l < 0 ) return ERR_MALFORMED;
+    *out++ = (uint8_t)(h << 4 | l);
+  }
+  return ERR_OK;
+}
+
+#ifdef BYTEARRAY_SIMD_X86
+// 3 bytes in each 32 bit lane, ordered 1 0 2 1, to 4 values of 6 bits one per byte
+__attribute__((target("ssse3")))
+static inline __m128i b64Split128( __m128i in )
+{
+  __m128i ac = _mm_mulhi_epu16( _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040) );
+  __m128i bd = _mm_mullo_epi16( _mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010) );
+  return _mm_or_si128( ac, bd );
+}
+
+// 0..63 to the alphabet by the offset of each range: A-Z 65, a-z 71, 0-9 -4, + -19, / -16
+__attribute__((target("ssse3")))
+static inline __m128i b64Chars128( __m128i v )
+{
+  __m128i offsets = _mm_setr_epi8( 65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0 );
+  __m128i i = _mm_subs_epu8( v, _mm_set1_epi8(51) );
+  i = _mm_sub_epi8( i, _mm_cmpgt_epi8(v, _mm_set1_epi8(25)) );
+  return _mm_add_epi8( v, _mm_shuffle_epi8(offsets, i) );
+}
+
+// characters to 6 bit values, a byte gets a class from its high and one
+// from its low nibble and they share a bit if it is not in the alphabet
+__attribute__((target("ssse3")))
+static inline __m128i b64Values128( __m128i str, int *bad )
+{
+  __m128i hiclass = _mm_setr_epi8( 0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10 );
+  __m128i loclass = _mm_setr_epi8( 0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a );
+  __m128i offsets = _mm_setr_epi8( 0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0 );
+  __m128i hi = _mm_and_si128( _mm_srli_epi32(str, 4), _mm_set1_epi8(0x0f) );
+  __m128i lo = _mm_and_si128( str, _mm_set1_epi8(0x0f) );
+  __m128i c = _mm_and_si128( _mm_shuffle_epi8(hiclass, hi), _mm_shuffle_epi8(loclass, lo) );
+  *bad = _mm_movemask_epi8( _mm_cmpgt_epi8(c, _mm_setzero_si128()) );
+  // the offset by high nibble, / shares it with + and moves down one
+  __m128i i = _mm_add_epi8( hi, _mm_cmpeq_epi8(str, _mm_set1_epi8('/')) );
+  return _mm_add_epi8( str, _mm_shuffle_epi8(offsets, i) );
+}
+
+// 4 values of 6 bits in each 32 bit lane to 3 bytes, packed in the low 12 bytes
+__attribute__((target("ssse3")))
+static inline __m128i b64Join128( __m128i v )
+{
+  __m128i ab = _mm_maddubs_epi16( v, _mm_set1_epi32(0x01400140) );
+  __m128i abcd = _mm_madd_epi16( ab, _mm_set1_epi32(0x00011000) );
+  return _mm_shuffle_epi8( abcd, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1) );
+}
+
+// pairs of hex digits to bytes in the low byte of each 16 bit lane
+__attribute__((target("ssse3")))
+static inline __m128i hexValues128( __m128i str, int *bad )
+{
+  __m128i d = _mm_sub_epi8( str, _mm_set1_epi8('0') );
+  __m128i l = _mm_sub_epi8( _mm_or_si128(str, _mm_set1_epi8(0x20)), _mm_set1_epi8('a') );
+  __m128i isd = _mm_cmpeq_epi8( _mm_min_epu8(d, _mm_set1_epi8(9)), d );
+  __m128i isl = _mm_cmpeq_epi8( _mm_min_epu8(l, _mm_set1_epi8(5)), l );
+  *bad = _mm_movemask_epi8( _mm_or_si128(isd, isl) ) != 0xffff;
+  __m128i v = _mm_or_si128( _mm_and_si128(isd, d), _mm_and_si128(isl, _mm_add_epi8(l, _mm_set1_epi8(10))) );
+  return _mm_maddubs_epi16( v, _mm_set1_epi16(0x0110) );
+}
+
+__attribute__((target("avx2")))
+static inline __m256i b64Split256( __m256i in )
+{
+  __m256i ac = _mm256_mulhi_epu16( _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040) );
+  __m256i bd = _mm256_mullo_epi16( _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010) );
+  return _mm256_or_si256( ac, bd );
+}
+
+__attribute__((target("avx2")))
+static inline __m256i b64Chars256( __m256i v )
+{
+  __m256i offsets = _mm256_setr_epi8( 65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0,
+				      65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0 );
+  __m256i i = _mm256_subs_epu8( v, _mm256_set1_epi8(51) );
+  i = _mm256_sub_epi8( i, _mm256_cmpgt_epi8(v, _mm256_set1_epi8(25)) );
+  return _mm256_add_epi8( v, _mm256_shuffle_epi8(offsets, i) );
+}
+
+__attribute__((target("avx2")))
+static inline __m256i b64Values256( __m256i str, int *bad )
+{
+  __m256i hiclass = _mm256_setr_epi8( 0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+				      0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10 );
+  __m256i loclass = _mm256_setr_epi8( 0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+				      0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a );
+  __m256i offsets = _mm256_setr_epi8( 0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+				      0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0 );
+  __m256i hi = _mm256_and_si256( _mm256_srli_epi32(str, 4), _mm256_set1_epi8(0x0f) );
+  __m256i lo = _mm256_and_si256( str, _mm256_set1_epi8(0x0f) );
+  __m256i c = _mm256_and_si256( _mm256_shuffle_epi8(hiclass, hi), _mm256_shuffle_epi8(loclass, lo) );
+  *bad = _mm256_movemask_epi8( _mm256_cmpgt_epi8(c, _mm256_setzero_si256()) );
+  __m256i i = _mm256_add_epi8( hi, _mm256_cmpeq_epi8(str, _mm256_set1_epi8('/')) );
+  return _mm256_add_epi8( str, _mm256_shuffle_epi8(offsets, i) );
+}
+
+__attribute__((target("avx2")))
+static inline __m256i b64Join256( __m256i v )
+{
+  __m256i ab = _mm256_maddubs_epi16( v, _mm256_set1_epi32(0x01400140) );
+  __m256i abcd = _mm256_madd_epi16( ab, _mm256_set1_epi32(0x00011000) );
+  __m256i order = _mm256_setr_epi8( 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+				    2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1 );
+  // the 12 bytes of the high lane follow those of the low lane
+  __m256i v24 = _mm256_shuffle_epi8( abcd, order );
+  return _mm256_permutevar8x32_epi32( v24, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7) );
+}
+
+__attribute__((target("avx2")))
+static inline __m256i hexValues256( __m256i str, int *bad )
+{
+  __m256i d = _mm256_sub_epi8( str, _mm256_set1_epi8('0') );
+  __m256i l = _mm256_sub_epi8( _mm256_or_si256(str, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a') );
+  __m256i isd = _mm256_cmpeq_epi8( _mm256_min_epu8(d, _mm256_set1_epi8(9)), d );
+  __m256i isl = _mm256_cmpeq_epi8( _mm256_min_epu8(l, _mm256_set1_epi8(5)), l );
+  *bad = _mm256_movemask_epi8( _mm256_or_si256(isd, isl) ) != -1;
+  __m256i v = _mm256_or_si256( _mm256_and_si256(isd, d), _mm256_and_si256(isl, _mm256_add_epi8(l, _mm256_set1_epi8(10))) );
+  return _mm256_maddubs_epi16( v, _mm256_set1_epi16(0x0110) );
+}
+
+__attribute__((target("ssse3")))
+static size_t b64EncodeSSSE3( const uint8_t *s, size_t n, char *out )
+{
+  __m128i order = _mm_setr_epi8( 1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10 );
+  size_t o = 0;
+  // 12 bytes of each 16 byte load
+  for( ; n >= 16; n -= 12, s += 12, o += 16 ){
+    __m128i in = _mm_shuffle_epi8( _mm_loadu_si128((const __m128i*)s), order );
+    _mm_storeu_si128( (__m128i*)(out + o), b64Chars128(b64Split128(in)) );
+  }
+  return o + b64EncodeScalar( s, n, out + o );
+}
+
+__attribute__((target("avx2")))
+static size_t b64EncodeAVX2( const uint8_t *s, size_t n, char *out )
+{
+  __m256i order = _mm256_setr_epi8( 1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+				    1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10 );
+  size_t o = 0;
+  // 12 bytes to each 128 bit lane
+  for( ; n >= 28; n -= 24, s += 24, o += 32 ){
+    __m256i in = _mm256_inserti128_si256( _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)s)),
+					  _mm_loadu_si128((const __m128i*)(s + 12)), 1 );
+    in = _mm256_shuffle_epi8( in, order );
+    _mm256_storeu_si256( (__m256i*)(out + o), b64Chars256(b64Split256(in)) );
+  }
+  return o + b64EncodeSSSE3( s, n, out + o );
+}
+
+// a block stores 16 bytes for 12, the 8 characters kept back give the other 4
+__attribute__((target("ssse3")))
+static int b64DecodeSSSE3( const uint8_t *s, size_t n, uint8_t *out )
+{
+  for( ; n >= 24; n -= 16, s += 16, out += 12 ){
+    int bad;
+    __m128i v = b64Values128( _mm_loadu_si128((const __m128i*)s), &bad );
+    if( bad ) break;
+    _mm_storeu_si128( (__m128i*)out, b64Join128(v) );
+  }
+  return b64DecodeScalar( s, n, out );
+}
+
+__attribute__((target("avx2")))
+static int b64DecodeAVX2( const uint8_t *s, size_t n, uint8_t *out )
+{
+  for( ; n >= 48; n -= 32, s += 32, out += 24 ){
+    int bad;
+    __m256i v = b64Values256( _mm256_loadu_si256((const __m256i*)s), &bad );
+    if( bad ) break;
+    _mm256_storeu_si256( (__m256i*)out, b64Join256(v) );
+  }
+  return b64DecodeSSSE3( s, n, out );
+}
+
+__attribute__((target("ssse3")))
+static size_t hexEncodeSSSE3( const uint8_t *s, size_t n, char *out )
+{
+  __m128i digits = _mm_loadu_si128( (const __m128i*)hex_digits );
+  __m128i mask = _mm_set1_epi8( 0x0f );
+  size_t o = 0;
+  for( ; n >= 16; n -= 16, s += 16, o += 32 ){
+    __m128i in = _mm_loadu_si128( (const __m128i*)s );
+    __m128i hi = _mm_shuffle_epi8( digits, _mm_and_si128(_mm_srli_epi16(in, 4), mask) );
+    __m128i lo = _mm_shuffle_epi8( digits, _mm_and_si128(in, mask) );
+    _mm_storeu_si128( (__m128i*)(out + o), _mm_unpacklo_epi8(hi, lo) );
+    _mm_storeu_si128( (__m128i*)(out + o + 16), _mm_unpackhi_epi8(hi, lo) );
+  }
+  return o + hexEncodeScalar( s, n, out + o );
+}
+
+__attribute__((target("avx2")))
+static size_t hexEncodeAVX2( const uint8_t *s, size_t n, char *out )
+{
+  __m256i digits = _mm256_broadcastsi128_si256( _mm_loadu_si128((const __m128i*)hex_digits) );
+  __m256i mask = _mm256_set1_epi8( 0x0f );
+  size_t o = 0;
+  for( ; n >= 32; n -= 32, s += 32, o += 64 ){
+    __m256i in = _mm256_loadu_si256( (const __m256i*)s );
+    __m256i hi = _mm256_shuffle_epi8( digits, _mm256_and_si256(_mm256_srli_epi16(in, 4), mask) );
+    __m256i lo = _mm256_shuffle_epi8( digits, _mm256_and_si256(in, mask) );
+    // unpack works per lane, a holds bytes 0-7 and 16-23
+    __m256i a = _mm256_unpacklo_epi8( hi, lo ), b = _mm256_unpackhi_epi8( hi, lo );
+    _mm256_storeu_si256( (__m256i*)(out + o), _mm256_permute2x128_si256(a, b, 0x20) );
+    _mm256_storeu_si256( (__m256i*)(out + o + 32), _mm256_permute2x128_si256(a, b, 0x31) );
+  }
+  return o + hexEncodeSSSE3( s, n, out + o );
+}
+
+__attribute__((target("ssse3")))
+static int hexDecodeSSSE3( const uint8_t *s, size_t n, uint8_t *out )
+{
+  for( ; n >= 32; n -= 32, s += 32, out += 16 ){
+    int bad0, bad1;
+    __m128i a = hexValues128( _mm_loadu_si128((const __m128i*)s), &bad0 );
+    __m128i b = hexValues128( _mm_loadu_si128((const __m128i*)(s + 16)), &bad1 );
+    if( bad0 || bad1 ) break;
+    _mm_storeu_si128( (__m128i*)out, _mm_packus_epi16(a, b) );
+  }
+  return hexDecodeScalar( s, n, out );
+}
+
+__attribute__((target("avx2")))
+static int hexDecodeAVX2( const uint8_t *s, size_t n, uint8_t *out )
+{
+  for( ; n >= 64; n -= 64, s += 64, out += 32 ){
+    int bad0, bad1;
+    __m256i a = hexValues256( _mm256_loadu_si256((const __m256i*)s), &bad0 );
+    __m256i b = hexValues256( _mm256_loadu_si256((const __m256i*)(s + 32)), &bad1 );
+    if( bad0 || bad1 ) break;
+    // packus works per lane too
+    __m256i v = _mm256_permute4x64_epi64( _mm256_packus_epi16(a, b), 0xd8 );
+    _mm256_storeu_si256( (__m256i*)out, v );
+  }
+  return hexDecodeSSSE3( s, n, out );
+}
+#endif//BYTEARRAY_SIMD_X86
+
+#ifdef BYTEARRAY_SIMD_X86
+#define CODEC_DISPATCH( NAME, ... )					\
+  if( __builtin_cpu_supports("avx2") ) return NAME##AVX2( __VA_ARGS__ ); \
+  if( __builtin_cpu_supports("ssse3") ) return NAME##SSSE3( __VA_ARGS__ );
+#else
+#define CODEC_DISPATCH( NAME, ... )
+#endif
+
+// B64_ENCODED(n) characters to out
+static size_t b64Encode( const uint8_t *s, size_t n, char *out )
+{
+  CODEC_DISPATCH( b64Encode, s, n, out )
+  return b64EncodeScalar( s, n, out );
+}
+
+// b64Decoded(s, n) bytes to out
+static int b64Decode( const uint8_t *s, size_t n, uint8_t *out )
+{
+  CODEC_DISPATCH( b64Decode, s, n, out )
+  return b64DecodeScalar( s, n, out );
+}
+
+static size_t hexEncode( const uint8_t *s, size_t n, char *out )
+{
+  CODEC_DISPATCH( hexEncode, s, n, out )
+  return hexEncodeScalar( s, n, out );
+}
+
+// n / 2 bytes to out, n is even
+static int hexDecode( const uint8_t *s, size_t n, uint8_t *out )
+{
+  CODEC_DISPATCH( hexDecode, s, n, out )
+  return hexDecodeScalar( s, n, out );
+}
+
+// ------------ segmented buffer ---------------
+// A chained Buf appends into fixed size chunks and is read from the
+// front, consumed chunks go back to a per lua_State free list. The Buf
+// itself is read only and empty, except while a reader runs on a window
+// of the unread bytes.
+
+static inline BufChain* getChain( Buf *p )
+{
+  return (BufChain*)p->local;
+}
+
+static BufChunk* takeChunk( BufAlloc *a )
+{
+  BufChunk *c = a->chunks;
+  if( c != NULL ){
+    a->chunks = c->next;
+    a->nchunks--;
+  }
+  else {
+    c = allocBytes( a, NULL, 0, sizeof(BufChunk) );
+    if( c == NULL ) return NULL;
+  }
+  c->next = NULL;
+  c->length = 0;
+  return c;
+}
+
+static void giveChunk( BufAlloc *a, BufChunk *c )
+{
+  if( a->nchunks < a->maxchunks ){
+    c->next = a->chunks;
+    a->chunks = c;
+    a->nchunks++;
+  }
+  else allocBytes( a, c, sizeof(BufChunk), 0 );
+}
+
+static void createChain( Buf *p, int endian )
+{
+  p->flag = flag( endian, READ_ONLY );
+  p->flag.chained = 1;
+  p->position = p->length = p->szbuffer = 0;
+  p->szlocal = 0;
+  BufChain *ch = getChain(p);
+  ch->head = ch->tail = NULL;
+  ch->offset = ch->length = 0;
+}
+
+static void releaseChain( Buf *p )
+{
+  BufChain *ch = getChain(p);
+  while( ch->head != NULL ){
+    BufChunk *c = ch->head;
+    ch->head = c->next;
+    giveChunk( p->alloc, c );
+  }
+  ch->tail = NULL;
+  ch->offset = ch->length = 0;
+}
+
+// O(1) per chunk, earlier bytes never move
+static int chainAppend( Buf *p, const uint8_t *src, size_t n )
+{
+  BufChain *ch = getChain(p);
+  while( n > 0 ){
+    BufChunk *c = ch->tail;
+    if( c == NULL || c->length == BYTEARRAY_CHUNK_SIZE ){
+      c = takeChunk( p->alloc );
+      if( c == NULL ) return ERR_NOMEM;
+      if( ch->tail ) ch->tail->next = c;
+      else ch->head = c;
+      ch->tail = c;
+    }
+    size_t step = BYTEARRAY_CHUNK_SIZE - c->length;
+    if( step > n ) step = n;
+    memcpy( c->data + c->length, src, step );
+    c->length += step;
+    ch->length += step;
+    src += step;
+    n -= step;
+  }
+  return ERR_OK;
+}
+
+// drop n unread bytes, n <= ch->length
+static void chainConsume( Buf *p, size_t n )
+{
+  BufChain *ch = getChain(p);
+  ch->length -= n;
+  ch->offset += n;
+  while( ch->head != NULL && ch->offset >= ch->head->length ){
+    BufChunk *c = ch->head;
+    if( c == ch->tail ){ // keep the last chunk for appending
+      ch->offset = 0;
+      c->length = 0;
+      break;
+    }
+    ch->offset -= c->length;
+    ch->head = c->next;
+    giveChunk( p->alloc, c );
+  }
+}
+
+// unread bytes that are contiguous in the head chunk
+static inline size_t chainContiguous( Buf *p )
+{
+  BufChain *ch = getChain(p);
+  return ch->head ? ch->head->length - ch->offset : 0;
+}
+
+// copy n unread bytes to dst without consuming them
+static void chainGather( Buf *p, uint8_t *dst, size_t n )
+{
+  BufChain *ch = getChain(p);
+  size_t off = ch->offset;
+  for( BufChunk *c = ch->head; n > 0; c = c->next, off = 0 ){
+    size_t step = c->length - off;
+    if( step > n ) step = n;
+    memcpy( dst, c->data + off, step );
+    dst += step;
+    n -= step;
+  }
+}
+
+// the Buf reads n unread bytes starting at src
+static inline void chainWindow( Buf *p, uint8_t *src, size_t n )
+{
+  p->buffer = src;
+  p->position = 0;
+  p->length = p->szbuffer = n;
+}
+
+static inline void chainWindowClose( Buf *p )
+{
+  chainWindow( p, p->local, 0 );
+}
+
+#ifdef BYTEARRAY_POSIX
+// unread bytes as an iovec list, returns the count used, at most max
+static int chainIovec( Buf *p, struct iovec *iov, int max )
+{
+  BufChain *ch = getChain(p);
+  size_t off = ch->offset;
+  int n = 0;
+  for( BufChunk *c = ch->head; c != NULL && n < max; c = c->next, off = 0 ){
+    if( c->length == off ) continue;
+    iov[n].iov_base = c->data + off;
+    iov[n].iov_len = c->length - off;
+    ++n;
+  }
+  return n;
+}
+#endif
+
+// ------------------- for lua -------------------
+
+// -------------- literal constant in lvm ----------------
+
+#ifdef _MEMORY_ECONOMY
+// declare lua_error message content
+#define MSG_NOMEM                      "NoMem"
+#define MSG_OUTOFRANGE                 "EndOfBuf"
+#define MSG_OVERFLOW                   "LenOvfl"
+#define MSG_INVALIDTYPE                "ErrorType"
+#define MSG_READONLY                   "RoBuf"
+#define MSG_MALFORMED                  "BadData"
+#define MSG_FORMAT                     "BadFmt"
+#define MSG_DEPTH                      "TooDeep"
+#define MSG_CYCLE                      "Cycle"
+
+// declare name for module
+#define MODULE_NAME                    "buf"
+
+#define CONSTANT_ENDIAN_L              "LE"
+#define CONSTANT_ENDIAN_B              "BE"
+
+// declare constructor
+#define CONSTRUCTOR_CREATE             "create" // local b = buf.create(size, endian)
+#define CONSTRUCTOR_INITER             "init"   // local b = buf.init( 49, 50, 51 )
+#define CONSTRUCTOR_FROMARR            "load"   // local b = buf.load( "hello,world" ) -- read only
+#define CONSTRUCTOR_MMAP               "mmap"   // local b = buf.mmap( "a.pak", 0, 4096 ) -- read only
+#define CONSTRUCTOR_CHAIN              "chain"  // local c = buf.chain( endian )
+
+// declare module function
+#define FUNCTION_MEMUSAGE              "mem"    // local n = buf.mem()
+#define FUNCTION_MEMLIMIT              "memlim" // buf.memlim( 64*1024*1024 )
+#define FUNCTION_WRITEV                "writev" // buf.writev( fd, { b1, b2 } )
+#define FUNCTION_SCHEMA                "pbs"    // local s = buf.pbs{ { 1, "id", "int32" } }
+#define FUNCTION_COMPRESSSTREAM        "czs"    // local put = buf.czs( out ); put( b, true )
+#define FUNCTION_DECOMPRESSSTREAM      "dzs"    // local get = buf.dzs( out ); local done = get( b )
+#define FUNCTION_FROMBASE64            "unb64"  // local b = buf.unb64( "aGVsbG8=" )
+#define FUNCTION_FROMHEX               "unhex"  // local b = buf.unhex( "68656c6c6f" )
+
+// declare member
+#define MEMBER_LENGTH                  "len"    // local l = b.length OR b.length = 1024
+#define MEMBER_POSITION                "pos"    // local p = b.pos OR b.pos = 1
+#define MEMBER_ENDIAN                  "endian" // local e = b.endian OR b.endian = 0
+#define MEMBER_AVAILABLE               "free"   // local a = b.free                    -- read only
+#define MEMBER_CAPACITY                "cap"    // local c = b.cap                     -- read only
+
+// declare method
+#define METHOD_READBOOL                "rdb"    // local t = b:rdb()
+#define METHOD_WRITEBOOL               "wrb"    // b:wrb( false )
+#define METHOD_READU8                  "u8r"    // local u = b:u8r()
+#define METHOD_WRITEU8                 "u8w"    // b:u8w( 0x21 )
+#define METHOD_READS8                  "s8r"    // local i = b:s8r()
+#define METHOD_WRITES8                 "s8w"    // b:s8w( 49 )
+#define METHOD_READU16                 "u16r"
+#define METHOD_WRITEU16                "u16w"
+#define METHOD_READS16                 "s16r"
+#define METHOD_WRITES16                "s16w"
+#define METHOD_READU32                 "u32r"
+#define METHOD_WRITEU32                "u32w"
+#define METHOD_READS32                 "s32r"
+#define METHOD_WRITES32                "s32w"
+#define METHOD_READU64                 "u64r"
+#define METHOD_WRITEU64                "u64w"
+#define METHOD_READS64                 "s64r"
+#define METHOD_WRITES64                "s64w"
+#define METHOD_READFLOAT               "f32r"
+#define METHOD_WRITEFLOAT              "f32w"
+#define METHOD_READDOUBLE              "f64r"
+#define METHOD_WRITEDOUBLE             "f64w"
+#define METHOD_READCSTR                "trr"
+#define METHOD_WRITECSTR               "trw"
+#define METHOD_READSTR                 "strr"
+#define METHOD_WRITESTR                "strw"
+#define METHOD_READUNTIL               "utr"    // local s = b:utr( "\r\n" )
+#define METHOD_READLINE                "lnr"
+
+#define METHOD_READU8ARR               "u8ra"   // local t = b:u8ra( 16 )
+#define METHOD_WRITEU8ARR              "u8wa"   // b:u8wa( {1,2,3} ) OR b:u8wa( 1,2,3 )
+#define METHOD_READS8ARR               "s8ra"
+#define METHOD_WRITES8ARR              "s8wa"
+#define METHOD_READU16ARR              "u16ra"
+#define METHOD_WRITEU16ARR             "u16wa"
+#define METHOD_READS16ARR              "s16ra"
+#define METHOD_WRITES16ARR             "s16wa"
+#define METHOD_READU32ARR              "u32ra"
+#define METHOD_WRITEU32ARR             "u32wa"
+#define METHOD_READS32ARR              "s32ra"
+#define METHOD_WRITES32ARR             "s32wa"
+#define METHOD_READFLOATARR            "f32ra"
+#define METHOD_WRITEFLOATARR           "f32wa"
+#define METHOD_READDOUBLEARR           "f64ra"
+#define METHOD_WRITEDOUBLEARR          "f64wa"
+
+#define METHOD_READVARU                "vur"    // local u = b:vur()
+#define METHOD_WRITEVARU               "vuw"    // b:vuw( 300 )
+#define METHOD_READVARS                "vsr"
+#define METHOD_WRITEVARS               "vsw"
+#define METHOD_READVARUARR             "vura"
+#define METHOD_WRITEVARUARR            "vuwa"
+#define METHOD_READVARSARR             "vsra"
+#define METHOD_WRITEVARSARR            "vswa"
+
+#define METHOD_READBYTES               "read"   // local s = buf.create(); b:read(s, 0, b.length)
 #define METHOD_WRITEBYTES              "write"  // local s = buf.load("hello"); b:write(s, 0, s.length)
 
-#define METHOD_CUT                     "cut"    // local t = buf.load("hello,world"):cut( 6, 11 )
-#define METHOD_CLEAR                   "clear"  // b:clear()
-#define METHOD_TOSTRING                "str"    // b:str()
-#else
-// declare lua_error message content
-#define MSG_NOMEM                      "memory not enough"
-#define MSG_OUTOFRANGE                 "out of buffer range"
-#define MSG_OVERFLOW                   "buffer size overflow"
-#define MSG_INVALIDTYPE                "invalid type"
-#define MSG_READONLY                   "buffer is readonly"
+#define METHOD_PACK                    "pack"   // b:pack( ">Hz", 1, "a" )
+#define METHOD_UNPACK                  "unpack" // local n, s = b:unpack( ">Hz" )
+#define METHOD_READPB                  "pbr"    // local t = b:pbr( s )
+#define METHOD_WRITEPB                 "pbw"    // b:pbw( s, { id = 1 } )
+#define METHOD_READOBJ                 "objr"   // local t = b:objr()
+#define METHOD_WRITEOBJ                "objw"   // b:objw( { 1, 2, x = "y" } )
+#define METHOD_READMP                  "mpr"    // local t = b:mpr()
+#define METHOD_WRITEMP                 "mpw"    // b:mpw( { 1, 2, x = "y" }, "single" )
+#define METHOD_COMPRESS                "cz"     // local z = b:cz()
+#define METHOD_DECOMPRESS              "dz"     // local b = z:dz( 4096 )
+#define METHOD_CRC32                   "crc"    // local c = b:crc( 0, 16 )
+#define METHOD_CRC32C                  "crcc"
+#define METHOD_ADLER32                 "adl"
+#define METHOD_XXH64                   "xxh"    // local h = b:xxh( 0, #b, 42 )
+#define METHOD_INDEXOF                 "find"   // local i = b:find( "\r\n", b.pos )
+#define METHOD_TOBASE64                "b64"    // local s = b:b64()
+#define METHOD_TOHEX                   "hex"    // local s = b:hex( 0, 16 )
+
+#define METHOD_SWAPENDIAN              "swap"   // b:swap( 4, 0, 16 )
+#define METHOD_XORMASK                 "xor"    // b:xor( key, b.pos, 125 )
+#define METHOD_FILL                    "fill"   // b:fill( 0, 16, 32 )
+#define METHOD_COPYWITHIN              "cpw"    // b:cpw( 0, 4, 8 )
+#define METHOD_COMPARE                 "cmp"    // local r = b:cmp( "GET ", 0, 4 )
+#define METHOD_EQUALS                  "eq"     // if b:eq( other ) then ... end
+#define METHOD_HASH                    "hash"   // cache[b:hash()] = b
+#define METHOD_CUT                     "cut"    // local t = buf.load("hello,world"):cut( 6, 11 )
+#define METHOD_CLEAR                   "clear"  // b:clear()
+#define METHOD_RESERVE                 "rsv"    // b:rsv( 4096 )
+#define METHOD_SHRINK                  "fit"    // b:fit()
+#define METHOD_DISCARD                 "drop"   // b:drop( 16 )
+#define METHOD_COMPACT                 "cmpt"   // b:cmpt()
+#define METHOD_TOSTRING                "str"    // b:str()
+#define METHOD_READFROM                "rdfd"   // local n = b:rdfd( fd, 4096 )
+#define METHOD_WRITETO                 "wrfd"   // local n = b:wrfd( fd )
+#else
+// declare lua_error message content
+#define MSG_NOMEM                      "memory not enough"
+#define MSG_OUTOFRANGE                 "out of buffer range"
+#define MSG_OVERFLOW                   "buffer size overflow"
+#define MSG_INVALIDTYPE                "invalid type"
+#define MSG_READONLY                   "buffer is readonly"
+#define MSG_MALFORMED                  "malformed data"
+#define MSG_FORMAT                     "invalid format"
+#define MSG_DEPTH                      "nesting too deep"
+#define MSG_CYCLE                      "circular reference"
+
+// declare name for module
+#define MODULE_NAME                    "ByteArray"
+
+#define CONSTANT_ENDIAN_L              "LITTLE_ENDIAN"
+#define CONSTANT_ENDIAN_B              "BIG_ENDIAN"
+
+// declare constructor
+#define CONSTRUCTOR_CREATE             "create"
+#define CONSTRUCTOR_INITER             "init"  
+#define CONSTRUCTOR_FROMARR            "load"  
+#define CONSTRUCTOR_MMAP               "mmap"
+#define CONSTRUCTOR_CHAIN              "chain"
+
+// declare module function
+#define FUNCTION_MEMUSAGE              "memoryUsage"
+#define FUNCTION_MEMLIMIT              "setMemoryLimit"
+#define FUNCTION_WRITEV                "writev"
+#define FUNCTION_SCHEMA                "schema"
+#define FUNCTION_COMPRESSSTREAM        "compressStream"
+#define FUNCTION_DECOMPRESSSTREAM      "decompressStream"
+#define FUNCTION_FROMBASE64            "fromBase64"
+#define FUNCTION_FROMHEX               "fromHex"
+
+// declare member
+#define MEMBER_LENGTH                  "length"
+#define MEMBER_POSITION                "position"   
+#define MEMBER_ENDIAN                  "endian"
+#define MEMBER_AVAILABLE               "bytesAvailable"
+#define MEMBER_CAPACITY                "capacity"
+
+// declare method
+#define METHOD_READBOOL                "readBoolean"
+#define METHOD_WRITEBOOL               "writeBoolean"
+#define METHOD_READU8                  "readUnsignedByte"
+#define METHOD_WRITEU8                 "writeUnsignedByte"
+#define METHOD_READS8                  "readByte"
+#define METHOD_WRITES8                 "writeByte"
+#define METHOD_READU16                 "readUnsignedShort"
+#define METHOD_WRITEU16                "writeUnsignedShort"
+#define METHOD_READS16                 "readShort"
+#define METHOD_WRITES16                "writeShort"
+#define METHOD_READU32                 "readUnsignedInt"
+#define METHOD_WRITEU32                "writeUnsignedInt"
+#define METHOD_READS32                 "readInt"
+#define METHOD_WRITES32                "writeInt"
+#define METHOD_READU64                 "readUnsignedInt64"
+#define METHOD_WRITEU64                "writeUnsignedInt64"
+#define METHOD_READS64                 "readInt64"
+#define METHOD_WRITES64                "writeInt64"
+#define METHOD_READFLOAT               "readFloat"
+#define METHOD_WRITEFLOAT              "writeFloat"
+#define METHOD_READDOUBLE              "readDouble"
+#define METHOD_WRITEDOUBLE             "writeDouble"
+#define METHOD_READCSTR                "readCString"
+#define METHOD_WRITECSTR               "writeCString"
+#define METHOD_READSTR                 "readString"
+#define METHOD_WRITESTR                "writeString"
+#define METHOD_READUNTIL               "readUntil"
+#define METHOD_READLINE                "readLine"
+
+#define METHOD_READU8ARR               "readUnsignedBytes"
+#define METHOD_WRITEU8ARR              "writeUnsignedBytes"
+#define METHOD_READS8ARR               "readSignedBytes"
+#define METHOD_WRITES8ARR              "writeSignedBytes"
+#define METHOD_READU16ARR              "readUnsignedShorts"
+#define METHOD_WRITEU16ARR             "writeUnsignedShorts"
+#define METHOD_READS16ARR              "readShorts"
+#define METHOD_WRITES16ARR             "writeShorts"
+#define METHOD_READU32ARR              "readUnsignedInts"
+#define METHOD_WRITEU32ARR             "writeUnsignedInts"
+#define METHOD_READS32ARR              "readInts"
+#define METHOD_WRITES32ARR             "writeInts"
+#define METHOD_READFLOATARR            "readFloats"
+#define METHOD_WRITEFLOATARR           "writeFloats"
+#define METHOD_READDOUBLEARR           "readDoubles"
+#define METHOD_WRITEDOUBLEARR          "writeDoubles"
+
+#define METHOD_READVARU                "readVarUInt"
+#define METHOD_WRITEVARU               "writeVarUInt"
+#define METHOD_READVARS                "readVarInt"
+#define METHOD_WRITEVARS               "writeVarInt"
+#define METHOD_READVARUARR             "readVarUInts"
+#define METHOD_WRITEVARUARR            "writeVarUInts"
+#define METHOD_READVARSARR             "readVarInts"
+#define METHOD_WRITEVARSARR            "writeVarInts"
+
+#define METHOD_READBYTES               "readBytes"
+#define METHOD_WRITEBYTES              "writeBytes"
+
+#define METHOD_PACK                    "pack"
+#define METHOD_UNPACK                  "unpack"
+#define METHOD_READPB                  "readProtobuf"
+#define METHOD_WRITEPB                 "writeProtobuf"
+#define METHOD_READOBJ                 "readObject"
+#define METHOD_WRITEOBJ                "writeObject"
+#define METHOD_READMP                  "readMsgPack"
+#define METHOD_WRITEMP                 "writeMsgPack"
+#define METHOD_COMPRESS                "compress"
+#define METHOD_DECOMPRESS              "decompress"
+#define METHOD_CRC32                   "crc32"
+#define METHOD_CRC32C                  "crc32c"
+#define METHOD_ADLER32                 "adler32"
+#define METHOD_XXH64                   "xxh64"
+#define METHOD_INDEXOF                 "indexOf"
+#define METHOD_TOBASE64                "toBase64"
+#define METHOD_TOHEX                   "toHex"
+
+#define METHOD_SWAPENDIAN              "swapEndian"
+#define METHOD_XORMASK                 "xorMask"
+#define METHOD_FILL                    "fill"
+#define METHOD_COPYWITHIN              "copyWithin"
+#define METHOD_COMPARE                 "compare"
+#define METHOD_EQUALS                  "equals"
+#define METHOD_HASH                    "hash"
+#define METHOD_CUT                     "slice"
+#define METHOD_CLEAR                   "clear"
+#define METHOD_RESERVE                 "reserve"
+#define METHOD_SHRINK                  "shrinkToFit"
+#define METHOD_DISCARD                 "discard"
+#define METHOD_COMPACT                 "compact"
+#define METHOD_TOSTRING                "toString"
+#define METHOD_READFROM                "readFrom"
+#define METHOD_WRITETO                 "writeTo"
+#endif
+
+// raise lua_error if the Buf operation failed
+#define handle_error( expr ) {			\
+    int status = (expr);			\
+    if( status ){				\
+      error_handle( L, status );		\
+      lua_error(L);				\
+      return 0;					\
+    }						\
+  }
+
+// leaves the new object on the stack, small sizes are stored inline
+#define new_buffer( p, sz, e ) {					\
+    buflen_t szlocal = (sz) <= BYTEARRAY_INLINE_SIZE ? ((sz) + 15) / 16 * 16 : 0; \
+    p = lua_newbuffer( L, szlocal );					\
+    handle_error( createBuf( p, szlocal, sz, e ) );			\
+  }
+
+// registry keys of the metatables, an address is looked up without
+// hashing a name first
+static char bytearr_mt_key, chain_mt_key;
+#define BYTEARRAY_MT ((void*)&bytearr_mt_key)
+#define CHAIN_MT     ((void*)&chain_mt_key)
+
+static inline void lua_getregistryp( lua_State *L, void *key )
+{
+#if LUA_VERSION_NUM >= 502
+  lua_rawgetp(L, LUA_REGISTRYINDEX, key);
+#else
+  lua_pushlightuserdata(L, key);
+  lua_rawget(L, LUA_REGISTRYINDEX);
+#endif
+}
+
+// 1 if the value at idx is a full userdata with the metatable under key
+static inline int lua_isudata( lua_State *L, int idx, void *key )
+{
+  if( lua_type(L, idx) != LUA_TUSERDATA || !lua_getmetatable(L, idx) ) return 0;
+  lua_getregistryp(L, key);
+  int r = lua_rawequal(L, -1, -2);
+  lua_pop(L, 2);
+  return r;
+}
+
+// 1 if the value at idx has the metatable at index mt, such as an upvalue
+static inline int lua_hasmetatable( lua_State *L, int idx, int mt )
+{
+  if( !lua_getmetatable(L, idx) ) return 0;
+  int r = lua_rawequal(L, -1, mt);
+  lua_pop(L, 1);
+  return r;
+}
+
+#define lua_isudataof( L, idx, mt )					\
+  (lua_type(L, idx) == LUA_TUSERDATA && lua_hasmetatable(L, idx, mt))
+
+#define lua_isbytearray( L, idx ) lua_isudata(L, idx, BYTEARRAY_MT)
+
+// every method and metamethod keeps the metatable of its self as upvalue
+// 1, see lua_setmethods, so self costs no registry lookup
+#define UPVALUE_SELF lua_upvalueindex(1)
+
+#define check_userdata_self( L )			\
+  if( !lua_isudataof(L, 1, UPVALUE_SELF) ){		\
+    luaL_argerror(L, 1, MSG_INVALIDTYPE);		\
+    return 0;						\
+  }
+
+#define set_bytearr_metatable( L ) {				\
+    lua_getregistryp( L, BYTEARRAY_MT );			\
+    lua_setmetatable( L, -2 );					\
+  }
+
+// keep the value on top alive as long as the userdata at idx, pops it
+static inline void lua_pinvalue( lua_State *L, int idx )
+{
+  idx = idx < 0 ? lua_gettop(L) + idx + 1 : idx;
+#if LUA_VERSION_NUM >= 503
+  lua_setuservalue(L, idx);
+#else
+  // only a table can be the environment
+  lua_createtable(L, 1, 0);
+  lua_insert(L, -2);
+  lua_rawseti(L, -2, 1);
+  lua_setfenv(L, idx);
+#endif
+}
+
+static inline BufAlloc* lua_tobufalloc( lua_State *L )
+{
+  lua_getfield( L, LUA_REGISTRYINDEX, MODULE_NAME "#alloc" );
+  BufAlloc *a = lua_touserdata( L, -1 );
+  lua_pop( L, 1 );
+  return a;
+}
+
+// tell the collector about buffer memory allocated since the last step
+static inline void settle_debt( lua_State *L, BufAlloc *a )
+{
+  if( a->debt >= BYTEARRAY_GC_STEP ){
+    int kb = (int)(a->debt >> 10);
+    a->debt = 0;
+    lua_gc( L, LUA_GCSTEP, kb );
+  }
+}
+
+// an empty Buf is safe to collect if the caller raises an error
+static inline Buf* lua_newbuffer( lua_State *L, buflen_t szlocal )
+{
+  BufAlloc *a = lua_tobufalloc( L );
+  settle_debt( L, a );
+
+  Buf *p = lua_newuserdata(L, sizeof(Buf) + szlocal);
+  p->alloc = a;
+  p->store = NULL;
+  p->flag = flag( ENDIAN_LITTLE, READ_ONLY );
+  p->buffer = p->local;
+  p->position = p->length = p->szbuffer = 0;
+  p->szlocal = 0;
+  set_bytearr_metatable( L );
+  return p;
+}
+
+// Growth inside a call is settled when the next call fetches a buffer,
+// the Buf layer itself never touches the lua_State.
+static inline Buf* lua_tobuffer(lua_State *L, int index)
+{
+  Buf *p = lua_touserdata(L, index);
+  settle_debt( L, p->alloc );
+  return p;
+}
+
+// for calls that never grow a buffer, the debt waits for the next one
+// that may
+#define lua_peekbuffer( L, index ) ((Buf*)lua_touserdata(L, index))
+
+static void error_handle( lua_State *L, int err )
+{
+  if( err == ERR_NOMEM ){
+    lua_pushstring( L, MSG_NOMEM );
+  }
+  else if( err == ERR_OVERFLOW ){
+    lua_pushstring( L, MSG_OVERFLOW );
+  }
+  else if( err == ERR_READONLY ){
+    lua_pushstring( L, MSG_READONLY );
+  }
+  else if( err == ERR_OUTOFRANGE ){
+    lua_pushstring( L, MSG_OUTOFRANGE );
+  }
+  else if( err == ERR_MALFORMED ){
+    lua_pushstring( L, MSG_MALFORMED );
+  }
+  else if( err == ERR_INVALIDTYPE ){
+    lua_pushstring( L, MSG_INVALIDTYPE );
+  }
+  else if( err == ERR_DEPTH ){
+    lua_pushstring( L, MSG_DEPTH );
+  }
+  else if( err == ERR_CYCLE ){
+    lua_pushstring( L, MSG_CYCLE );
+  }
+}
+
+// buf.create( [size, endian] )
+static int lbytearr_create( lua_State *L )
+{
+  lua_Integer size = BYTEARRAY_INLINE_SIZE;
+  if( lua_isnumber( L, 1 ) ) {
+    size = luaL_checkinteger( L, 1 );
+    luaL_argcheck( L, 0 <= size && (uint64_t)size <= BUFLEN_MAX, 1, MSG_OVERFLOW );
+  }
+  
+  int endian = getNativeEndian();
+  if( lua_isnumber( L, 2 ) ) {
+    endian = luaL_checkint( L, 2 );
+  }
+  
+  Buf* retval;
+  new_buffer( retval, size, endian );
+  return 1;
+}
+
+// buf.init( 1,2,3 ) or buf.init( {1,2,3} )
+static int lbytearr_init( lua_State *L )
+{
+  int n = lua_gettop( L );
+  if( n < 1 ) {
+    luaL_argerror(L, 1, MSG_INVALIDTYPE);
+    return 0;
+  }
+  
+  Buf *retval = NULL;
+  int endian = getNativeEndian();
+  
+  if(lua_isnumber(L, 1)){
+    new_buffer( retval, n, endian );
+    
+    for( int i=1; i <= n; ++i ){
+      if( !lua_isnumber(L, i) ){
+	luaL_argerror(L, i, MSG_INVALIDTYPE);
+	
+	return 0;
+      }
+
+      getBuffer(retval)[i-1] = (uint8_t)lua_tointeger(L, i);
+    }
+    retval->length = n;
+  }
+  else {
+    size_t total = 0;
+    for( int i=1; i <= n; ++i ){
+      luaL_checktype(L, i, LUA_TTABLE);
+      total += lua_objlen(L, i);
+    }
+
+    if( total > (size_t)BUFLEN_MAX ){
+      error_handle(L, ERR_OVERFLOW);
+      lua_error(L);
+      return 0;
+    }
+
+    new_buffer( retval, total, endian );
+    for( int i=1; i <= n; ++i ){
+      size_t len = lua_objlen( L, i );
+      for( size_t j=1; j <= len; ++j ){
+	lua_pushinteger(L, j);
+	lua_gettable(L, i);
+	if( !lua_isnumber(L, -1) ){
+	  luaL_argerror( L, i, MSG_INVALIDTYPE );
+	  return 0;
+	}
+
+	writeUnsignedByte(retval, lua_tointeger(L, -1));
+	lua_pop(L, 1);
+      }// end of j
+    }// end of i
+    
+    // rewind the cursor
+    setPosition(retval, 0);
+  }
+
+  return 1;
+}
+
+// local buf = ByteArray.load("hello,world")
+static int lbytearr_load( lua_State *L )
+{
+  luaL_checkstring(L, 1);
+
+  size_t sz;
+  const char *p = lua_tolstring(L, 1, &sz);
+  int endian = getNativeEndian();
+  if( lua_isnumber(L, 2) ){
+    endian = lua_tonumber( L, 2 );
+  }
+
+  Buf *retval = lua_newbuffer( L, 0 );
+  fromArray( retval, (void*)p, sz, endian );
+
+  // the bytes belong to the string, it lives as long as the object
+  lua_pushvalue(L, 1);
+  lua_pinvalue(L, -2);
+  return 1;
+}
+
+#ifdef BYTEARRAY_MMAP
+// local buf = ByteArray.mmap( "assets.pak"[, offset, length, endian] )
+static int lbytearr_mmap( lua_State *L )
+{
+  const char *path = luaL_checkstring(L, 1);
+  lua_Integer offset = luaL_optinteger(L, 2, 0);
+  lua_Integer length = luaL_optinteger(L, 3, -1);
+  int endian = (int)luaL_optinteger(L, 4, getNativeEndian());
+  luaL_argcheck(L, 0 <= offset, 2, MSG_OUTOFRANGE);
+  luaL_argcheck(L, -1 <= length, 3, MSG_OUTOFRANGE);
+
+  Buf *retval = lua_newbuffer( L, sizeof(BufMap) );
+  fromArray( retval, retval->local, 0, endian );
+
+  int fd = open( path, O_RDONLY );
+  if( fd < 0 ) return luaL_error(L, "%s: %s", path, strerror(errno));
+
+  struct stat st;
+  if( fstat(fd, &st) != 0 ){
+    int e = errno;
+    close( fd );
+    return luaL_error(L, "%s: %s", path, strerror(e));
+  }
+
+  uint64_t size = st.st_size;
+  if( (uint64_t)offset > size || (length >= 0 && (uint64_t)length > size - offset) ){
+    close( fd );
+    handle_error( ERR_OUTOFRANGE );
+  }
+  if( length < 0 ) length = size - offset;
+  if( (uint64_t)length > BUFLEN_MAX || (uint64_t)length > SIZE_MAX ){
+    close( fd );
+    handle_error( ERR_OVERFLOW );
+  }
+  if( length == 0 ){ // nothing to map
+    close( fd );
+    return 1;
+  }
+
+  // the mapping has to start on a page boundary
+  size_t skip = offset % sysconf(_SC_PAGESIZE);
+  size_t mapsize = skip + length;
+  void *base = mmap( NULL, mapsize, PROT_READ, MAP_PRIVATE, fd, offset - skip );
+  int e = errno;
+  close( fd );
+  if( base == MAP_FAILED ) return luaL_error(L, "%s: %s", path, strerror(e));
+#ifdef MADV_SEQUENTIAL
+  madvise( base, mapsize, MADV_SEQUENTIAL );
+#endif
+
+  BufMap *m = (BufMap*)retval->local;
+  m->base = base;
+  m->size = mapsize;
+  retval->flag.mapped = 1;
+  retval->buffer = (uint8_t*)base + skip;
+  retval->length = retval->szbuffer = length;
+  return 1;
+}
+#endif//BYTEARRAY_MMAP
+
+// local c = ByteArray.chain( [endian] )
+static int lbytearr_chain( lua_State *L )
+{
+  int endian = (int)luaL_optinteger(L, 1, getNativeEndian());
+
+  Buf *p = lua_newbuffer( L, sizeof(BufChain) );
+  createChain( p, endian );
+  lua_getregistryp( L, CHAIN_MT );
+  lua_setmetatable( L, -2 );
+  return 1;
+}
+
+// local str = buf:toString()
+static int lbytearr_tostring( lua_State *L )
+{
+  check_userdata_self(L);
+  
+  Buf *p = lua_tobuffer(L, 1);
+  char *b = (char*)getBuffer(p);
+  size_t len = getLength(p);
+  lua_pushlstring(L, b, len);
+  return 1;
+}
+
+#define bytes_param_check(p, s, offset, length) {	\
+    check_userdata_self(L);				\
+    luaL_argcheck(L, lua_isbytearray(L, 2), 2, MSG_INVALIDTYPE); \
+    p = lua_tobuffer(L, 1);				\
+    s = lua_tobuffer(L, 2);				\
+    lua_Integer o = 0, l = 0;				\
+    int n = lua_gettop(L);				\
+    if( n >= 3 ){					\
+      o = luaL_checkinteger(L, 3);			\
+    }							\
+    if( n >= 4 ) {					\
+      l = luaL_checkinteger(L, 4);			\
+    }							\
+    luaL_argcheck(L, 0 <= o, 3, MSG_OUTOFRANGE);	\
+    luaL_argcheck(L, 0 <= l, 4, MSG_OUTOFRANGE);	\
+    if( (uint64_t)o > BUFLEN_MAX || (uint64_t)l > BUFLEN_MAX ){ \
+      error_handle(L, ERR_OVERFLOW);			\
+      lua_error(L);					\
+      return 0;						\
+    }							\
+    offset = o;						\
+    length = l;						\
+  }
+
+// local buffer = ByteArray.load("hello,world")
+// local s = ByteArray.create()
+// buffer:readBytes( s, 0, buffer.bytesAvailable )
+static int lbytearr_readbytes( lua_State *L )
+{
+  Buf *p, *bytes;
+  size_t offset, length;
+  
+  bytes_param_check(p, bytes, offset, length);
+
+  if( length == 0 ) length = getBytesAvailable(p);
+  if( length > BUFLEN_MAX - offset ) handle_error( ERR_OVERFLOW );
+  if( getLength(bytes) < offset + length ) {
+    handle_error( setLength(bytes, offset+length) );
+  }
+  handle_error( writable(bytes) );
+    
+  handle_error( readBytes(p, getBuffer(bytes), offset, length) );
+  return 0;
+}
+
+// local buffer = ByteArray.load("hello,world")
+// local s = ByteArray.create()
+// s:writeBytes( buffer, 6, 5 )
+static int lbytearr_writebytes( lua_State *L )
+{
+  Buf *p, *bytes;
+  size_t offset, length;
+
+  bytes_param_check(p, bytes, offset, length);
+
+  if( getLength(bytes) < offset ) handle_error( ERR_OUTOFRANGE );
+  if( length == 0 || getLength(bytes) - offset < length ){
+    length = getLength(bytes) - offset;
+  }
+  
+  handle_error( writeBytes( p, getBuffer(bytes), offset, length ) );
+  return 0;
+}
+
+// 64 bit integers are native lua_Integer since lua 5.3, values of
+// 2^63 and above come back negative as in string.unpack("J").
+// Before 5.3 they are lua_Number, exact up to 2^53. Define
+// BYTEARRAY_INT64_STRING to get a decimal string for larger values.
+// The writers accept a number or a decimal string in any version.
+#if LUA_VERSION_NUM >= 503
+static inline void lua_pushuint64( lua_State *L, uint64_t v )
+{
+  lua_pushinteger(L, (lua_Integer)v);
+}
+
+static inline void lua_pushint64( lua_State *L, int64_t v )
+{
+  lua_pushinteger(L, (lua_Integer)v);
+}
+#else
+#define INT64_EXACT_MAX 9007199254740992ll // 2^53
+
+static inline void lua_pushuint64( lua_State *L, uint64_t v )
+{
+#ifdef BYTEARRAY_INT64_STRING
+  if( v > INT64_EXACT_MAX ){
+    char s[24];
+    snprintf( s, sizeof(s), "%llu", (unsigned long long)v );
+    lua_pushstring(L, s);
+    return;
+  }
+#endif
+  lua_pushnumber(L, (lua_Number)v);
+}
+
+static inline void lua_pushint64( lua_State *L, int64_t v )
+{
+#ifdef BYTEARRAY_INT64_STRING
+  if( v > INT64_EXACT_MAX || v < -INT64_EXACT_MAX ){
+    char s[24];
+    snprintf( s, sizeof(s), "%lld", (long long)v );
+    lua_pushstring(L, s);
+    return;
+  }
+#endif
+  lua_pushnumber(L, (lua_Number)v);
+}
+#endif
+
+// *ok is 0 if the value is not an integer in range
+static uint64_t lua_touint64( lua_State *L, int idx, int *ok )
+{
+  *ok = 0;
+  if( lua_type(L, idx) == LUA_TSTRING ){
+    const char *s = lua_tostring(L, idx), *e;
+    if( *s == '-' ) return 0;
+    char *end;
+    errno = 0;
+    uint64_t v = strtoull( s, &end, 10 );
+    for( e = end; *e == ' '; ++e );
+    *ok = end != s && *e == '\0' && errno == 0;
+    if( *ok ) return v;
+  }
+#if LUA_VERSION_NUM >= 503
+  if( lua_isinteger(L, idx) ){
+    *ok = 1;
+    return (uint64_t)lua_tointeger(L, idx);
+  }
+#endif
+  lua_Number n = lua_tonumber(L, idx);
+  *ok = lua_isnumber(L, idx) && 0 <= n && n < 18446744073709551616.0;
+  return *ok ? (uint64_t)n : 0;
+}
+
+static int64_t lua_toint64( lua_State *L, int idx, int *ok )
+{
+  *ok = 0;
+  if( lua_type(L, idx) == LUA_TSTRING ){
+    const char *s = lua_tostring(L, idx), *e;
+    char *end;
+    errno = 0;
+    int64_t v = strtoll( s, &end, 10 );
+    for( e = end; *e == ' '; ++e );
+    *ok = end != s && *e == '\0' && errno == 0;
+    if( *ok ) return v;
+  }
+#if LUA_VERSION_NUM >= 503
+  if( lua_isinteger(L, idx) ){
+    *ok = 1;
+    return lua_tointeger(L, idx);
+  }
+#endif
+  lua_Number n = lua_tonumber(L, idx);
+  *ok = lua_isnumber(L, idx) && -9223372036854775808.0 <= n && n < 9223372036854775808.0;
+  return *ok ? (int64_t)n : 0;
+}
+
+#define LUA_BIND_BUILDIN_WRITER( NAME, FUNC, CHECKF, TYPE )	\
+  static int lbytearr_##NAME( lua_State *L )			\
+  {								\
+    check_userdata_self(L);					\
+								\
+    Buf *p = lua_tobuffer(L, 1);				\
+    TYPE b = CHECKF(L, 2);					\
+								\
+    handle_error( FUNC(p, b) );					\
+    lua_pushvalue(L, 1);					\
+    return 1;							\
+  }
+
+LUA_BIND_BUILDIN_WRITER( writebool, writeBoolean, lua_toboolean, int );
+LUA_BIND_BUILDIN_WRITER( writes8, writeByte, luaL_checknumber, int );
+LUA_BIND_BUILDIN_WRITER( writeu8, writeUnsignedByte, luaL_checknumber, int );
+LUA_BIND_BUILDIN_WRITER( writes16, writeShort, luaL_checknumber, int );
+LUA_BIND_BUILDIN_WRITER( writeu16, writeUnsignedShort, luaL_checknumber, int );
+LUA_BIND_BUILDIN_WRITER( writes32, writeInt, luaL_checknumber, int );
+LUA_BIND_BUILDIN_WRITER( writeu32, writeUnsignedInt, luaL_checknumber, uint32_t );
+LUA_BIND_BUILDIN_WRITER( writef32, writeFloat, luaL_checknumber, float );
+LUA_BIND_BUILDIN_WRITER( writef64, writeDouble, luaL_checknumber, double );
+
+#define LUA_BIND_BUILDIN_READER( NAME, FUNC, TYPE, PUSHF ) \
+  static int lbytearr_##NAME( lua_State *L )		   \
+  {							   \
+    check_userdata_self(L);				   \
+							   \
+    Buf *p = lua_peekbuffer(L, 1);			   \
+							   \
+    TYPE retval;					   \
+    handle_error( FUNC(p, &retval) );			   \
+    lua_##PUSHF(L, retval);				   \
+    return 1;						   \
+  }
+
+LUA_BIND_BUILDIN_READER( readbool, readBoolean, int, pushboolean );
+LUA_BIND_BUILDIN_READER( reads8, readByte, int8_t, pushinteger );
+LUA_BIND_BUILDIN_READER( readu8, readUnsignedByte, uint8_t, pushinteger );
+LUA_BIND_BUILDIN_READER( reads16, readShort, int16_t, pushinteger );
+LUA_BIND_BUILDIN_READER( readu16, readUnsignedShort, uint16_t, pushinteger );
+LUA_BIND_BUILDIN_READER( reads32, readInt, int32_t, pushinteger );
+LUA_BIND_BUILDIN_READER( readu32, readUnsignedInt, uint32_t, pushnumber );
+LUA_BIND_BUILDIN_READER( readf32, readFloat, float, pushnumber );
+LUA_BIND_BUILDIN_READER( readf64, readDouble, double, pushnumber );
+
+// values are moved through a stack chunk so that the endian pass runs
+// over a whole run instead of value by value
+#define ARRAY_CHUNK 256
+
+// local t = buf:readInts( [n[, t]] ) -- default n reads all available,
+// at most INT_MAX as table sizes and keys are int
+#define LUA_BIND_ARRAY_READER( NAME, TYPE, PUSHF )			\
+  static int lbytearr_##NAME( lua_State *L )				\
+  {									\
+    check_userdata_self(L);						\
+									\
+    Buf *p = lua_peekbuffer(L, 1);					\
+    size_t width = sizeof(TYPE);					\
+    lua_Integer n = luaL_optinteger(L, 2, getBytesAvailable(p) / width); \
+    luaL_argcheck(L, 0 <= n, 2, MSG_OUTOFRANGE);			\
+    if( (size_t)n > getBytesAvailable(p) / width )			\
+      handle_error( ERR_OUTOFRANGE );					\
+    if( n > INT_MAX ) handle_error( ERR_OVERFLOW );			\
+									\
+    if( lua_istable(L, 3) ) lua_pushvalue(L, 3);			\
+    else lua_createtable(L, (int)n, 0);					\
+									\
+    TYPE chunk[ARRAY_CHUNK];						\
+    for( lua_Integer i=0; i < n; ){					\
+      size_t m = n - i < ARRAY_CHUNK ? (size_t)(n - i) : ARRAY_CHUNK;	\
+      readArray(p, chunk, width, m);					\
+      for( size_t j=0; j < m; ++j ){					\
+	lua_##PUSHF(L, chunk[j]);					\
+	lua_rawseti(L, -2, (int)(++i));					\
+      }									\
+    }									\
+    return 1;								\
+  }
+
+LUA_BIND_ARRAY_READER( reads8arr, int8_t, pushinteger );
+LUA_BIND_ARRAY_READER( readu8arr, uint8_t, pushinteger );
+LUA_BIND_ARRAY_READER( reads16arr, int16_t, pushinteger );
+LUA_BIND_ARRAY_READER( readu16arr, uint16_t, pushinteger );
+LUA_BIND_ARRAY_READER( reads32arr, int32_t, pushinteger );
+LUA_BIND_ARRAY_READER( readu32arr, uint32_t, pushnumber );
+LUA_BIND_ARRAY_READER( readf32arr, float, pushnumber );
+LUA_BIND_ARRAY_READER( readf64arr, double, pushnumber );
+
+// buf:writeInts( {1,2,3} ) or buf:writeInts( 1,2,3 )
+// a non-number value leaves position and length untouched
+#define LUA_BIND_ARRAY_WRITER( NAME, TYPE, TOF )			\
+  static int lbytearr_##NAME( lua_State *L )				\
+  {									\
+    check_userdata_self(L);						\
+									\
+    Buf *p = lua_tobuffer(L, 1);					\
+    size_t width = sizeof(TYPE);					\
+    int istable = lua_istable(L, 2);					\
+    size_t n = istable ? lua_objlen(L, 2) : (size_t)(lua_gettop(L) - 1); \
+    if( n > (buflen_t)~0 / width ) handle_error( ERR_OVERFLOW );	\
+    handle_error( reserve(p, n * width) );				\
+									\
+    buflen_t position = getPosition(p);					\
+    buflen_t length = getLength(p);					\
+    TYPE chunk[ARRAY_CHUNK];						\
+    for( size_t i=0; i < n; ){						\
+      size_t m = n - i < ARRAY_CHUNK ? n - i : ARRAY_CHUNK;		\
+      for( size_t j=0; j < m; ++j, ++i ){				\
+	int idx = 2 + (int)i;						\
+	if( istable ){							\
+	  lua_rawgeti(L, 2, (int)i + 1);				\
+	  idx = -1;							\
+	}								\
+	if( !lua_isnumber(L, idx) ){					\
+	  p->position = position;					\
+	  p->length = length;						\
+	  luaL_argerror(L, istable ? 2 : idx, MSG_INVALIDTYPE);		\
+	  return 0;							\
+	}								\
+	chunk[j] = (TYPE)TOF(L, idx);					\
+	if( istable ) lua_pop(L, 1);					\
+      }									\
+      writeArray(p, chunk, width, m);					\
+    }									\
+    lua_pushvalue(L, 1);						\
+    return 1;								\
+  }
+
+LUA_BIND_ARRAY_WRITER( writes8arr, int8_t, lua_tointeger );
+LUA_BIND_ARRAY_WRITER( writeu8arr, uint8_t, lua_tointeger );
+LUA_BIND_ARRAY_WRITER( writes16arr, int16_t, lua_tointeger );
+LUA_BIND_ARRAY_WRITER( writeu16arr, uint16_t, lua_tointeger );
+LUA_BIND_ARRAY_WRITER( writes32arr, int32_t, lua_tointeger );
+LUA_BIND_ARRAY_WRITER( writeu32arr, uint32_t, lua_tointeger );
+LUA_BIND_ARRAY_WRITER( writef32arr, float, lua_tonumber );
+LUA_BIND_ARRAY_WRITER( writef64arr, double, lua_tonumber );
+
+#define LUA_BIND_INT64_READER( NAME, FUNC, TYPE, PUSHF )	\
+  static int lbytearr_##NAME( lua_State *L )			\
+  {								\
+    check_userdata_self(L);					\
+								\
+    Buf *p = lua_peekbuffer(L, 1);				\
+								\
+    TYPE retval;						\
+    handle_error( FUNC(p, &retval) );				\
+    PUSHF(L, retval);						\
+    return 1;							\
+  }
+
+#define LUA_BIND_INT64_WRITER( NAME, FUNC, TYPE, TOF )		\
+  static int lbytearr_##NAME( lua_State *L )			\
+  {								\
+    check_userdata_self(L);					\
+								\
+    Buf *p = lua_tobuffer(L, 1);				\
+    int ok;							\
+    TYPE v = TOF(L, 2, &ok);					\
+    luaL_argcheck(L, ok, 2, MSG_INVALIDTYPE);			\
+								\
+    handle_error( FUNC(p, v) );					\
+    lua_pushvalue(L, 1);					\
+    return 1;							\
+  }
+
+LUA_BIND_INT64_READER( readu64, readUnsignedInt64, uint64_t, lua_pushuint64 );
+LUA_BIND_INT64_READER( reads64, readInt64, int64_t, lua_pushint64 );
+LUA_BIND_INT64_WRITER( writeu64, writeUnsignedInt64, uint64_t, lua_touint64 );
+LUA_BIND_INT64_WRITER( writes64, writeInt64, int64_t, lua_toint64 );
+LUA_BIND_INT64_READER( readvaru, readVarUInt, uint64_t, lua_pushuint64 );
+LUA_BIND_INT64_READER( readvars, readVarInt, int64_t, lua_pushint64 );
+LUA_BIND_INT64_WRITER( writevaru, writeVarUInt, uint64_t, lua_touint64 );
+LUA_BIND_INT64_WRITER( writevars, writeVarInt, int64_t, lua_toint64 );
+
+// local t = buf:readVarInts( [n[, t]] ) -- default n reads until the end
+// a malformed value leaves position untouched, n more than the bytes
+// available fails at once as every value takes at least one byte
+#define LUA_BIND_VARINT_ARRAY_READER( NAME, FUNC, TYPE, PUSHF )	\
+  static int lbytearr_##NAME( lua_State *L )				\
+  {									\
+    check_userdata_self(L);						\
+									\
+    Buf *p = lua_peekbuffer(L, 1);					\
+    lua_Integer n = luaL_optinteger(L, 2, -1);				\
+    luaL_argcheck(L, -1 <= n, 2, MSG_OUTOFRANGE);			\
+    if( n > 0 && (size_t)n > getBytesAvailable(p) )			\
+      handle_error( ERR_OUTOFRANGE );					\
+    if( n > INT_MAX ) handle_error( ERR_OVERFLOW );			\
+									\
+    if( lua_istable(L, 3) ) lua_pushvalue(L, 3);			\
+    else lua_createtable(L, n < 0 ? 0 : (int)n, 0);			\
+									\
+    buflen_t position = getPosition(p);				\
+    for( lua_Integer i=0; n < 0 ? getBytesAvailable(p) > 0 : i < n; ){ \
+      TYPE v;								\
+      int err = FUNC(p, &v);						\
+      if( err ){							\
+	p->position = position;						\
+	handle_error( err );						\
+      }									\
+      PUSHF(L, v);							\
+      lua_rawseti(L, -2, (int)(++i));					\
+    }									\
+    return 1;								\
+  }
+
+// buf:writeVarInts( {1,2,3} ) or buf:writeVarInts( 1,2,3 )
+#define LUA_BIND_VARINT_ARRAY_WRITER( NAME, FUNC, TYPE, TOF )		\
+  static int lbytearr_##NAME( lua_State *L )				\
+  {									\
+    check_userdata_self(L);						\
+									\
+    Buf *p = lua_tobuffer(L, 1);					\
+    int istable = lua_istable(L, 2);					\
+    size_t n = istable ? lua_objlen(L, 2) : (size_t)(lua_gettop(L) - 1); \
+									\
+    buflen_t position = getPosition(p);				\
+    buflen_t length = getLength(p);					\
+    for( size_t i=0; i < n; ++i ){					\
+      int idx = 2 + (int)i;						\
+      if( istable ){							\
+	lua_rawgeti(L, 2, (int)i + 1);					\
+	idx = -1;							\
+      }									\
+      int ok;								\
+      TYPE v = TOF(L, idx, &ok);					\
+      int err = ok ? FUNC(p, v) : ERR_OK;				\
+      if( !ok || err ){							\
+	p->position = position;						\
+	p->length = length;						\
+	if( err ) handle_error( err );					\
+	luaL_argerror(L, istable ? 2 : idx, MSG_INVALIDTYPE);		\
+	return 0;							\
+      }									\
+      if( istable ) lua_pop(L, 1);					\
+    }									\
+    lua_pushvalue(L, 1);						\
+    return 1;								\
+  }
+
+LUA_BIND_VARINT_ARRAY_READER( readvaruarr, readVarUInt, uint64_t, lua_pushuint64 );
+LUA_BIND_VARINT_ARRAY_READER( readvarsarr, readVarInt, int64_t, lua_pushint64 );
+LUA_BIND_VARINT_ARRAY_WRITER( writevaruarr, writeVarUInt, uint64_t, lua_touint64 );
+LUA_BIND_VARINT_ARRAY_WRITER( writevarsarr, writeVarInt, int64_t, lua_toint64 );
+
+// local s = buf:readString( 3 ) -- read 3 byte as lua string
+static int lbytearr_readlstr( lua_State *L )
+{
+  check_userdata_self(L);
+
+  Buf *p = lua_tobuffer(L, 1);
+  size_t l = lua_tointeger( L, 2 );
+  char *str = (char*)&getBuffer(p)[getPosition(p)];
+
+  if( getBytesAvailable(p) < l ){
+    error_handle(L, ERR_OUTOFRANGE);
+    lua_error(L);
+    return 0;
+  }
+  
+  lua_pushlstring(L, str, l);
+  p->position += l;
+  return 1;
+}
+
+// buf:writeString( "hello" )
+static int lbytearr_writelstr( lua_State *L )
+{
+  check_userdata_self(L);
+
+  luaL_checktype(L, 2, LUA_TSTRING);
+  
+  Buf *p = lua_tobuffer(L, 1);
+  const char *pstr = lua_tostring(L, 2);
+  size_t l = lua_objlen(L, 2);
+  
+  handle_error( writeBytes(p, pstr, 0, l) );
+  
+  lua_pushvalue(L, 1);
+  return 1;
+}
+
+#ifdef BYTEARRAY_USE_CSTRING
+// local t = b:readCString()
+static int lbytearr_readcstr( lua_State *L )
+{
+  check_userdata_self(L);
+  
+  Buf *p = lua_tobuffer(L, 1);
+  char *str = (char*)&getBuffer(p)[getPosition(p)];
+  
+  // bytes past length are not zero filled
+  char *end = (char*)findBytes( (uint8_t*)str, getBytesAvailable(p), (const uint8_t*)"", 1 );
+  if( end == NULL ){
+    error_handle(L, ERR_OUTOFRANGE);
+    lua_error(L);
+    return 0;
+  }
+  
+  size_t l = end - str;
+  lua_pushlstring(L, str, l);
+  p->position += l + 1;
+  return 1;
+}
+static int lbytearr_writecstr( lua_State *L )
+{
+  check_userdata_self(L);
+
+  luaL_checktype(L, 2, LUA_TSTRING);
+  
+  Buf *p = lua_tobuffer(L, 1);
+  const char *pstr = lua_tostring(L, 2);
+  
+  size_t l = 1 + strlen(pstr);
+  
+  handle_error( writeBytes(p, pstr, 0, l) );
+
+  lua_pushvalue(L, 1);
+  return 1;
+}
+#endif//BYTEARRAY_USE_CSTRING
+
+#define UPVALUE_FORMATS    lua_upvalueindex(2)
+#define UPVALUE_NFORMAT    lua_upvalueindex(3)
+
+// compiled format at idx, from the cache of the pack / unpack closure
+static PackProg* lua_topackprog( lua_State *L, int idx )
+{
+  luaL_checktype(L, idx, LUA_TSTRING);
+  lua_pushvalue(L, idx);
+  lua_rawget(L, UPVALUE_FORMATS);
+  PackProg *prog = lua_touserdata(L, -1);
+  lua_pop(L, 1);
+  if( prog != NULL ) return prog;
+
+  size_t l;
+  const char *fmt = lua_tolstring(L, idx, &l);
+  prog = lua_newuserdata(L, sizeof(PackProg) + l * sizeof(PackOp));
+  if( compilePack(prog, fmt, l) ) luaL_argerror(L, idx, MSG_FORMAT);
+
+  lua_Integer n = lua_tointeger(L, UPVALUE_NFORMAT);
+  if( n >= BYTEARRAY_FORMAT_CACHE ){
+    lua_newtable(L);
+    lua_replace(L, UPVALUE_FORMATS);
+    n = 0;
+  }
+  lua_pushinteger(L, n + 1);
+  lua_replace(L, UPVALUE_NFORMAT);
+
+  // the cache keeps prog alive
+  lua_pushvalue(L, idx);
+  lua_insert(L, -2);
+  lua_rawset(L, UPVALUE_FORMATS);
+  return prog;
+}
+
+static int readLength( Buf *p, buflen_t width, uint64_t *out )
+{
+  int err;
+  if( width == 1 ){ uint8_t v; err = readUnsignedByte(p, &v); *out = v; }
+  else if( width == 2 ){ uint16_t v; err = readUnsignedShort(p, &v); *out = v; }
+  else if( width == 4 ){ uint32_t v; err = readUnsignedInt(p, &v); *out = v; }
+  else err = readUnsignedInt64(p, out);
+  return err;
+}
+
+static int writeLength( Buf *p, buflen_t width, uint64_t v )
+{
+  if( width == 1 ) return writeUnsignedByte(p, (uint8_t)v);
+  if( width == 2 ) return writeUnsignedShort(p, (uint16_t)v);
+  if( width == 4 ) return writeUnsignedInt(p, (uint32_t)v);
+  return writeUnsignedInt64(p, v);
+}
+
+#define UNPACK_CASE( CODE, TYPE, FUNC, PUSHF )			\
+  case CODE: {							\
+    TYPE v;							\
+    err = FUNC(&q, &v);						\
+    if( !err ) PUSHF(L, v);					\
+    break;							\
+  }
+
+// local a, b, s = buf:unpack( ">Hiz" ) -- position moves past the values
+// nothing moves if the data runs out
+static int lbytearr_unpack( lua_State *L )
+{
+  check_userdata_self(L);
+
+  Buf *p = lua_tobuffer(L, 1);
+  PackProg *prog = lua_topackprog(L, 2);
+  luaL_checkstack(L, (int)prog->nvalue, MSG_OVERFLOW);
+
+  // runs on a copy, p only changes on success
+  Buf q = *p;
+  int err = ERR_OK;
+  for( size_t i=0; i < prog->nop && !err; ++i ){
+    const PackOp *op = &prog->op[i];
+    q.flag.endian = op->endian == ENDIAN_BUFFER ? p->flag.endian : op->endian;
+    switch( op->code ){
+      UNPACK_CASE( PACK_S8, int8_t, readByte, lua_pushinteger )
+      UNPACK_CASE( PACK_U8, uint8_t, readUnsignedByte, lua_pushinteger )
+      UNPACK_CASE( PACK_S16, int16_t, readShort, lua_pushinteger )
+      UNPACK_CASE( PACK_U16, uint16_t, readUnsignedShort, lua_pushinteger )
+      UNPACK_CASE( PACK_S32, int32_t, readInt, lua_pushinteger )
+      UNPACK_CASE( PACK_U32, uint32_t, readUnsignedInt, lua_pushuint64 )
+      UNPACK_CASE( PACK_S64, int64_t, readInt64, lua_pushint64 )
+      UNPACK_CASE( PACK_U64, uint64_t, readUnsignedInt64, lua_pushuint64 )
+      UNPACK_CASE( PACK_F32, float, readFloat, lua_pushnumber )
+      UNPACK_CASE( PACK_F64, double, readDouble, lua_pushnumber )
+      UNPACK_CASE( PACK_BOOL, int, readBoolean, lua_pushboolean )
+      UNPACK_CASE( PACK_VARU, uint64_t, readVarUInt, lua_pushuint64 )
+      UNPACK_CASE( PACK_VARS, int64_t, readVarInt, lua_pushint64 )
+    case PACK_CSTR: {
+      const char *s = (const char*)q.buffer + q.position;
+      const char *z = (const char*)findBytes( (const uint8_t*)s, getBytesAvailable(&q), (const uint8_t*)"", 1 );
+      if( z == NULL ){ err = ERR_OUTOFRANGE; break; }
+      lua_pushlstring(L, s, z - s);
+      q.position += z - s + 1;
+      break;
+    }
+    case PACK_LSTR: {
+      uint64_t l;
+      if( (err = readLength(&q, op->arg, &l)) ) break;
+      if( getBytesAvailable(&q) < l ){ err = ERR_OUTOFRANGE; break; }
+      lua_pushlstring(L, (const char*)q.buffer + q.position, (size_t)l);
+      q.position += l;
+      break;
+    }
+    case PACK_FSTR:
+    case PACK_SKIP:
+      if( getBytesAvailable(&q) < op->arg ){ err = ERR_OUTOFRANGE; break; }
+      if( op->code == PACK_FSTR )
+	lua_pushlstring(L, (const char*)q.buffer + q.position, op->arg);
+      q.position += op->arg;
+      break;
+    }
+  }
+  handle_error( err );
+
+  p->position = q.position;
+  return (int)prog->nvalue;
+}
+
+// number at idx converted like the typed writers, *ok is 0 if it is not one
+static inline int64_t lua_tointx( lua_State *L, int idx, int *ok )
+{
+#if LUA_VERSION_NUM >= 503
+  lua_Integer i = lua_tointegerx(L, idx, ok);
+  if( *ok ) return i;
+#endif
+#if LUA_VERSION_NUM >= 502
+  return (int64_t)lua_tonumberx(L, idx, ok);
+#else
+  *ok = lua_isnumber(L, idx);
+  return (int64_t)lua_tonumber(L, idx);
+#endif
+}
+
+static inline lua_Number lua_tonumx( lua_State *L, int idx, int *ok )
+{
+#if LUA_VERSION_NUM >= 502
+  return lua_tonumberx(L, idx, ok);
+#else
+  *ok = lua_isnumber(L, idx);
+  return lua_tonumber(L, idx);
+#endif
+}
+
+// the bytes the strings take, after checking each value against its op
+// so that a failing pack writes nothing
+static uint64_t packCheck( lua_State *L, const PackProg *prog )
+{
+  uint64_t strings = 0;
+  int idx = 3;
+  for( size_t i=0; i < prog->nop; ++i ){
+    const PackOp *op = &prog->op[i];
+    int ok = 1;
+    size_t l;
+    switch( op->code ){
+    case PACK_S8: case PACK_U8: case PACK_S16: case PACK_U16:
+    case PACK_S32: case PACK_U32:
+      lua_tointx(L, idx, &ok);
+      break;
+    case PACK_S64: case PACK_VARS:
+      lua_toint64(L, idx, &ok);
+      break;
+    case PACK_U64: case PACK_VARU:
+      lua_touint64(L, idx, &ok);
+      break;
+    case PACK_F32: case PACK_F64:
+      lua_tonumx(L, idx, &ok);
+      break;
+    case PACK_BOOL:
+      break;
+    case PACK_CSTR:
+      if( (ok = lua_isstring(L, idx)) ) strings += strlen(lua_tostring(L, idx)) + 1;
+      break;
+    case PACK_LSTR:
+      if( !(ok = lua_isstring(L, idx)) ) break;
+      lua_tolstring(L, idx, &l);
+      ok = op->arg == 8 || ((uint64_t)l >> (8 * op->arg)) == 0;
+      strings += l;
+      break;
+    case PACK_FSTR:
+      if( (ok = lua_isstring(L, idx)) ) lua_tolstring(L, idx, &l);
+      ok = ok && l <= op->arg;
+      break;
+    case PACK_SKIP:
+      continue;
+    }
+    luaL_argcheck(L, ok, idx, MSG_INVALIDTYPE);
+    ++idx;
+  }
+  return strings;
+}
+
+#define PACK_CASE( CODE, TYPE, TOF, FUNC )			\
+  case CODE: {							\
+    int ok;							\
+    FUNC(&q, (TYPE)TOF(L, idx, &ok));				\
+    break;							\
+  }
+
+// buf:pack( ">Hiz", 1, 2, "three" ) -- written at position
+// nothing is written if a value does not fit the format
+static int lbytearr_pack( lua_State *L )
+{
+  check_userdata_self(L);
+
+  Buf *p = lua_tobuffer(L, 1);
+  PackProg *prog = lua_topackprog(L, 2);
+  uint64_t strings = packCheck(L, prog);
+  if( prog->fixed > BUFLEN_MAX - getPosition(p) ||
+      strings > BUFLEN_MAX - getPosition(p) - prog->fixed ) handle_error( ERR_OVERFLOW );
+  handle_error( reserve(p, (size_t)(prog->fixed + strings)) );
+
+  // every value is checked and the room is there, the writes never fail
+  Buf q = *p;
+  int idx = 3;
+  for( size_t i=0; i < prog->nop; ++i ){
+    const PackOp *op = &prog->op[i];
+    q.flag.endian = op->endian == ENDIAN_BUFFER ? p->flag.endian : op->endian;
+    size_t l;
+    const char *s;
+    switch( op->code ){
+      PACK_CASE( PACK_S8, int8_t, lua_tointx, writeByte )
+      PACK_CASE( PACK_U8, uint8_t, lua_tointx, writeUnsignedByte )
+      PACK_CASE( PACK_S16, int16_t, lua_tointx, writeShort )
+      PACK_CASE( PACK_U16, uint16_t, lua_tointx, writeUnsignedShort )
+      PACK_CASE( PACK_S32, int32_t, lua_tointx, writeInt )
+      PACK_CASE( PACK_U32, uint32_t, lua_tointx, writeUnsignedInt )
+      PACK_CASE( PACK_S64, int64_t, lua_toint64, writeInt64 )
+      PACK_CASE( PACK_U64, uint64_t, lua_touint64, writeUnsignedInt64 )
+      PACK_CASE( PACK_F32, float, lua_tonumx, writeFloat )
+      PACK_CASE( PACK_F64, double, lua_tonumx, writeDouble )
+      PACK_CASE( PACK_VARU, uint64_t, lua_touint64, writeVarUInt )
+      PACK_CASE( PACK_VARS, int64_t, lua_toint64, writeVarInt )
+    case PACK_BOOL:
+      writeBoolean(&q, lua_toboolean(L, idx));
+      break;
+    case PACK_CSTR:
+      s = lua_tostring(L, idx);
+      writeBytes(&q, s, 0, strlen(s) + 1);
+      break;
+    case PACK_LSTR:
+      s = lua_tolstring(L, idx, &l);
+      writeLength(&q, op->arg, l);
+      writeBytes(&q, s, 0, l);
+      break;
+    case PACK_FSTR:
+      s = lua_tolstring(L, idx, &l);
+      memcpy(q.buffer + q.position, s, l);
+      memset(q.buffer + q.position + l, 0, op->arg - l);
+      q.position += op->arg;
+      UPDATE_LENGTH((&q));
+      break;
+    case PACK_SKIP:
+      memset(q.buffer + q.position, 0, op->arg);
+      q.position += op->arg;
+      UPDATE_LENGTH((&q));
+      continue;
+    }
+    ++idx;
+  }
+
+  p->position = q.position;
+  p->length = q.length;
+  lua_pushvalue(L, 1);
+  return 1;
+}
+
+// ------------ protobuf ---------------
+#define PB_SCHEMA_MT   MODULE_NAME "#pbmt"
+
+// ByteArray of len bytes of p from pos, sharing heap storage like slice
+static int lua_pushview( lua_State *L, Buf *p, buflen_t pos, buflen_t len )
+{
+  Buf *r;
+  if( p->store != NULL && len > BYTEARRAY_INLINE_SIZE ){
+    r = lua_newbuffer(L, 0);
+    shareBuf(r, p, pos, len);
+    return ERR_OK;
+  }
+
+  buflen_t szlocal = len <= BYTEARRAY_INLINE_SIZE ? (len + 15) / 16 * 16 : 0;
+  r = lua_newbuffer(L, szlocal);
+  int err = createBuf(r, szlocal, len, getEndian(p));
+  if( err ) return err;
+  memcpy(r->buffer, p->buffer + pos, len);
+  r->length = len;
+  return ERR_OK;
+}
+
+// local s = ByteArray.schema{ { 1, "id", "int32" }, { 2, "tags", "string", repeated = true },
+//                             { 3, "child", "message", other, lazy = true } }
+static int lbytearr_schema( lua_State *L )
+{
+  luaL_checktype(L, 1, LUA_TTABLE);
+  size_t n = lua_objlen(L, 1);
+
+  PbSchema *s = lua_newuserdata(L, sizeof(PbSchema) + n * sizeof(PbField));
+  s->nfield = 0;
+  luaL_getmetatable(L, PB_SCHEMA_MT);
+  lua_setmetatable(L, -2);
+
+  // [slot] = name, [n + slot] = schema of a message field
+  lua_createtable(L, (int)(2 * n), 0);
+  int uv = lua_gettop(L);
+
+  for( size_t i=1; i <= n; ++i ){
+    lua_rawgeti(L, 1, (int)i);
+    int def = lua_gettop(L);
+    if( !lua_istable(L, def) ) luaL_error(L, "field %d: %s", (int)i, MSG_INVALIDTYPE);
+
+    lua_rawgeti(L, def, 1);
+    lua_rawgeti(L, def, 2);
+    lua_rawgeti(L, def, 3);
+    lua_Number number = lua_tonumber(L, -3);
+    int type = -1;
+    if( lua_type(L, -1) == LUA_TSTRING ){
+      const char *t = lua_tostring(L, -1);
+      for( int k=0; pb_typenames[k]; ++k )
+	if( strcmp(pb_typenames[k], t) == 0 ) type = k;
+    }
+    if( number < 1 || number >= (1 << 29) || number != (uint32_t)number ||
+	lua_type(L, -2) != LUA_TSTRING || type < 0 )
+      luaL_error(L, "field %d: %s", (int)i, MSG_INVALIDTYPE);
+
+    PbField *f = &s->field[i-1];
+    f->number = (uint32_t)number;
+    f->slot = (uint32_t)i;
+    f->type = type;
+    f->wire = pbWireType(type);
+    lua_getfield(L, def, "repeated");
+    f->repeated = lua_toboolean(L, -1);
+    lua_getfield(L, def, "packed");
+    f->packed = lua_toboolean(L, -1);
+    lua_getfield(L, def, "lazy");
+    f->lazy = lua_toboolean(L, -1);
+    lua_pop(L, 3);
+    if( (f->packed && (!f->repeated || f->wire == PB_LEN)) ||
+	(f->lazy && type != PBT_MESSAGE && type != PBT_BYTES) )
+      luaL_error(L, "field %d: %s", (int)i, MSG_INVALIDTYPE);
+
+    lua_pushvalue(L, -2);
+    lua_rawseti(L, uv, (int)i);
+    if( type == PBT_MESSAGE ){
+      luaL_getmetatable(L, PB_SCHEMA_MT);
+      lua_rawgeti(L, def, 4);
+      if( !lua_isudataof(L, -1, lua_gettop(L) - 1) ) luaL_error(L, "field %d: %s", (int)i, MSG_INVALIDTYPE);
+      lua_rawseti(L, uv, (int)(n + i));
+    }
+    lua_settop(L, uv);
+    s->nfield = i;
+  }
+
+  // sorted by number for the decoder
+  for( size_t i=1; i < n; ++i ){
+    PbField f = s->field[i];
+    size_t j = i;
+    for( ; j > 0 && s->field[j-1].number > f.number; --j ) s->field[j] = s->field[j-1];
+    s->field[j] = f;
+  }
+  for( size_t i=1; i < n; ++i ){
+    if( s->field[i].number == s->field[i-1].number )
+      luaL_error(L, "field %d: %s", (int)s->field[i].slot, MSG_INVALIDTYPE);
+  }
+
+  (void)lua_setfenv(L, -2);
+  return 1;
+}
+
+static int pbReadScalar( lua_State *L, Buf *q, int type )
+{
+  int err;
+  uint64_t u;
+  switch( type ){
+  case PBT_DOUBLE: {
+    double v;
+    if( (err = readDouble(q, &v)) ) return err;
+    lua_pushnumber(L, v);
+    return ERR_OK;
+  }
+  case PBT_FLOAT: {
+    float v;
+    if( (err = readFloat(q, &v)) ) return err;
+    lua_pushnumber(L, v);
+    return ERR_OK;
+  }
+  case PBT_FIXED32:
+  case PBT_SFIXED32: {
+    uint32_t v;
+    if( (err = readUnsignedInt(q, &v)) ) return err;
+    if( type == PBT_FIXED32 ) lua_pushuint64(L, v);
+    else lua_pushinteger(L, (int32_t)v);
+    return ERR_OK;
+  }
+  case PBT_FIXED64:
+  case PBT_SFIXED64:
+    if( (err = readUnsignedInt64(q, &u)) ) return err;
+    if( type == PBT_FIXED64 ) lua_pushuint64(L, u);
+    else lua_pushint64(L, (int64_t)u);
+    return ERR_OK;
+  }
+
+  if( (err = readVarUInt(q, &u)) ) return err;
+  switch( type ){
+  case PBT_INT32: case PBT_ENUM: lua_pushinteger(L, (int32_t)u); break;
+  case PBT_INT64: lua_pushint64(L, (int64_t)u); break;
+  case PBT_UINT32: lua_pushuint64(L, (uint32_t)u); break;
+  case PBT_UINT64: lua_pushuint64(L, u); break;
+  case PBT_SINT32: lua_pushinteger(L, (int32_t)ZIGZAG_DECODE(u)); break;
+  case PBT_SINT64: lua_pushint64(L, ZIGZAG_DECODE(u)); break;
+  default: lua_pushboolean(L, u != 0); break;
+  }
+  return ERR_OK;
+}
+
+static int pbDecode( lua_State *L, Buf *p, Buf *q, const PbSchema *s, int schema, int depth );
+
+// pushes the value of field f, q is a little endian copy of p
+static int pbReadValue( lua_State *L, Buf *p, Buf *q, const PbSchema *s, const PbField *f, int uv, int depth )
+{
+  if( f->wire != PB_LEN ) return pbReadScalar(L, q, f->type);
+
+  uint64_t len;
+  int err = readVarUInt(q, &len);
+  if( err ) return err;
+  if( getBytesAvailable(q) < len ) return ERR_OUTOFRANGE;
+  buflen_t pos = getPosition(q);
+
+  if( f->lazy ){
+    if( (err = lua_pushview(L, p, pos, (buflen_t)len)) ) return err;
+  }
+  else if( f->type != PBT_MESSAGE ){
+    lua_pushlstring(L, (const char*)q->buffer + pos, (size_t)len);
+  }
+  else {
+    if( depth >= BYTEARRAY_MAX_DEPTH ) return ERR_DEPTH;
+    buflen_t length = q->length;
+    q->length = pos + (buflen_t)len;
+    lua_rawgeti(L, uv, (int)(s->nfield + f->slot));
+    err = pbDecode(L, p, q, lua_touserdata(L, -1), lua_gettop(L), depth + 1);
+    q->length = length;
+    if( err ) return err;
+    lua_remove(L, -2);
+  }
+  q->position = pos + (buflen_t)len;
+  return ERR_OK;
+}
+
+// pushes a table of the fields read from q until its length
+static int pbDecode( lua_State *L, Buf *p, Buf *q, const PbSchema *s, int schema, int depth )
+{
+  luaL_checkstack(L, 8, MSG_DEPTH);
+  lua_getfenv(L, schema);
+  int uv = lua_gettop(L);
+  lua_createtable(L, 0, (int)s->nfield);
+  int t = uv + 1;
+
+  int err = ERR_OK;
+  while( getBytesAvailable(q) > 0 ){
+    uint64_t key;
+    if( (err = readVarUInt(q, &key)) ) return err;
+    int wire = (int)(key & 7);
+    const PbField *f = pbFind(s, key >> 3);
+    if( f == NULL ){
+      // unknown field, skipped
+      if( (err = pbSkip(q, wire)) ) return err;
+      continue;
+    }
+
+    lua_rawgeti(L, uv, (int)f->slot);
+    if( !f->repeated ){
+      if( wire != f->wire ) return ERR_MALFORMED;
+      if( (err = pbReadValue(L, p, q, s, f, uv, depth)) ) return err;
+      lua_rawset(L, t);
+      continue;
+    }
+
+    lua_pushvalue(L, -1);
+    lua_rawget(L, t);
+    if( lua_isnil(L, -1) ){
+      lua_pop(L, 1);
+      lua_newtable(L);
+      lua_pushvalue(L, -2);
+      lua_pushvalue(L, -2);
+      lua_rawset(L, t);
+    }
+    int n = (int)lua_objlen(L, -1);
+
+    // numbers may come packed whatever the schema says
+    if( wire == PB_LEN && f->wire != PB_LEN ){
+      uint64_t len;
+      if( (err = readVarUInt(q, &len)) ) return err;
+      if( getBytesAvailable(q) < len ) return ERR_OUTOFRANGE;
+      buflen_t length = q->length;
+      q->length = getPosition(q) + (buflen_t)len;
+      while( !err && getBytesAvailable(q) > 0 ){
+	if( !(err = pbReadScalar(L, q, f->type)) ) lua_rawseti(L, -2, ++n);
+      }
+      q->length = length;
+      if( err ) return err;
+    }
+    else {
+      if( wire != f->wire ) return ERR_MALFORMED;
+      if( (err = pbReadValue(L, p, q, s, f, uv, depth)) ) return err;
+      lua_rawseti(L, -2, ++n);
+    }
+    lua_pop(L, 2);
+  }
+
+  lua_remove(L, uv);
+  return ERR_OK;
+}
+
+// local t = buf:readProtobuf( schema[, length] ) -- length defaults to bytesAvailable
+static int lbytearr_readpb( lua_State *L )
+{
+  check_userdata_self(L);
+
+  Buf *p = lua_tobuffer(L, 1);
+  const PbSchema *s = luaL_checkudata(L, 2, PB_SCHEMA_MT);
+  lua_Integer len = luaL_optinteger(L, 3, getBytesAvailable(p));
+  luaL_argcheck(L, 0 <= len && (uint64_t)len <= getBytesAvailable(p), 3, MSG_OUTOFRANGE);
+
+  // fixed width values are little endian on the wire
+  Buf q = *p;
+  q.flag.endian = ENDIAN_LITTLE;
+  q.length = getPosition(p) + (buflen_t)len;
+  handle_error( pbDecode(L, p, &q, s, 2, 0) );
+
+  p->position = q.position;
+  return 1;
+}
+
+static inline uint32_t toLE32( uint32_t v )
+{
+  return getNativeEndian() == ENDIAN_BIG ? BSWAP32(v) : v;
+}
+
+static inline uint64_t toLE64( uint64_t v )
+{
+  return getNativeEndian() == ENDIAN_BIG ? BSWAP64(v) : v;
+}
+
+static int pbWriteScalar( lua_State *L, Buf *p, int type, int idx )
+{
+  int ok;
+  uint64_t u;
+  switch( type ){
+  case PBT_DOUBLE: {
+    double v = lua_tonumx(L, idx, &ok);
+    memcpy(&u, &v, sizeof(u));
+    u = toLE64(u);
+    return ok ? writeBytes(p, &u, 0, 8) : ERR_INVALIDTYPE;
+  }
+  case PBT_FLOAT: {
+    float v = (float)lua_tonumx(L, idx, &ok);
+    uint32_t w;
+    memcpy(&w, &v, sizeof(w));
+    w = toLE32(w);
+    return ok ? writeBytes(p, &w, 0, 4) : ERR_INVALIDTYPE;
+  }
+  case PBT_FIXED32:
+  case PBT_SFIXED32: {
+    uint32_t w = toLE32((uint32_t)lua_tointx(L, idx, &ok));
+    return ok ? writeBytes(p, &w, 0, 4) : ERR_INVALIDTYPE;
+  }
+  case PBT_FIXED64:
+  case PBT_UINT64:
+    u = lua_touint64(L, idx, &ok);
+    break;
+  case PBT_SFIXED64:
+  case PBT_INT64:
+    u = (uint64_t)lua_toint64(L, idx, &ok);
+    break;
+  case PBT_SINT64:
+    u = ZIGZAG_ENCODE(lua_toint64(L, idx, &ok));
+    break;
+  case PBT_SINT32:
+    u = ZIGZAG_ENCODE((int32_t)lua_tointx(L, idx, &ok));
+    break;
+  case PBT_UINT32:
+    u = (uint32_t)lua_tointx(L, idx, &ok);
+    break;
+  case PBT_BOOL:
+    ok = lua_isboolean(L, idx);
+    u = lua_toboolean(L, idx);
+    break;
+  default:
+    // negative int32 are sign extended to ten bytes
+    u = (uint64_t)(int64_t)(int32_t)lua_tointx(L, idx, &ok);
+    break;
+  }
+  if( !ok ) return ERR_INVALIDTYPE;
+  if( type == PBT_FIXED64 || type == PBT_SFIXED64 ){
+    u = toLE64(u);
+    return writeBytes(p, &u, 0, 8);
+  }
+  return writeVarUInt(p, u);
+}
+
+typedef struct {
+  int depth;
+  const char *field;   // name of the field with a value of invalid type
+} PbState;
+
+static int pbEncode( lua_State *L, Buf *p, const PbSchema *s, int schema, int t, PbState *st );
+
+// writes the value at the top of the stack, key included
+static int pbWriteValue( lua_State *L, Buf *p, const PbSchema *s, const PbField *f, int uv, PbState *st )
+{
+  // a ByteArray is written as it is, such as a lazy message. It may be
+  // p itself, so its length is taken before the key goes in
+  buflen_t len = 0;
+  Buf *b = NULL;
+  if( f->wire == PB_LEN && lua_isbytearray(L, -1) ){
+    b = lua_touserdata(L, -1);
+    len = getLength(b);
+  }
+
+  int err = writeVarUInt(p, ((uint64_t)f->number << 3) | f->wire);
+  if( err ) return err;
+  if( f->wire != PB_LEN ) return pbWriteScalar(L, p, f->type, -1);
+
+  if( b ){
+    if( (err = writeVarUInt(p, len)) ) return err;
+    return writeBuf(p, b, len);
+  }
+  if( f->type != PBT_MESSAGE ){
+    if( lua_type(L, -1) != LUA_TSTRING ) return ERR_INVALIDTYPE;
+    size_t l;
+    const char *str = lua_tolstring(L, -1, &l);
+    if( (err = writeVarUInt(p, l)) ) return err;
+    return writeBytes(p, str, 0, l);
+  }
+
+  if( !lua_istable(L, -1) ) return ERR_INVALIDTYPE;
+  if( st->depth >= BYTEARRAY_MAX_DEPTH ) return ERR_DEPTH;
+  buflen_t start;
+  if( (err = pbBeginLen(p, &start)) ) return err;
+  lua_rawgeti(L, uv, (int)(s->nfield + f->slot));
+  ++st->depth;
+  err = pbEncode(L, p, lua_touserdata(L, -1), lua_gettop(L), lua_gettop(L) - 1, st);
+  --st->depth;
+  if( err ) return err;
+  lua_pop(L, 1);
+  return pbEndLen(p, start);
+}
+
+// fields in the order of their numbers, nil values are left out
+static int pbEncode( lua_State *L, Buf *p, const PbSchema *s, int schema, int t, PbState *st )
+{
+  luaL_checkstack(L, 8, MSG_DEPTH);
+  lua_getfenv(L, schema);
+  int uv = lua_gettop(L);
+
+  int err = ERR_OK;
+  for( size_t i=0; i < s->nfield && !err; ++i ){
+    const PbField *f = &s->field[i];
+    lua_rawgeti(L, uv, (int)f->slot);
+    st->field = lua_tostring(L, -1);
+    lua_rawget(L, t);
+    if( lua_isnil(L, -1) ){
+      lua_pop(L, 1);
+      continue;
+    }
+    if( !f->repeated ){
+      err = pbWriteValue(L, p, s, f, uv, st);
+    }
+    else if( !lua_istable(L, -1) ){
+      err = ERR_INVALIDTYPE;
+    }
+    else if( f->packed ){
+      int n = (int)lua_objlen(L, -1);
+      buflen_t start;
+      if( n > 0 && !(err = writeVarUInt(p, ((uint64_t)f->number << 3) | PB_LEN)) &&
+	  !(err = pbBeginLen(p, &start)) ){
+	for( int j=1; j <= n && !err; ++j ){
+	  lua_rawgeti(L, -1, j);
+	  err = pbWriteScalar(L, p, f->type, -1);
+	  lua_pop(L, 1);
+	}
+	if( !err ) err = pbEndLen(p, start);
+      }
+    }
+    else {
+      int n = (int)lua_objlen(L, -1);
+      for( int j=1; j <= n && !err; ++j ){
+	lua_rawgeti(L, -1, j);
+	err = pbWriteValue(L, p, s, f, uv, st);
+	lua_pop(L, 1);
+      }
+    }
+    lua_pop(L, 1);
+  }
+  if( err ) return err;
+
+  lua_pop(L, 1);
+  return ERR_OK;
+}
+
+// where an encoder writes for p: p itself when it appends, else a
+// scratch ByteArray left on the stack so that a failure keeps the bytes
+// after the position of p
+static Buf* lua_toscratch( lua_State *L, Buf *p )
+{
+  if( getPosition(p) >= getLength(p) ) return p;
+  Buf *q;
+  new_buffer( q, 0, getEndian(p) );
+  return q;
+}
+
+// buf:writeProtobuf( schema, t ) -- nothing is written if a value does not fit
+static int lbytearr_writepb( lua_State *L )
+{
+  check_userdata_self(L);
+
+  Buf *p = lua_tobuffer(L, 1);
+  const PbSchema *s = luaL_checkudata(L, 2, PB_SCHEMA_MT);
+  luaL_checktype(L, 3, LUA_TTABLE);
+  lua_settop(L, 3);
+  Buf *q = lua_toscratch(L, p);
+
+  buflen_t position = getPosition(p), length = getLength(p);
+  PbState st = { 0, NULL };
+  int err = pbEncode(L, q, s, 2, 3, &st);
+  if( !err && q != p ) err = writeBuf(p, q, getLength(q));
+  if( err ){
+    p->position = position;
+    p->length = length;
+    if( err == ERR_INVALIDTYPE ) luaL_error(L, "%s: %s", st.field, MSG_INVALIDTYPE);
+    handle_error( err );
+  }
+
+  lua_settop(L, 1);
+  return 1;
+}
+
+// ------------ AMF3 ---------------
+// Strings, objects and traits are sent once and then referenced by
+// index, the tables live on the lua stack for the length of one call.
+// Objects of a class carry its name in the member __class.
+#define AMF3_CLASS   "__class"
+
+typedef struct {
+  int strings, objects, traits;   // stack index of the tables
+  int nstring, nobject, ntrait;
+  int depth;
+} AmfState;
+
+static int amfReadValue( lua_State *L, Buf *p, Buf *q, AmfState *st );
+
+// pushes the value of reference h from the table at tab
+static int amfPushRef( lua_State *L, int tab, uint32_t h )
+{
+  lua_rawgeti(L, tab, (int)(h >> 1) + 1);
+  return lua_isnil(L, -1) ? ERR_MALFORMED : ERR_OK;
+}
+
+static inline void amfKeep( lua_State *L, int tab, int *n )
+{
+  lua_pushvalue(L, -1);
+  lua_rawseti(L, tab, ++*n);
+}
+
+static int amfReadString( lua_State *L, Buf *q, AmfState *st )
+{
+  uint32_t h;
+  int err = readU29(q, &h);
+  if( err ) return err;
+  if( !(h & 1) ) return amfPushRef(L, st->strings, h);
+
+  buflen_t len = h >> 1;
+  if( getBytesAvailable(q) < len ) return ERR_OUTOFRANGE;
+  lua_pushlstring(L, (const char*)q->buffer + q->position, len);
+  q->position += len;
+  // the empty string is never referenced
+  if( len > 0 ) amfKeep(L, st->strings, &st->nstring);
+  return ERR_OK;
+}
+
+// string pairs until an empty name, set into the table at -1
+static int amfReadMembers( lua_State *L, Buf *p, Buf *q, AmfState *st, int *n )
+{
+  for( ;; ++*n ){
+    int err = amfReadString(L, q, st);
+    if( err ) return err;
+    if( lua_objlen(L, -1) == 0 ){
+      lua_pop(L, 1);
+      return ERR_OK;
+    }
+    if( (err = amfReadValue(L, p, q, st)) ) return err;
+    lua_rawset(L, -3);
+  }
+}
+
+static int amfReadArray( lua_State *L, Buf *p, Buf *q, AmfState *st, uint32_t h )
+{
+  int n = (int)(h >> 1);
+  // every element takes a byte at least, checked before presizing
+  if( (buflen_t)n > getBytesAvailable(q) ) return ERR_OUTOFRANGE;
+  lua_createtable(L, n, 0);
+  amfKeep(L, st->objects, &st->nobject);
+
+  int m = 0;
+  int err = amfReadMembers(L, p, q, st, &m);
+  for( int i=1; i <= n && !err; ++i ){
+    if( !(err = amfReadValue(L, p, q, st)) ) lua_rawseti(L, -2, i);
+  }
+  return err;
+}
+
+static int amfReadObject( lua_State *L, Buf *p, Buf *q, AmfState *st, uint32_t h )
+{
+  int err;
+  // traits are { class name, dynamic, sealed member names... } and
+  // [0] the number of dynamic members of the last object
+  if( !(h & 2) ){
+    if( (err = amfPushRef(L, st->traits, h >> 1)) ) return err;
+  }
+  else {
+    // externalizable classes have their own encoding
+    if( h & 4 ) return ERR_MALFORMED;
+    int nsealed = (int)(h >> 4);
+    if( (buflen_t)nsealed > getBytesAvailable(q) ) return ERR_OUTOFRANGE;
+    lua_createtable(L, nsealed + 2, 0);
+    if( (err = amfReadString(L, q, st)) ) return err;
+    lua_rawseti(L, -2, 1);
+    lua_pushboolean(L, (h & 8) != 0);
+    lua_rawseti(L, -2, 2);
+    for( int i=1; i <= nsealed; ++i ){
+      luaL_checkstack(L, 4, MSG_DEPTH);
+      if( (err = amfReadString(L, q, st)) ) return err;
+      lua_rawseti(L, -2, i + 2);
+    }
+    amfKeep(L, st->traits, &st->ntrait);
+  }
+  int tr = lua_gettop(L);
+  int nsealed = (int)lua_objlen(L, tr) - 2;
+  lua_rawgeti(L, tr, 0);
+  int ndynamic = (int)lua_tointeger(L, -1);
+  lua_pop(L, 1);
+  if( (buflen_t)nsealed > getBytesAvailable(q) ) return ERR_OUTOFRANGE;
+
+  lua_createtable(L, 0, 1 + nsealed + ndynamic);
+  amfKeep(L, st->objects, &st->nobject);
+  lua_rawgeti(L, tr, 1);
+  if( lua_objlen(L, -1) > 0 ){
+    lua_setfield(L, -2, AMF3_CLASS);
+  }
+  else lua_pop(L, 1);
+
+  for( int i=1; i <= nsealed; ++i ){
+    lua_rawgeti(L, tr, i + 2);
+    if( (err = amfReadValue(L, p, q, st)) ) return err;
+    lua_rawset(L, -3);
+  }
+  lua_rawgeti(L, tr, 2);
+  int dynamic = lua_toboolean(L, -1);
+  lua_pop(L, 1);
+  int n = 0;
+  if( dynamic && (err = amfReadMembers(L, p, q, st, &n)) ) return err;
+  if( n != ndynamic ){
+    lua_pushinteger(L, n);
+    lua_rawseti(L, tr, 0);
+  }
+
+  lua_remove(L, tr);
+  return ERR_OK;
+}
+
+// pushes one value, q is a big endian copy of p
+static int amfReadValue( lua_State *L, Buf *p, Buf *q, AmfState *st )
+{
+  luaL_checkstack(L, 8, MSG_DEPTH);
+  uint8_t marker;
+  uint32_t h;
+  double d;
+  int err = readUnsignedByte(q, &marker);
+  if( err ) return err;
+
+  switch( marker ){
+  case AMF3_UNDEFINED:
+  case AMF3_NULL:
+    lua_pushnil(L);
+    return ERR_OK;
+  case AMF3_FALSE:
+  case AMF3_TRUE:
+    lua_pushboolean(L, marker == AMF3_TRUE);
+    return ERR_OK;
+  case AMF3_INTEGER:
+    if( (err = readU29(q, &h)) ) return err;
+    // 29 bit two's complement
+    lua_pushinteger(L, (h & 0x10000000) ? (lua_Integer)h - 0x20000000 : (lua_Integer)h);
+    return ERR_OK;
+  case AMF3_DOUBLE:
+    if( (err = readDouble(q, &d)) ) return err;
+    lua_pushnumber(L, d);
+    return ERR_OK;
+  case AMF3_STRING:
+    return amfReadString(L, q, st);
+  }
+
+  // the rest are objects, sent once and then referenced
+  if( (err = readU29(q, &h)) ) return err;
+  if( !(h & 1) ) return amfPushRef(L, st->objects, h);
+  if( st->depth >= BYTEARRAY_MAX_DEPTH ) return ERR_DEPTH;
+
+  buflen_t len = h >> 1;
+  switch( marker ){
+  case AMF3_DATE:
+    // milliseconds since 1970
+    if( (err = readDouble(q, &d)) ) return err;
+    lua_pushnumber(L, d);
+    break;
+  case AMF3_XMLDOC:
+  case AMF3_XML:
+  case AMF3_BYTEARRAY:
+    if( getBytesAvailable(q) < len ) return ERR_OUTOFRANGE;
+    if( marker == AMF3_BYTEARRAY ){
+      if( (err = lua_pushview(L, p, q->position, len)) ) return err;
+    }
+    else lua_pushlstring(L, (const char*)q->buffer + q->position, len);
+    q->position += len;
+    break;
+  case AMF3_ARRAY:
+  case AMF3_OBJECT:
+    ++st->depth;
+    err = marker == AMF3_ARRAY ? amfReadArray(L, p, q, st, h) : amfReadObject(L, p, q, st, h);
+    --st->depth;
+    return err;
+  default:
+    // vectors and dictionaries are not supported
+    return ERR_MALFORMED;
+  }
+  amfKeep(L, st->objects, &st->nobject);
+  return ERR_OK;
+}
+
+static void amfBegin( lua_State *L, AmfState *st )
+{
+  lua_newtable(L);
+  st->strings = lua_gettop(L);
+  lua_newtable(L);
+  st->objects = lua_gettop(L);
+  lua_newtable(L);
+  st->traits = lua_gettop(L);
+  st->nstring = st->nobject = st->ntrait = 0;
+  st->depth = 0;
+}
+
+// local v = buf:readObject() -- one AMF3 value
+static int lbytearr_readobj( lua_State *L )
+{
+  check_userdata_self(L);
+
+  Buf *p = lua_tobuffer(L, 1);
+  AmfState st;
+  amfBegin(L, &st);
 
-// declare name for module
-#define MODULE_NAME                    "ByteArray"
+  Buf q = *p;
+  q.flag.endian = ENDIAN_BIG;
+  handle_error( amfReadValue(L, p, &q, &st) );
 
-#define CONSTANT_ENDIAN_L              "LITTLE_ENDIAN"
-#define CONSTANT_ENDIAN_B              "BIG_ENDIAN"
+  p->position = q.position;
+  return 1;
+}
 
-// declare constructor
-#define CONSTRUCTOR_CREATE             "create"
-#define CONSTRUCTOR_INITER             "init"  
-#define CONSTRUCTOR_FROMARR            "load"  
+static int amfWriteValue( lua_State *L, Buf *p, int idx, AmfState *st );
 
-// declare member
-#define MEMBER_LENGTH                  "length"
-#define MEMBER_POSITION                "position"   
-#define MEMBER_ENDIAN                  "endian"
-#define MEMBER_AVAILABLE               "bytesAvailable"
+static int amfWriteString( lua_State *L, Buf *p, int idx, AmfState *st )
+{
+  size_t l;
+  const char *s = lua_tolstring(L, idx, &l);
+  if( l == 0 ) return writeU29(p, 1);
+
+  lua_pushvalue(L, idx);
+  lua_rawget(L, st->strings);
+  if( !lua_isnil(L, -1) ){
+    uint32_t ref = (uint32_t)lua_tointeger(L, -1);
+    lua_pop(L, 1);
+    return writeU29(p, ref << 1);
+  }
+  lua_pop(L, 1);
+
+  if( l > (U29_MAX >> 1) ) return ERR_OVERFLOW;
+  lua_pushvalue(L, idx);
+  lua_pushinteger(L, st->nstring++);
+  lua_rawset(L, st->strings);
+  int err = writeU29(p, (uint32_t)(l << 1 | 1));
+  return err ? err : writeBytes(p, s, 0, l);
+}
 
-// declare method
-#define METHOD_READBOOL                "readBoolean"
-#define METHOD_WRITEBOOL               "writeBoolean"
-#define METHOD_READU8                  "readUnsignedByte"
-#define METHOD_WRITEU8                 "writeUnsignedByte"
-#define METHOD_READS8                  "readByte"
-#define METHOD_WRITES8                 "writeByte"
-#define METHOD_READU16                 "readUnsignedShort"
-#define METHOD_WRITEU16                "writeUnsignedShort"
-#define METHOD_READS16                 "readShort"
-#define METHOD_WRITES16                "writeShort"
-#define METHOD_READU32                 "readUnsignedInt"
-#define METHOD_WRITEU32                "writeUnsignedInt"
-#define METHOD_READS32                 "readInt"
-#define METHOD_WRITES32                "writeInt"
-#define METHOD_READFLOAT               "readFloat"
-#define METHOD_WRITEFLOAT              "writeFloat"
-#define METHOD_READDOUBLE              "readDouble"
-#define METHOD_WRITEDOUBLE             "writeDouble"
-#define METHOD_READCSTR                "readCString"
-#define METHOD_WRITECSTR               "writeCString"
-#define METHOD_READSTR                 "readString"
-#define METHOD_WRITESTR                "writeString"
+// a member name, numbers become strings
+static int amfWriteKey( lua_State *L, Buf *p, int idx, AmfState *st )
+{
+  int t = lua_type(L, idx);
+  if( t != LUA_TSTRING && t != LUA_TNUMBER ) return ERR_INVALIDTYPE;
+  // a copy, lua_tolstring would change the key of lua_next
+  lua_pushvalue(L, idx);
+  lua_tostring(L, -1);
+  int err = amfWriteString(L, p, lua_gettop(L), st);
+  lua_pop(L, 1);
+  return err;
+}
+
+// members of the table at t other than the array part 1..n
+static int amfWriteMembers( lua_State *L, Buf *p, int t, int n, AmfState *st )
+{
+  int err = ERR_OK;
+  lua_pushnil(L);
+  while( !err && lua_next(L, t) ){
+    int k = lua_gettop(L) - 1;
+    if( lua_type(L, k) == LUA_TNUMBER ){
+      lua_Number x = lua_tonumber(L, k);
+      if( x >= 1 && x <= n && x == (int)x ){
+	lua_pop(L, 1);
+	continue;
+      }
+    }
+    else if( lua_type(L, k) == LUA_TSTRING && strcmp(lua_tostring(L, k), AMF3_CLASS) == 0 ){
+      lua_pop(L, 1);
+      continue;
+    }
+    if( !(err = amfWriteKey(L, p, k, st)) )
+      err = amfWriteValue(L, p, k + 1, st);
+    lua_pop(L, 1);
+  }
+  if( err ){
+    lua_pop(L, 1);
+    return err;
+  }
+  return writeU29(p, 1);
+}
+
+// a sequence is an array, the other keys go to its associative part
+static int amfIsArray( lua_State *L, int t )
+{
+  if( lua_objlen(L, t) == 0 ) return 0;
+  lua_getfield(L, t, AMF3_CLASS);
+  int typed = lua_type(L, -1) == LUA_TSTRING;
+  lua_pop(L, 1);
+  return !typed;
+}
+
+static int amfWriteTable( lua_State *L, Buf *p, int t, AmfState *st )
+{
+  int n = (int)lua_objlen(L, t);
+  int err;
+  if( amfIsArray(L, t) ){
+    if( (err = writeUnsignedByte(p, AMF3_ARRAY)) ) return err;
+    if( (err = writeU29(p, (uint32_t)n << 1 | 1)) ) return err;
+    if( (err = amfWriteMembers(L, p, t, n, st)) ) return err;
+    for( int i=1; i <= n && !err; ++i ){
+      lua_rawgeti(L, t, i);
+      err = amfWriteValue(L, p, lua_gettop(L), st);
+      lua_pop(L, 1);
+    }
+    return err;
+  }
+
+  // dynamic object, traits are referenced by class name
+  lua_getfield(L, t, AMF3_CLASS);
+  if( lua_type(L, -1) != LUA_TSTRING ){
+    lua_pop(L, 1);
+    lua_pushliteral(L, "");
+  }
+  int cls = lua_gettop(L);
+  if( (err = writeUnsignedByte(p, AMF3_OBJECT)) ) return err;
+  lua_pushvalue(L, cls);
+  lua_rawget(L, st->traits);
+  if( !lua_isnil(L, -1) ){
+    err = writeU29(p, (uint32_t)lua_tointeger(L, -1) << 2 | 1);
+    lua_pop(L, 1);
+  }
+  else {
+    lua_pop(L, 1);
+    lua_pushvalue(L, cls);
+    lua_pushinteger(L, st->ntrait++);
+    lua_rawset(L, st->traits);
+    // inline traits, dynamic, no sealed members
+    if( !(err = writeU29(p, 0x0b)) )
+      err = amfWriteString(L, p, cls, st);
+  }
+  lua_pop(L, 1);
+  return err ? err : amfWriteMembers(L, p, t, 0, st);
+}
+
+static int amfWriteValue( lua_State *L, Buf *p, int idx, AmfState *st )
+{
+  luaL_checkstack(L, 8, MSG_DEPTH);
+  int err;
+  switch( lua_type(L, idx) ){
+  case LUA_TNIL:
+    return writeUnsignedByte(p, AMF3_NULL);
+  case LUA_TBOOLEAN:
+    return writeUnsignedByte(p, lua_toboolean(L, idx) ? AMF3_TRUE : AMF3_FALSE);
+  case LUA_TNUMBER: {
+    lua_Number d = lua_tonumber(L, idx);
+#if LUA_VERSION_NUM >= 503
+    if( lua_isinteger(L, idx) ){
+      lua_Integer i = lua_tointeger(L, idx);
+      if( AMF3_INTMIN <= i && i <= AMF3_INTMAX ){
+	if( (err = writeUnsignedByte(p, AMF3_INTEGER)) ) return err;
+	return writeU29(p, (uint32_t)i & U29_MAX);
+      }
+    }
+    else
+#endif
+    if( AMF3_INTMIN <= d && d <= AMF3_INTMAX && d == (int32_t)d ){
+      if( (err = writeUnsignedByte(p, AMF3_INTEGER)) ) return err;
+      return writeU29(p, (uint32_t)(int32_t)d & U29_MAX);
+    }
+    uint64_t u;
+    memcpy(&u, &d, sizeof(u));
+    if( getNativeEndian() == ENDIAN_LITTLE ) u = BSWAP64(u);
+    if( (err = writeUnsignedByte(p, AMF3_DOUBLE)) ) return err;
+    return writeBytes(p, &u, 0, sizeof(u));
+  }
+  case LUA_TSTRING:
+    if( (err = writeUnsignedByte(p, AMF3_STRING)) ) return err;
+    return amfWriteString(L, p, idx, st);
+  case LUA_TTABLE:
+  case LUA_TUSERDATA:
+    break;
+  default:
+    return ERR_INVALIDTYPE;
+  }
+
+  int isbuf = lua_type(L, idx) == LUA_TUSERDATA;
+  if( isbuf && !lua_isbytearray(L, idx) ) return ERR_INVALIDTYPE;
+
+  // a table or ByteArray met again, cycles included, is a reference
+  lua_pushvalue(L, idx);
+  lua_rawget(L, st->objects);
+  if( !lua_isnil(L, -1) ){
+    uint32_t ref = (uint32_t)lua_tointeger(L, -1);
+    lua_pop(L, 1);
+    int marker = isbuf ? AMF3_BYTEARRAY : amfIsArray(L, idx) ? AMF3_ARRAY : AMF3_OBJECT;
+    if( (err = writeUnsignedByte(p, marker)) ) return err;
+    return writeU29(p, ref << 1);
+  }
+  lua_pop(L, 1);
+  lua_pushvalue(L, idx);
+  lua_pushinteger(L, st->nobject++);
+  lua_rawset(L, st->objects);
+
+  if( isbuf ){
+    // b may be p itself, its length is taken before the marker
+    Buf *b = lua_touserdata(L, idx);
+    buflen_t len = getLength(b);
+    if( len > (U29_MAX >> 1) ) return ERR_OVERFLOW;
+    if( (err = writeUnsignedByte(p, AMF3_BYTEARRAY)) ) return err;
+    if( (err = writeU29(p, len << 1 | 1)) ) return err;
+    return writeBuf(p, b, len);
+  }
+
+  if( st->depth >= BYTEARRAY_MAX_DEPTH ) return ERR_DEPTH;
+  ++st->depth;
+  err = amfWriteTable(L, p, idx, st);
+  --st->depth;
+  return err;
+}
+
+// buf:writeObject( v ) -- v as AMF3, nothing is written if it cannot be
+static int lbytearr_writeobj( lua_State *L )
+{
+  check_userdata_self(L);
+
+  Buf *p = lua_tobuffer(L, 1);
+  lua_settop(L, 2);
+  Buf *q = lua_toscratch(L, p);
+  // value -> index maps, unlike the arrays of readObject
+  AmfState st;
+  amfBegin(L, &st);
+
+  buflen_t position = getPosition(p), length = getLength(p);
+  int err = amfWriteValue(L, q, 2, &st);
+  if( !err && q != p ) err = writeBuf(p, q, getLength(q));
+  if( err ){
+    p->position = position;
+    p->length = length;
+    handle_error( err );
+  }
+
+  lua_settop(L, 1);
+  return 1;
+}
+
+// ------------ MessagePack ---------------
+
+static int mpReadValue( lua_State *L, Buf *p, Buf *q, int depth );
+
+static int mpReadArray( lua_State *L, Buf *p, Buf *q, uint64_t n, int depth )
+{
+  // every element takes a byte at least
+  if( n > getBytesAvailable(q) ) return ERR_OUTOFRANGE;
+  if( n > INT_MAX ) return ERR_OVERFLOW;
+  if( depth >= BYTEARRAY_MAX_DEPTH ) return ERR_DEPTH;
+  lua_createtable(L, (int)n, 0);
+  for( uint64_t i=1; i <= n; ++i ){
+    int err = mpReadValue(L, p, q, depth + 1);
+    if( err ) return err;
+    lua_rawseti(L, -2, (int)i);
+  }
+  return ERR_OK;
+}
+
+static int mpReadMap( lua_State *L, Buf *p, Buf *q, uint64_t n, int depth )
+{
+  if( n > getBytesAvailable(q) / 2 ) return ERR_OUTOFRANGE;
+  if( n > INT_MAX ) return ERR_OVERFLOW;
+  if( depth >= BYTEARRAY_MAX_DEPTH ) return ERR_DEPTH;
+  lua_createtable(L, 0, (int)n);
+  for( uint64_t i=0; i < n; ++i ){
+    int err = mpReadValue(L, p, q, depth + 1);
+    if( !err ) err = mpReadValue(L, p, q, depth + 1);
+    if( err ) return err;
+    // nil and NaN can not be keys
+    if( lua_isnil(L, -2) || lua_rawequal(L, -2, -2) == 0 ) return ERR_MALFORMED;
+    lua_rawset(L, -3);
+  }
+  return ERR_OK;
+}
+
+// pushes one value, q is a big endian copy of p
+static int mpReadValue( lua_State *L, Buf *p, Buf *q, int depth )
+{
+  luaL_checkstack(L, 8, MSG_DEPTH);
+  uint8_t m;
+  uint64_t n;
+  int err = readUnsignedByte(q, &m);
+  if( err ) return err;
+
+  if( m < MP_FIXMAP || m >= MP_NEGFIXINT ){
+    lua_pushinteger(L, (int8_t)m);
+    return ERR_OK;
+  }
+  if( m < MP_FIXARRAY ) return mpReadMap(L, p, q, m & 0x0f, depth);
+  if( m < MP_FIXSTR ) return mpReadArray(L, p, q, m & 0x0f, depth);
+  if( m < MP_NIL ){
+    n = m & 0x1f;
+    goto str;
+  }
+
+  switch( m ){
+  case MP_NIL:
+    lua_pushnil(L);
+    return ERR_OK;
+  case MP_FALSE:
+  case MP_TRUE:
+    lua_pushboolean(L, m == MP_TRUE);
+    return ERR_OK;
+  case MP_BIN8:
+  case MP_BIN8 + 1:
+  case MP_BIN8 + 2:
+    if( (err = mpReadUInt(q, (buflen_t)1 << (m - MP_BIN8), &n)) ) return err;
+    if( getBytesAvailable(q) < n ) return ERR_OUTOFRANGE;
+    if( (err = lua_pushview(L, p, q->position, (buflen_t)n)) ) return err;
+    q->position += n;
+    return ERR_OK;
+  case MP_FLOAT32: {
+    float f;
+    if( (err = readFloat(q, &f)) ) return err;
+    lua_pushnumber(L, f);
+    return ERR_OK;
+  }
+  case MP_FLOAT64: {
+    double d;
+    if( (err = readDouble(q, &d)) ) return err;
+    lua_pushnumber(L, d);
+    return ERR_OK;
+  }
+  case MP_UINT8:
+  case MP_UINT8 + 1:
+  case MP_UINT8 + 2:
+  case MP_UINT8 + 3:
+    if( (err = mpReadUInt(q, (buflen_t)1 << (m - MP_UINT8), &n)) ) return err;
+    lua_pushuint64(L, n);
+    return ERR_OK;
+  case MP_INT8:
+  case MP_INT8 + 1:
+  case MP_INT8 + 2:
+  case MP_INT8 + 3: {
+    int shift = 64 - (8 << (m - MP_INT8));
+    if( (err = mpReadUInt(q, (buflen_t)1 << (m - MP_INT8), &n)) ) return err;
+    lua_pushint64(L, (int64_t)(n << shift) >> shift);
+    return ERR_OK;
+  }
+  case MP_STR8:
+  case MP_STR8 + 1:
+  case MP_STR8 + 2:
+    if( (err = mpReadUInt(q, (buflen_t)1 << (m - MP_STR8), &n)) ) return err;
+    goto str;
+  case MP_ARRAY16:
+  case MP_ARRAY32:
+    if( (err = mpReadUInt(q, (buflen_t)2 << (m - MP_ARRAY16), &n)) ) return err;
+    return mpReadArray(L, p, q, n, depth);
+  case MP_MAP16:
+  case MP_MAP32:
+    if( (err = mpReadUInt(q, (buflen_t)2 << (m - MP_MAP16), &n)) ) return err;
+    return mpReadMap(L, p, q, n, depth);
+  default:
+    // extension types are not supported
+    return ERR_MALFORMED;
+  }
+
+ str:
+  if( getBytesAvailable(q) < n ) return ERR_OUTOFRANGE;
+  lua_pushlstring(L, (const char*)q->buffer + q->position, (size_t)n);
+  q->position += n;
+  return ERR_OK;
+}
+
+// local v = buf:readMsgPack() -- one MessagePack value
+static int lbytearr_readmp( lua_State *L )
+{
+  check_userdata_self(L);
+
+  Buf *p = lua_tobuffer(L, 1);
+  Buf q = *p;
+  q.flag.endian = ENDIAN_BIG;
+  handle_error( mpReadValue(L, p, &q, 0) );
+
+  p->position = q.position;
+  return 1;
+}
+
+static const char *const mp_policies[] = { "auto", "double", "single", NULL };
+
+typedef struct {
+  int policy;
+  int depth;
+  const void *path[BYTEARRAY_MAX_DEPTH];  // tables being written
+} MpState;
+
+static int mpWriteValue( lua_State *L, Buf *p, int idx, MpState *st );
+
+// bytes a value takes at most, nested tables not counted
+static inline size_t mpSizeHint( lua_State *L, int idx )
+{
+  switch( lua_type(L, idx) ){
+  case LUA_TNUMBER: return 9;
+  case LUA_TSTRING: return lua_objlen(L, idx) + 5;
+  default: return 1;
+  }
+}
+
+// an integer key in 1..n
+static inline int mpIsIndex( lua_State *L, int idx, size_t n )
+{
+  if( lua_type(L, idx) != LUA_TNUMBER ) return 0;
+#if LUA_VERSION_NUM >= 503
+  if( lua_isinteger(L, idx) ){
+    lua_Integer i = lua_tointeger(L, idx);
+    return 1 <= i && (lua_Unsigned)i <= n;
+  }
+#endif
+  lua_Number x = lua_tonumber(L, idx);
+  return x >= 1 && x <= n && x == (lua_Number)(size_t)x;
+}
+
+// a table with keys 1..n only is an array, anything else a map
+static int mpWriteTable( lua_State *L, Buf *p, int t, MpState *st )
+{
+  const void *self = lua_topointer(L, t);
+  for( int i=0; i < st->depth; ++i ){
+    if( st->path[i] == self ) return ERR_CYCLE;
+  }
+  if( st->depth >= BYTEARRAY_MAX_DEPTH ) return ERR_DEPTH;
+
+  // one pass to count the pairs and reserve for them
+  size_t n = lua_objlen(L, t), count = 0, size = 5;
+  int array = n > 0;
+  lua_pushnil(L);
+  while( lua_next(L, t) ){
+    ++count;
+    if( array ) array = mpIsIndex(L, -2, n);
+    size += mpSizeHint(L, -2) + mpSizeHint(L, -1);
+    lua_pop(L, 1);
+  }
+  RANGE_RESERVE(p, size);
+
+  int err;
+  st->path[st->depth++] = self;
+  if( array ){
+    err = mpWriteLen(p, MP_FIXARRAY, 16, 0, MP_ARRAY16, n);
+    for( size_t i=1; i <= n && !err; ++i ){
+      lua_rawgeti(L, t, (int)i);
+      err = mpWriteValue(L, p, lua_gettop(L), st);
+      lua_pop(L, 1);
+    }
+  }
+  else {
+    err = mpWriteLen(p, MP_FIXMAP, 16, 0, MP_MAP16, count);
+    lua_pushnil(L);
+    while( !err && lua_next(L, t) ){
+      int k = lua_gettop(L) - 1;
+      if( !(err = mpWriteValue(L, p, k, st)) )
+	err = mpWriteValue(L, p, k + 1, st);
+      lua_pop(L, 1);
+    }
+    if( err ) lua_pop(L, 1);
+  }
+  --st->depth;
+  return err;
+}
+
+static int mpWriteValue( lua_State *L, Buf *p, int idx, MpState *st )
+{
+  luaL_checkstack(L, 8, MSG_DEPTH);
+  int err;
+  switch( lua_type(L, idx) ){
+  case LUA_TNIL:
+    return writeUnsignedByte(p, MP_NIL);
+  case LUA_TBOOLEAN:
+    return writeUnsignedByte(p, lua_toboolean(L, idx) ? MP_TRUE : MP_FALSE);
+  case LUA_TNUMBER:
+#if LUA_VERSION_NUM >= 503
+    if( lua_isinteger(L, idx) ) return mpWriteInt(p, lua_tointeger(L, idx));
+#endif
+    return mpWriteFloat(p, lua_tonumber(L, idx), st->policy);
+  case LUA_TSTRING: {
+    size_t l;
+    const char *s = lua_tolstring(L, idx, &l);
+    if( (err = mpWriteLen(p, MP_FIXSTR, 32, MP_STR8, MP_STR8 + 1, l)) ) return err;
+    return writeBytes(p, s, 0, l);
+  }
+  case LUA_TTABLE:
+    return mpWriteTable(L, p, idx, st);
+  case LUA_TUSERDATA:
+    if( lua_isbytearray(L, idx) ){
+      Buf *b = lua_touserdata(L, idx);
+      buflen_t len = getLength(b);
+      if( (err = mpWriteLen(p, 0, 0, MP_BIN8, MP_BIN8 + 1, len)) ) return err;
+      return writeBuf(p, b, len);
+    }
+    return ERR_INVALIDTYPE;
+  default:
+    return ERR_INVALIDTYPE;
+  }
+}
+
+// buf:writeMsgPack( v[, numbers] ) -- nothing is written if v cannot be
+static int lbytearr_writemp( lua_State *L )
+{
+  check_userdata_self(L);
+
+  Buf *p = lua_tobuffer(L, 1);
+  MpState st;
+  st.policy = luaL_checkoption(L, 3, "auto", mp_policies);
+  st.depth = 0;
+  lua_settop(L, 2);
+  Buf *q = lua_toscratch(L, p);
+
+  buflen_t position = getPosition(p), length = getLength(p);
+  int err = mpWriteValue(L, q, 2, &st);
+  if( !err && q != p ) err = writeBuf(p, q, getLength(q));
+  if( err ){
+    p->position = position;
+    p->length = length;
+    handle_error( err );
+  }
+
+  lua_settop(L, 1);
+  return 1;
+}
+
+// ------------ LZ4 ---------------
+
+// the ByteArray at idx, a new one of capacity sz if none, in the endian
+// of p or the native one
+static Buf* lua_totarget( lua_State *L, int idx, Buf *p, size_t sz )
+{
+  if( lua_isnoneornil(L, idx) ){
+    Buf *to;
+    new_buffer( to, sz <= BUFLEN_MAX ? (buflen_t)sz : BUFLEN_MAX, p ? getEndian(p) : getNativeEndian() );
+    lua_replace(L, idx);
+    return to;
+  }
+  luaL_argcheck(L, lua_isbytearray(L, idx) && lua_touserdata(L, idx) != p, idx, MSG_INVALIDTYPE);
+  return lua_touserdata(L, idx);
+}
+
+static inline int lua_checklevel( lua_State *L, int idx )
+{
+  int level = (int)luaL_optinteger(L, idx, 1);
+  luaL_argcheck(L, 1 <= level && level <= LZ4_MAXLEVEL, idx, MSG_OUTOFRANGE);
+  return level;
+}
+
+// local to = buf:compress( [to, level] ) -- the unread bytes as one LZ4
+// block at the position of to, a new ByteArray if not given
+static int lbytearr_compress( lua_State *L )
+{
+  check_userdata_self(L);
+
+  Buf *p = lua_tobuffer(L, 1);
+  size_t n = getBytesAvailable(p);
+  int level = lua_checklevel(L, 3);
+  if( n > LZ4_MAXINPUT ) handle_error( ERR_OVERFLOW );
+  lua_settop(L, 3);
+  Buf *to = lua_totarget(L, 2, p, LZ4_BOUND(n));
+  void *scratch = level > 1 ? lua_newuserdata(L, LZ4_SCRATCH_SIZE) : NULL;
+
+  handle_error( reserve(to, LZ4_BOUND(n)) );
+  to->position += lz4Encode(p->buffer + p->position, n, to->buffer + to->position, level, scratch);
+  UPDATE_LENGTH(to);
+  p->position += n;
+
+  lua_pushvalue(L, 2);
+  return 1;
+}
+
+// local to = buf:decompress( size[, to] ) -- one LZ4 block of size bytes
+// decoded, position moves past the block
+static int lbytearr_decompress( lua_State *L )
+{
+  check_userdata_self(L);
+
+  Buf *p = lua_tobuffer(L, 1);
+  lua_Number size = luaL_checknumber(L, 2);
+  luaL_argcheck(L, 0 <= size && size <= BUFLEN_MAX, 2, MSG_OVERFLOW);
+  size_t n = (size_t)size, consumed, produced;
+  lua_settop(L, 3);
+  Buf *to = lua_totarget(L, 3, p, n);
+
+  handle_error( reserve(to, n) );
+  uint8_t *out = to->buffer + to->position;
+  handle_error( lz4Decode(p->buffer + p->position, getBytesAvailable(p), out, out, n, &consumed, &produced) );
+  if( produced != n ) handle_error( ERR_MALFORMED );
+  to->position += n;
+  UPDATE_LENGTH(to);
+  p->position += consumed;
+
+  lua_pushvalue(L, 3);
+  return 1;
+}
+
+#define UPVALUE_TARGET     lua_upvalueindex(1)
+#define UPVALUE_STATE      lua_upvalueindex(2)
+#define UPVALUE_LEVEL      lua_upvalueindex(3)
+
+static Buf* lua_tosource( lua_State *L, int idx )
+{
+  luaL_argcheck(L, lua_isbytearray(L, idx) && !lua_rawequal(L, idx, UPVALUE_TARGET), idx, MSG_INVALIDTYPE);
+  return lua_touserdata(L, idx);
+}
+
+// put( src[, last] ) -- the unread bytes of src as blocks of a frame,
+// last ends the frame and the next call starts another
+static int lz4f_put( lua_State *L )
+{
+  Buf *to = lua_touserdata(L, UPVALUE_TARGET);
+  Buf *src = lua_tosource(L, 1);
+  int last = lua_toboolean(L, 2);
+  int level = (int)lua_tointeger(L, UPVALUE_LEVEL);
+  void *scratch = level > 1 ? lua_newuserdata(L, LZ4_SCRATCH_SIZE) : NULL;
+
+  buflen_t position = getPosition(to), length = getLength(to), from = getPosition(src);
+  int err = ERR_OK;
+  if( lua_tointeger(L, UPVALUE_STATE) == 0 ){
+    uint8_t h[7] = { 0, 0, 0, 0, LZ4F_FLG, LZ4F_BD };
+    store32le( h, LZ4F_MAGIC );
+    h[6] = (uint8_t)(xxh32(h + 4, 2, 0) >> 8);
+    err = writeBytes(to, h, 0, sizeof(h));
+  }
+  while( !err && getBytesAvailable(src) > 0 ){
+    size_t n = getBytesAvailable(src) < LZ4F_BLOCKSIZE ? getBytesAvailable(src) : LZ4F_BLOCKSIZE;
+    if( (err = reserve(to, 4 + LZ4_BOUND(n))) ) break;
+    const uint8_t *in = src->buffer + src->position;
+    uint8_t *dst = to->buffer + to->position;
+    size_t sz = lz4Encode(in, n, dst + 4, level, scratch);
+    if( sz < n ) store32le( dst, (uint32_t)sz );
+    else {
+      memcpy( dst + 4, in, n );
+      store32le( dst, (uint32_t)n | LZ4F_UNCOMPRESSED );
+      sz = n;
+    }
+    to->position += 4 + sz;
+    UPDATE_LENGTH(to);
+    src->position += n;
+  }
+  if( !err && last ){
+    uint8_t end[4] = { 0 };
+    err = writeBytes(to, end, 0, sizeof(end));
+  }
+  if( err ){
+    to->position = position;
+    to->length = length;
+    src->position = from;
+    handle_error( err );
+  }
+
+  lua_pushinteger(L, !last);
+  lua_replace(L, UPVALUE_STATE);
+  lua_pushvalue(L, UPVALUE_TARGET);
+  return 1;
+}
+
+// local done = get( src ) -- decodes the whole blocks in the unread bytes
+// of src, true at the end of a frame and the next call reads another
+static int lz4f_get( lua_State *L )
+{
+  Buf *to = lua_touserdata(L, UPVALUE_TARGET);
+  Buf *src = lua_tosource(L, 1);
+  // 0 before a header, else its FLG and BD bytes
+  lua_Integer state = lua_tointeger(L, UPVALUE_STATE);
+  int err = ERR_OK, done = 0;
+
+  while( !err && !done ){
+    const uint8_t *in = src->buffer + src->position;
+    size_t avail = getBytesAvailable(src);
+    int flg = (int)(state & 0xff), bd = (int)(state >> 8 & 0xff);
+    if( state == 0 ){
+      if( avail < 7 ) break;
+      flg = in[4];
+      bd = in[5];
+      if( load32le(in) != LZ4F_MAGIC || flg >> 6 != 1 || (flg & 0x02) || (bd & 0x8f) || bd >> 4 < 4 ){
+	err = ERR_MALFORMED;
+	break;
+      }
+      // dictionaries are not supported
+      if( flg & LZ4F_DICTID ){
+	err = ERR_MALFORMED;
+	break;
+      }
+      size_t hl = flg & LZ4F_CONTENT_SIZE ? 15 : 7;
+      if( avail < hl ) break;
+      if( (uint8_t)(xxh32(in + 4, hl - 5, 0) >> 8) != in[hl - 1] ){
+	err = ERR_MALFORMED;
+	break;
+      }
+      src->position += hl;
+      state = flg | bd << 8;
+      continue;
+    }
+
+    if( avail < 4 ) break;
+    uint32_t w = load32le(in);
+    if( w == 0 ){
+      size_t tail = flg & LZ4F_CONTENT_CHECKSUM ? 8 : 4;
+      if( avail < tail ) break;
+      src->position += tail;
+      state = 0;
+      done = 1;
+      break;
+    }
+    size_t bsize = w & ~LZ4F_UNCOMPRESSED, bmax = (size_t)1 << (8 + 2 * (bd >> 4));
+    size_t need = 4 + bsize + (flg & LZ4F_BLOCK_CHECKSUM ? 4 : 0);
+    if( bsize > bmax ){
+      err = ERR_MALFORMED;
+      break;
+    }
+    if( avail < need ) break;
+    if( (flg & LZ4F_BLOCK_CHECKSUM) && xxh32(in + 4, bsize, 0) != load32le(in + 4 + bsize) ){
+      err = ERR_MALFORMED;
+      break;
+    }
+    if( w & LZ4F_UNCOMPRESSED ) err = writeBytes(to, in + 4, 0, bsize);
+    else if( !(err = reserve(to, bmax)) ){
+      size_t consumed, produced;
+      uint8_t *out = to->buffer + to->position;
+      // linked blocks refer back into the output before them
+      const uint8_t *base = (flg & 0x20) ? out : to->buffer;
+      err = lz4Decode(in + 4, bsize, base, out, bmax, &consumed, &produced);
+      if( !err && consumed != bsize ) err = ERR_MALFORMED;
+      if( !err ){
+	to->position += produced;
+	UPDATE_LENGTH(to);
+      }
+    }
+    if( !err ) src->position += need;
+  }
+
+  lua_pushinteger(L, state);
+  lua_replace(L, UPVALUE_STATE);
+  handle_error( err );
+  lua_pushboolean(L, done);
+  return 1;
+}
+
+// local put = buf.compressStream( to[, level] )
+static int lbytearr_compressstream( lua_State *L )
+{
+  luaL_argcheck(L, lua_isbytearray(L, 1), 1, MSG_INVALIDTYPE);
+  int level = lua_checklevel(L, 2);
+  lua_settop(L, 1);
+  lua_pushinteger(L, 0);
+  lua_pushinteger(L, level);
+  lua_pushcclosure(L, lz4f_put, 3);
+  return 1;
+}
+
+// local get = buf.decompressStream( to )
+static int lbytearr_decompressstream( lua_State *L )
+{
+  luaL_argcheck(L, lua_isbytearray(L, 1), 1, MSG_INVALIDTYPE);
+  lua_settop(L, 1);
+  lua_pushinteger(L, 0);
+  lua_pushcclosure(L, lz4f_get, 2);
+  return 1;
+}
+
+// ------------ checksums ---------------
+
+// the bytes at offset, length from idx and idx + 1, all of them by default
+static const uint8_t* lua_checkrange( lua_State *L, Buf *p, int idx, size_t *len )
+{
+  lua_Integer offset = luaL_optinteger(L, idx, 0);
+  luaL_argcheck(L, 0 <= offset && (uint64_t)offset <= getLength(p), idx, MSG_OUTOFRANGE);
+  uint64_t rest = getLength(p) - (uint64_t)offset;
+  lua_Integer length = luaL_optinteger(L, idx + 1, (lua_Integer)rest);
+  luaL_argcheck(L, 0 <= length && (uint64_t)length <= rest, idx + 1, MSG_OUTOFRANGE);
+  *len = (size_t)length;
+  return getBuffer(p) + offset;
+}
+
+// local c = buf:crc32( [offset, length, crc] ) -- crc of the bytes before
+#define LUA_BIND_CHECKSUM( NAME, FUNC, INIT )				\
+  static int lbytearr_##NAME( lua_State *L )				\
+  {									\
+    check_userdata_self(L);						\
+									\
+    Buf *p = lua_tobuffer(L, 1);					\
+    size_t n;								\
+    const uint8_t *q = lua_checkrange(L, p, 2, &n);			\
+    lua_Number init = luaL_optnumber(L, 4, INIT);			\
+    luaL_argcheck(L, 0 <= init && init <= 0xffffffff, 4, MSG_OUTOFRANGE); \
+    lua_pushuint64(L, FUNC((uint32_t)init, q, n));			\
+    return 1;								\
+  }
+
+LUA_BIND_CHECKSUM( crc32, crc32, 0 )
+LUA_BIND_CHECKSUM( crc32c, crc32c, 0 )
+LUA_BIND_CHECKSUM( adler32, adler32, 1 )
+
+// local h = buf:xxh64( [offset, length, seed] )
+static int lbytearr_xxh64( lua_State *L )
+{
+  check_userdata_self(L);
+
+  Buf *p = lua_tobuffer(L, 1);
+  size_t n;
+  const uint8_t *q = lua_checkrange(L, p, 2, &n);
+  uint64_t seed = 0;
+  if( !lua_isnoneornil(L, 4) ){
+    int ok;
+    seed = lua_touint64(L, 4, &ok);
+    if( !ok ) seed = (uint64_t)lua_toint64(L, 4, &ok);
+    luaL_argcheck(L, ok, 4, MSG_INVALIDTYPE);
+  }
+  lua_pushuint64(L, xxh64(q, n, seed));
+  return 1;
+}
+
+// ------------ searching ---------------
+
+// a string, or a number for one byte
+static const uint8_t* lua_checkneedle( lua_State *L, int idx, uint8_t *byte, size_t *len )
+{
+  if( lua_type(L, idx) == LUA_TNUMBER ){
+    lua_Integer c = luaL_checkinteger(L, idx);
+    luaL_argcheck(L, 0 <= c && c <= 0xff, idx, MSG_OUTOFRANGE);
+    *byte = (uint8_t)c;
+    *len = 1;
+    return byte;
+  }
+  return (const uint8_t*)luaL_checklstring(L, idx, len);
+}
+
+// local i = buf:indexOf( "\r\n"[, from] ) -- nil if not found
+static int lbytearr_indexof( lua_State *L )
+{
+  check_userdata_self(L);
+
+  Buf *p = lua_tobuffer(L, 1);
+  uint8_t byte;
+  size_t m;
+  const uint8_t *k = lua_checkneedle(L, 2, &byte, &m);
+  lua_Integer from = luaL_optinteger(L, 3, 0);
+  luaL_argcheck(L, 0 <= from && (uint64_t)from <= getLength(p), 3, MSG_OUTOFRANGE);
+
+  const uint8_t *s = getBuffer(p);
+  const uint8_t *q = findBytes(s + from, getLength(p) - (size_t)from, k, m);
+  if( q == NULL ) return 0;
+  lua_pushinteger(L, (lua_Integer)(q - s));
+  return 1;
+}
+
+// the bytes from position to the delimiter, which is skipped too
+static int readUntil( lua_State *L, Buf *p, const uint8_t *k, size_t m, int line )
+{
+  const uint8_t *s = getBuffer(p) + getPosition(p);
+  const uint8_t *q = findBytes(s, getBytesAvailable(p), k, m);
+  if( q == NULL ){
+    error_handle(L, ERR_OUTOFRANGE);
+    return lua_error(L);
+  }
 
-#define METHOD_READBYTES               "readBytes"
-#define METHOD_WRITEBYTES              "writeBytes"
+  size_t l = q - s;
+  p->position += l + m;
+  if( line && l > 0 && s[l-1] == '\r' ) --l;
+  lua_pushlstring(L, (const char*)s, l);
+  return 1;
+}
 
-#define METHOD_CUT                     "slice"
-#define METHOD_CLEAR                   "clear"
-#define METHOD_TOSTRING                "toString"
-#endif
+// local s = buf:readUntil( "\r\n" )
+static int lbytearr_readuntil( lua_State *L )
+{
+  check_userdata_self(L);
 
-#define new_buffer( p, sz, e ) {		\
-    p = createBuf( sz, e );			\
-    if( !p ){					\
-      error_handle(L, ERR_NOMEM);		\
-      lua_error(L);				\
-      return 0;					\
-    }						\
-  }
+  Buf *p = lua_tobuffer(L, 1);
+  uint8_t byte;
+  size_t m;
+  const uint8_t *k = lua_checkneedle(L, 2, &byte, &m);
+  luaL_argcheck(L, m > 0, 2, MSG_FORMAT);
+  return readUntil(L, p, k, m, 0);
+}
 
-#define check_userdata_self( L )		\
-  if( !lua_isuserdata(L, 1) ){			\
-    luaL_argerror(L, 1, MSG_INVALIDTYPE);	\
-    return 0;					\
-  }
+// local s = buf:readLine() -- without the \n or \r\n
+static int lbytearr_readline( lua_State *L )
+{
+  check_userdata_self(L);
 
-#define set_bytearr_metatable( L ) {				\
-    lua_getfield( L, LUA_REGISTRYINDEX, MODULE_NAME "#mt" );	\
-    lua_setmetatable( L, -2 );					\
-  }
+  return readUntil(L, lua_tobuffer(L, 1), (const uint8_t*)"\n", 1, 1);
+}
 
-#define lua_pushbuffer( L, p ){		\
-    void *m = lua_newuserdata(L, sizeof(p));	\
-    memcpy(m, &p, sizeof(p));			\
-    set_bytearr_metatable( L );			\
-  }
+// ------------ base64 / hex ---------------
 
-static inline Buf* lua_tobuffer(lua_State *L, int index)
+// local s = buf:toBase64( [offset, length] )
+static int lbytearr_tobase64( lua_State *L )
 {
-  Buf **ud = lua_touserdata(L, index);
-  return *ud;
+  check_userdata_self(L);
+
+  Buf *p = lua_tobuffer(L, 1);
+  size_t n;
+  const uint8_t *q = lua_checkrange(L, p, 2, &n);
+  if( n > SIZE_MAX / 4 * 3 - 2 ) handle_error( ERR_OVERFLOW );
+  char *out = lua_newuserdata(L, B64_ENCODED(n));
+  lua_pushlstring(L, out, b64Encode(q, n, out));
+  return 1;
 }
 
-void error_handle( lua_State *L, int errno )
+// local s = buf:toHex( [offset, length] )
+static int lbytearr_tohex( lua_State *L )
 {
-  if( errno == ERR_NOMEM ){
-    lua_pushstring( L, MSG_NOMEM );
-  }
-  else if( errno == ERR_OVERFLOW ){
-    lua_pushstring( L, MSG_OVERFLOW );
-  }
-  else if( errno == ERR_READONLY ){
-    lua_pushstring( L, MSG_READONLY );
-  }
-  else if( errno == ERR_OUTOFRANGE ){
-    lua_pushstring( L, MSG_OUTOFRANGE );
-  }
+  check_userdata_self(L);
+
+  Buf *p = lua_tobuffer(L, 1);
+  size_t n;
+  const uint8_t *q = lua_checkrange(L, p, 2, &n);
+  if( n > SIZE_MAX / 2 ) handle_error( ERR_OVERFLOW );
+  char *out = lua_newuserdata(L, 2 * n);
+  lua_pushlstring(L, out, hexEncode(q, n, out));
+  return 1;
 }
 
-// buf.create( [size, endian] )
-static int lbytearr_create( lua_State *L )
+// the decoded bytes at the position of to, a new ByteArray read from 0 if
+// not given
+static int decodeTo( lua_State *L, size_t n, int (*decode)( const uint8_t*, size_t, uint8_t* ) )
 {
-  int size = BYTEARRAY_RESERVE_SIZE;
-  if( lua_isnumber( L, 1 ) ) {
-    size = luaL_checkint( L, 1 );
-  }
-  
-  int endian = getNativeEndian();
-  if( lua_isnumber( L, 2 ) ) {
-    endian = luaL_checkint( L, 2 );
-  }
-  
-  Buf* retval;
-  new_buffer( retval, size, endian );
-  
-  lua_pushbuffer( L, retval );
+  const uint8_t *s = (const uint8_t*)lua_tostring(L, 1);
+  size_t l = lua_objlen(L, 1);
+  int fresh = lua_isnoneornil(L, 2);
+  lua_settop(L, 2);
+  Buf *to = lua_totarget(L, 2, NULL, n);
+
+  handle_error( reserve(to, n) );
+  handle_error( decode(s, l, to->buffer + to->position) );
+  to->position += n;
+  UPDATE_LENGTH(to);
+  if( fresh ) to->position = 0;
+
+  lua_pushvalue(L, 2);
   return 1;
 }
 
-// buf.init( 1,2,3 ) or buf.init( {1,2,3} )
-static int lbytearr_init( lua_State *L )
+// local b = ByteArray.fromBase64( s[, to] )
+static int lbytearr_frombase64( lua_State *L )
 {
-  int n = lua_gettop( L );
-  if( n < 1 ) {
-    luaL_argerror(L, 1, MSG_INVALIDTYPE);
-    return 0;
-  }
-  
-  Buf *retval = NULL;
-  int endian = getNativeEndian();
-  
-  if(lua_isnumber(L, 1)){
-    new_buffer( retval, n, endian );
-    
-    for( int i=1; i <= n; ++i ){
-      if( !lua_isnumber(L, i) ){
-	release( retval );
-	luaL_argerror(L, i, MSG_INVALIDTYPE);
-	
-	return 0;
-      }
+  luaL_checktype(L, 1, LUA_TSTRING);
+  int64_t n = b64Decoded((const uint8_t*)lua_tostring(L, 1), lua_objlen(L, 1));
+  if( n < 0 ) handle_error( ERR_MALFORMED );
+  return decodeTo(L, (size_t)n, b64Decode);
+}
 
-      getBuffer(retval)[i-1] = (uint8_t)lua_tointeger(L, i);
-    }
-    retval->length = n;
-  }
-  else {
-    buflen_t max = ~0;
-    size_t total = 0;
-    for( int i=1; i <= n; ++i ){
-      luaL_checktype(L, i, LUA_TTABLE);
-      total += lua_objlen(L, i);
-    }
+// local b = ByteArray.fromHex( s[, to] )
+static int lbytearr_fromhex( lua_State *L )
+{
+  luaL_checktype(L, 1, LUA_TSTRING);
+  size_t l = lua_objlen(L, 1);
+  if( l % 2 != 0 ) handle_error( ERR_MALFORMED );
+  return decodeTo(L, l / 2, hexDecode);
+}
 
-    if( total > (size_t) max ){
-      error_handle(L, ERR_OVERFLOW);
-      lua_error(L);
-      return 0;
-    }
+// ------------ comparing ---------------
 
-    new_buffer( retval, total, endian );
-    for( int i=1; i <= n; ++i ){
-      size_t len = lua_objlen( L, i );
-      for( int j=1; j <= len; ++j ){
-	lua_pushinteger(L, j);
-	lua_gettable(L, i);
-	if( !lua_isnumber(L, -1) ){
-	  release(retval);
-	  luaL_argerror( L, i, MSG_INVALIDTYPE );
-	  return 0;
-	}
+// the bytes of a ByteArray or a string
+static const uint8_t* lua_checkbytes( lua_State *L, int idx, size_t *len )
+{
+  if( lua_type(L, idx) == LUA_TSTRING ) return (const uint8_t*)lua_tolstring(L, idx, len);
+  luaL_argcheck(L, lua_isbytearray(L, idx), idx, MSG_INVALIDTYPE);
+  Buf *p = lua_tobuffer(L, idx);
+  *len = getLength(p);
+  return getBuffer(p);
+}
 
-	writeUnsignedByte(retval, lua_tointeger(L, -1));
-	lua_pop(L, 1);
-      }// end of j
-    }// end of i
-    
-    // rewind the cursor
-    setPosition(retval, 0);
-  }
+// <0, 0 or >0 as memcmp, a prefix before the longer
+static int compareBytes( const uint8_t *a, size_t na, const uint8_t *b, size_t nb )
+{
+  size_t n = na < nb ? na : nb;
+  int r = n > 0 ? memcmp( a, b, n ) : 0;
+  if( r != 0 ) return r;
+  return na < nb ? -1 : na > nb;
+}
+
+// local r = buf:compare( other[, offset, length] ) -- -1, 0 or 1, the range
+// of buf against all of other, a ByteArray or a string
+static int lbytearr_compare( lua_State *L )
+{
+  check_userdata_self(L);
 
-  lua_pushbuffer(L, retval);
+  size_t na, nb;
+  const uint8_t *b = lua_checkbytes(L, 2, &nb);
+  const uint8_t *a = lua_checkrange(L, lua_tobuffer(L, 1), 3, &na);
+  int r = compareBytes(a, na, b, nb);
+  lua_pushinteger(L, (r > 0) - (r < 0));
   return 1;
 }
 
-// local buf = ByteArray.load("hello,world")
-static int lbytearr_load( lua_State *L )
+// local ok = buf:equals( other[, offset, length] )
+static int lbytearr_equals( lua_State *L )
 {
-  luaL_checkstring(L, 1);
-
-  size_t sz;
-  const char *p = lua_tolstring(L, 1, &sz);
-  int endian = getNativeEndian();
-  if( lua_isnumber(L, 2) ){
-    endian = lua_tonumber( L, 2 );
-  }
+  check_userdata_self(L);
 
-  Buf *retval = fromArray( (void*)p, sz, endian );
-  if( !retval ){
-    error_handle(L, ERR_NOMEM);
-    lua_error(L);
-    return 0;
-  }
-  
-  lua_pushbuffer( L, retval );
+  size_t na, nb;
+  const uint8_t *b = lua_checkbytes(L, 2, &nb);
+  const uint8_t *a = lua_checkrange(L, lua_tobuffer(L, 1), 3, &na);
+  lua_pushboolean(L, na == nb && compareBytes(a, na, b, nb) == 0);
   return 1;
 }
 
-// local str = buf:toString()
-static int lbytearr_tostring( lua_State *L )
+// local h = buf:hash( [offset, length] ) -- xxh64 of the bytes as a number,
+// equal bytes give equal numbers, Lua before 5.3 gets the top 53 bits
+static int lbytearr_hash( lua_State *L )
 {
   check_userdata_self(L);
-  
-  Buf *p = lua_tobuffer(L, 1);
-  char *b = (char*)getBuffer(p);
-  size_t len = getLength(p);
-  lua_pushlstring(L, b, len);
+
+  size_t n;
+  const uint8_t *q = lua_checkrange(L, lua_tobuffer(L, 1), 2, &n);
+  uint64_t h = xxh64(q, n, 0);
+#if LUA_VERSION_NUM >= 503
+  lua_pushinteger(L, (lua_Integer)h);
+#else
+  lua_pushnumber(L, (lua_Number)(h >> 11));
+#endif
   return 1;
 }
 
-#define handle_scope_except()			\
-  int err = setjmp( except );			\
-  if( err ){					\
-    error_handle( L, err );			\
-    lua_error(L);				\
-    return 0;					\
+// a == b, only called when both are userdata
+static int lbytearr_eq( lua_State *L )
+{
+  if( !lua_isbytearray(L, 1) || !lua_isbytearray(L, 2) ){
+    lua_pushboolean(L, 0);
+    return 1;
   }
+  Buf *a = lua_tobuffer(L, 1), *b = lua_tobuffer(L, 2);
+  lua_pushboolean(L, getLength(a) == getLength(b) &&
+		  compareBytes(getBuffer(a), getLength(a), getBuffer(b), getLength(b)) == 0);
+  return 1;
+}
 
-#define bytes_param_check(p, s, offset, length) {	\
-    luaL_checktype(L, 1, LUA_TUSERDATA);		\
-    luaL_checktype(L, 2, LUA_TUSERDATA);		\
-    p = lua_tobuffer(L, 1);				\
-    s = lua_tobuffer(L, 2);				\
-    buflen_t max = ~0;					\
-    offset = 0;						\
-    length = 0;						\
-    int n = lua_gettop(L);				\
-    if( n >= 3 ){					\
-      offset = luaL_checkint(L, 3);			\
-    }							\
-    if( n >= 4 ) {					\
-      length = luaL_checkint(L, 4);			\
-    }							\
-    if( offset > (size_t)max || length > (size_t)max ){	\
-      error_handle(L, ERR_OVERFLOW);			\
-      lua_error(L);					\
-      return 0;						\
-    }							\
-  }							
+// a < b and a <= b in byte order. A string can stand on either side
+// from lua 5.3, before that the VM compares mixed types by itself
+static int lbytearr_lt( lua_State *L )
+{
+  size_t na, nb;
+  const uint8_t *a = lua_checkbytes(L, 1, &na);
+  const uint8_t *b = lua_checkbytes(L, 2, &nb);
+  lua_pushboolean(L, compareBytes(a, na, b, nb) < 0);
+  return 1;
+}
 
-// local buffer = ByteArray.load("hello,world")
-// local s = ByteArray.create()
-// buffer:readBytes( s, 0, buffer.bytesAvailable )
-static int lbytearr_readbytes( lua_State *L )
+static int lbytearr_le( lua_State *L )
 {
-  Buf *p, *bytes;
-  size_t offset, length;
-  
-  bytes_param_check(p, bytes, offset, length);
+  size_t na, nb;
+  const uint8_t *a = lua_checkbytes(L, 1, &na);
+  const uint8_t *b = lua_checkbytes(L, 2, &nb);
+  lua_pushboolean(L, compareBytes(a, na, b, nb) <= 0);
+  return 1;
+}
 
-  handle_scope_except();
+static int lbytearr_clear( lua_State *L )
+{
+  check_userdata_self(L);
 
-  if( length == 0 ) length = getBytesAvailable(p);
-  if( getLength(bytes) < offset + length ) {
-    setLength(bytes, offset+length);
-  }
-    
-  readBytes(p, getBuffer(bytes), offset, length);
+  Buf *p = lua_tobuffer(L, 1);
+  handle_error( clear( p ) );
   return 0;
 }
 
-// local buffer = ByteArray.load("hello,world")
-// local s = ByteArray.create()
-// s:writeBytes( buffer, 6, 5 )
-static int lbytearr_writebytes( lua_State *L )
+// buf:swapEndian( width[, offset, count] )
+// offset defaults to position, count to all whole values until length
+static int lbytearr_swapendian( lua_State *L )
 {
-  Buf *p, *bytes;
-  size_t offset, length;
+  check_userdata_self(L);
 
-  bytes_param_check(p, bytes, offset, length);
+  Buf *p = lua_tobuffer(L, 1);
+  int width = luaL_checkint(L, 2);
+  luaL_argcheck(L, width == 2 || width == 4 || width == 8, 2, MSG_INVALIDTYPE);
 
-  handle_scope_except();
+  lua_Integer offset = luaL_optinteger(L, 3, getPosition(p));
+  luaL_argcheck(L, 0 <= offset && (uint64_t)offset <= getLength(p), 3, MSG_OUTOFRANGE);
+  lua_Integer count = luaL_optinteger(L, 4, (getLength(p) - offset) / width);
+  luaL_argcheck(L, 0 <= count, 4, MSG_OUTOFRANGE);
 
-  if( length == 0 ) length = getLength(bytes) - offset;
-  if( getLength(bytes) < offset + length ){
-    length = getLength(bytes) - offset;
-  }
-  
-  writeBytes( p, getBuffer(bytes), offset, length );
-  return 0;
+  handle_error( swapEndian(p, width, offset, count) );
+  lua_pushvalue(L, 1);
+  return 1;
 }
 
-#define LUA_BIND_BUILDIN_WRITER( NAME, FUNC, CHECKF, TYPE )	\
-  static int lbytearr_##NAME( lua_State *L )			\
-  {								\
-    check_userdata_self(L);					\
-								\
-    Buf *p = lua_tobuffer(L, 1);				\
-    TYPE b = CHECKF(L, 2);					\
-								\
-    handle_scope_except();					\
-    								\
-    FUNC(p, b);							\
-    lua_pushvalue(L, 1);					\
-    return 1;							\
-  }
+// buf:xorMask( key[, offset, length, phase] ) -- key of 4 bytes, phase
+// counts the bytes masked before offset when a payload comes in parts
+static int lbytearr_xormask( lua_State *L )
+{
+  check_userdata_self(L);
 
-LUA_BIND_BUILDIN_WRITER( writebool, writeBoolean, lua_toboolean, int );
-LUA_BIND_BUILDIN_WRITER( writes8, writeByte, luaL_checknumber, int );
-LUA_BIND_BUILDIN_WRITER( writeu8, writeUnsignedByte, luaL_checknumber, int );
-LUA_BIND_BUILDIN_WRITER( writes16, writeShort, luaL_checknumber, int );
-LUA_BIND_BUILDIN_WRITER( writeu16, writeUnsignedShort, luaL_checknumber, int );
-LUA_BIND_BUILDIN_WRITER( writes32, writeInt, luaL_checknumber, int );
-LUA_BIND_BUILDIN_WRITER( writeu32, writeUnsignedInt, luaL_checknumber, uint32_t );
-LUA_BIND_BUILDIN_WRITER( writef32, writeFloat, luaL_checknumber, float );
-LUA_BIND_BUILDIN_WRITER( writef64, writeDouble, luaL_checknumber, double );
+  Buf *p = lua_tobuffer(L, 1);
+  size_t kl, n;
+  const char *key = luaL_checklstring(L, 2, &kl);
+  luaL_argcheck(L, kl == 4, 2, MSG_INVALIDTYPE);
+  buflen_t offset = lua_checkrange(L, p, 3, &n) - getBuffer(p);
+  lua_Integer phase = luaL_optinteger(L, 5, 0);
+  luaL_argcheck(L, 0 <= phase, 5, MSG_OUTOFRANGE);
+
+  handle_error( xorMask(p, (const uint8_t*)key, (size_t)(phase % 4), offset, n) );
+  lua_pushvalue(L, 1);
+  return 1;
+}
 
-#define LUA_BIND_BUILDIN_READER( NAME, FUNC, TYPE, PUSHF ) \
-  static int lbytearr_##NAME( lua_State *L )		   \
-  {							   \
-    check_userdata_self(L);				   \
-							   \
-    Buf *p = lua_tobuffer(L, 1);			   \
-							   \
-    handle_scope_except();				   \
-							   \
-    TYPE retval = FUNC(p);				   \
-    lua_##PUSHF(L, retval);				   \
-    return 1;						   \
-  }
+// buf:fill( byte[, offset, length] )
+static int lbytearr_fill( lua_State *L )
+{
+  check_userdata_self(L);
+
+  Buf *p = lua_tobuffer(L, 1);
+  lua_Integer c = luaL_checkinteger(L, 2);
+  luaL_argcheck(L, -0x80 <= c && c <= 0xff, 2, MSG_OUTOFRANGE);
+  size_t n;
+  buflen_t offset = lua_checkrange(L, p, 3, &n) - getBuffer(p);
+
+  handle_error( fill(p, (uint8_t)c, offset, n) );
+  lua_pushvalue(L, 1);
+  return 1;
+}
+
+// buf:copyWithin( target[, start, end] ) -- the bytes [start, end) to target
+static int lbytearr_copywithin( lua_State *L )
+{
+  check_userdata_self(L);
+
+  Buf *p = lua_tobuffer(L, 1);
+  lua_Integer target = luaL_checkinteger(L, 2);
+  lua_Integer start = luaL_optinteger(L, 3, 0);
+  lua_Integer end = luaL_optinteger(L, 4, getLength(p));
+  luaL_argcheck(L, 0 <= target && (uint64_t)target <= getLength(p), 2, MSG_OUTOFRANGE);
+  luaL_argcheck(L, 0 <= start && (uint64_t)start <= getLength(p), 3, MSG_OUTOFRANGE);
+  luaL_argcheck(L, start <= end && (uint64_t)end <= getLength(p), 4, MSG_OUTOFRANGE);
+
+  handle_error( copyWithin(p, (buflen_t)target, (buflen_t)start, (buflen_t)end) );
+  lua_pushvalue(L, 1);
+  return 1;
+}
+
+// buf:reserve( n ) -- capacity for n bytes without reallocating
+static int lbytearr_reserve( lua_State *L )
+{
+  check_userdata_self(L);
+
+  Buf *p = lua_tobuffer(L, 1);
+  lua_Integer n = luaL_checkinteger(L, 2);
+  luaL_argcheck(L, 0 <= n, 2, MSG_OUTOFRANGE);
+  if( (uint64_t)n > BUFLEN_MAX ) handle_error( ERR_OVERFLOW );
+
+  handle_error( reserveCapacity(p, n) );
+  lua_pushvalue(L, 1);
+  return 1;
+}
+
+static int lbytearr_shrink( lua_State *L )
+{
+  check_userdata_self(L);
 
-LUA_BIND_BUILDIN_READER( readbool, readBoolean, int, pushboolean );
-LUA_BIND_BUILDIN_READER( reads8, readByte, int, pushinteger );
-LUA_BIND_BUILDIN_READER( readu8, readUnsignedByte, int, pushinteger );
-LUA_BIND_BUILDIN_READER( reads16, readShort, int, pushinteger );
-LUA_BIND_BUILDIN_READER( readu16, readUnsignedShort, int, pushinteger );
-LUA_BIND_BUILDIN_READER( reads32, readInt, int, pushinteger );
-LUA_BIND_BUILDIN_READER( readu32, readUnsignedInt, uint32_t, pushnumber );
-LUA_BIND_BUILDIN_READER( readf32, readFloat, float, pushnumber );
-LUA_BIND_BUILDIN_READER( readf64, readDouble, double, pushnumber );
+  Buf *p = lua_tobuffer(L, 1);
+  handle_error( shrinkToFit(p) );
+  lua_pushvalue(L, 1);
+  return 1;
+}
 
-// local s = buf:readString( 3 ) -- read 3 byte as lua string
-static int lbytearr_readlstr( lua_State *L )
+// buf:discard( [n] ) -- drop the bytes before position, or the first n
+static int lbytearr_discard( lua_State *L )
 {
   check_userdata_self(L);
 
   Buf *p = lua_tobuffer(L, 1);
-  size_t l = lua_tointeger( L, 2 );
-  char *str = (char*)&getBuffer(p)[getPosition(p)];
+  lua_Integer n = luaL_optinteger(L, 2, getPosition(p));
+  luaL_argcheck(L, 0 <= n && (uint64_t)n <= getLength(p), 2, MSG_OUTOFRANGE);
 
-  if( getBytesAvailable(p) < l ){
-    error_handle(L, ERR_OUTOFRANGE);
-    lua_error(L);
-    return 0;
-  }
-  
-  lua_pushlstring(L, str, l);
-  p->position += l;
+  handle_error( discard(p, n) );
+  lua_pushvalue(L, 1);
   return 1;
 }
 
-// buf:writeString( "hello" )
-static int lbytearr_writelstr( lua_State *L )
+static int lbytearr_compact( lua_State *L )
 {
   check_userdata_self(L);
 
-  luaL_checktype(L, 2, LUA_TSTRING);
-  
   Buf *p = lua_tobuffer(L, 1);
-  const char *pstr = lua_tostring(L, 2);
-  size_t l = lua_objlen(L, 2);
-  
-  handle_scope_except();
-  writeBytes(p, pstr, 0, l);
-  
+  handle_error( compact(p) );
   lua_pushvalue(L, 1);
   return 1;
 }
 
-#ifdef BYTEARRAY_USE_CSTRING
-// local t = b:readCString()
-static int lbytearr_readcstr( lua_State *L )
+#ifdef BYTEARRAY_POSIX
+// nil, message, errno
+static int push_syserror( lua_State *L, int e )
+{
+  lua_pushnil(L);
+  lua_pushstring(L, strerror(e));
+  lua_pushinteger(L, e);
+  return 3;
+}
+
+static inline int would_block( int e )
+{
+  return e == EAGAIN || e == EWOULDBLOCK;
+}
+
+// local n = buf:readFrom( fd[, maxBytes] )
+// One read appended after length, position is left alone. Returns the
+// bytes read, 0 at end of file, or nil, "again" when fd would block.
+static int lbytearr_readfrom( lua_State *L )
 {
   check_userdata_self(L);
-  
+
   Buf *p = lua_tobuffer(L, 1);
-  char *str = (char*)&getBuffer(p)[getPosition(p)];
-  
-  size_t l = 1 + strlen( str );
-  if( getBytesAvailable(p) < l ){
-    error_handle(L, ERR_OUTOFRANGE);
-    lua_error(L);
-    return 0;
+  int fd = luaL_checkint(L, 2);
+  lua_Integer max = luaL_optinteger(L, 3, BYTEARRAY_READ_SIZE);
+  luaL_argcheck(L, 0 < max, 3, MSG_OUTOFRANGE);
+  if( (uint64_t)max > BUFLEN_MAX ) handle_error( ERR_OVERFLOW );
+
+  handle_error( reserveTail(p, max) );
+
+  ssize_t n;
+  do {
+    n = read( fd, getBuffer(p) + getLength(p), max );
+  } while( n < 0 && errno == EINTR );
+
+  if( n < 0 ){
+    if( would_block(errno) ){
+      lua_pushnil(L);
+      lua_pushliteral(L, "again");
+      return 2;
+    }
+    return push_syserror(L, errno);
   }
-  
-  lua_pushstring(L, str);
-  p->position += l;
+
+  p->length += n;
+  lua_pushinteger(L, n);
   return 1;
 }
-static int lbytearr_writecstr( lua_State *L )
+
+// local n = buf:writeTo( fd )
+// Writes from position until length or until fd would block, position
+// advances over what was written. Returns the bytes written.
+static int lbytearr_writeto( lua_State *L )
 {
   check_userdata_self(L);
 
-  luaL_checktype(L, 2, LUA_TSTRING);
-  
   Buf *p = lua_tobuffer(L, 1);
-  const char *pstr = lua_tostring(L, 2);
-  uint8_t *str = &getBuffer(p)[getPosition(p)];
-  
-  size_t l = 1 + strlen(pstr);
-  
-  handle_scope_except();
-  
-  RANGE_RESERVE( p, l );
-  
-  memcpy( str, pstr, l-1 );
-  str[l-1] = '\0';
-  p->position += l;
-  p->length += l;
+  int fd = luaL_checkint(L, 2);
+
+  size_t total = 0;
+  while( getBytesAvailable(p) > 0 ){
+    ssize_t n = write( fd, getBuffer(p) + getPosition(p), getBytesAvailable(p) );
+    if( n < 0 ){
+      if( errno == EINTR ) continue;
+      if( would_block(errno) ) break;
+      return push_syserror(L, errno);
+    }
+    p->position += n;
+    total += n;
+  }
 
-  lua_pushvalue(L, 1);
+  lua_pushinteger(L, total);
   return 1;
 }
-#endif//BYTEARRAY_USE_CSTRING
 
-static int lbytearr_clear( lua_State *L )
+// local n = ByteArray.writev( fd, { buf1, buf2, ... } )
+// writeTo for many buffers, BYTEARRAY_WRITEV_BATCH of them per syscall.
+static int lbytearr_writev( lua_State *L )
 {
-  check_userdata_self(L);
+  int fd = luaL_checkint(L, 1);
+  luaL_checktype(L, 2, LUA_TTABLE);
+  int count = (int)lua_objlen(L, 2);
+  // a bad element fails before any batch is sent
+  for( int i=1; i <= count; ++i ){
+    lua_rawgeti(L, 2, i);
+    if( !lua_isbytearray(L, -1) ) luaL_argerror(L, 2, MSG_INVALIDTYPE);
+    lua_pop(L, 1);
+  }
 
-  handle_scope_except();
-  
-  Buf *p = lua_tobuffer(L, 1);
-  clear( p );
+  struct iovec iov[BYTEARRAY_WRITEV_BATCH];
+  Buf *bufs[BYTEARRAY_WRITEV_BATCH];
+  size_t total = 0;
+  int next = 1;
+  while( next <= count ){
+    // gather the next batch, skipping drained buffers
+    int nbuf = 0;
+    size_t want = 0;
+    for( ; next <= count && nbuf < BYTEARRAY_WRITEV_BATCH; ++next ){
+      lua_rawgeti(L, 2, next);
+      Buf *p = lua_tobuffer(L, -1);
+      lua_pop(L, 1);
+      if( getBytesAvailable(p) == 0 ) continue;
+
+      bufs[nbuf] = p;
+      iov[nbuf].iov_base = getBuffer(p) + getPosition(p);
+      iov[nbuf].iov_len = getBytesAvailable(p);
+      want += iov[nbuf].iov_len;
+      ++nbuf;
+    }
+    if( nbuf == 0 ) break;
+
+    ssize_t n;
+    do {
+      n = writev( fd, iov, nbuf );
+    } while( n < 0 && errno == EINTR );
+    if( n < 0 ){
+      if( would_block(errno) ) break;
+      return push_syserror(L, errno);
+    }
+
+    total += n;
+    // a short write means the descriptor is full, stop after this batch
+    int full = (size_t)n < want;
+    for( int i=0; i < nbuf && n > 0; ++i ){
+      size_t step = (size_t)n < iov[i].iov_len ? (size_t)n : iov[i].iov_len;
+      bufs[i]->position += step;
+      n -= step;
+    }
+    if( full ) break;
+  }
+
+  lua_pushinteger(L, total);
   return 1;
 }
+#endif//BYTEARRAY_POSIX
 
 static int lbytearr_slice( lua_State *L )
 {
@@ -892,38 +6693,63 @@ static int lbytearr_slice( lua_State *L )
 
   Buf *p = lua_tobuffer(L, 1);
   
-  int start = 0;
-  int end = getLength(p);
+  lua_Integer len = getLength(p);
+  lua_Integer start = 0;
+  lua_Integer end = len;
   size_t n = lua_gettop( L );
   if( n > 1 ){
-    start = luaL_checkint(L, 2);
+    start = luaL_checkinteger(L, 2);
   }
   if( n > 2 ){
-    end = luaL_checkint(L, 3);
+    end = luaL_checkinteger(L, 3);
   }
   if( start < 0 ){
-    start += getLength(p);
+    start += len;
   }
   if( end <= 0 ){
-    end += getLength(p);
+    end += len;
   }
   
-  handle_scope_except();
-  
   Buf *r;
-  if( end < 0 || start > end || (int)getLength(p) <= start ){ // empty array
-    r = createBuf( BYTEARRAY_RESERVE_SIZE, getNativeEndian() );
+  if( end < 0 || start > end || len <= start ){ // empty array
+    new_buffer( r, BYTEARRAY_INLINE_SIZE, getNativeEndian() );
   }
   else{
     if( start < 0 ){ // set start to 0 )
       start = 0;
     }
-    if( getLength(p) <= end ){
-      end = getLength(p);
+    if( len <= end ){
+      end = len;
+    }
+    // heap storage is shared copy-on-write, small slices are copied
+    if( p->store != NULL && end-start > BYTEARRAY_INLINE_SIZE ){
+      r = lua_newbuffer( L, 0 );
+      shareBuf( r, p, start, end-start );
+    }
+    else {
+      new_buffer( r, 0, getEndian(p) );
+      handle_error( cut(r, p, start, end-start) );
     }
-    r = cut(p, start, end-start);
   }
-  lua_pushbuffer(L, r);
+  return 1;
+}
+
+// ByteArray.memoryUsage() -- bytes of buffer memory in this lua_State
+static int lbytearr_memusage( lua_State *L )
+{
+  lua_pushnumber( L, (lua_Number)lua_tobufalloc(L)->used );
+  return 1;
+}
+
+// ByteArray.setMemoryLimit( n ) -- 0 for no limit, returns the old one
+static int lbytearr_memlimit( lua_State *L )
+{
+  lua_Number n = luaL_checknumber( L, 1 );
+  luaL_argcheck( L, 0 <= n, 1, MSG_OUTOFRANGE );
+
+  BufAlloc *a = lua_tobufalloc( L );
+  lua_pushnumber( L, (lua_Number)a->limit );
+  a->limit = n < (lua_Number)SIZE_MAX ? (size_t)n : SIZE_MAX;
   return 1;
 }
 
@@ -931,10 +6757,52 @@ static luaL_Reg bytearr_map[] = {
   { CONSTRUCTOR_CREATE, lbytearr_create },
   { CONSTRUCTOR_INITER, lbytearr_init },
   { CONSTRUCTOR_FROMARR, lbytearr_load },
+#ifdef BYTEARRAY_MMAP
+  { CONSTRUCTOR_MMAP, lbytearr_mmap },
+#endif
+  { FUNCTION_MEMUSAGE, lbytearr_memusage },
+  { FUNCTION_MEMLIMIT, lbytearr_memlimit },
+  { CONSTRUCTOR_CHAIN, lbytearr_chain },
+  { FUNCTION_SCHEMA, lbytearr_schema },
+  { FUNCTION_COMPRESSSTREAM, lbytearr_compressstream },
+  { FUNCTION_DECOMPRESSSTREAM, lbytearr_decompressstream },
+  { FUNCTION_FROMBASE64, lbytearr_frombase64 },
+  { FUNCTION_FROMHEX, lbytearr_fromhex },
 
   { METHOD_TOSTRING, lbytearr_tostring },
+#ifdef BYTEARRAY_POSIX
+  { METHOD_READFROM, lbytearr_readfrom },
+  { METHOD_WRITETO, lbytearr_writeto },
+  { FUNCTION_WRITEV, lbytearr_writev },
+#endif
   { METHOD_CLEAR, lbytearr_clear },
+  { METHOD_RESERVE, lbytearr_reserve },
+  { METHOD_SHRINK, lbytearr_shrink },
+  { METHOD_READPB, lbytearr_readpb },
+  { METHOD_WRITEPB, lbytearr_writepb },
+  { METHOD_READOBJ, lbytearr_readobj },
+  { METHOD_WRITEOBJ, lbytearr_writeobj },
+  { METHOD_READMP, lbytearr_readmp },
+  { METHOD_WRITEMP, lbytearr_writemp },
+  { METHOD_COMPRESS, lbytearr_compress },
+  { METHOD_DECOMPRESS, lbytearr_decompress },
+  { METHOD_CRC32, lbytearr_crc32 },
+  { METHOD_CRC32C, lbytearr_crc32c },
+  { METHOD_ADLER32, lbytearr_adler32 },
+  { METHOD_XXH64, lbytearr_xxh64 },
+  { METHOD_INDEXOF, lbytearr_indexof },
+  { METHOD_TOBASE64, lbytearr_tobase64 },
+  { METHOD_TOHEX, lbytearr_tohex },
+  { METHOD_DISCARD, lbytearr_discard },
+  { METHOD_COMPACT, lbytearr_compact },
   { METHOD_CUT, lbytearr_slice },
+  { METHOD_SWAPENDIAN, lbytearr_swapendian },
+  { METHOD_XORMASK, lbytearr_xormask },
+  { METHOD_FILL, lbytearr_fill },
+  { METHOD_COPYWITHIN, lbytearr_copywithin },
+  { METHOD_COMPARE, lbytearr_compare },
+  { METHOD_EQUALS, lbytearr_equals },
+  { METHOD_HASH, lbytearr_hash },
 
   { METHOD_WRITEBOOL, lbytearr_writebool },
   { METHOD_WRITEU8, lbytearr_writeu8 },
@@ -943,6 +6811,8 @@ static luaL_Reg bytearr_map[] = {
   { METHOD_WRITES16, lbytearr_writes16 },
   { METHOD_WRITEU32, lbytearr_writeu32 },
   { METHOD_WRITES32, lbytearr_writes32 },
+  { METHOD_WRITEU64, lbytearr_writeu64 },
+  { METHOD_WRITES64, lbytearr_writes64 },
   { METHOD_WRITEFLOAT, lbytearr_writef32 },
   { METHOD_WRITEDOUBLE, lbytearr_writef64 },
   { METHOD_READBOOL, lbytearr_readbool },
@@ -952,12 +6822,40 @@ static luaL_Reg bytearr_map[] = {
   { METHOD_READS16, lbytearr_reads16 },
   { METHOD_READU32, lbytearr_readu32 },
   { METHOD_READS32, lbytearr_reads32 },
+  { METHOD_READU64, lbytearr_readu64 },
+  { METHOD_READS64, lbytearr_reads64 },
   { METHOD_READFLOAT, lbytearr_readf32 },
   { METHOD_READDOUBLE, lbytearr_readf64 },
+  { METHOD_READU8ARR, lbytearr_readu8arr },
+  { METHOD_READS8ARR, lbytearr_reads8arr },
+  { METHOD_READU16ARR, lbytearr_readu16arr },
+  { METHOD_READS16ARR, lbytearr_reads16arr },
+  { METHOD_READU32ARR, lbytearr_readu32arr },
+  { METHOD_READS32ARR, lbytearr_reads32arr },
+  { METHOD_READFLOATARR, lbytearr_readf32arr },
+  { METHOD_READDOUBLEARR, lbytearr_readf64arr },
+  { METHOD_WRITEU8ARR, lbytearr_writeu8arr },
+  { METHOD_WRITES8ARR, lbytearr_writes8arr },
+  { METHOD_WRITEU16ARR, lbytearr_writeu16arr },
+  { METHOD_WRITES16ARR, lbytearr_writes16arr },
+  { METHOD_WRITEU32ARR, lbytearr_writeu32arr },
+  { METHOD_WRITES32ARR, lbytearr_writes32arr },
+  { METHOD_WRITEFLOATARR, lbytearr_writef32arr },
+  { METHOD_WRITEDOUBLEARR, lbytearr_writef64arr },
+  { METHOD_READVARU, lbytearr_readvaru },
+  { METHOD_READVARS, lbytearr_readvars },
+  { METHOD_WRITEVARU, lbytearr_writevaru },
+  { METHOD_WRITEVARS, lbytearr_writevars },
+  { METHOD_READVARUARR, lbytearr_readvaruarr },
+  { METHOD_READVARSARR, lbytearr_readvarsarr },
+  { METHOD_WRITEVARUARR, lbytearr_writevaruarr },
+  { METHOD_WRITEVARSARR, lbytearr_writevarsarr },
   { METHOD_READBYTES, lbytearr_readbytes },
   { METHOD_WRITEBYTES, lbytearr_writebytes },
   { METHOD_READSTR, lbytearr_readlstr },
   { METHOD_WRITESTR, lbytearr_writelstr },
+  { METHOD_READUNTIL, lbytearr_readuntil },
+  { METHOD_READLINE, lbytearr_readline },
 #ifdef BYTEARRAY_USE_CSTRING
   { METHOD_READCSTR, lbytearr_readcstr },
   { METHOD_WRITECSTR, lbytearr_writecstr },
@@ -969,44 +6867,79 @@ static int lbytearr_getlen( lua_State *L )
 {
   check_userdata_self(L);
 
-  Buf *p = lua_tobuffer(L, 1);
+  Buf *p = lua_peekbuffer(L, 1);
   lua_pushinteger( L, getLength(p) );
   return 1;
 }
 
-static int lbytearr_getter( lua_State *L )
+// property ids stored in the dispatch table, see luaopen_bytearr
+enum {
+  PROP_NONE,
+  PROP_LENGTH,
+  PROP_POSITION,
+  PROP_AVAILABLE,
+  PROP_ENDIAN,
+  PROP_CAPACITY
+};
+
+#define UPVALUE_METHODS    lua_upvalueindex(2)
+#define UPVALUE_PROPERTIES lua_upvalueindex(3)
+
+// self of the getter and setter, p from lua_touserdata stands for the
+// type check
+#define check_metamethod_self( L, p )					\
+  luaL_argcheck(L, (p) && lua_hasmetatable(L, 1, UPVALUE_SELF), 1, MSG_INVALIDTYPE)
+
+static inline int property_id( lua_State *L, int key )
 {
-  check_userdata_self(L);
+  lua_pushvalue(L, key);
+  lua_rawget(L, UPVALUE_PROPERTIES);
+  int id = (int)lua_tointeger(L, -1);
+  lua_pop(L, 1);
+  return id;
+}
 
-  Buf *p = lua_tobuffer(L, 1);
-  
-  if( lua_type(L, 2) == LUA_TNUMBER ){
+// upvalue 2: method table, upvalue 3: property name => PROP_xxx
+static int lbytearr_getter( lua_State *L )
+{
+  // p is NULL for anything but a userdata. A method does not look at
+  // self, the method itself checks it.
+  Buf *p = lua_peekbuffer(L, 1);
+  int t = lua_type(L, 2);
+  if( t == LUA_TNUMBER ){
+    check_metamethod_self(L, p);
     lua_Number arg2 = lua_tonumber(L, 2);
-    buflen_t idx = (buflen_t)arg2;
-    if( fabs( (float)arg2 - (float)idx ) < 0.00001f )
-      lua_pushinteger( L, at(p, lua_tointeger(L, 2)-1) );
+    lua_Integer idx = (lua_Integer)arg2;
+    if( (lua_Number)idx == arg2 && idx > 0 && (uint64_t)idx <= getLength(p) )
+      lua_pushinteger( L, at(p, (buflen_t)(idx-1)) );
     else lua_pushinteger(L, -1);
   }
-  else if( lua_isstring(L, 2) ){
-    const char *key = lua_tostring(L, 2);
-    // if exist in MODULE
-    lua_getglobal(L, MODULE_NAME);
-    lua_getfield(L, -1, key);
-    
-    if( lua_isnil(L, -1) ){
-      //if the member name
-      if( 0 == strcmp(key, MEMBER_LENGTH) ){
-	lua_pushinteger(L, getLength(p));
-      }
-      else if( 0 == strcmp(key, MEMBER_POSITION) ){
-	lua_pushinteger(L, getPosition(p));
-      }
-      else if( 0 == strcmp(key, MEMBER_AVAILABLE) ){
-	lua_pushinteger(L, getBytesAvailable(p));
-      }
-      else if( 0 == strcmp(key, MEMBER_ENDIAN) ){
-	lua_pushinteger(L, getEndian(p));
-      }
+  else if( t == LUA_TSTRING ){
+    // methods first, keys are interned so this is a single hash lookup
+    lua_pushvalue(L, 2);
+    lua_rawget(L, UPVALUE_METHODS);
+    if( !lua_isnil(L, -1) ) return 1;
+    lua_pop(L, 1);
+
+    check_metamethod_self(L, p);
+    switch( property_id(L, 2) ){
+    case PROP_LENGTH:
+      lua_pushinteger(L, getLength(p));
+      break;
+    case PROP_POSITION:
+      lua_pushinteger(L, getPosition(p));
+      break;
+    case PROP_AVAILABLE:
+      lua_pushinteger(L, getBytesAvailable(p));
+      break;
+    case PROP_ENDIAN:
+      lua_pushinteger(L, getEndian(p));
+      break;
+    case PROP_CAPACITY:
+      lua_pushinteger(L, getCapacity(p));
+      break;
+    default:
+      lua_pushnil(L);
     }
   }
   else lua_pushnil(L);
@@ -1014,40 +6947,44 @@ static int lbytearr_getter( lua_State *L )
   return 1;
 }
 
+// same upvalues as lbytearr_getter
 static int lbytearr_setter( lua_State *L )
 {
-  check_userdata_self(L);
-
-  Buf *p = lua_tobuffer(L, 1);
-  
-  handle_scope_except();
+  Buf *p = lua_peekbuffer(L, 1);
+  check_metamethod_self(L, p);
+  settle_debt( L, p->alloc );
   
-  int val;
-  val = luaL_checkint(L, 3);
-  if( lua_isnumber(L, 2) ){
-    int index = lua_tointeger(L, 2) - 1;
+  int err = ERR_OK;
+  lua_Integer val;
+  val = luaL_checkinteger(L, 3);
+  int t = lua_type(L, 2);
+  if( t == LUA_TNUMBER ){
+    lua_Integer index = lua_tointeger(L, 2) - 1;
     luaL_argcheck(L, 0 <= index, 2, MSG_OUTOFRANGE);
-    assign( p, index, (uint8_t)(val & 0xff) );
+    if( (uint64_t)index >= BUFLEN_MAX ) err = ERR_OVERFLOW;
+    else err = assign( p, index, (uint8_t)(val & 0xff) );
   }
-  else if( lua_isstring(L, 2) ){
-    const char *key = lua_tostring(L, 2);
-    
-    //if the member name
-    if( 0 == strcmp(key, MEMBER_LENGTH) ){
-      if( val < 0 ) longjmp( except, ERR_OUTOFRANGE );
-      setLength(p, val);
-    }
-    else if( 0 == strcmp(key, MEMBER_POSITION) ){
-      if( val < 0 ) longjmp( except, ERR_OUTOFRANGE );
-      setPosition(p, val);
-    }
-    else if( 0 == strcmp(key, MEMBER_ENDIAN) ){
+  else if( t == LUA_TSTRING ){
+    switch( property_id(L, 2) ){
+    case PROP_LENGTH:
+      if( val < 0 ) err = ERR_OUTOFRANGE;
+      else if( (uint64_t)val > BUFLEN_MAX ) err = ERR_OVERFLOW;
+      else err = setLength(p, val);
+      break;
+    case PROP_POSITION:
+      if( val < 0 ) err = ERR_OUTOFRANGE;
+      else setPosition(p, (uint64_t)val > BUFLEN_MAX ? BUFLEN_MAX : (buflen_t)val);
+      break;
+    case PROP_ENDIAN:
       setEndian(p, val);
+      break;
+    default:
+      err = ERR_OUTOFRANGE;
     }
-    else longjmp( except, ERR_OUTOFRANGE );
   }
-  else longjmp( except, ERR_OUTOFRANGE );
+  else err = ERR_OUTOFRANGE;
   
+  handle_error( err );
   return 0;
 }
 
@@ -1055,39 +6992,509 @@ static int lbytearr_gc( lua_State *L )
 {
   check_userdata_self(L);
 
-  Buf *p = lua_tobuffer(L, 1);
+  // not lua_tobuffer, no collector step from inside a finalizer
+  Buf *p = lua_touserdata(L, 1);
   release( p );
   return 0;
 }
 
+// ------------ segmented buffer ---------------
+// Chain methods wrap the ByteArray functions: writers run on a scratch
+// ByteArray that is then appended, readers run on the chain itself with
+// a window of the unread bytes.
+#define UPVALUE_SCRATCH    lua_upvalueindex(2)
+#define UPVALUE_FUNCTION   lua_upvalueindex(3)
+#define UPVALUE_COUNTARG   lua_upvalueindex(4)
+
+// keep scratch memory after a large write below this
+#define SCRATCH_KEEP_SIZE  (4*BYTEARRAY_CHUNK_SIZE)
+
+static inline Buf* lua_tochain( lua_State *L, int idx )
+{
+  Buf *p = lua_tobuffer(L, idx);
+  if( !p->flag.chained ) luaL_argerror(L, idx, MSG_INVALIDTYPE);
+  return p;
+}
+
+// upvalue 2: scratch ByteArray, upvalue 3: ByteArray writer
+static int lchain_write( lua_State *L )
+{
+  check_userdata_self(L);
+
+  Buf *p = lua_tochain(L, 1);
+  Buf *s = lua_tobuffer(L, UPVALUE_SCRATCH);
+  s->position = s->length = 0;
+  setEndian( s, getEndian(p) );
+
+  int n = lua_gettop(L);
+  lua_pushvalue(L, UPVALUE_FUNCTION);
+  lua_pushvalue(L, UPVALUE_SCRATCH);
+  for( int i=2; i <= n; ++i ) lua_pushvalue(L, i);
+  lua_call(L, n, LUA_MULTRET);
+
+  int err = chainAppend( p, getBuffer(s), getLength(s) );
+  s->position = s->length = 0;
+  if( getCapacity(s) > SCRATCH_KEEP_SIZE ) resizeBuffer( s, SCRATCH_KEEP_SIZE );
+  handle_error( err );
+
+  // writers return the scratch as self
+  int top = lua_gettop(L);
+  for( int i=n+1; i <= top; ++i ){
+    if( lua_rawequal(L, i, UPVALUE_SCRATCH) ){
+      lua_pushvalue(L, 1);
+      lua_replace(L, i);
+    }
+  }
+  return top - n;
+}
+
+// 1 if the error at idx is the one handle_error raises for ERR_OUTOFRANGE
+static int lua_isoutofrange( lua_State *L, int idx )
+{
+  size_t len;
+  const char *msg = lua_type(L, idx) == LUA_TSTRING ? lua_tolstring(L, idx, &len) : NULL;
+  return msg && len == sizeof(MSG_OUTOFRANGE) - 1 && memcmp(msg, MSG_OUTOFRANGE, len) == 0;
+}
+
+// upvalue 2: scratch ByteArray, upvalue 3: ByteArray reader, upvalue 4:
+// index of the count argument that reads all bytes when missing or 0.
+// The window is the head chunk, it is retried over copies of more chunks
+// when the value straddles them.
+static int lchain_read( lua_State *L )
+{
+  check_userdata_self(L);
+
+  Buf *p = lua_tochain(L, 1);
+  BufChain *ch = getChain(p);
+  int n = lua_gettop(L);
+  int countarg = (int)lua_tointeger(L, UPVALUE_COUNTARG);
+
+  size_t avail = ch->length < BUFLEN_MAX ? ch->length : BUFLEN_MAX;
+  size_t window = chainContiguous(p);
+  if( countarg > 0 && lua_tointeger(L, countarg) == 0 ) window = avail;
+  if( window > avail ) window = avail;
+
+  for(;;){
+    if( window <= chainContiguous(p) ){
+      chainWindow( p, ch->head ? ch->head->data + ch->offset : p->local, window );
+    }
+    else {
+      Buf *s = lua_tobuffer(L, UPVALUE_SCRATCH);
+      s->position = s->length = 0;
+      handle_error( reserveCapacity(s, window) );
+      chainGather( p, getBuffer(s), window );
+      chainWindow( p, getBuffer(s), window );
+    }
+
+    lua_pushvalue(L, UPVALUE_FUNCTION);
+    for( int i=1; i <= n; ++i ) lua_pushvalue(L, i);
+    int err = lua_pcall(L, n, LUA_MULTRET, 0);
+    if( err == 0 ) break;
+
+    // only a value cut off by the window end is worth a wider one
+    if( window >= avail || !lua_isoutofrange(L, -1) ){
+      chainWindowClose(p);
+      return lua_error(L);
+    }
+    lua_pop(L, 1);
+    window = window < avail / 2 ? window * 2 + BYTEARRAY_CHUNK_SIZE : avail;
+    if( window > avail ) window = avail;
+  }
+
+  size_t used = getPosition(p);
+  chainWindowClose(p);
+  chainConsume(p, used);
+  return lua_gettop(L) - n;
+}
+
+// local str = c:toString() -- the unread bytes
+// upvalue 2: scratch ByteArray
+static int lchain_tostring( lua_State *L )
+{
+  check_userdata_self(L);
+
+  Buf *p = lua_tochain(L, 1);
+  size_t n = getChain(p)->length;
+  if( n == chainContiguous(p) ){
+    lua_pushlstring(L, n ? (const char*)getChain(p)->head->data + getChain(p)->offset : "", n);
+    return 1;
+  }
+
+  Buf *s = lua_tobuffer(L, UPVALUE_SCRATCH);
+  s->position = s->length = 0;
+  if( n > BUFLEN_MAX ) handle_error( ERR_OVERFLOW );
+  handle_error( reserveCapacity(s, n) );
+  chainGather( p, getBuffer(s), n );
+  lua_pushlstring(L, (const char*)getBuffer(s), n);
+  if( getCapacity(s) > SCRATCH_KEEP_SIZE ) resizeBuffer( s, SCRATCH_KEEP_SIZE );
+  return 1;
+}
+
+static int lchain_clear( lua_State *L )
+{
+  check_userdata_self(L);
+
+  Buf *p = lua_tochain(L, 1);
+  releaseChain( p );
+  return 0;
+}
+
+#ifdef BYTEARRAY_POSIX
+// local n = c:writeTo( fd ) -- writev of the chunks, written bytes are consumed
+static int lchain_writeto( lua_State *L )
+{
+  check_userdata_self(L);
+
+  Buf *p = lua_tochain(L, 1);
+  int fd = luaL_checkint(L, 2);
+
+  struct iovec iov[BYTEARRAY_WRITEV_BATCH];
+  size_t total = 0;
+  int nbuf;
+  while( (nbuf = chainIovec(p, iov, BYTEARRAY_WRITEV_BATCH)) > 0 ){
+    size_t want = 0;
+    for( int i=0; i < nbuf; ++i ) want += iov[i].iov_len;
+
+    ssize_t n = writev( fd, iov, nbuf );
+    if( n < 0 ){
+      if( errno == EINTR ) continue;
+      if( would_block(errno) ) break;
+      return push_syserror(L, errno);
+    }
+    chainConsume( p, n );
+    total += n;
+    if( (size_t)n < want ) break;
+  }
+
+  lua_pushinteger(L, total);
+  return 1;
+}
+#endif
+
+static int lchain_getlen( lua_State *L )
+{
+  check_userdata_self(L);
+
+  Buf *p = lua_tochain(L, 1);
+  lua_pushinteger( L, getChain(p)->length );
+  return 1;
+}
+
+// same upvalues as lbytearr_getter, with the chain methods
+static int lchain_getter( lua_State *L )
+{
+  check_userdata_self(L);
+
+  Buf *p = lua_tochain(L, 1);
+  if( lua_type(L, 2) != LUA_TSTRING ){
+    lua_pushnil(L);
+    return 1;
+  }
+
+  lua_pushvalue(L, 2);
+  lua_rawget(L, UPVALUE_METHODS);
+  if( !lua_isnil(L, -1) ) return 1;
+  lua_pop(L, 1);
+
+  switch( property_id(L, 2) ){
+  case PROP_LENGTH:
+  case PROP_AVAILABLE:
+    lua_pushinteger(L, getChain(p)->length);
+    break;
+  case PROP_POSITION:
+    lua_pushinteger(L, 0);
+    break;
+  case PROP_ENDIAN:
+    lua_pushinteger(L, getEndian(p));
+    break;
+  default:
+    lua_pushnil(L);
+  }
+  return 1;
+}
+
+static int lchain_setter( lua_State *L )
+{
+  check_userdata_self(L);
+
+  Buf *p = lua_tochain(L, 1);
+  lua_Integer val = luaL_checkinteger(L, 3);
+  int err = ERR_READONLY;
+  if( lua_type(L, 2) == LUA_TSTRING && property_id(L, 2) == PROP_ENDIAN ){
+    setEndian(p, val);
+    err = ERR_OK;
+  }
+  handle_error( err );
+  return 0;
+}
+
+static luaL_Reg chain_writers[] = {
+  { METHOD_WRITEBOOL, lbytearr_writebool },
+  { METHOD_WRITEU8, lbytearr_writeu8 },
+  { METHOD_WRITES8, lbytearr_writes8 },
+  { METHOD_WRITEU16, lbytearr_writeu16 },
+  { METHOD_WRITES16, lbytearr_writes16 },
+  { METHOD_WRITEU32, lbytearr_writeu32 },
+  { METHOD_WRITES32, lbytearr_writes32 },
+  { METHOD_WRITEU64, lbytearr_writeu64 },
+  { METHOD_WRITES64, lbytearr_writes64 },
+  { METHOD_WRITEFLOAT, lbytearr_writef32 },
+  { METHOD_WRITEDOUBLE, lbytearr_writef64 },
+  { METHOD_WRITEU8ARR, lbytearr_writeu8arr },
+  { METHOD_WRITES8ARR, lbytearr_writes8arr },
+  { METHOD_WRITEU16ARR, lbytearr_writeu16arr },
+  { METHOD_WRITES16ARR, lbytearr_writes16arr },
+  { METHOD_WRITEU32ARR, lbytearr_writeu32arr },
+  { METHOD_WRITES32ARR, lbytearr_writes32arr },
+  { METHOD_WRITEFLOATARR, lbytearr_writef32arr },
+  { METHOD_WRITEDOUBLEARR, lbytearr_writef64arr },
+  { METHOD_WRITEVARU, lbytearr_writevaru },
+  { METHOD_WRITEVARS, lbytearr_writevars },
+  { METHOD_WRITEVARUARR, lbytearr_writevaruarr },
+  { METHOD_WRITEVARSARR, lbytearr_writevarsarr },
+  { METHOD_WRITEBYTES, lbytearr_writebytes },
+  { METHOD_WRITESTR, lbytearr_writelstr },
+#ifdef BYTEARRAY_USE_CSTRING
+  { METHOD_WRITECSTR, lbytearr_writecstr },
+#endif
+#ifdef BYTEARRAY_POSIX
+  { METHOD_READFROM, lbytearr_readfrom },
+#endif
+  {NULL, NULL}
+};
+
+// readers with the index of their optional count argument, or 0
+static struct {
+  const char *name;
+  lua_CFunction func;
+  int countarg;
+} chain_readers[] = {
+  { METHOD_READBOOL, lbytearr_readbool, 0 },
+  { METHOD_READU8, lbytearr_readu8, 0 },
+  { METHOD_READS8, lbytearr_reads8, 0 },
+  { METHOD_READU16, lbytearr_readu16, 0 },
+  { METHOD_READS16, lbytearr_reads16, 0 },
+  { METHOD_READU32, lbytearr_readu32, 0 },
+  { METHOD_READS32, lbytearr_reads32, 0 },
+  { METHOD_READU64, lbytearr_readu64, 0 },
+  { METHOD_READS64, lbytearr_reads64, 0 },
+  { METHOD_READFLOAT, lbytearr_readf32, 0 },
+  { METHOD_READDOUBLE, lbytearr_readf64, 0 },
+  { METHOD_READU8ARR, lbytearr_readu8arr, 2 },
+  { METHOD_READS8ARR, lbytearr_reads8arr, 2 },
+  { METHOD_READU16ARR, lbytearr_readu16arr, 2 },
+  { METHOD_READS16ARR, lbytearr_reads16arr, 2 },
+  { METHOD_READU32ARR, lbytearr_readu32arr, 2 },
+  { METHOD_READS32ARR, lbytearr_reads32arr, 2 },
+  { METHOD_READFLOATARR, lbytearr_readf32arr, 2 },
+  { METHOD_READDOUBLEARR, lbytearr_readf64arr, 2 },
+  { METHOD_READVARU, lbytearr_readvaru, 0 },
+  { METHOD_READVARS, lbytearr_readvars, 0 },
+  { METHOD_READVARUARR, lbytearr_readvaruarr, 2 },
+  { METHOD_READVARSARR, lbytearr_readvarsarr, 2 },
+  { METHOD_READBYTES, lbytearr_readbytes, 4 },
+  { METHOD_READSTR, lbytearr_readlstr, 0 },
+  { METHOD_READUNTIL, lbytearr_readuntil, 0 },
+  { METHOD_READLINE, lbytearr_readline, 0 },
+#ifdef BYTEARRAY_USE_CSTRING
+  { METHOD_READCSTR, lbytearr_readcstr, 0 },
+#endif
+  { NULL, NULL, 0 }
+};
+
+static luaL_Reg chain_methods[] = {
+  { METHOD_CLEAR, lchain_clear },
+#ifdef BYTEARRAY_POSIX
+  { METHOD_WRITETO, lchain_writeto },
+#endif
+  {NULL, NULL}
+};
+
+// free chunks are kept until the lua_State closes
+static int lbytearr_gcalloc( lua_State *L )
+{
+  BufAlloc *a = lua_touserdata(L, 1);
+  a->maxchunks = 0;
+  while( a->chunks != NULL ){
+    BufChunk *c = a->chunks;
+    a->chunks = c->next;
+    allocBytes( a, c, sizeof(BufChunk), 0 );
+  }
+  a->nchunks = 0;
+  return 0;
+}
+
+// the functions of l into the table at t, each a closure over the
+// metatable at mt
+static void lua_setmethods( lua_State *L, int t, const luaL_Reg *l, int mt )
+{
+  for( ; l->name != NULL; ++l ){
+    lua_pushvalue(L, mt);
+    lua_pushcclosure(L, l->func, 1);
+    lua_setfield(L, t, l->name);
+  }
+}
+
 int luaopen_bytearr( lua_State *L )
 {
+  // buffer allocator of this lua_State, kept alive by the registry
+  BufAlloc *a = lua_newuserdata(L, sizeof(BufAlloc));
+  a->allocf = lua_getallocf(L, &a->ud);
+  a->used = 0;
+  a->limit = BYTEARRAY_MEMORY_LIMIT;
+  a->debt = 0;
+  a->chunks = NULL;
+  a->nchunks = 0;
+  a->maxchunks = BYTEARRAY_CHUNK_CACHE;
+  lua_createtable(L, 0, 1);
+  lua_pushcfunction(L, lbytearr_gcalloc);
+  lua_setfield(L, -2, "__gc");
+  lua_setmetatable(L, -2);
+  lua_setfield(L, LUA_REGISTRYINDEX, MODULE_NAME "#alloc");
+
   luaL_register(L, MODULE_NAME, bytearr_map );
+  int module = lua_gettop(L);
+
+  // the metatables come first, every method keeps the one of its self
+  // as upvalue 1
+  lua_newtable(L);
+  int mt = lua_gettop(L);
+  lua_pushlightuserdata(L, BYTEARRAY_MT);
+  lua_pushvalue(L, mt);
+  lua_rawset(L, LUA_REGISTRYINDEX);
+  lua_newtable(L);
+  int chainmt = lua_gettop(L);
+  lua_pushlightuserdata(L, CHAIN_MT);
+  lua_pushvalue(L, chainmt);
+  lua_rawset(L, LUA_REGISTRYINDEX);
+  lua_setmethods(L, module, bytearr_map, mt);
 
   lua_pushinteger(L, ENDIAN_LITTLE);
-  lua_setfield(L, -2, CONSTANT_ENDIAN_L );
+  lua_setfield(L, module, CONSTANT_ENDIAN_L );
 
   lua_pushinteger(L, ENDIAN_BIG);
-  lua_setfield(L, -2, CONSTANT_ENDIAN_B );
+  lua_setfield(L, module, CONSTANT_ENDIAN_B );
+
+  // pack and unpack each cache their compiled formats
+  lua_pushvalue(L, mt);
+  lua_newtable(L);
+  lua_pushinteger(L, 0);
+  lua_pushcclosure(L, lbytearr_pack, 3);
+  lua_setfield(L, module, METHOD_PACK);
+  lua_pushvalue(L, mt);
+  lua_newtable(L);
+  lua_pushinteger(L, 0);
+  lua_pushcclosure(L, lbytearr_unpack, 3);
+  lua_setfield(L, module, METHOD_UNPACK);
+  
+  // property dispatch table
+  lua_createtable(L, 0, 5);
+  lua_pushinteger(L, PROP_LENGTH);
+  lua_setfield(L, -2, MEMBER_LENGTH);
+  lua_pushinteger(L, PROP_POSITION);
+  lua_setfield(L, -2, MEMBER_POSITION);
+  lua_pushinteger(L, PROP_AVAILABLE);
+  lua_setfield(L, -2, MEMBER_AVAILABLE);
+  lua_pushinteger(L, PROP_ENDIAN);
+  lua_setfield(L, -2, MEMBER_ENDIAN);
+  lua_pushinteger(L, PROP_CAPACITY);
+  lua_setfield(L, -2, MEMBER_CAPACITY);
+  int props = lua_gettop(L);
   
   // metatable
-  lua_newtable(L);
+  lua_pushvalue(L, mt);
 
-  lua_pushcfunction(L, lbytearr_getlen);
+  lua_pushvalue(L, mt);
+  lua_pushcclosure(L, lbytearr_getlen, 1);
   lua_setfield(L, -2, "__len");
+
+  lua_pushcfunction(L, lbytearr_eq);
+  lua_setfield(L, -2, "__eq");
+  lua_pushcfunction(L, lbytearr_lt);
+  lua_setfield(L, -2, "__lt");
+  lua_pushcfunction(L, lbytearr_le);
+  lua_setfield(L, -2, "__le");
   
-  lua_pushcfunction(L, lbytearr_getter);
+  // the module table is captured so that shadowing the global is harmless
+  lua_pushvalue(L, mt);
+  lua_pushvalue(L, module);
+  lua_pushvalue(L, props);
+  lua_pushcclosure(L, lbytearr_getter, 3);
   lua_setfield(L, -2, "__index");
 
-  lua_pushcfunction(L, lbytearr_setter);
+  lua_pushvalue(L, mt);
+  lua_pushvalue(L, module);
+  lua_pushvalue(L, props);
+  lua_pushcclosure(L, lbytearr_setter, 3);
   lua_setfield(L, -2, "__newindex");
 
-  lua_pushcfunction(L, lbytearr_gc);
+  lua_pushvalue(L, mt);
+  lua_pushcclosure(L, lbytearr_gc, 1);
   lua_setfield(L, -2, "__gc");
 
   //lua_pushcfunction(L, lbytearr_add);
   //lua_pushstring(L, "__add");
-  lua_setfield(L, LUA_REGISTRYINDEX, MODULE_NAME "#mt");
+  lua_pop(L, 1);
+
+  // segmented buffers share one scratch ByteArray, the writers take it
+  // as self
+  Buf *s = lua_newbuffer(L, 0);
+  if( createBuf(s, 0, BYTEARRAY_CHUNK_SIZE, getNativeEndian()) != ERR_OK ){
+    error_handle(L, ERR_NOMEM);
+    lua_error(L);
+  }
+  lua_pushvalue(L, mt);
+  lua_setmetatable(L, -2);
+  int scratch = lua_gettop(L);
+
+  // the readers run on the chain itself, so they hold its metatable
+  lua_newtable(L);
+  for( luaL_Reg *r = chain_writers; r->name != NULL; ++r ){
+    lua_pushvalue(L, chainmt);
+    lua_pushvalue(L, scratch);
+    lua_pushvalue(L, mt);
+    lua_pushcclosure(L, r->func, 1);
+    lua_pushcclosure(L, lchain_write, 3);
+    lua_setfield(L, -2, r->name);
+  }
+  for( int i=0; chain_readers[i].name != NULL; ++i ){
+    lua_pushvalue(L, chainmt);
+    lua_pushvalue(L, scratch);
+    lua_pushvalue(L, chainmt);
+    lua_pushcclosure(L, chain_readers[i].func, 1);
+    lua_pushinteger(L, chain_readers[i].countarg);
+    lua_pushcclosure(L, lchain_read, 4);
+    lua_setfield(L, -2, chain_readers[i].name);
+  }
+  lua_setmethods(L, lua_gettop(L), chain_methods, chainmt);
+  lua_pushvalue(L, chainmt);
+  lua_pushvalue(L, scratch);
+  lua_pushcclosure(L, lchain_tostring, 2);
+  lua_setfield(L, -2, METHOD_TOSTRING);
+  int methods = lua_gettop(L);
+
+  lua_pushvalue(L, chainmt);
+  lua_pushvalue(L, chainmt);
+  lua_pushcclosure(L, lchain_getlen, 1);
+  lua_setfield(L, -2, "__len");
+  lua_pushvalue(L, chainmt);
+  lua_pushvalue(L, methods);
+  lua_pushvalue(L, props);
+  lua_pushcclosure(L, lchain_getter, 3);
+  lua_setfield(L, -2, "__index");
+  lua_pushvalue(L, chainmt);
+  lua_pushvalue(L, methods);
+  lua_pushvalue(L, props);
+  lua_pushcclosure(L, lchain_setter, 3);
+  lua_setfield(L, -2, "__newindex");
+  lua_pushvalue(L, chainmt);
+  lua_pushcclosure(L, lbytearr_gc, 1);
+  lua_setfield(L, -2, "__gc");
+  lua_pop(L, 1);
+
+  luaL_newmetatable(L, PB_SCHEMA_MT);
+  lua_pop(L, 1);
+  lua_settop(L, module);
   
   return 0;
 }
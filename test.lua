@@ -198,6 +198,16 @@ local function test_read_bytes()
    assert( dst[7] == 55 )
    assert( dst:readByte() == 44 )
    assert( dst:readByte() == 55 )
+
+   -- only ByteArray objects are buffers, other userdata are refused
+   assert( not pcall( ByteArray.toString, io.stdout ) and not pcall( ByteArray.readByte, io.stdout ) )
+   assert( not pcall( src.readBytes, src, io.stdout ) and not pcall( ByteArray.writeBytes, io.stdout, src ) )
+   local mt = getmetatable( src )
+   assert( not pcall( mt.__index, io.stdout, "length" ) and not pcall( mt.__index, io.stdout, 1 ) )
+   assert( not pcall( mt.__newindex, io.stdout, "position", 0 ) and not pcall( mt.__len, io.stdout ) )
+   local fake = setmetatable( {}, mt )
+   assert( not pcall( function() return fake.length end ) and not pcall( function() return fake[1] end ) )
+   assert( not pcall( function() fake.position = 0 end ) )
 end
 
 local function test_write_integer()
@@ -348,6 +358,1364 @@ local function test_gc()
    assert( is_collect )
 end
 
+local function test_dispatch()
+   local buf = ByteArray.init( 1, 2, 3 )
+   local module = ByteArray
+   ByteArray = nil		-- shadowing the global must not break methods
+   assert( buf:readUnsignedByte() == 1 )
+   assert( buf.position == 1 )
+   assert( buf.length == 3 )
+   assert( buf.bytesAvailable == 2 )
+   assert( buf.endian == module.LITTLE_ENDIAN or buf.endian == module.BIG_ENDIAN )
+   assert( buf[2.0] == 2 )
+   assert( buf.nonexist == nil )
+   assert( buf[true] == nil )
+   ByteArray = module
+end
+
+local function test_errors()
+   local buf = ByteArray.init( 1, 2, 3 )
+   buf.position = 2
+   local ok, msg = pcall( buf.readInt, buf )
+   assert( not ok and msg:find( "out of buffer range" ) )
+   assert( buf.position == 2 )	-- failed read does not move the cursor
+   assert( buf:readUnsignedByte() == 3 )
+   assert( not pcall( buf.readUnsignedByte, buf ) )
+   local robuf = ByteArray.load( "abc" )
+   ok, msg = pcall( robuf.writeInt, robuf, 1 )
+   assert( not ok and msg:find( "readonly" ) )
+   assert( not pcall( robuf.clear, robuf ) )
+   assert( not pcall( function() buf.length = -1 end ) )
+   assert( not pcall( function() buf.foo = 1 end ) )
+   buf:writeCString( "xy" )
+   assert( #buf == 6 )
+end
+
+local function test_array()
+   for _, e in ipairs{ ByteArray.LITTLE_ENDIAN, ByteArray.BIG_ENDIAN } do
+      local buf = ByteArray.create( 16, e )
+      local values = {}
+      for i=1, 1000 do values[i] = i * 37 - 20000 end
+      buf:writeInts( values ):writeShorts( 1, -2, 3 ):writeDoubles( { 0.5, -1.25 } )
+      buf:writeUnsignedBytes( {} ):writeUnsignedInts( 0xffffffff, 7 )
+      buf.position = 0
+      local t = buf:readInts( 1000 )
+      assert( #t == 1000 )
+      for i=1, 1000 do assert( t[i] == values[i] ) end
+      local s = buf:readShorts( 3 )
+      assert( s[1] == 1 and s[2] == -2 and s[3] == 3 )
+      local d = {}
+      assert( buf:readDoubles( 2, d ) == d )
+      assert( d[1] == 0.5 and d[2] == -1.25 )
+      local u = buf:readUnsignedInts()
+      assert( #u == 2 and u[1] == 0xffffffff and u[2] == 7 )
+      assert( #buf:readFloats() == 0 )
+   end
+
+   local buf = ByteArray.init( 1, 2, 255 )
+   local b = buf:readSignedBytes( 3 )
+   assert( b[1] == 1 and b[2] == 2 and b[3] == -1 )
+   buf.position = 0
+   assert( not pcall( buf.readUnsignedShorts, buf, 2 ) )
+   assert( buf.position == 0 )
+   buf.position = #buf
+   assert( not pcall( buf.writeFloats, buf, { 1, "x", 3 } ) )
+   assert( buf.position == 3 and #buf == 3 )
+end
+
+local function test_swap_endian()
+   for _, n in ipairs{ 1, 7, 16, 33, 100 } do
+      local le = ByteArray.create( 16, ByteArray.LITTLE_ENDIAN )
+      local be = ByteArray.create( 16, ByteArray.BIG_ENDIAN )
+      for i=1, n do
+	 le:writeShort( i ):writeInt( -i ):writeDouble( i / 7 )
+	 be:writeShort( i ):writeInt( -i ):writeDouble( i / 7 )
+      end
+      le.position = 0
+      for i=1, n do
+	 le:swapEndian( 2, le.position, 1 )
+	 le.position = le.position + 2
+	 le:swapEndian( 4, nil, 1 )
+	 le.position = le.position + 4
+	 le:swapEndian( 8, le.position, 1 )
+	 le.position = le.position + 8
+      end
+      assert( le:toString() == be:toString() )
+      be.position = 0
+      local s = ByteArray.init( be:readUnsignedBytes( #be ) )
+      s:swapEndian( 2, 0 ):swapEndian( 2, 0 )
+      assert( s:toString() == be:toString() )
+   end
+
+   -- a run swaps as its values one by one, whatever the alignment
+   local bytes, seed = {}, 7
+   for i=1, 8 * 100 + 3 do
+      seed = (seed * 1103515245 + 12345) % 2147483648
+      bytes[i] = math.floor( seed / 65536 ) % 256
+   end
+   local data = ByteArray.init( bytes ):toString()
+   for _, width in ipairs{ 2, 4, 8 } do
+      for _, count in ipairs{ 33, 40, 100 } do
+	 for offset=1, 3 do
+	    local run, one = ByteArray.init( bytes ), ByteArray.init( bytes )
+	    run:swapEndian( width, offset, count )
+	    local want = { data:sub( 1, offset ) }
+	    for i=0, count - 1 do
+	       one:swapEndian( width, offset + i * width, 1 )
+	       local at = offset + i * width
+	       want[#want+1] = data:sub( at + 1, at + width ):reverse()
+	    end
+	    want[#want+1] = data:sub( offset + count * width + 1 )
+	    assert( run:toString() == table.concat( want ) and one:toString() == run:toString() )
+	 end
+      end
+   end
+
+   local buf = ByteArray.init( 1, 2, 3, 4, 5, 6, 7, 8, 9 )
+   buf:swapEndian( 4 )
+   assert( buf:toString() == string.char( 4, 3, 2, 1, 8, 7, 6, 5, 9 ) )
+   buf:swapEndian( 8, 1 )
+   assert( buf:toString() == string.char( 4, 9, 5, 6, 7, 8, 1, 2, 3 ) )
+   assert( not pcall( buf.swapEndian, buf, 3 ) )
+   assert( not pcall( buf.swapEndian, buf, 2, 0, 5 ) )
+   local robuf = ByteArray.load( "abcd" )
+   assert( not pcall( robuf.swapEndian, robuf, 2 ) )
+end
+
+local function test_varint()
+   local buf = ByteArray.create()
+   buf:writeVarUInt( 0 ):writeVarUInt( 1 ):writeVarUInt( 300 )
+   assert( buf:toString() == string.char( 0, 1, 0xac, 0x02 ) )
+   buf:clear()
+   buf:writeVarInt( 0 ):writeVarInt( -1 ):writeVarInt( 1 ):writeVarInt( -64 ):writeVarInt( 64 )
+   assert( buf:toString() == string.char( 0, 1, 2, 0x7f, 0x80, 0x01 ) )
+
+   local unsigned = { 0, 1, 127, 128, 16383, 16384, 2^21, 2^28 - 1, 2^32 - 1, 2^35 + 3, 2^49, 2^53 }
+   local signed = { 0, -1, 1, -63, -64, 64, -2^31, 2^31 - 1, -2^53, 2^53 }
+   buf:clear()
+   buf:writeVarUInts( unsigned ):writeVarInts( unsigned ):writeVarInts( signed )
+   buf.position = 0
+   for _, v in ipairs( unsigned ) do assert( buf:readVarUInt() == v ) end
+   local u = buf:readVarInts( #unsigned )
+   for i, v in ipairs( unsigned ) do assert( u[i] == v ) end
+   local s = buf:readVarInts()
+   assert( #s == #signed )
+   for i, v in ipairs( signed ) do assert( s[i] == v ) end
+   assert( buf.bytesAvailable == 0 )
+
+   -- 10 bytes encoding of the largest values
+   buf = ByteArray.init( 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x01, 0 )
+   assert( tonumber( buf:readVarUInt() ) == (math.type and -1 or 2^64) ) -- wraps on lua 5.3+
+   assert( buf:readVarUInt() == 0 )
+   buf = ByteArray.init( 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x01 )
+   assert( not pcall( buf.readVarUInt, buf ) )
+   buf = ByteArray.init( 0x80, 0x80 )
+   assert( not pcall( buf.readVarUInt, buf ) )
+   assert( buf.position == 0 )
+   buf = ByteArray.init( 1, 2, 0x80 )
+   assert( not pcall( buf.readVarUInts, buf ) )
+   assert( buf.position == 0 )
+   local ok, err = pcall( buf.readVarUInts, buf, 1e9 )
+   assert( not ok and not err:find( "memory" ) and buf.position == 0 )
+   assert( #buf:readVarUInts( 2 ) == 2 )
+   buf.position = 0
+   assert( not pcall( buf.writeVarUInt, buf, -1.5 ) )
+   assert( not pcall( buf.writeVarUInts, buf, { 1, -1.5 } ) )
+   assert( #buf == 3 )
+end
+
+local function test_int64()
+   local buf = ByteArray.create( 16, ByteArray.BIG_ENDIAN )
+   buf:writeInt64( -2 ):writeUnsignedInt64( 2^40 + 5 ):writeInt64( "-9007199254740993" )
+   assert( buf[1] == 0xff and buf[8] == 0xfe )
+   assert( buf[11] == 1 and buf[16] == 5 )
+   buf.position = 0
+   assert( buf:readInt64() == -2 )
+   assert( buf:readUnsignedInt64() == 2^40 + 5 )
+   local big = buf:readInt64()
+   if math.type then
+      assert( math.type( big ) == "integer" and big == -9007199254740993 )
+   else
+      assert( big == -9007199254740993 or big == "-9007199254740993" )
+   end
+   buf:writeUnsignedInt64( "18446744073709551615" )
+   buf.position = buf.position - 8
+   assert( buf:readInt64() == -1 )
+   assert( not pcall( buf.writeUnsignedInt64, buf, -1.5 ) )
+   assert( not pcall( buf.writeInt64, buf, "99999999999999999999" ) )
+   assert( not pcall( buf.writeInt64, buf, {} ) )
+
+   -- sizes and offsets past 32 bits are rejected instead of wrapping
+   buf = ByteArray.init( 1, 2, 3 )
+   assert( buf[2^32 + 1] == -1 )
+   assert( not pcall( function() buf.length = 2^40 end ) )
+   buf.position = 2^40
+   assert( buf.position == 3 )
+   local dst = ByteArray.create()
+   assert( not pcall( buf.writeBytes, buf, dst, -1 ) )
+   assert( not pcall( dst.writeBytes, dst, buf, 5 ) )
+   assert( not pcall( ByteArray.create, -1 ) )
+end
+
+local function test_capacity()
+   local buf = ByteArray.create()
+   local caps, last = 0, buf.capacity
+   for i=1, 100000 do
+      buf:writeUnsignedByte( i % 256 )
+      if buf.capacity ~= last then caps, last = caps + 1, buf.capacity end
+   end
+   assert( #buf == 100000 and buf[100000] == 100000 % 256 )
+   assert( caps < 20 )
+   assert( not pcall( function() buf.capacity = 1 end ) )
+
+   buf:shrinkToFit()
+   assert( buf.capacity == 100000 )
+   assert( buf:reserve( 10 ) == buf and buf.capacity == 100000 )
+   buf:reserve( 200000 )
+   assert( buf.capacity == 200000 and #buf == 100000 )
+   assert( not pcall( buf.reserve, buf, -1 ) )
+
+   -- spare capacity is not zero filled but growing length is
+   buf:clear()
+   assert( buf.capacity == 200000 and #buf == 0 )
+   buf.length = 3
+   assert( buf[1] == 0 and buf[3] == 0 )
+   buf[10] = 7
+   assert( #buf == 10 and buf[4] == 0 and buf[9] == 0 and buf[10] == 7 )
+   buf:clear()
+   buf:writeUnsignedInt( 0xffffffff )
+   buf.length = 0
+   buf.length = 4
+   assert( buf[1] == 0 and buf[4] == 0 )
+
+   buf:clear()
+   buf:writeString( "abc" )
+   buf.position = 0
+   assert( not pcall( buf.readCString, buf ) )
+   buf:shrinkToFit()
+   assert( buf.capacity == 3 )
+   buf.length = 0
+   buf:shrinkToFit()
+   assert( buf.capacity == 0 and buf:toString() == "" )
+   buf:writeCString( "x" )
+   buf.position = 0
+   assert( buf:readCString() == "x" )
+
+   local ro = ByteArray.load( "abc" )
+   assert( not pcall( ro.reserve, ro, 100 ) )
+   assert( not pcall( ro.shrinkToFit, ro ) )
+end
+
+local function test_inline()
+   -- small payloads are stored in the object, larger ones spill to the heap
+   local buf = ByteArray.create( 6, ByteArray.BIG_ENDIAN )
+   assert( buf.capacity == 6 )
+   buf:writeUnsignedShort( 0x0102 ):writeUnsignedInt( 0x03040506 )
+   for i=1, 200 do buf:writeUnsignedByte( i ) end
+   assert( #buf == 206 and buf[1] == 1 and buf[6] == 6 and buf[206] == 200 )
+   buf.length = 8
+   buf:shrinkToFit()
+   assert( buf.capacity == 8 and buf[7] == 1 and buf[8] == 2 )
+   buf:writeString( string.rep( "x", 1000 ) )
+   assert( #buf == 1008 and buf[8] == 2 and buf[1008] == 120 )
+
+   local a = ByteArray.create()
+   local b = ByteArray.create( 1 )
+   a:writeInt( 1 )
+   b:writeInt( 2 )
+   a.position, b.position = 0, 0
+   assert( a:readInt() == 1 and b:readInt() == 2 )
+   local s = buf:slice( 0, 4 )
+   assert( #s == 4 and s[4] == 4 )
+   assert( #ByteArray.create( 0 ) == 0 )
+end
+
+local function test_memory()
+   collectgarbage( "collect" )
+   local base = ByteArray.memoryUsage()
+   local buf = ByteArray.create( 1024 * 1024 )
+   local used = ByteArray.memoryUsage() - base
+   assert( used >= 1024 * 1024 and used < 1024 * 1024 + 64 )
+   buf:shrinkToFit()
+   assert( ByteArray.memoryUsage() == base )
+
+   -- the collector sees the buffers, not only the small userdata
+   local kb = collectgarbage( "count" )
+   for i=1, 200 do ByteArray.create( 1024 * 1024 ) end
+   assert( ByteArray.memoryUsage() - base < 200 * 1024 * 1024 )
+   collectgarbage( "collect" )
+   assert( ByteArray.memoryUsage() == base )
+
+   assert( ByteArray.setMemoryLimit( base + 4096 ) == 0 )
+   assert( not pcall( ByteArray.create, 8192 ) )
+   buf = ByteArray.create()
+   local ok, err = pcall( function() for i=1, 8192 do buf:writeUnsignedByte( 1 ) end end )
+   assert( not ok and #buf <= 4096 )
+   buf:clear()
+   buf:shrinkToFit()
+   buf:writeString( string.rep( "x", 1000 ) )
+   assert( ByteArray.setMemoryLimit( 0 ) == base + 4096 )
+   buf:writeString( string.rep( "x", 8192 ) )
+   assert( #buf == 9192 )
+end
+
+local function test_view()
+   local buf = ByteArray.create( 1024, ByteArray.BIG_ENDIAN )
+   for i=1, 1000 do buf:writeUnsignedByte( i % 256 ) end
+   collectgarbage( "collect" )
+   local used = ByteArray.memoryUsage()
+
+   -- large slices share the storage until one side writes
+   local v = buf:slice( 100, 300 )
+   local w = v:slice( 50, 150 )
+   assert( ByteArray.memoryUsage() == used )
+   assert( #v == 200 and v[1] == 101 and v[200] == 300 % 256 )
+   assert( #w == 100 and w[1] == 151 and v.endian == ByteArray.BIG_ENDIAN )
+   assert( v.position == 0 and v:readUnsignedShort() == 101 * 256 + 102 )
+
+   v[1] = 0
+   assert( v[1] == 0 and buf[101] == 101 and w[1] == 151 )
+   assert( ByteArray.memoryUsage() > used )
+   buf[152] = 0
+   assert( w[2] == 152 and buf[152] == 0 )
+   w.position = #w
+   w:writeInt( -1 )
+   assert( #w == 104 and w[104] == 255 and buf[251] == 251 )
+
+   local x = buf:slice( 0, 500 )
+   x:swapEndian( 2 )
+   assert( x[1] == 2 and x[2] == 1 and buf[1] == 1 )
+   local y = buf:slice( 0, 500 )
+   y:clear()
+   assert( #y == 0 and #buf == 1000 )
+   y:writeString( "abc" )
+   assert( buf[1] == 1 )
+   local z = buf:slice( 500 )
+   z.length = 1000
+   assert( z[1] == 501 % 256 and z[1000] == 0 and #buf == 1000 )
+
+   -- the view outlives its parent
+   local u = buf:slice( 900 )
+   buf = nil
+   collectgarbage( "collect" )
+   assert( #u == 100 and u[100] == 1000 % 256 )
+   u[1] = 7
+   assert( u[1] == 7 )
+
+   -- readBytes into a view writes its own copy
+   local src = ByteArray.init( 9, 9, 9 )
+   local dst = u:slice( 0, 80 )
+   src:readBytes( dst, 0, 3 )
+   assert( dst[1] == 9 and u[1] == 7 )
+   assert( not pcall( src.readBytes, src, ByteArray.load( "abc" ), 0, 1 ) )
+end
+
+local function test_load_pin()
+   local buf = ByteArray.load( string.rep( "ab", 5000 ) .. "c" )
+   collectgarbage( "collect" )
+   collectgarbage( "collect" )
+   assert( #buf == 10001 and buf[1] == 97 and buf[10001] == 99 )
+   assert( buf:toString() == string.rep( "ab", 5000 ) .. "c" )
+end
+
+local function test_mmap()
+   if not ByteArray.mmap then return end
+   local path = os.tmpname()
+   local f = io.open( path, "wb" )
+   f:write( string.rep( "x", 5000 ), "hello", string.rep( "y", 3000 ) )
+   f:close()
+
+   local m = ByteArray.mmap( path )
+   assert( #m == 8005 and m[1] == 120 and m[8005] == 121 )
+   assert( not pcall( m.writeByte, m, 1 ) )
+   local h = ByteArray.mmap( path, 5000, 5 )
+   assert( h:toString() == "hello" and h:readUnsignedByte() == 104 )
+   assert( #ByteArray.mmap( path, 8005 ) == 0 )
+   assert( not pcall( ByteArray.mmap, path, 8006 ) )
+   assert( not pcall( ByteArray.mmap, path, 5000, 5000 ) )
+   local s = m:slice( 4000, 6000 )
+   m, h = nil, nil
+   collectgarbage( "collect" )
+   assert( #s == 2000 and s[1001] == 104 )
+   os.remove( path )
+   assert( not pcall( ByteArray.mmap, path ) )
+end
+
+-- the descriptor of a file opened with io.open, linux only
+local function fd_of( open )
+   local function fds()
+      local r = {}
+      for i=3, 64 do
+	 local f = io.open( "/proc/self/fd/" .. i )
+	 if f then r[i] = true f:close() end
+      end
+      return r
+   end
+   local before = fds()
+   local f = open()
+   for i in pairs( fds() ) do
+      if not before[i] then return f, i end
+   end
+end
+
+local function test_fd_io()
+   if not ByteArray.writev or not io.open( "/proc/self/fd/0" ) then return end
+   local path = os.tmpname()
+   local f, fd = fd_of( function() return io.open( path, "w+b" ) end )
+   assert( fd )
+
+   local a = ByteArray.load( "hello " )
+   local b = ByteArray.init( 119, 111, 114, 108, 100 )
+   b.position = 0
+   assert( a:writeTo( fd ) == 6 and a.position == 6 and a:writeTo( fd ) == 0 )
+   a.position = 0
+   assert( ByteArray.writev( fd, { a, ByteArray.create(), b } ) == 11 )
+   assert( a.position == 6 and b.position == 5 )
+   local many = {}
+   for i=1, 200 do many[i] = ByteArray.load( "x" ) end
+   assert( ByteArray.writev( fd, many ) == 200 )
+   assert( not pcall( ByteArray.writev, fd, { a, 1 } ) and not pcall( ByteArray.writev, fd, { io.stdout } ) )
+   -- a bad element past the first batches sends nothing
+   for i=1, 200 do many[i].position = 0 end
+   many[201] = 1
+   assert( not pcall( ByteArray.writev, fd, many ) )
+   for i=1, 200 do assert( many[i].position == 0 ) end
+
+   f:seek( "set", 0 )
+   local buf = ByteArray.create()
+   buf:writeString( "<" )
+   buf.position = 1
+   assert( buf:readFrom( fd, 6 ) == 6 and #buf == 7 and buf.position == 1 )
+   assert( buf:readFrom( fd ) == 211 and #buf == 218 )
+   assert( buf:readFrom( fd ) == 0 )
+   assert( buf:toString() == "<hello hello world" .. string.rep( "x", 200 ) )
+   assert( not pcall( a.readFrom, a, fd ) )
+   assert( not pcall( buf.readFrom, buf, fd, 0 ) )
+   f:close()
+   os.remove( path )
+
+   local n, err, code = buf:readFrom( -1 )
+   assert( n == nil and type( err ) == "string" and code > 0 )
+   buf.position = 0
+   assert( buf:writeTo( -1 ) == nil )
+
+   -- a chain is written with writev and consumed
+   f, fd = fd_of( function() return io.open( path, "w+b" ) end )
+   local c = ByteArray.chain()
+   c:writeString( string.rep( "a", 50000 ) ):writeString( "b" )
+   assert( c:writeTo( fd ) == 50001 and #c == 0 )
+   f:seek( "set", 0 )
+   assert( f:read( "*a" ) == string.rep( "a", 50000 ) .. "b" )
+   f:seek( "set", 0 )
+   assert( c:readFrom( fd ) == 50001 and #c == 50001 )
+   f:close()
+   os.remove( path )
+end
+
+local function test_chain()
+   local c = ByteArray.chain( ByteArray.BIG_ENDIAN )
+   assert( #c == 0 and c.length == 0 and c.endian == ByteArray.BIG_ENDIAN )
+   -- values straddle the 16KB chunks
+   local N = 20000
+   for i=1, N do c:writeUnsignedInt( i ):writeDouble( i / 7 ) end
+   assert( #c == N * 12 and c.bytesAvailable == N * 12 )
+   assert( c:writeVarUInt( 300 ) == c )
+   c:writeString( string.rep( "z", 40000 ) ):writeCString( "end" )
+   c:writeUnsignedShorts( { 1, 2, 3 } )
+   for i=1, N do
+      assert( c:readUnsignedInt() == i )
+      assert( c:readDouble() == i / 7 )
+   end
+   assert( c:readVarUInt() == 300 )
+   assert( c:readString( 40000 ) == string.rep( "z", 40000 ) )
+   assert( c:readCString() == "end" )
+   local t = c:readUnsignedShorts()
+   assert( #t == 3 and t[3] == 3 and #c == 0 )
+   assert( not pcall( c.readByte, c ) )
+
+   -- little endian and readBytes across chunks
+   local l = ByteArray.chain( ByteArray.LITTLE_ENDIAN )
+   local src = ByteArray.create()
+   for i=1, 70000 do src:writeUnsignedByte( i % 251 ) end
+   l:writeInt( -2 ):writeBytes( src )
+   assert( l:readInt() == -2 and #l == 70000 )
+   local dst = ByteArray.create()
+   l:readBytes( dst )
+   assert( #dst == 70000 and dst[1] == 1 and dst[70000] == 70000 % 251 and #l == 0 )
+
+   l:writeString( "abc" ):writeString( string.rep( "d", 20000 ) )
+   assert( l:toString() == "abc" .. string.rep( "d", 20000 ) )
+   assert( l:readString( 2 ) == "ab" and l:toString():sub( 1, 2 ) == "cd" )
+   l:clear()
+   assert( #l == 0 and l:toString() == "" )
+
+   -- chains are not ByteArrays
+   assert( l.position == 0 and l.capacity == nil )
+   assert( not pcall( function() l.length = 1 end ) )
+   l.endian = ByteArray.BIG_ENDIAN
+   l:writeUnsignedShort( 1 )
+   assert( l:readByte() == 0 )
+   -- ByteArray functions refuse a chain
+   assert( not pcall( src.writeBytes, src, l ) and not pcall( src.readBytes, src, l ) )
+   assert( not pcall( ByteArray.crc32, l ) and not pcall( ByteArray.toString, l ) )
+   assert( not pcall( src.readByte, l ) and not pcall( l.writeInt, src, 1 ) )
+   assert( #src == 70000 and #l == 1 )
+   -- a bad argument fails at once, without gathering wider windows
+   l:writeString( string.rep( "e", 40000 ) )
+   local ok, err = pcall( l.readBytes, l, "x" )
+   assert( not ok and err:find( "#2" ) and #l == 40001 )
+end
+
+local function test_consume()
+   local buf = ByteArray.create( 0, ByteArray.BIG_ENDIAN )
+   buf:writeUnsignedInt( 1 ):writeUnsignedInt( 2 ):writeUnsignedInt( 3 )
+   buf.position = 0
+   assert( buf:readUnsignedInt() == 1 )
+
+   -- drop what was read, the rest moves to the front
+   assert( buf:discard() == buf )
+   assert( #buf == 8 and buf.position == 0 and buf[4] == 2 )
+   assert( buf:readUnsignedInt() == 2 )
+   buf:discard( 2 )
+   assert( #buf == 6 and buf.position == 2 and buf[2] == 2 )
+   assert( buf:readUnsignedShort() == 0 and buf:readUnsignedShort() == 3 )
+   assert( not pcall( buf.discard, buf, 7 ) )
+   assert( not pcall( buf.discard, buf, -1 ) )
+
+   -- writes after discard land after the kept bytes
+   buf:writeString( "tail" )
+   assert( #buf == 10 and buf:slice( 6 ):toString() == "tail" )
+   local cap = buf.capacity
+   buf:compact()
+   assert( buf.capacity >= cap and #buf == 10 and buf:slice( 6 ):toString() == "tail" )
+
+   local d = ByteArray.create()
+   buf.position = 6
+   buf:readBytes( d )
+   assert( d:toString() == "tail" )
+   buf:discard( #buf )
+   assert( #buf == 0 and buf.position == 0 )
+
+   -- a receive loop: memory stays bounded by the largest backlog
+   local rx = ByteArray.create()
+   local top, sum = 0, 0
+   for i=1, 20000 do
+      rx.position = #rx
+      rx:writeUnsignedShort( i % 65536 ):writeString( "payload" )
+      rx.position = 0
+      while rx.bytesAvailable >= 9 and i % 3 == 0 do
+	 sum = sum + rx:readUnsignedShort()
+	 rx:readString( 7 )
+	 rx:discard()
+      end
+      top = math.max( top, rx.capacity )
+   end
+   assert( top < 256 and sum > 0 )
+
+   -- slices keep their bytes
+   local big = ByteArray.create()
+   for i=1, 200 do big:writeUnsignedByte( i ) end
+   local s = big:slice( 100, 200 )
+   big:discard( 150 )
+   assert( #big == 50 and big[1] == 151 and s[1] == 101 and #s == 100 )
+   big:compact()
+   assert( big[1] == 151 and s[1] == 101 )
+
+   local ro = ByteArray.load( "abc" )
+   assert( not pcall( ro.discard, ro, 1 ) )
+   assert( not pcall( ro.compact, ro ) )
+end
+
+local function bytes_of( buf )
+   local t = {}
+   for i=1, #buf do t[i] = buf[i] end
+   return table.concat( t, " " )
+end
+
+local function test_protobuf()
+   -- the examples of the protobuf encoding guide
+   local Test1 = ByteArray.schema{ { 1, "a", "int32" } }
+   local Test = ByteArray.schema{
+      { 1, "a", "int32" },
+      { 2, "b", "string" },
+      { 3, "c", "message", Test1 },
+      { 4, "d", "int32", repeated = true, packed = true },
+   }
+   local buf = ByteArray.create()
+   assert( buf:writeProtobuf( Test1, { a = 150 } ) == buf )
+   assert( bytes_of( buf ) == "8 150 1" )
+   buf:clear()
+   buf:writeProtobuf( Test, { b = "testing" } )
+   assert( bytes_of( buf ) == "18 7 116 101 115 116 105 110 103" )
+   buf:clear()
+   buf:writeProtobuf( Test, { c = { a = 150 } } )
+   assert( bytes_of( buf ) == "26 3 8 150 1" )
+   buf:clear()
+   buf:writeProtobuf( Test, { d = { 3, 270, 86942 } } )
+   assert( bytes_of( buf ) == "34 6 3 142 2 158 167 5" )
+
+   buf.position = 0
+   local t = buf:readProtobuf( Test )
+   assert( t.d[1] == 3 and t.d[2] == 270 and t.d[3] == 86942 and t.a == nil )
+   assert( buf.position == #buf )
+
+   -- every type, in and out
+   local All = ByteArray.schema{
+      { 1, "f64", "double" }, { 2, "f32", "float" }, { 3, "i32", "int32" },
+      { 4, "i64", "int64" }, { 5, "u32", "uint32" }, { 6, "u64", "uint64" },
+      { 7, "s32", "sint32" }, { 8, "s64", "sint64" }, { 9, "x32", "fixed32" },
+      { 10, "x64", "fixed64" }, { 11, "sx32", "sfixed32" }, { 12, "sx64", "sfixed64" },
+      { 13, "ok", "bool" }, { 14, "kind", "enum" }, { 15, "name", "string" },
+      { 16, "raw", "bytes" }, { 17, "child", "message", Test },
+      { 18, "names", "string", repeated = true },
+      { 19, "kids", "message", Test1, repeated = true },
+      { 2000, "big", "uint32" },
+   }
+   local v = {
+      f64 = 1.25, f32 = -0.5, i32 = -2, i64 = -3000000000, u32 = 4000000000,
+      u64 = 2^40, s32 = -64, s64 = -2^40, x32 = 0xdeadbeef, x64 = 2^50,
+      sx32 = -7, sx64 = -2^45, ok = true, kind = 3, name = "n\0me",
+      raw = "\1\2\3", child = { a = 1, b = "x", c = { a = 2 }, d = { 9 } },
+      names = { "a", "", "c" }, kids = { { a = 1 }, {}, { a = 3 } }, big = 7,
+   }
+   buf = ByteArray.create()
+   buf:writeInt( 77 )
+   buf:writeProtobuf( All, v )
+   buf.position = 4
+   local r = buf:readProtobuf( All )
+   for k, x in pairs( v ) do
+      if type( x ) ~= "table" then assert( r[k] == x, k ) end
+   end
+   assert( r.child.a == 1 and r.child.b == "x" and r.child.c.a == 2 and r.child.d[1] == 9 )
+   assert( #r.names == 3 and r.names[2] == "" and r.names[3] == "c" )
+   assert( #r.kids == 3 and r.kids[1].a == 1 and r.kids[2].a == nil and r.kids[3].a == 3 )
+
+   -- unknown fields are skipped, repeated numbers read packed or not
+   local Few = ByteArray.schema{ { 15, "name", "string" }, { 40, "d", "int32", repeated = true } }
+   buf.position = 4
+   r = buf:readProtobuf( Few )
+   assert( r.name == "n\0me" and r.d == nil and buf.position == #buf )
+   local plain = ByteArray.create()
+   plain:writeProtobuf( ByteArray.schema{ { 4, "d", "int32", repeated = true } }, { d = { 1, 2 } } )
+   assert( bytes_of( plain ) == "32 1 32 2" )
+   plain.position = 0
+   r = plain:readProtobuf( Test )
+   assert( #r.d == 2 and r.d[2] == 2 )
+
+   -- a length limits what is read
+   local two = ByteArray.create()
+   two:writeProtobuf( Test1, { a = 1 } ):writeProtobuf( Test1, { a = 2 } )
+   two.position = 0
+   assert( two:readProtobuf( Test1, 2 ).a == 1 and two:readProtobuf( Test1, 2 ).a == 2 )
+   assert( not pcall( two.readProtobuf, two, Test1, 1 ) )
+
+   -- lazy messages are slices, written back as they are
+   local big = string.rep( "z", 200 )
+   local Outer = ByteArray.schema{ { 1, "head", "int32" }, { 2, "body", "message", Test, lazy = true } }
+   buf = ByteArray.create()
+   buf:writeProtobuf( Outer, { head = 5, body = { b = big, a = 6 } } )
+   buf.position = 0
+   r = buf:readProtobuf( Outer )
+   assert( r.head == 5 and #r.body == 205 )
+   local body = r.body:readProtobuf( Test )
+   assert( body.a == 6 and body.b == big )
+   local again = ByteArray.create()
+   again:writeProtobuf( Outer, r )
+   assert( again:toString() == buf:toString() )
+
+   -- failures move nothing
+   local n = #buf
+   buf.position = 0
+   assert( not pcall( buf.writeProtobuf, buf, Test, { a = "x" } ) )
+   assert( not pcall( buf.writeProtobuf, buf, Test, { c = { a = {} } } ) )
+   assert( not pcall( buf.writeProtobuf, buf, Test, { d = 1 } ) )
+   assert( buf.position == 0 and #buf == n )
+   -- nor the bytes they would have overwritten
+   local zs = ByteArray.create()
+   zs:writeString( string.rep( "Z", 20 ) )
+   zs.position = 0
+   local AB = ByteArray.schema{ { 1, "a", "string" }, { 2, "b", "int32" } }
+   assert( not pcall( zs.writeProtobuf, zs, AB, { a = "hello", b = "notanumber" } ) )
+   assert( zs:toString() == string.rep( "Z", 20 ) and zs.position == 0 )
+   local cut = ByteArray.load( buf:toString():sub( 1, -2 ) )
+   assert( not pcall( cut.readProtobuf, cut, Outer ) )
+   assert( cut.position == 0 )
+   assert( not pcall( cut.readProtobuf, cut, Test ) ) -- wire type mismatch
+   local ro = ByteArray.load( "" )
+   assert( not pcall( ro.writeProtobuf, ro, Test1, { a = 1 } ) )
+
+   -- a buffer can write itself as a bytes field
+   local Raw = ByteArray.schema{ { 4, "d", "bytes" } }
+   local self = ByteArray.create()
+   self:writeString( string.rep( "payload ", 40 ) )
+   self:writeProtobuf( Raw, { d = self } )
+   self.position = 320
+   assert( self:readProtobuf( Raw ).d == string.rep( "payload ", 40 ) )
+
+   -- bad schemas
+   assert( not pcall( ByteArray.schema, { { 0, "a", "int32" } } ) )
+   assert( not pcall( ByteArray.schema, { { 1, "a", "int33" } } ) )
+   assert( not pcall( ByteArray.schema, { { 1, "a", "int32" }, { 1, "b", "int32" } } ) )
+   assert( not pcall( ByteArray.schema, { { 1, "a", "message" } } ) )
+   assert( not pcall( ByteArray.schema, { { 1, "a", "string", repeated = true, packed = true } } ) )
+
+   -- nesting is limited
+   local S, deep = ByteArray.schema{}, {}
+   for i=1, 150 do
+      S, deep = ByteArray.schema{ { 1, "c", "message", S } }, { c = deep }
+   end
+   buf:clear()
+   local ok, msg = pcall( buf.writeProtobuf, buf, S, deep )
+   assert( not ok and msg:find( "deep" ) and #buf == 0 )
+   local enc = ""
+   for i=1, 150 do
+      enc = ByteArray.create():writeUnsignedByte( 10 ):writeVarUInt( #enc ):writeString( enc ):toString()
+   end
+   buf = ByteArray.load( enc )
+   ok, msg = pcall( buf.readProtobuf, buf, S )
+   assert( not ok and msg:find( "deep" ) )
+   buf = ByteArray.load( enc:sub( 1 + #enc - 100 ) )
+   assert( buf:readProtobuf( S ).c.c.c )
+end
+
+local function amf( v )
+   local buf = ByteArray.create()
+   assert( buf:writeObject( v ) == buf )
+   return bytes_of( buf )
+end
+
+local function test_amf3()
+   assert( amf( nil ) == "1" and amf( false ) == "2" and amf( true ) == "3" )
+   assert( amf( 1 ) == "4 1" and amf( 200 ) == "4 129 72" )
+   assert( amf( -1 ) == "4 255 255 255 255" )
+   assert( amf( 2^28 ) == "5 65 176 0 0 0 0 0 0" and amf( 0.5 ) == "5 63 224 0 0 0 0 0 0" )
+   assert( amf( "hi" ) == "6 5 104 105" and amf( "" ) == "6 1" )
+   assert( amf( { 1, 2 } ) == "9 5 1 4 1 4 2" )
+   assert( amf( { a = 1 } ) == "10 11 1 3 97 4 1 1" )
+   assert( amf( { __class = "Foo", x = 1 } ) == "10 11 7 70 111 111 3 120 4 1 1" )
+   -- strings, traits and objects met again are references
+   assert( amf( { "ab", "ab" } ) == "9 5 1 6 5 97 98 6 0" )
+   assert( amf( { {}, {} } ) == "9 5 1 10 11 1 1 10 1 1" )
+   local shared = { 7 }
+   assert( amf( { shared, shared } ) == "9 5 1 9 3 1 4 7 9 2" )
+
+   -- round trip
+   local ba = ByteArray.init( 1, 2, 3 )
+   local v = {
+      1, 2.5, "three", false, { 4, 5 }, ba,
+      name = "x", n = -268435456, big = 2^40, neg = -2^40, nested = { a = { b = { c = "d" } } },
+      typed = { __class = "com.example.Point", x = 1, y = 2 },
+      other = { __class = "com.example.Point", x = 3, y = 4 },
+   }
+   local buf = ByteArray.create()
+   buf:writeInt( 99 )
+   buf:writeObject( v ):writeObject( "after" )
+   buf.position = 4
+   local r = buf:readObject()
+   assert( buf:readObject() == "after" and buf.position == #buf )
+   assert( r[1] == 1 and r[2] == 2.5 and r[3] == "three" and r[4] == false )
+   assert( r[5][1] == 4 and r[5][2] == 5 and r[6]:toString() == "\1\2\3" )
+   assert( r.name == "x" and r.n == -268435456 and r.big == 2^40 and r.neg == -2^40 )
+   assert( r.nested.a.b.c == "d" )
+   assert( r.typed.__class == "com.example.Point" and r.typed.x == 1 and r.other.y == 4 )
+
+   -- cycles
+   local t = { name = "loop" }
+   t.self = t
+   buf:clear()
+   buf:writeObject( t )
+   buf.position = 0
+   r = buf:readObject()
+   assert( r.self == r and r.name == "loop" )
+
+   -- sealed members, as sent by AS3 classes
+   r = ByteArray.init( 10, 0x23, 3, 80, 3, 120, 3, 121, 4, 1, 4, 2 ):readObject()
+   assert( r.__class == "P" and r.x == 1 and r.y == 2 )
+   r = ByteArray.init( 8, 1, 0x42, 0x70, 0, 0, 0, 0, 0, 0 ):readObject()
+   assert( r == 2^40 )
+   r = ByteArray.init( 0 ):readObject()
+   assert( r == nil )
+
+   -- failures move nothing
+   buf:clear()
+   buf:writeInt( 1 )
+   assert( not pcall( buf.writeObject, buf, { 1, print } ) )
+   assert( not pcall( buf.writeObject, buf, { [true] = 1 } ) )
+   assert( #buf == 4 and buf.position == 4 )
+   local deep = {}
+   for i=1, 150 do deep = { deep } end
+   assert( not pcall( buf.writeObject, buf, deep ) )
+   assert( #buf == 4 )
+   -- nor the bytes they would have overwritten
+   buf.position = 0
+   assert( not pcall( buf.writeObject, buf, { 1, print } ) )
+   assert( buf.position == 0 and buf:readInt() == 1 )
+   buf.position = 0
+   buf:writeObject( 7 )
+   assert( #buf == 4 and buf.position == 2 )
+   buf.position = 0
+   assert( buf:readObject() == 7 )
+
+   -- a ByteArray written into itself
+   local s = ByteArray.create()
+   s:writeString( string.rep( "x", 100 ) )
+   s:writeObject( s )
+   s.position = 100
+   assert( #s == 203 and s:readObject():toString() == string.rep( "x", 100 ) )
+   for _, bad in ipairs{
+      { 10, 7, 1 },          -- externalizable
+      { 13, 3, 0, 0, 0, 0, 1 }, -- vector
+      { 6, 0 },              -- string reference out of range
+      { 9, 5, 1, 4 },        -- truncated
+      { 9, 255, 255, 255, 255, 1 }, -- 2^28 elements in 6 bytes
+      { 10, 255, 255, 255, 251, 1 }, -- 2^25 sealed members
+      { 99 },
+   } do
+      local b = ByteArray.init( bad )
+      assert( not pcall( b.readObject, b ) and b.position == 0 )
+   end
+   local ro = ByteArray.load( "" )
+   assert( not pcall( ro.writeObject, ro, 1 ) )
+end
+
+local function mp( v, numbers )
+   local buf = ByteArray.create()
+   assert( buf:writeMsgPack( v, numbers ) == buf )
+   return bytes_of( buf )
+end
+
+local function test_msgpack()
+   assert( mp( nil ) == "192" and mp( false ) == "194" and mp( true ) == "195" )
+   assert( mp( 1 ) == "1" and mp( 127 ) == "127" and mp( 128 ) == "204 128" )
+   assert( mp( 256 ) == "205 1 0" and mp( 65536 ) == "206 0 1 0 0" )
+   assert( mp( 2^32 ) == "207 0 0 0 1 0 0 0 0" and mp( 2^53 ) == "207 0 32 0 0 0 0 0 0" )
+   assert( mp( -1 ) == "255" and mp( -32 ) == "224" and mp( -33 ) == "208 223" )
+   assert( mp( -129 ) == "209 255 127" and mp( -2^31 ) == "210 128 0 0 0" )
+   assert( mp( -2^31 - 1 ) == "211 255 255 255 255 127 255 255 255" )
+   assert( mp( 0.5 ) == "203 63 224 0 0 0 0 0 0" )
+   assert( mp( "hi" ) == "162 104 105" and mp( "" ) == "160" )
+   assert( mp( string.rep( "a", 32 ) ):sub( 1, 7 ) == "217 32 " )
+   assert( mp( { 1, 2 } ) == "146 1 2" and mp( { a = 1 } ) == "129 161 97 1" and mp( {} ) == "128" )
+   assert( mp( ByteArray.init( 1, 2 ) ) == "196 2 1 2" )
+
+   -- number policies
+   assert( mp( 0.5, "single" ) == "202 63 0 0 0" and mp( 1, "single" ) == "1" )
+   assert( mp( 0.1, "single" ) == mp( 0.1 ) and mp( 1/0, "single" ) == "202 127 128 0 0" )
+   assert( mp( 2^53, "double" ) == "203 67 64 0 0 0 0 0 0" )
+   assert( not pcall( mp, 1, "fixed" ) )
+
+   -- round trip
+   local ba = ByteArray.init( 1, 2, 3 )
+   local v = {
+      1, 2.5, "three", false, { 4, 5 }, ba,
+      name = "x", big = 2^40, neg = -2^40, nested = { a = { b = { c = "d" } } },
+      [10] = "ten", [true] = "yes", long = string.rep( "z", 70000 ),
+   }
+   local buf = ByteArray.create()
+   buf:writeInt( 99 )
+   buf:writeMsgPack( v ):writeMsgPack( "after" )
+   buf.position = 4
+   local r = buf:readMsgPack()
+   assert( buf:readMsgPack() == "after" and buf.position == #buf )
+   assert( r[1] == 1 and r[2] == 2.5 and r[3] == "three" and r[4] == false )
+   assert( r[5][1] == 4 and r[5][2] == 5 and r[6]:toString() == "\1\2\3" )
+   assert( r.name == "x" and r.big == 2^40 and r.neg == -2^40 and r.nested.a.b.c == "d" )
+   assert( r[10] == "ten" and r[true] == "yes" and r.long == v.long )
+
+   -- shared tables are written twice, cycles fail
+   local shared = { 7 }
+   assert( mp( { shared, shared } ) == "146 145 7 145 7" )
+   local t = { name = "loop" }
+   t.self = t
+   buf:clear()
+   buf:writeInt( 1 )
+   local ok, err = pcall( buf.writeMsgPack, buf, { t } )
+   assert( not ok and err:find( "circular" ) and #buf == 4 and buf.position == 4 )
+
+   -- a ByteArray written into itself
+   local s = ByteArray.create()
+   s:writeString( string.rep( "x", 100 ) )
+   s:writeMsgPack( s )
+   s.position = 100
+   assert( #s == 202 and s:readMsgPack():toString() == string.rep( "x", 100 ) )
+
+   -- failures move nothing
+   assert( not pcall( buf.writeMsgPack, buf, { 1, print } ) )
+   local deep = {}
+   for i=1, 150 do deep = { deep } end
+   assert( not pcall( buf.writeMsgPack, buf, deep ) )
+   assert( #buf == 4 and buf.position == 4 )
+   buf.position = 0
+   assert( not pcall( buf.writeMsgPack, buf, { 1, 2, print } ) )
+   assert( buf.position == 0 and buf:readInt() == 1 )
+   buf.position = 0
+   buf:writeMsgPack( 7 )
+   assert( #buf == 4 and buf.position == 1 )
+   buf.position = 0
+   assert( buf:readMsgPack() == 7 )
+   for _, bad in ipairs{
+      { 129, 203, 127, 248, 0, 0, 0, 0, 0, 0, 1 }, -- NaN key
+      { 129, 192, 1 },        -- nil key
+      { 212, 1, 0 },          -- extension
+      { 193 },
+      { 163, 97 },            -- truncated
+      { 221, 255, 255, 255, 255 },
+      { 146, 1 },
+   } do
+      local b = ByteArray.init( bad )
+      assert( not pcall( b.readMsgPack, b ) and b.position == 0 )
+   end
+   local nested = ByteArray.create()
+   for i=1, 150 do nested:writeUnsignedByte( 145 ) end
+   nested:writeUnsignedByte( 1 )
+   nested.position = 0
+   assert( not pcall( nested.readMsgPack, nested ) )
+   local ro = ByteArray.load( "" )
+   assert( not pcall( ro.writeMsgPack, ro, 1 ) )
+end
+
+local function test_lz4()
+   local text = string.rep( "hello world, this is a test. ", 200 )
+   local r, seed = {}, 1
+   for i=1, 3000 do
+      seed = (seed * 1103515245 + 12345) % 2^31
+      r[i] = string.char( math.floor( seed / 2^16 ) % 256 )
+   end
+   local noise = table.concat( r )
+
+   -- blocks, every level, into a new and a given ByteArray
+   for _, s in ipairs{ "", "a", "abcdefghijklm", text, noise, text .. noise .. text } do
+      for level=1, 9, 2 do
+	 local src = ByteArray.load( s )
+	 local z = src:compress( nil, level )
+	 assert( src.position == #s and #z <= #s + #s / 255 + 16 )
+	 z.position = 0
+	 assert( z:decompress( #s ):toString() == s and z.position == #z )
+      end
+   end
+   local src = ByteArray.load( text )
+   local z = ByteArray.create()
+   z:writeInt( 7 )
+   assert( src:compress( z ) == z and #z < #text / 10 )
+   z.position = 4
+   local out = ByteArray.init( 1, 2 )
+   out.position = 2
+   assert( z:decompress( #text, out ) == out and #out == #text + 2 and out[1] == 1 )
+
+   -- bad blocks or sizes move nothing
+   z.position = 4
+   assert( not pcall( z.decompress, z, #text + 1 ) and z.position == 4 )
+   assert( not pcall( z.decompress, z, #text - 1 ) )
+   for _, bad in ipairs{
+      { 0x10, 97, 2, 0 },     -- offset before the start
+      { 0x10, 97, 0, 0 },     -- offset 0
+      { 0xf0 },               -- truncated length
+      { 0x50, 97 },           -- truncated literals
+   } do
+      local b = ByteArray.init( bad )
+      assert( not pcall( b.decompress, b, 20 ) and b.position == 0 )
+   end
+   assert( not pcall( src.compress, src, src ) )
+   assert( not pcall( src.compress, src, nil, 10 ) )
+   assert( not pcall( src.compress, src, ByteArray.load( "" ) ) )
+
+   -- frames written by the lz4 tool, with a content or block checksum
+   local hello = "hello hello hello hello hello hello!"
+   for _, frame in ipairs{
+      { 4, 34, 77, 24, 100, 64, 167, 16, 0, 0, 0, 111, 104, 101, 108, 108, 111, 32, 6, 0, 6, 80,
+	101, 108, 108, 111, 33, 0, 0, 0, 0, 24, 96, 11, 46 },
+      { 4, 34, 77, 24, 112, 64, 173, 16, 0, 0, 0, 111, 104, 101, 108, 108, 111, 32, 6, 0, 6, 80,
+	101, 108, 108, 111, 33, 236, 40, 197, 243, 0, 0, 0, 0 },
+   } do
+      local o = ByteArray.create()
+      local get = ByteArray.decompressStream( o )
+      local b = ByteArray.init( frame )
+      assert( get( b ) == true and b.position == #b and o:toString() == hello )
+      -- a byte at a time
+      o:clear()
+      local part = ByteArray.create()
+      for i=1, #frame do
+	 part.position = #part
+	 part:writeUnsignedByte( frame[i] )
+	 part.position = 0
+	 assert( get( part ) == (i == #frame) )
+	 part:discard()
+      end
+      assert( o:toString() == hello )
+   end
+   local frame = ByteArray.init( 4, 34, 77, 24, 112, 64, 173, 16, 0, 0, 0, 111, 104, 101, 108, 108, 111, 32, 6, 0, 6, 80,
+				 101, 108, 108, 111, 33, 236, 40, 197, 244, 0, 0, 0, 0 )
+   assert( not pcall( ByteArray.decompressStream( ByteArray.create() ), frame ) )
+   frame = ByteArray.init( 4, 34, 77, 24, 96, 64, 0, 0, 0, 0, 0 )
+   assert( not pcall( ByteArray.decompressStream( ByteArray.create() ), frame ) )
+
+   -- streaming round trip, two frames back to back
+   local big = string.rep( text .. noise, 30 )
+   local zs = ByteArray.create()
+   local put = ByteArray.compressStream( zs, 3 )
+   for i=1, #big, 50000 do
+      assert( put( ByteArray.load( big:sub( i, i + 49999 ) ) ) == zs )
+   end
+   put( ByteArray.load( "" ), true )
+   put( ByteArray.load( "second" ), true )
+   assert( #zs < #big / 2 )
+   zs.position = 0
+   local o = ByteArray.create()
+   local get = ByteArray.decompressStream( o )
+   assert( get( zs ) == true and o:toString() == big )
+   assert( get( zs ) == true and o:toString() == big .. "second" and zs.position == #zs )
+   assert( get( zs ) == false )
+   assert( not pcall( ByteArray.compressStream, "x" ) )
+   assert( not pcall( put, zs ) )
+end
+
+local function test_checksum()
+   local b = ByteArray.load( "123456789" )
+   assert( b:crc32() == 0xcbf43926 and b:crc32c() == 0xe3069283 and b:adler32() == 0x091e01de )
+   local e = ByteArray.load( "" )
+   assert( e:crc32() == 0 and e:crc32c() == 0 and e:adler32() == 1 )
+   local fox = ByteArray.load( "The quick brown fox jumps over the lazy dog" )
+   if math.type then
+      assert( ByteArray.load( "a" ):xxh64() == 0xd24ec4f1a98c6e5b )
+      assert( fox:xxh64() == 0x0b242d361fda71bc and e:xxh64() == 0xef46db3751d8e999 )
+   else
+      assert( tonumber( fox:xxh64() ) == 802816344064684476 )
+   end
+   assert( fox:xxh64( 0, 9, 1 ) ~= fox:xxh64( 0, 9 ) and fox:xxh64( 4, 5 ) == fox:xxh64( 4, 5, 0 ) )
+
+   -- ranges, and a stream over several buffers
+   local s = string.rep( "The quick brown fox jumps over the lazy dog. ", 100 )
+   local big = ByteArray.load( s )
+   for _, f in ipairs{ "crc32", "crc32c", "adler32" } do
+      local whole = big[f]( big )
+      for _, cut in ipairs{ 0, 1, 7, 100, #s } do
+	 local h = big[f]( big, 0, cut )
+	 assert( big[f]( big, cut, nil, h ) == whole )
+	 local rest = ByteArray.load( s:sub( cut + 1 ) )
+	 assert( rest[f]( rest, 0, nil, h ) == whole )
+      end
+      -- every alignment and tail length
+      for i=0, 17 do
+	 local part = ByteArray.load( s:sub( i + 1, i + 100 ) )
+	 assert( big[f]( big, i, 100 ) == part[f]( part ) )
+      end
+      assert( not pcall( big[f], big, #s + 1 ) and not pcall( big[f], big, 10, #s ) )
+      assert( not pcall( big[f], big, -1 ) and not pcall( big[f], big, 0, 1, -1 ) )
+   end
+   assert( not pcall( big.xxh64, big, 0, 1, {} ) )
+end
+
+local function test_search()
+   local b = ByteArray.load( "GET / HTTP/1.1\r\nHost: x\r\n\r\nbody" )
+   assert( b:indexOf( "\r\n" ) == 14 and b:indexOf( "\r\n", 15 ) == 23 )
+   assert( b:indexOf( "\r\n\r\n" ) == 23 and b:indexOf( 10 ) == 15 )
+   assert( b:indexOf( "body" ) == 27 and b:indexOf( "GET" ) == 0 and b:indexOf( "" ) == 0 )
+   assert( b:indexOf( "bodyx" ) == nil and b:indexOf( "G", 1 ) == nil and b:indexOf( "y", #b ) == nil )
+   assert( not pcall( b.indexOf, b, "x", #b + 1 ) and not pcall( b.indexOf, b, 256 ) )
+   assert( b:readLine() == "GET / HTTP/1.1" and b:readLine() == "Host: x" and b:readLine() == "" )
+   assert( b.position == 27 and not pcall( b.readLine, b ) and b.position == 27 )
+   assert( b:readUntil( "dy" ) == "bo" and b.bytesAvailable == 0 )
+   assert( not pcall( b.readUntil, b, "" ) )
+
+   -- redis style framing, a needle at every offset past the SIMD blocks
+   local r = ByteArray.load( "*2\r\n$3\r\nGET\r\n$1\nk\r\n" )
+   assert( r:readUntil( "\r\n" ) == "*2" and r:readLine() == "$3" and r:readUntil( 13 ) == "GET" )
+   assert( r:readLine() == "" and r:readLine() == "$1" and r:readLine() == "k" )
+   for n=1, 70 do
+      local s = ByteArray.load( string.rep( "ab", 40 ) .. "abc" .. string.rep( "x", n ) )
+      assert( s:indexOf( "abc" ) == 80 and s:indexOf( "abcx" ) == 80 and s:indexOf( "bab" ) == 1 )
+      local k = string.rep( "x", n )
+      assert( s:indexOf( k ) == 83 and s:indexOf( k .. "x" ) == nil )
+      assert( s:indexOf( "xa" ) == nil and s:indexOf( "c" .. k ) == 82 )
+      -- a needle that only matches at the very end
+      local t = ByteArray.load( string.rep( "a", n ) .. "b" )
+      assert( t:indexOf( "ab" ) == n - 1 and t:indexOf( "aab", 0 ) == (n > 1 and n - 2 or nil) )
+   end
+
+   -- readCString is bounded by length, not by a \0 past it
+   local z = ByteArray.create( 16 )
+   z:writeString( "abc" ):writeByte( 0 ):writeString( "def" )
+   z.position = 0
+   assert( z:readCString() == "abc" and not pcall( z.readCString, z ) and z.position == 4 )
+
+   -- across chunks of a segmented buffer
+   local c = ByteArray.chain()
+   c:writeString( string.rep( "y", 40000 ) ):writeString( "\r\nend\n" )
+   assert( c:readLine() == string.rep( "y", 40000 ) and not pcall( c.readUntil, c, "!" ) )
+   assert( c:readUntil( "d\n" ) == "en" and #c == 0 )
+end
+
+local function test_codec()
+   local A = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"
+   local function b64( s )
+      local out = {}
+      for i=1, #s, 3 do
+	 local a, b, c = s:byte( i, i + 2 )
+	 local v = a * 65536 + (b or 0) * 256 + (c or 0)
+	 local q = {}
+	 for k=3, 0, -1 do
+	    local x = math.floor( v / 64^k ) % 64
+	    q[#q+1] = A:sub( x + 1, x + 1 )
+	 end
+	 if not c then q[4] = "=" end
+	 if not b then q[3] = "=" end
+	 out[#out+1] = table.concat( q )
+      end
+      return table.concat( out )
+   end
+   local function hex( s )
+      return ( s:gsub( ".", function( c ) return string.format( "%02x", c:byte() ) end ) )
+   end
+
+   assert( ByteArray.load( "" ):toBase64() == "" and ByteArray.load( "" ):toHex() == "" )
+   assert( ByteArray.load( "hello" ):toBase64() == "aGVsbG8=" and ByteArray.load( "hello" ):toHex() == "68656c6c6f" )
+   assert( ByteArray.fromBase64( "aGVsbG8=" ):toString() == "hello" and #ByteArray.fromBase64( "" ) == 0 )
+   assert( ByteArray.fromHex( "68656C6c6F" ):toString() == "hello" )
+
+   -- every length around the SIMD blocks, against the lua versions
+   local seed = 7
+   local t = {}
+   for i=1, 300 do
+      seed = (seed * 1103515245 + 12345) % 2147483648
+      t[i] = string.char( math.floor( seed / 65536 ) % 256 )
+   end
+   local data = table.concat( t )
+   local buf = ByteArray.load( data )
+   for n=0, 150 do
+      for _, off in ipairs{ 0, 1, 5 } do
+	 local s = data:sub( off + 1, off + n )
+	 local e, h = buf:toBase64( off, n ), buf:toHex( off, n )
+	 assert( e == b64( s ) and h == hex( s ) )
+	 local d = ByteArray.fromBase64( e )
+	 assert( d:toString() == s and d.position == 0 and #d == n )
+	 assert( ByteArray.fromHex( h ):toString() == s and ByteArray.fromHex( h:upper() ):toString() == s )
+      end
+   end
+   assert( buf:toBase64() == b64( data ) and buf:toHex( 299 ) == hex( data:sub( 300 ) ) )
+   assert( not pcall( buf.toBase64, buf, 301 ) and not pcall( buf.toHex, buf, 0, 301 ) )
+
+   -- every byte at every place of a block is accepted only if it belongs
+   local ok64, okhex = {}, {}
+   for i=1, #A do ok64[A:byte( i )] = true end
+   for c in ( "0123456789abcdefABCDEF" ):gmatch( "." ) do okhex[c:byte()] = true end
+   local e, h = b64( data:sub( 1, 72 ) ), hex( data:sub( 1, 64 ) )
+   for c=0, 255 do
+      for _, i in ipairs{ 1, 2, 16, 17, 31, 32, 33, 48, 63, 64, 95 } do
+	 local s = e:sub( 1, i - 1 ) .. string.char( c ) .. e:sub( i + 1 )
+	 assert( pcall( ByteArray.fromBase64, s ) == (ok64[c] or false) )
+	 if ok64[c] then assert( ByteArray.fromBase64( s ):toBase64() == s ) end
+	 s = h:sub( 1, i - 1 ) .. string.char( c ) .. h:sub( i + 1 )
+	 assert( pcall( ByteArray.fromHex, s ) == (okhex[c] or false) )
+      end
+   end
+
+   -- strict padding, no whitespace, no bits past the end
+   for _, s in ipairs{ "aGVsbG8", "aGVsbG8==", "aGVs bG8=", "aGVsbG9=", "aGVsbA==x", "aGVsbB==",
+		       "aG=sbG8=", "====", "a===", "aGVsbG8=aGVsbG8=" } do
+      assert( not pcall( ByteArray.fromBase64, s ) )
+   end
+   assert( ByteArray.fromBase64( "aGVsbA==" ):toString() == "hell" )
+   assert( not pcall( ByteArray.fromHex, "abc" ) and not pcall( ByteArray.fromHex, "0x" ) )
+   assert( not pcall( ByteArray.fromHex, 1 ) and not pcall( ByteArray.fromBase64, {} ) )
+
+   -- into an existing ByteArray at its position, untouched on errors
+   local to = ByteArray.create()
+   to:writeString( "<" )
+   assert( ByteArray.fromBase64( "aGVsbG8=", to ) == to and ByteArray.fromHex( "3e", to ) == to )
+   assert( to:toString() == "<hello>" and to.position == 7 )
+   to.position = 1
+   assert( not pcall( ByteArray.fromHex, "4a4z", to ) and to.position == 1 and #to == 7 )
+   ByteArray.fromHex( "4a", to )
+   assert( to:toString() == "<Jello>" and to.position == 2 )
+   assert( not pcall( ByteArray.fromHex, "00", ByteArray.load( "x" ) ) )
+end
+
+local function test_transform()
+   -- websocket masking, against the byte loop
+   local key = "\55\250\33\61"
+   local function mask( s, phase )
+      local t = {}
+      for i=1, #s do
+	 local k = key:byte( (i - 1 + phase) % 4 + 1 )
+	 local a, b, r = s:byte( i ), k, 0
+	 for bit=0, 7 do
+	    if a % 2 ~= b % 2 then r = r + 2^bit end
+	    a, b = math.floor( a / 2 ), math.floor( b / 2 )
+	 end
+	 t[i] = string.char( r )
+      end
+      return table.concat( t )
+   end
+   local text = string.rep( "Hello, WebSocket! ", 20 )
+   for _, n in ipairs{ 0, 1, 3, 4, 7, 8, 15, 16, 31, 33, 63, 64, 65, 100, 200 } do
+      for _, off in ipairs{ 0, 1, 2, 3, 9 } do
+	 local b = ByteArray.create()
+	 b:writeString( text )
+	 assert( b:xorMask( key, off, n ) == b )
+	 local s = text:sub( off + 1, off + n )
+	 assert( b:toString() == text:sub( 1, off ) .. mask( s, 0 ) .. text:sub( off + n + 1 ) )
+	 b:xorMask( key, off, n )
+	 assert( b:toString() == text )
+      end
+   end
+   -- a payload masked in parts continues the key
+   local b = ByteArray.create()
+   b:writeString( text )
+   b:xorMask( key, 0, 5 ):xorMask( key, 5, 30, 5 ):xorMask( key, 35, nil, 35 )
+   assert( b:toString() == mask( text, 0 ) )
+   b:xorMask( key ):xorMask( key, 1, 4, 1 )
+   assert( b:toString():sub( 2, 5 ) == mask( text:sub( 2, 5 ), 1 ) )
+   assert( not pcall( b.xorMask, b, "abc" ) and not pcall( b.xorMask, b, key, #text + 1 ) )
+   assert( not pcall( b.xorMask, b, key, 0, #text + 1 ) and not pcall( b.xorMask, b, key, 0, 1, -1 ) )
+
+   -- fill
+   local f = ByteArray.create()
+   f:writeString( "abcdefgh" )
+   assert( f:fill( 0x2e, 2, 3 ) == f and f:toString() == "ab...fgh" )
+   f:fill( -1, 7 )
+   assert( f[8] == 255 and f:fill( 0 ):toString() == string.rep( "\0", 8 ) and #f == 8 )
+   assert( not pcall( f.fill, f, 256 ) and not pcall( f.fill, f, 0, 4, 5 ) )
+
+   -- copyWithin both ways over an overlap
+   local c = ByteArray.create()
+   c:writeString( "0123456789" )
+   assert( c:copyWithin( 2, 0, 5 ) == c and c:toString() == "0101234789" )
+   c:copyWithin( 0, 5 )
+   assert( c:toString() == "3478934789" and #c == 10 )
+   c:copyWithin( 10, 3, 3 ):copyWithin( 0, 0 )
+   assert( c:toString() == "3478934789" )
+   assert( not pcall( c.copyWithin, c, 6, 0, 5 ) and not pcall( c.copyWithin, c, 0, 5, 4 ) )
+   assert( not pcall( c.copyWithin, c, 11 ) and not pcall( c.copyWithin, c, 0, 0, 11 ) )
+
+   -- read only buffers refuse, shared storage is copied first
+   local ro = ByteArray.load( "abcd" )
+   assert( not pcall( ro.xorMask, ro, key ) and not pcall( ro.fill, ro, 0 ) )
+   assert( not pcall( ro.copyWithin, ro, 0, 2 ) and ro:toString() == "abcd" )
+   local s = c:slice( 0, 4 )
+   s:fill( 0x78 ):xorMask( key ):copyWithin( 0, 3 )
+   assert( c:toString() == "3478934789" and #s == 4 )
+end
+
+local function test_compare()
+   local a, b = ByteArray.load( "abc" ), ByteArray.create()
+   b:writeString( "abc" )
+   assert( a == b and a ~= ByteArray.load( "abd" ) and a ~= ByteArray.load( "ab" ) )
+   assert( a ~= "abc" and ByteArray.create() == ByteArray.load( "" ) )
+   assert( a < ByteArray.load( "abd" ) and ByteArray.load( "ab" ) < a and not (a < b) )
+   assert( a <= b and not (ByteArray.load( "b" ) <= a) and a > ByteArray.load( "ab\0\255" ) )
+   assert( ByteArray.load( "\0" ) > ByteArray.create() and ByteArray.load( "\128" ) > ByteArray.load( "\127" ) )
+
+   -- ranges against strings or ByteArrays
+   local r = ByteArray.load( "GET /index.html HTTP/1.1" )
+   assert( r:equals( "GET ", 0, 4 ) and r:equals( "HTTP/1.1", 16 ) and not r:equals( "GET" ) )
+   assert( r:equals( r ) and r:equals( ByteArray.load( "index" ), 5, 5 ) and r:equals( "", 3, 0 ) )
+   assert( r:compare( "GET ", 0, 4 ) == 0 and r:compare( "GET" ) == 1 and r:compare( "POST" ) == -1 )
+   assert( r:compare( "GET /index.html HTTP/1.2" ) == -1 and r:compare( ByteArray.load( "A" ) ) == 1 )
+   assert( not pcall( r.compare, r, 1 ) and not pcall( r.equals, r, "x", #r + 1 ) )
+   assert( not pcall( function() return r < 1 end ) )
+   if math.type then
+      -- lua 5.3 and later call __lt / __le for a string on either side
+      assert( a < "abd" and "ab" < a and a <= "abc" and "abc" <= a and not (a < "abc") )
+   else
+      assert( not pcall( function() return a < "abd" end ) )
+   end
+
+   -- equal bytes hash alike, whatever holds them
+   local seen = {}
+   for _, s in ipairs{ "", "a", "abc", "GET ", string.rep( "x", 1000 ) } do
+      local h = ByteArray.load( s ):hash()
+      assert( seen[h] == nil and type( h ) == "number" )
+      seen[h] = s
+   end
+   local c = ByteArray.create()
+   c:writeString( "--abc--" )
+   assert( seen[c:hash( 2, 3 )] == "abc" and seen[r:hash( 0, 4 )] == "GET " and seen[r:hash( 3, 0 )] == "" )
+   assert( c:slice( 2, 5 ) == a and c:slice( 2, 5 ):hash() == a:hash() )
+end
+
+local function test_pack()
+   local buf = ByteArray.create( 0, ByteArray.LITTLE_ENDIAN )
+   assert( buf:pack( "bBhHiI", -1, 255, -2, 65535, -3, 4000000000 ) == buf )
+   assert( #buf == 14 and buf[1] == 255 and buf[2] == 255 and buf[3] == 254 )
+   buf.position = 0
+   local a, b, c, d, e, f = buf:unpack( "bBhHiI" )
+   assert( a == -1 and b == 255 and c == -2 and d == 65535 and e == -3 and f == 4000000000 )
+   assert( buf.position == 14 )
+
+   -- same bytes as the typed methods
+   buf:clear()
+   buf:pack( ">H <H =d ?", 0x0102, 0x0102, 1.5, true )
+   assert( buf[1] == 1 and buf[2] == 2 and buf[3] == 2 and buf[4] == 1 and #buf == 13 )
+   buf.position = 0
+   buf.endian = ByteArray.BIG_ENDIAN
+   assert( buf:readUnsignedShort() == 0x0102 )
+   buf.endian = ByteArray.LITTLE_ENDIAN
+   assert( buf:readUnsignedShort() == 0x0102 )
+   buf.position = 0
+   local x, y, z, t = buf:unpack( ">H<H=d?" )
+   assert( x == 0x0102 and y == 0x0102 and z == 1.5 and t == true )
+   assert( buf.endian == ByteArray.LITTLE_ENDIAN )
+
+   -- strings, varints, 64-bit and skips
+   buf:clear()
+   buf:pack( "z s1 s c4 x2 vV lLf", "hi", "abc", "", "ab", 300, -2, -5, 7, 0.5 )
+   assert( #buf == 3 + 4 + 4 + 4 + 2 + 2 + 1 + 8 + 8 + 4 )
+   buf.position = 0
+   local r = { buf:unpack( "zs1sc4x2vVlLf" ) }
+   assert( #r == 9 and r[1] == "hi" and r[2] == "abc" and r[3] == "" and r[4] == "ab\0\0" )
+   assert( r[5] == 300 and r[6] == -2 and r[7] == -5 and r[8] == 7 and r[9] == 0.5 )
+
+   -- failures move nothing
+   buf.position = 0
+   local n = #buf
+   assert( not pcall( buf.unpack, buf, "zs1s c4 x2 vVlLf d" ) )
+   assert( buf.position == 0 )
+   assert( not pcall( buf.pack, buf, "Hz", 1, {} ) )
+   assert( not pcall( buf.pack, buf, "H" ) )
+   assert( not pcall( buf.pack, buf, "s1", string.rep( "x", 256 ) ) )
+   assert( not pcall( buf.pack, buf, "c2", "abc" ) )
+   assert( buf.position == 0 and #buf == n )
+   local old = ByteArray.create( 0 )
+   old:writeString( "abcdefgh" )
+   old.position = 0
+   assert( not pcall( old.pack, old, "BBz", 65, 66, {} ) )
+   assert( old:toString() == "abcdefgh" and old.position == 0 )
+   for _, bad in ipairs{ "q", "s3", "c", "s16", "H!" } do
+      assert( not pcall( buf.unpack, buf, bad ) )
+   end
+
+   -- a long string in the middle grows the buffer
+   local long = string.rep( "y", 5000 )
+   local g = ByteArray.create( 0 )
+   g:pack( "<I s2 d I", 1, long, 2.5, 3 )
+   assert( #g == 4 + 2 + 5000 + 8 + 4 )
+   g.position = 0
+   local g1, g2, g3, g4 = g:unpack( "<Is2dI" )
+   assert( g1 == 1 and g2 == long and g3 == 2.5 and g4 == 3 )
+   assert( not pcall( g.pack, g, "z z B", long, long, "x" ) )
+   assert( #g == 5018 and g.position == 5018 )
+
+   -- skip on read, position is the next value
+   buf:clear()
+   buf:pack( ">I x3 B", 1, 2 )
+   buf.position = 0
+   local i, j = buf:unpack( ">Ix3B" )
+   assert( i == 1 and j == 2 and buf.position == 8 )
+
+   local ro = ByteArray.load( "\1\2" )
+   assert( ro:unpack( "<H" ) == 0x0201 )
+   assert( not pcall( ro.pack, ro, "B", 1 ) )
+
+   -- many formats, the cache starts over
+   for k=1, 1000 do
+      local fmt = "<B x" .. k
+      buf:clear()
+      buf:pack( fmt, k % 256 )
+      buf.position = 0
+      assert( #buf == k + 1 and buf:unpack( fmt ) == k % 256 )
+   end
+end
+
 test_readonly()
 test_index()
 test_tostring()
@@ -366,3 +1734,28 @@ test_write_cstr()
 test_write_str()
 test_write_bytes()
 test_gc()
+test_dispatch()
+test_errors()
+test_array()
+test_swap_endian()
+test_varint()
+test_int64()
+test_capacity()
+test_inline()
+test_memory()
+test_view()
+test_load_pin()
+test_mmap()
+test_fd_io()
+test_chain()
+test_consume()
+test_pack()
+test_protobuf()
+test_amf3()
+test_msgpack()
+test_lz4()
+test_checksum()
+test_search()
+test_codec()
+test_transform()
+test_compare()
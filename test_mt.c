@@ -0,0 +1,77 @@
+// Stress test: independent lua_State per OS thread, all using the module.
+//
+// cc -std=gnu99 -O2 test_mt.c bytearr.c -llua -lm -lpthread -o test_mt
+// ./test_mt [threads [iterations]]
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "pthread.h"
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+int luaopen_bytearr( lua_State *L );
+
+// every error path is taken on purpose, they used to share one jmp_buf
+static const char *stress_chunk =
+  "local n = ...\n"
+  "for i=1, n do\n"
+  "  local le = ByteArray.create( 16, ByteArray.LITTLE_ENDIAN )\n"
+  "  local be = ByteArray.create( 16, ByteArray.BIG_ENDIAN )\n"
+  "  le:writeInt( i ):writeDouble( i / 3 ):writeCString( 'x' .. i )\n"
+  "  be:writeInt( i ):writeDouble( i / 3 ):writeCString( 'x' .. i )\n"
+  "  assert( be[4] == i % 256 and le[1] == i % 256 )\n"
+  "  le.position = 0\n"
+  "  be.position = 0\n"
+  "  assert( le:readInt() == i and be:readInt() == i )\n"
+  "  assert( le:readDouble() == i / 3 and be:readDouble() == i / 3 )\n"
+  "  assert( le:readCString() == 'x' .. i and be:readCString() == 'x' .. i )\n"
+  "  assert( not pcall( le.readInt, le ) )\n"
+  "  local ro = ByteArray.load( 'abc' )\n"
+  "  assert( not pcall( ro.writeByte, ro, 1 ) )\n"
+  "  assert( #le:slice( 4 ) == #le - 4 )\n"
+  "end\n";
+
+static int iterations = 20000;
+
+static void* worker( void *arg )
+{
+  lua_State *L = luaL_newstate();
+  luaL_openlibs( L );
+  luaopen_bytearr( L );
+  lua_settop( L, 0 );
+
+  int err = luaL_loadstring( L, stress_chunk );
+  if( !err ){
+    lua_pushinteger( L, iterations );
+    err = lua_pcall( L, 1, 0, 0 );
+  }
+  if( err ){
+    fprintf( stderr, "thread %ld: %s\n", (long)arg, lua_tostring(L, -1) );
+  }
+
+  lua_close( L );
+  return (void*)(ptrdiff_t)err;
+}
+
+int main( int argc, char **argv )
+{
+  int nthread = argc > 1 ? atoi( argv[1] ) : 8;
+  if( argc > 2 ) iterations = atoi( argv[2] );
+
+  pthread_t *threads = malloc( sizeof(pthread_t) * nthread );
+  for( long i=0; i < nthread; ++i ){
+    pthread_create( &threads[i], NULL, worker, (void*)i );
+  }
+
+  int failed = 0;
+  for( int i=0; i < nthread; ++i ){
+    void *ret;
+    pthread_join( threads[i], &ret );
+    if( ret != NULL ) ++failed;
+  }
+  free( threads );
+
+  printf( "%d threads x %d iterations, %d failed\n", nthread, iterations, failed );
+  return failed != 0;
+}